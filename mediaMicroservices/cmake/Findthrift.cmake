@@ -25,6 +25,7 @@
 #  THRIFT_INCLUDE_DIR, where to find THRIFT headers
 #  THRIFT_CONTRIB_DIR, where contrib thrift files (e.g. fb303.thrift) are installed
 #  THRIFT_LIBS, THRIFT libraries
+#  THRIFT_NB_LIB, the nonblocking server library, and LIBEVENT_LIB for it
 #  thriftstatic - imported static library
 
 # prefer the thrift version supplied in THRIFT_HOME
@@ -54,6 +55,9 @@ find_path(THRIFT_STATIC_LIB_PATH libthrift.a PATHS ${THRIFT_LIB_PATHS})
 
 # prefer the thrift version supplied in THRIFT_HOME
 find_library(THRIFT_LIB NAMES thrift HINTS ${THRIFT_LIB_PATHS})
+# TNonblockingServer lives in libthriftnb, which needs libevent
+find_library(THRIFT_NB_LIB NAMES thriftnb HINTS ${THRIFT_LIB_PATHS})
+find_library(LIBEVENT_LIB NAMES event HINTS ${THRIFT_LIB_PATHS})
 
 find_program(THRIFT_COMPILER thrift
     ${THRIFT_ROOT}/bin
@@ -86,6 +90,8 @@ endif ()
 
 mark_as_advanced(
     THRIFT_LIB
+    THRIFT_NB_LIB
+    LIBEVENT_LIB
     THRIFT_COMPILER
     THRIFT_INCLUDE_DIR
     thriftstatic
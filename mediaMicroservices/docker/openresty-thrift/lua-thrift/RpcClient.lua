@@ -5,6 +5,7 @@
 local TSocket = require "TSocket"
 local TFramedTransport = require "TFramedTransport"
 local TBinaryProtocol = require "TBinaryProtocol"
+local TCompactProtocol = require "TCompactProtocol"
 local Object = require "Object"
 
 local RpcClient = Object:new({
@@ -24,9 +25,17 @@ function RpcClient:init(ip,port)
 	local transport = TFramedTransport:new{
 		trans = socket
 	}
-	local protocol = TBinaryProtocol:new{
-		trans = transport
-        }
+	--须与服务端 thrift-protocol.type 一致, nginx.conf 需声明 env THRIFT_PROTOCOL
+	local protocol
+	if os.getenv("THRIFT_PROTOCOL") == "compact" then
+		protocol = TCompactProtocol:new{
+			trans = transport
+		}
+	else
+		protocol = TBinaryProtocol:new{
+			trans = transport
+		}
+	end
 	transport:open()
 	return protocol;
 end
@@ -6,6 +6,10 @@ load_module modules/ngx_http_opentracing_module.so;
 # nginx process
 worker_processes  auto;
 
+# Thrift protocol of the lua clients, must match thrift-protocol.type in
+# service-config.json (binary when unset).
+env THRIFT_PROTOCOL;
+
 error_log  logs/error.log;
 
 # Checklist: Make sure that worker_connections * worker_processes
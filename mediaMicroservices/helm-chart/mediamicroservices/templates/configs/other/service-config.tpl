@@ -7,7 +7,9 @@
   },
   "movie-id-service": {
     "addr": "movie-id-service",
-    "port": 9090
+    "port": 9090,
+    "title_cache_size": 100000,
+    "title_cache_negative_ttl_ms": 10000
   },
   "movie-id-mongodb": {
     "addr": "movie-id-mongodb",
@@ -43,7 +45,9 @@
   },
   "compose-review-service": {
     "addr": "compose-review-service",
-    "port": 9090
+    "port": 9090,
+    "assembly_table_shards": 64,
+    "assembly_timeout_ms": 1000
   },
   "compose-review-memcached": {
     "addr": "compose-review-memcached",
@@ -75,7 +79,9 @@
   },
   "movie-review-service": {
     "addr": "movie-review-service",
-    "port": 9090
+    "port": 9090,
+    "connections": 128,
+    "timeout_ms": 1000
   },
   "movie-review-mongodb": {
     "addr": "movie-review-mongodb",
@@ -87,7 +93,9 @@
   },
   "cast-info-service": {
     "addr": "cast-info-service",
-    "port": 9090
+    "port": 9090,
+    "connections": 128,
+    "timeout_ms": 1000
   },
   "cast-info-mongodb": {
     "addr": "cast-info-mongodb",
@@ -99,7 +107,9 @@
   },
   "plot-service": {
     "addr": "plot-service",
-    "port": 9090
+    "port": 9090,
+    "connections": 128,
+    "timeout_ms": 1000
   },
   "plot-mongodb": {
     "addr": "plot-mongodb",
@@ -111,7 +121,11 @@
   },
   "movie-info-service": {
     "addr": "movie-info-service",
-    "port": 9090
+    "port": 9090,
+    "rating_commit_interval_ms": 1000,
+    "rating_commit_batch_size": 512,
+    "connections": 128,
+    "timeout_ms": 1000
   },
   "movie-info-mongodb": {
     "addr": "movie-info-mongodb",
@@ -123,7 +137,25 @@
   },
   "page-service": {
     "addr": "page-service",
-    "port": 9090
+    "port": 9090,
+    "page_cache_size": 10000,
+    "page_cache_ttl_ms": 10000,
+    "timeout_ms": 1000
+  },
+  "metrics": {
+    "port": 9091
+  },
+  "thrift-server": {
+    "mode": "threaded",
+    "io_threads": 4,
+    "worker_threads": 64
+  },
+  "thrift-protocol": {
+    "type": "binary",
+    "frame_buffer_size": 16384
+  },
+  "cache-format": {
+    "type": "json"
   }
 }
 {{- end }}
\ No newline at end of file
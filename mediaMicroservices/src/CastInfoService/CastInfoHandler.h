@@ -15,6 +15,7 @@
 #include "../ThriftClient.h"
 #include "../logger.h"
 #include "../tracing.h"
+#include "../utils_cache_format.h"
 
 namespace media_service {
 
@@ -38,6 +39,14 @@ class CastInfoHandler : public CastInfoServiceIf {
   mongoc_client_pool_t *_mongodb_client_pool;
 };
 
+// Fills cast_info from the JSON of a cast-info document.
+void CastInfoFromJson(const json &cast_info_json, CastInfo *cast_info) {
+  cast_info->cast_info_id = cast_info_json["cast_info_id"];
+  cast_info->gender = cast_info_json["gender"];
+  cast_info->name = cast_info_json["name"];
+  cast_info->intro = cast_info_json["intro"];
+}
+
 CastInfoHandler::CastInfoHandler(
     memcached_pool_st *memcached_client_pool,
     mongoc_client_pool_t *mongodb_client_pool) {
@@ -195,15 +204,25 @@ void CastInfoHandler::ReadCastInfo(
       se.message =  "Cannot get usernames of request " + std::to_string(req_id);
       throw se;
     }
+    // An entry that fails to decode stays in cast_info_ids_not_cached and
+    // is read from MongoDB.
     CastInfo new_cast_info;
-    json cast_info_json = json::parse(std::string(
-        return_value, return_value + return_value_length));
-    new_cast_info.cast_info_id = cast_info_json["cast_info_id"];
-    new_cast_info.gender = cast_info_json["gender"];
-    new_cast_info.name = cast_info_json["name"];
-    new_cast_info.intro = cast_info_json["intro"];
-    return_map.insert(std::make_pair(new_cast_info.cast_info_id, new_cast_info));
-    cast_info_ids_not_cached.erase(new_cast_info.cast_info_id);
+    try {
+      if (flags == CacheFormat::COMPACT) {
+        DecodeCompact(return_value, return_value_length, &new_cast_info);
+      } else {
+        CastInfoFromJson(json::parse(std::string(
+            return_value, return_value + return_value_length)),
+            &new_cast_info);
+      }
+      return_map.insert(
+          std::make_pair(new_cast_info.cast_info_id, new_cast_info));
+      cast_info_ids_not_cached.erase(new_cast_info.cast_info_id);
+    } catch (...) {
+      LOG(warning) << "Failed to decode cast-info "
+                   << std::string(return_key, return_key_length)
+                   << " from Memcached";
+    }
     free(return_value);
   }
   get_span->Finish();
@@ -216,7 +235,8 @@ void CastInfoHandler::ReadCastInfo(
   delete[] key_sizes;
 
   std::vector<std::future<void>> set_futures;
-  std::map<int64_t, std::string> cast_info_json_map;
+  auto cache_format = GetCacheFormat();
+  std::map<int64_t, std::string> cast_info_cached_map;
 
   // Find the rest in MongoDB
   if (!cast_info_ids_not_cached.empty()) {
@@ -269,13 +289,11 @@ void CastInfoHandler::ReadCastInfo(
       bson_iter_t iter;
       CastInfo new_cast_info;
       char *cast_info_json_char = bson_as_json(doc, nullptr);
-      json cast_info_json = json::parse(cast_info_json_char);
-      new_cast_info.cast_info_id = cast_info_json["cast_info_id"];
-      new_cast_info.gender = cast_info_json["gender"];
-      new_cast_info.name = cast_info_json["name"];
-      new_cast_info.intro = cast_info_json["intro"];
-      cast_info_json_map.insert({
-        new_cast_info.cast_info_id, std::string(cast_info_json_char)});
+      CastInfoFromJson(json::parse(cast_info_json_char), &new_cast_info);
+      cast_info_cached_map.insert({
+        new_cast_info.cast_info_id,
+        cache_format == CacheFormat::COMPACT ? EncodeCompact(new_cast_info)
+                                             : cast_info_json_char});
       return_map.insert({new_cast_info.cast_info_id, new_cast_info});
       bson_free(cast_info_json_char);
     }
@@ -311,7 +329,7 @@ void CastInfoHandler::ReadCastInfo(
       }
       auto set_span = opentracing::Tracer::Global()->StartSpan(
           "MmcSetCastInfo", {opentracing::ChildOf(&span->context())});
-      for (auto & it : cast_info_json_map) {
+      for (auto & it : cast_info_cached_map) {
         std::string id_str = std::to_string(it.first);
         _rc = memcached_set(
             _memcached_client,
@@ -320,7 +338,7 @@ void CastInfoHandler::ReadCastInfo(
             it.second.c_str(),
             it.second.length(),
             static_cast<time_t>(0),
-            static_cast<uint32_t>(0));
+            static_cast<uint32_t>(cache_format));
       }
       memcached_pool_push(_memcached_client_pool, _memcached_client);
       set_span->Finish();
@@ -1,19 +1,13 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "CastInfoHandler.h"
 
 using json = nlohmann::json;
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -30,6 +24,8 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
+  SetUpCacheFormat(config_json);
 
   int port = config_json["cast-info-service"]["port"];
 
@@ -58,16 +54,15 @@ int main(int argc, char *argv[]) {
   }
   mongoc_client_pool_push(mongodb_client_pool, mongodb_client);
 
-  TThreadedServer server(
-      std::make_shared<CastInfoServiceProcessor>(
+  auto processor = std::make_shared<CastInfoServiceProcessor>(
       std::make_shared<CastInfoHandler>(
-              memcached_client_pool, mongodb_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+          memcached_client_pool, mongodb_client_pool));
+  SetUpServerMetrics(processor.get(), config_json, "cast-info-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "cast-info-service", port);
   std::cout << "Starting the cast-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
 
 
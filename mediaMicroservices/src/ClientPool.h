@@ -9,6 +9,7 @@
 #include <string>
 
 #include "logger.h"
+#include "metrics.h"
 
 namespace media_service {
 
@@ -40,7 +41,8 @@ class ClientPool {
   int _timeout_ms;
   std::mutex _mtx;
   std::condition_variable _cv;
-
+  // Calls from Pop() to Push(), or to Remove() for failed ones.
+  LatencyMetric *_metric;
 };
 
 template<class TClient>
@@ -53,6 +55,7 @@ ClientPool<TClient>::ClientPool(const std::string &client_type,
   _max_pool_size = max_pool_size;
   _timeout_ms = timeout_ms;
   _client_type = client_type;
+  _metric = Metrics::Get().Client(client_type);
 
   for (int i = 0; i < min_pool_size; ++i) {
     TClient *client = new TClient(addr, port);
@@ -91,7 +94,8 @@ TClient * ClientPool<TClient>::Pop() {
         bool wait_success = _cv.wait_until(cv_lock, wait_time,
             [this] { return _pool.size() > 0; });
         if (!wait_success) {
-          LOG(warning) << "ClientPool pop timeout";
+          LOG_RATE_LIMITED(warning) << "ClientPool pop timeout: "
+              << _client_type;
           cv_lock.unlock();
           return nullptr;
         }
@@ -106,10 +110,12 @@ TClient * ClientPool<TClient>::Pop() {
   cv_lock.unlock();
 
   if (client) {
+    client->_pop_time = std::chrono::steady_clock::now();
     try {
       client->Connect();
     } catch (...) {
-      LOG(error) << "Failed to connect " + _client_type;
+      LOG_RATE_LIMITED(error) << "Failed to connect " + _client_type;
+      _metric->Record(MetricsElapsedUs(client->_pop_time), true);
       _pool.push_back(client);
       throw;
     }    
@@ -119,6 +125,7 @@ TClient * ClientPool<TClient>::Pop() {
 
 template<class TClient>
 void ClientPool<TClient>::Push(TClient *client) {
+  _metric->Record(MetricsElapsedUs(client->_pop_time), false);
   std::unique_lock<std::mutex> cv_lock(_mtx);
   client->KeepAlive();
   _pool.push_back(client);
@@ -128,6 +135,7 @@ void ClientPool<TClient>::Push(TClient *client) {
 
 template<class TClient>
 void ClientPool<TClient>::Push(TClient *client, int timeout_ms) {
+  _metric->Record(MetricsElapsedUs(client->_pop_time), false);
   std::unique_lock<std::mutex> cv_lock(_mtx);
   client->KeepAlive(timeout_ms);
   _pool.push_back(client);
@@ -137,6 +145,7 @@ void ClientPool<TClient>::Push(TClient *client, int timeout_ms) {
 
 template<class TClient>
 void ClientPool<TClient>::Remove(TClient *client) {
+  _metric->Record(MetricsElapsedUs(client->_pop_time), true);
   std::unique_lock<std::mutex> lock(_mtx);
   delete client;
   _curr_pool_size--;
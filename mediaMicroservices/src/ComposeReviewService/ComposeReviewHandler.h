@@ -1,10 +1,12 @@
 #ifndef MEDIA_MICROSERVICES_COMPOSEREVIEWHANDLER_H
 #define MEDIA_MICROSERVICES_COMPOSEREVIEWHANDLER_H
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <chrono>
 #include <future>
+#include <thread>
 
 #include <libmemcached/memcached.h>
 #include <libmemcached/util.h>
@@ -18,6 +20,7 @@
 #include "../ThriftClient.h"
 #include "../logger.h"
 #include "../tracing.h"
+#include "ReviewAssemblyTable.h"
 
 namespace media_service {
 #define NUM_COMPONENTS 5
@@ -33,7 +36,8 @@ class ComposeReviewHandler : public ComposeReviewServiceIf {
       memcached_pool_st *,
       ClientPool<ThriftClient<ReviewStorageServiceClient>> *,
       ClientPool<ThriftClient<UserReviewServiceClient>> *,
-      ClientPool<ThriftClient<MovieReviewServiceClient>> *);
+      ClientPool<ThriftClient<MovieReviewServiceClient>> *,
+      ReviewAssemblyTable *);
   ~ComposeReviewHandler() override = default;
 
   void UploadText(int64_t, const std::string &,
@@ -56,9 +60,44 @@ class ComposeReviewHandler : public ComposeReviewServiceIf {
       *_user_review_client_pool;
   ClientPool<ThriftClient<MovieReviewServiceClient>>
       *_movie_review_client_pool;
+  ReviewAssemblyTable *_assembly_table;
+
+  template<class TSet>
+  void _UploadComponent(int64_t, ReviewComponent::type, TSet,
+                        const std::string &,
+                        const std::map<std::string, std::string> &);
+  bool _MmcUploadComponent(int64_t, ReviewComponent::type,
+                           const std::string &);
+  void _FlushToMemcached(const PartialReview &);
   void _ComposeAndUpload(int64_t, const std::map<std::string, std::string> &);
+  void _UploadReview(int64_t, Review &,
+                     const std::map<std::string, std::string> &);
 };
 
+// Memcached key suffix and value of a component.
+const char *ComponentKey(ReviewComponent::type component) {
+  static const char *kKeys[] = {
+      "review_id", "movie_id", "user_id", "text", "rating"};
+  return kKeys[component];
+}
+
+std::string ComponentValue(const Review &review,
+                           ReviewComponent::type component) {
+  switch (component) {
+    case ReviewComponent::REVIEW_ID:
+      return std::to_string(review.review_id);
+    case ReviewComponent::MOVIE_ID:
+      return review.movie_id;
+    case ReviewComponent::USER_ID:
+      return std::to_string(review.user_id);
+    case ReviewComponent::TEXT:
+      return review.text;
+    case ReviewComponent::RATING:
+      return std::to_string(review.rating);
+  }
+  return "";
+}
+
 ComposeReviewHandler::ComposeReviewHandler(
     memcached_pool_st *memcached_client_pool,
     ClientPool<ThriftClient<ReviewStorageServiceClient>> 
@@ -66,11 +105,32 @@ ComposeReviewHandler::ComposeReviewHandler(
     ClientPool<ThriftClient<UserReviewServiceClient>>
         *user_review_client_pool,
     ClientPool<ThriftClient<MovieReviewServiceClient>>
-        *movie_review_client_pool ) {
+        *movie_review_client_pool,
+    ReviewAssemblyTable *assembly_table) {
   _memcached_client_pool = memcached_client_pool;
   _review_storage_client_pool = review_storage_client_pool;
   _user_review_client_pool = user_review_client_pool;
   _movie_review_client_pool = movie_review_client_pool;
+  _assembly_table = assembly_table;
+
+  if (_assembly_table) {
+    // Slots that do not complete in time had components sent to another
+    // replica; they are composed through memcached instead.
+    std::thread([this]() {
+      int interval_ms = std::max(_assembly_table->TimeoutMs() / 2, 1);
+      while (true) {
+        std::this_thread::sleep_for(milliseconds(interval_ms));
+        for (auto &partial : _assembly_table->EvictExpired()) {
+          try {
+            _FlushToMemcached(partial);
+          } catch (...) {
+            LOG(error) << "Failed to hand request " << partial.req_id
+                       << " over to memcached";
+          }
+        }
+      }
+    }).detach();
+  }
 }
 
 void ComposeReviewHandler::_ComposeAndUpload(
@@ -175,6 +235,12 @@ void ComposeReviewHandler::_ComposeAndUpload(
   memcached_quit(client);
   memcached_pool_push(_memcached_client_pool, client);
 
+  _UploadReview(req_id, new_review, writer_text_map);
+}
+
+void ComposeReviewHandler::_UploadReview(
+    int64_t req_id, Review &new_review,
+    const std::map<std::string, std::string> &writer_text_map) {
   new_review.timestamp = duration_cast<milliseconds>(
       system_clock::now().time_since_epoch()).count();
   new_review.req_id = req_id;
@@ -251,25 +317,21 @@ void ComposeReviewHandler::_ComposeAndUpload(
   }
 }
 
-void ComposeReviewHandler::UploadMovieId(
-    int64_t req_id,
-    const std::string &movie_id,
-    const std::map<std::string, std::string> & carrier) {
-
-  // Initialize a span
-  TextMapReader reader(carrier);
-  std::map<std::string, std::string> writer_text_map;
-  TextMapWriter writer(writer_text_map);
-  auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  auto span = opentracing::Tracer::Global()->StartSpan(
-      "UploadMovieId",
-      { opentracing::ChildOf(parent_span->get()) });
-  opentracing::Tracer::Global()->Inject(span->context(), writer);
-
+// Stores one component in memcached and returns whether it was the last of
+// its review, by counting the stored components in <req_id>:counter.
+bool ComposeReviewHandler::_MmcUploadComponent(
+    int64_t req_id, ReviewComponent::type component,
+    const std::string &value) {
   memcached_return_t memcached_rc;
   std::string key_counter = std::to_string(req_id) + ":counter";
   memcached_st *memcached_client = memcached_pool_pop(
       _memcached_client_pool, true, &memcached_rc);
+  if (!memcached_client) {
+    ServiceException se;
+    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
+    se.message = "Failed to pop a client from memcached pool";
+    throw se;
+  }
 
   // Initialize the counter to 0 if there it is not in the memcached
   memcached_rc = memcached_add(
@@ -282,8 +344,8 @@ void ComposeReviewHandler::UploadMovieId(
   if (memcached_rc != MEMCACHED_SUCCESS &&
       memcached_rc != MEMCACHED_DATA_EXISTS) {
     LOG(error) << "Failed to initilize the counter for request " << req_id
-        << " Error code: "
-        << memcached_strerror(memcached_client, memcached_rc);
+               << " Error code: "
+               << memcached_strerror(memcached_client, memcached_rc);
     ServiceException se;
     se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
     se.message = memcached_strerror(memcached_client, memcached_rc);
@@ -291,19 +353,21 @@ void ComposeReviewHandler::UploadMovieId(
     throw se;
   }
 
-  // Store movie_id to memcached
+  // Store the component to memcached
   uint64_t counter_value;
-  std::string key_movie_id = std::to_string(req_id) + ":movie_id";
+  std::string key_component =
+      std::to_string(req_id) + ":" + ComponentKey(component);
   memcached_rc = memcached_add(
       memcached_client,
-      key_movie_id.c_str(),
-      key_movie_id.size(),
-      movie_id.c_str(),
-      movie_id.size(),
+      key_component.c_str(),
+      key_component.size(),
+      value.c_str(),
+      value.size(),
       MMC_EXP_TIME, 0);
   if (memcached_rc == MEMCACHED_DATA_EXISTS) {
-    // Another thread has uploaded movie_id, which is an unexpected behaviour.
-    LOG(warning) << "movie_id of request " << req_id
+    // Another thread has uploaded the component, which is an unexpected
+    // behaviour.
+    LOG(warning) << ComponentKey(component) << " of request " << req_id
                  << " has already been stored";
     size_t value_size;
     char *counter_value_str = memcached_get(
@@ -324,7 +388,8 @@ void ComposeReviewHandler::UploadMovieId(
     counter_value = std::stoul(counter_value_str);
     free(counter_value_str);
   } else if (memcached_rc != MEMCACHED_SUCCESS) {
-    LOG(error) << "Cannot store movie_id of request " << req_id;
+    LOG(error) << "Cannot store " << ComponentKey(component)
+               << " of request " << req_id;
     ServiceException se;
     se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
     se.message = memcached_strerror(memcached_client, memcached_rc);
@@ -332,14 +397,14 @@ void ComposeReviewHandler::UploadMovieId(
     throw se;
   } else {
     // Atomically increment and get the counter value
-    memcached_increment(
+    memcached_rc = memcached_increment(
         memcached_client,
         key_counter.c_str(),
         key_counter.size(),
         1, &counter_value);
     if (memcached_rc != MEMCACHED_SUCCESS) {
       LOG(error) << "Cannot increment and get the counter of request "
-          << req_id;
+                 << req_id;
       ServiceException se;
       se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
       se.message = memcached_strerror(memcached_client, memcached_rc);
@@ -347,16 +412,63 @@ void ComposeReviewHandler::UploadMovieId(
       throw se;
     }
   }
-  LOG(debug) << "req_id " << req_id
-      << " caching movie_id to Memcached finished";
+  LOG(debug) << "req_id " << req_id << " caching " << ComponentKey(component)
+             << " to Memcached finished";
   memcached_pool_push(_memcached_client_pool, memcached_client);
+  return counter_value == NUM_COMPONENTS;
+}
 
-  // If this thread is the last one uploading the review components,
-  // it is in charge of compose the request and upload to the microservices in
-  // the next tier.
-  if (counter_value == NUM_COMPONENTS) {
+// Uploads one component, to the assembly table when there is one and to
+// memcached otherwise. The upload that completes the review composes it and
+// uploads it to the microservices in the next tier.
+template<class TSet>
+void ComposeReviewHandler::_UploadComponent(
+    int64_t req_id, ReviewComponent::type component, TSet set,
+    const std::string &value,
+    const std::map<std::string, std::string> &writer_text_map) {
+  if (_assembly_table) {
+    Review review;
+    if (_assembly_table->Add(req_id, component, set, writer_text_map,
+                             &review)) {
+      _UploadReview(req_id, review, writer_text_map);
+    }
+  } else if (_MmcUploadComponent(req_id, component, value)) {
     _ComposeAndUpload(req_id, writer_text_map);
   }
+}
+
+void ComposeReviewHandler::_FlushToMemcached(const PartialReview &partial) {
+  LOG(debug) << "Request " << partial.req_id
+             << " incomplete in the assembly table, composing in memcached";
+  for (int i = 0; i < NUM_COMPONENTS; ++i) {
+    auto component = static_cast<ReviewComponent::type>(i);
+    if ((partial.mask & (1u << component)) &&
+        _MmcUploadComponent(partial.req_id, component,
+                            ComponentValue(partial.review, component))) {
+      _ComposeAndUpload(partial.req_id, partial.carrier);
+    }
+  }
+}
+
+void ComposeReviewHandler::UploadMovieId(
+    int64_t req_id,
+    const std::string &movie_id,
+    const std::map<std::string, std::string> & carrier) {
+
+  // Initialize a span
+  TextMapReader reader(carrier);
+  std::map<std::string, std::string> writer_text_map;
+  TextMapWriter writer(writer_text_map);
+  auto parent_span = opentracing::Tracer::Global()->Extract(reader);
+  auto span = opentracing::Tracer::Global()->StartSpan(
+      "UploadMovieId",
+      { opentracing::ChildOf(parent_span->get()) });
+  opentracing::Tracer::Global()->Inject(span->context(), writer);
+
+  _UploadComponent(
+      req_id, ReviewComponent::MOVIE_ID,
+      [&](Review *review) { review->movie_id = movie_id; },
+      movie_id, writer_text_map);
   span->Finish();
 }
 
@@ -374,99 +486,10 @@ void ComposeReviewHandler::UploadUserId(
       { opentracing::ChildOf(parent_span->get()) });
   opentracing::Tracer::Global()->Inject(span->context(), writer);
 
-  memcached_return_t memcached_rc;
-  std::string key_counter = std::to_string(req_id) + ":counter";
-  memcached_st *memcached_client = memcached_pool_pop(
-      _memcached_client_pool, true, &memcached_rc);
-
-  // Initialize the counter to 0 if there it is not in the memcached
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_counter.c_str(),
-      key_counter.size(),
-      "0", 1, MMC_EXP_TIME, 0);
-
-  // error if it cannot be stored
-  if (memcached_rc != MEMCACHED_SUCCESS &&
-      memcached_rc != MEMCACHED_DATA_EXISTS) {
-    LOG(error) << "Failed to initilize the counter for request " << req_id
-        << " Error code: "
-        << memcached_strerror(memcached_client, memcached_rc);
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  }
-
-  // Store user_id to memcached
-  uint64_t counter_value;
-  std::string key_user_id = std::to_string(req_id) + ":user_id";
-  std::string user_id_str = std::to_string(user_id);
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_user_id.c_str(),
-      key_user_id.size(),
-      user_id_str.c_str(),
-      user_id_str.size(),
-      MMC_EXP_TIME, 0);
-  if (memcached_rc == MEMCACHED_DATA_EXISTS) {
-    // Another thread has uploaded user_id, which is an unexpected behaviour.
-    LOG(warning) << "user_id of request " << req_id
-                 << " has already been stored";
-    size_t value_size;
-    char *counter_value_str = memcached_get(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        &value_size,
-        0,
-        &memcached_rc);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot get the counter of request " << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-    counter_value = std::stoul(counter_value_str);
-    free(counter_value_str);
-  } else if (memcached_rc != MEMCACHED_SUCCESS) {
-    LOG(error) << "Cannot store user_id of request " << req_id
-               << " Error code: "
-               << memcached_strerror(memcached_client, memcached_rc);
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  } else {
-    // Atomically increment and get the counter value
-    memcached_increment(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        1, &counter_value);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot increment and get the counter of request "
-                 << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-  }
-  LOG(debug) << "req_id " << req_id << "caching user to Memcached finished";
-  memcached_pool_push(_memcached_client_pool, memcached_client);
-
-  // If this thread is the last one uploading the review components,
-  // it is in charge of compose the request and upload to the microservices in
-  // the next tier.
-  if (counter_value == NUM_COMPONENTS) {
-    _ComposeAndUpload(req_id, writer_text_map);
-  }
+  _UploadComponent(
+      req_id, ReviewComponent::USER_ID,
+      [&](Review *review) { review->user_id = user_id; },
+      std::to_string(user_id), writer_text_map);
   span->Finish();
 }
 
@@ -484,100 +507,10 @@ void ComposeReviewHandler::UploadUniqueId(
       { opentracing::ChildOf(parent_span->get()) });
   opentracing::Tracer::Global()->Inject(span->context(), writer);
 
-  memcached_return_t memcached_rc;
-  std::string key_counter = std::to_string(req_id) + ":counter";
-  memcached_st *memcached_client = memcached_pool_pop(
-      _memcached_client_pool, true, &memcached_rc);
-
-  // Initialize the counter to 0 if there it is not in the memcached
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_counter.c_str(),
-      key_counter.size(),
-      "0", 1, MMC_EXP_TIME, 0);
-
-  // error if it cannot be stored
-  if (memcached_rc != MEMCACHED_SUCCESS &&
-      memcached_rc != MEMCACHED_DATA_EXISTS) {
-    LOG(error) << "Failed to initilize the counter for request " << req_id
-               << " Error code: "
-               << memcached_strerror(memcached_client, memcached_rc);
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  }
-
-  // Store review_id to memcached
-  uint64_t counter_value;
-  std::string key_unique_id = std::to_string(req_id) + ":review_id";
-  std::string unique_id_str = std::to_string(review_id);
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_unique_id.c_str(),
-      key_unique_id.size(),
-      unique_id_str.c_str(),
-      unique_id_str.size(),
-      MMC_EXP_TIME, 0);
-  if (memcached_rc == MEMCACHED_DATA_EXISTS) {
-    // Another thread has uploaded review_id, which is an unexpected behaviour.
-    LOG(warning) << "review_id of request " << req_id
-                 << " has already been stored";
-    size_t value_size;
-    char *counter_value_str = memcached_get(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        &value_size,
-        nullptr,
-        &memcached_rc);
-
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot get the counter of request " << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-    counter_value = std::stoul(counter_value_str);
-    free(counter_value_str);
-  } else if (memcached_rc != MEMCACHED_SUCCESS) {
-    LOG(error) << "Cannot store review_id of request " << req_id;
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  } else {
-    // Atomically increment and get the counter value
-    memcached_increment(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        1, &counter_value);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot increment and get the counter of request "
-                 << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-  }
-  LOG(debug) << "req_id " << req_id
-             << " caching review_id to Memcached finished";
-
-  memcached_pool_push(_memcached_client_pool, memcached_client);
-
-  // If this thread is the last one uploading the review components,
-  // it is in charge of compose the request and upload to the microservices in
-  // the next tier.
-  if (counter_value == NUM_COMPONENTS) {
-    _ComposeAndUpload(req_id, writer_text_map);
-  }
+  _UploadComponent(
+      req_id, ReviewComponent::REVIEW_ID,
+      [&](Review *review) { review->review_id = review_id; },
+      std::to_string(review_id), writer_text_map);
   span->Finish();
 }
 
@@ -596,101 +529,16 @@ void ComposeReviewHandler::UploadText(
       { opentracing::ChildOf(parent_span->get()) });
   opentracing::Tracer::Global()->Inject(span->context(), writer);
 
-  memcached_return_t memcached_rc;
-  std::string key_counter = std::to_string(req_id) + ":counter";
-  memcached_st *memcached_client = memcached_pool_pop(
-      _memcached_client_pool, true, &memcached_rc);
-
-  // Initialize the counter to 0 if there it is not in the memcached
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_counter.c_str(),
-      key_counter.size(),
-      "0", 1, MMC_EXP_TIME, 0);
-
-  // error if it cannot be stored
-  if (memcached_rc != MEMCACHED_SUCCESS &&
-      memcached_rc != MEMCACHED_DATA_EXISTS) {
-    LOG(error) << "Failed to initilize the counter for request " << req_id
-               << " Error code: "
-               << memcached_strerror(memcached_client, memcached_rc);
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  }
-
-  // Store text to memcached
-  uint64_t counter_value;
-  std::string key_text = std::to_string(req_id) + ":text";
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_text.c_str(),
-      key_text.size(),
-      text.c_str(),
-      text.size(),
-      MMC_EXP_TIME, 0);
-  if (memcached_rc == MEMCACHED_DATA_EXISTS) {
-    // Another thread has uploaded text, which is an unexpected behaviour.
-    LOG(warning) << "text of request " << req_id
-                 << " has already been stored";
-    size_t value_size;
-    char *counter_value_str = memcached_get(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        &value_size,
-        nullptr,
-        &memcached_rc);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot get the counter of request " << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-    counter_value = std::stoul(counter_value_str);
-    free(counter_value_str);
-  } else if (memcached_rc != MEMCACHED_SUCCESS) {
-    LOG(error) << "Cannot store text of request " << req_id;
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  } else {
-    // Atomically increment and get the counter value
-    memcached_increment(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        1, &counter_value);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot increment and get the counter of request "
-                 << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-  }
-  LOG(debug) << "req_id " << req_id << "caching text to Memcached finished";
-  memcached_pool_push(_memcached_client_pool, memcached_client);
-
-  // If this thread is the last one uploading the review components,
-  // it is in charge of compose the request and upload to the microservices in
-  // the next tier.
-  if (counter_value == NUM_COMPONENTS) {
-    _ComposeAndUpload(req_id, writer_text_map);
-  }
+  _UploadComponent(
+      req_id, ReviewComponent::TEXT,
+      [&](Review *review) { review->text = text; },
+      text, writer_text_map);
   span->Finish();
 }
 
 void ComposeReviewHandler::UploadRating(
-    int64_t req_id, int32_t rating, const std::map<std::string, std::string> & carrier) {
+    int64_t req_id, int32_t rating,
+    const std::map<std::string, std::string> & carrier) {
 
   // Initialize a span
   TextMapReader reader(carrier);
@@ -702,100 +550,13 @@ void ComposeReviewHandler::UploadRating(
       { opentracing::ChildOf(parent_span->get()) });
   opentracing::Tracer::Global()->Inject(span->context(), writer);
 
-  memcached_return_t memcached_rc;
-  std::string key_counter = std::to_string(req_id) + ":counter";
-  memcached_st *memcached_client = memcached_pool_pop(
-      _memcached_client_pool, true, &memcached_rc);
-
-  // Initialize the counter to 0 if there it is not in the memcached
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_counter.c_str(),
-      key_counter.size(),
-      "0", 1, MMC_EXP_TIME, 0);
-
-  // error if it cannot be stored
-  if (memcached_rc != MEMCACHED_SUCCESS &&
-      memcached_rc != MEMCACHED_DATA_EXISTS) {
-    LOG(error) << "Failed to initilize the counter for request " << req_id
-               << " Error code: " << memcached_strerror(memcached_client, memcached_rc);
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  }
-
-  // Store rating to memcached
-  uint64_t counter_value;
-  std::string key_rating = std::to_string(req_id) + ":rating";
-  std::string rating_str = std::to_string(rating);
-  memcached_rc = memcached_add(
-      memcached_client,
-      key_rating.c_str(),
-      key_rating.size(),
-      rating_str.c_str(),
-      rating_str.size(),
-      MMC_EXP_TIME, 0);
-  if (memcached_rc == MEMCACHED_DATA_EXISTS) {
-    // Another thread has uploaded rating, which is an unexpected behaviour.
-    LOG(warning) << "rating of request " << req_id
-                 << " has already been stored";
-    size_t value_size;
-    char *counter_value_str = memcached_get(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        &value_size,
-        0,
-        &memcached_rc);
-    counter_value = std::stoul(counter_value_str);
-    free(counter_value_str);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot get the counter of request " << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-  } else if (memcached_rc != MEMCACHED_SUCCESS) {
-    LOG(error) << "Cannot store rating of request " << req_id;
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  } else {
-    // Atomically increment and get the counter value
-    memcached_increment(
-        memcached_client,
-        key_counter.c_str(),
-        key_counter.size(),
-        1, &counter_value);
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(error) << "Cannot increment and get the counter of request "
-                 << req_id;
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-      se.message = memcached_strerror(memcached_client, memcached_rc);
-      memcached_pool_push(_memcached_client_pool, memcached_client);
-      throw se;
-    }
-  }
-  LOG(debug) << "req_id " << req_id << " caching rating to Memcached finished";
-  memcached_pool_push(_memcached_client_pool, memcached_client);
-
-  // If this thread is the last one uploading the review components,
-  // it is in charge of compose the request and upload to the microservices in
-  // the next tier.
-  if (counter_value == NUM_COMPONENTS) {
-    _ComposeAndUpload(req_id, writer_text_map);
-  }
+  _UploadComponent(
+      req_id, ReviewComponent::RATING,
+      [&](Review *review) { review->rating = rating; },
+      std::to_string(rating), writer_text_map);
   span->Finish();
 }
 
 } // namespace media_service
 
-
 #endif //MEDIA_MICROSERVICES_COMPOSEREVIEWHANDLER_H
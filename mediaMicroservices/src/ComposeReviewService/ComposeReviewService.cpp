@@ -1,18 +1,12 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
 #include "ComposeReviewHandler.h"
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_memcached.h"
 
 using json = nlohmann::json;
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -29,8 +23,13 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   int port = config_json["compose-review-service"]["port"];
+  int assembly_table_shards =
+      config_json["compose-review-service"]["assembly_table_shards"];
+  int assembly_timeout_ms =
+      config_json["compose-review-service"]["assembly_timeout_ms"];
   std::string review_storage_addr =
       config_json["review-storage-service"]["addr"];
   int review_storage_port = config_json["review-storage-service"]["port"];
@@ -42,11 +41,11 @@ int main(int argc, char *argv[]) {
   int movie_review_port = config_json["movie-review-service"]["port"];
 
   ClientPool<ThriftClient<ReviewStorageServiceClient>> compose_client_pool(
-      "compose-review-service", review_storage_addr, review_storage_port, 0, 128, 1000);
+      "review-storage-client", review_storage_addr, review_storage_port, 0, 128, 1000);
   ClientPool<ThriftClient<UserReviewServiceClient>> user_client_pool(
-      "user-review-service", user_review_addr, user_review_port, 0, 128, 1000);
+      "user-review-client", user_review_addr, user_review_port, 0, 128, 1000);
   ClientPool<ThriftClient<MovieReviewServiceClient>> movie_client_pool(
-      "movie-review-service", movie_review_addr, movie_review_port, 0, 128, 1000);
+      "movie-review-client", movie_review_addr, movie_review_port, 0, 128, 1000);
 
 
   std::string mmc_addr = config_json["compose-review-memcached"]["addr"];
@@ -60,19 +59,25 @@ int main(int argc, char *argv[]) {
   auto memcached_client_pool = memcached_pool_create(
       memcached_client, MEMCACHED_POOL_MIN_SIZE, MEMCACHED_POOL_MAX_SIZE);
 
-  TThreadedServer server(
-      std::make_shared<ComposeReviewServiceProcessor>(
-          std::make_shared<ComposeReviewHandler>(
-              memcached_client_pool,
-              &compose_client_pool,
-              &user_client_pool,
-              &movie_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  std::unique_ptr<ReviewAssemblyTable> assembly_table;
+  if (assembly_table_shards > 0) {
+    assembly_table.reset(new ReviewAssemblyTable(
+        assembly_table_shards, assembly_timeout_ms));
+  }
+
+  auto processor = std::make_shared<ComposeReviewServiceProcessor>(
+      std::make_shared<ComposeReviewHandler>(
+          memcached_client_pool,
+          &compose_client_pool,
+          &user_client_pool,
+          &movie_client_pool,
+          assembly_table.get()));
+  SetUpServerMetrics(processor.get(), config_json, "compose-review-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "compose-review-service", port);
   std::cout << "Starting the compose-review-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
 
 
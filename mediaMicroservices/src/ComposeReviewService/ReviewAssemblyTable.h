@@ -0,0 +1,142 @@
+#ifndef MEDIA_MICROSERVICES_REVIEWASSEMBLYTABLE_H
+#define MEDIA_MICROSERVICES_REVIEWASSEMBLYTABLE_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../../gen-cpp/media_service_types.h"
+#include "../logger.h"
+
+namespace media_service {
+
+// The five uploads a review is composed from. Each sets one bit of a slot's
+// completion mask.
+struct ReviewComponent {
+  enum type {
+    REVIEW_ID = 0,
+    MOVIE_ID = 1,
+    USER_ID = 2,
+    TEXT = 3,
+    RATING = 4
+  };
+  static const uint32_t kAll = (1u << 5) - 1;
+};
+
+// A review whose components did not all arrive within the timeout.
+struct PartialReview {
+  int64_t req_id;
+  Review review;
+  uint32_t mask;
+  std::map<std::string, std::string> carrier;
+};
+
+// Assembles reviews in process memory, keyed by req_id. The table is split
+// into shards, each with its own lock and map, so uploads of different
+// reviews rarely contend. An upload sets its field and its bit in the slot's
+// completion mask under the shard lock; the upload that completes the mask
+// takes the review out of the table and composes it.
+//
+// Components of one review can reach different compose-review-service
+// replicas. Their slots never complete, and EvictExpired() hands them back
+// after timeout_ms so their components can go through memcached instead.
+class ReviewAssemblyTable {
+ public:
+  ReviewAssemblyTable(int n_shards, int timeout_ms);
+
+  ReviewAssemblyTable(const ReviewAssemblyTable &) = delete;
+  ReviewAssemblyTable &operator=(const ReviewAssemblyTable &) = delete;
+
+  // Stores a component with set(Review *). Returns true, with the review in
+  // *complete, if it was the last one. A component uploaded twice is
+  // ignored. carrier is kept from the first upload, for the fallback.
+  template<class TSet>
+  bool Add(int64_t req_id, ReviewComponent::type component, TSet set,
+           const std::map<std::string, std::string> &carrier,
+           Review *complete);
+
+  // Takes out the slots older than timeout_ms.
+  std::vector<PartialReview> EvictExpired();
+
+  int TimeoutMs() const {
+    return static_cast<int>(_timeout.count());
+  }
+
+ private:
+  struct Slot {
+    PartialReview partial;
+    std::chrono::steady_clock::time_point created;
+  };
+
+  struct Shard {
+    std::mutex mtx;
+    std::unordered_map<int64_t, Slot> slots;
+  };
+
+  Shard &_GetShard(int64_t req_id) {
+    return _shards[static_cast<uint64_t>(req_id) % _shards.size()];
+  }
+
+  std::vector<Shard> _shards;
+  std::chrono::milliseconds _timeout;
+};
+
+ReviewAssemblyTable::ReviewAssemblyTable(int n_shards, int timeout_ms)
+    : _shards(n_shards), _timeout(timeout_ms) {}
+
+template<class TSet>
+bool ReviewAssemblyTable::Add(
+    int64_t req_id, ReviewComponent::type component, TSet set,
+    const std::map<std::string, std::string> &carrier, Review *complete) {
+  uint32_t bit = 1u << component;
+  Shard &shard = _GetShard(req_id);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  auto it = shard.slots.find(req_id);
+  if (it == shard.slots.end()) {
+    Slot slot;
+    slot.partial.req_id = req_id;
+    slot.partial.mask = 0;
+    slot.partial.carrier = carrier;
+    slot.created = std::chrono::steady_clock::now();
+    it = shard.slots.emplace(req_id, std::move(slot)).first;
+  }
+  PartialReview &partial = it->second.partial;
+  if (partial.mask & bit) {
+    LOG(warning) << "Component " << component << " of request " << req_id
+                 << " has already been stored";
+    return false;
+  }
+  set(&partial.review);
+  partial.mask |= bit;
+  if (partial.mask != ReviewComponent::kAll) {
+    return false;
+  }
+  *complete = std::move(partial.review);
+  shard.slots.erase(it);
+  return true;
+}
+
+std::vector<PartialReview> ReviewAssemblyTable::EvictExpired() {
+  std::vector<PartialReview> expired;
+  auto deadline = std::chrono::steady_clock::now() - _timeout;
+  for (auto &shard : _shards) {
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    for (auto it = shard.slots.begin(); it != shard.slots.end();) {
+      if (it->second.created <= deadline) {
+        expired.emplace_back(std::move(it->second.partial));
+        it = shard.slots.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+  return expired;
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_REVIEWASSEMBLYTABLE_H
@@ -0,0 +1,159 @@
+#ifndef MEDIA_MICROSERVICES_FANOUT_H
+#define MEDIA_MICROSERVICES_FANOUT_H
+
+#include <poll.h>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../gen-cpp/media_service_types.h"
+#include "ClientPool.h"
+#include "ThriftClient.h"
+#include "logger.h"
+
+namespace media_service {
+
+// Drives several outstanding Thrift calls from the calling thread.
+//
+// Call() pops a client, issues the generated send_<Method>() right away and
+// leaves the matching recv_<Method>() to Wait(), which polls the sockets and
+// completes each call as soon as its reply is readable. Completion callbacks
+// may issue further calls on the same FanOut, so a dependent hop (ReadPage's
+// cast-info/plot after movie-info) starts without blocking the independent
+// ones. No threads are spawned, unlike the std::async fan-out it replaces.
+class FanOut {
+ public:
+  explicit FanOut(int timeout_ms) : _timeout_ms(timeout_ms) {}
+  ~FanOut();
+
+  FanOut(const FanOut &) = delete;
+  FanOut &operator=(const FanOut &) = delete;
+
+  // send(TThriftClient *) issues send_<Method>(); recv(TThriftClient *) runs
+  // recv_<Method>() from within Wait() and consumes the result.
+  template<class TThriftClient, class TSend, class TRecv>
+  void Call(ClientPool<ThriftClient<TThriftClient>> *pool,
+            const std::string &service_name, TSend send, TRecv recv);
+
+  // Completes all outstanding calls, including the ones added by callbacks.
+  // Rethrows the first failure after every other call has been drained.
+  void Wait();
+
+ private:
+  struct Pending {
+    int fd;
+    std::function<void()> on_ready;
+    std::function<void()> on_abort;
+  };
+
+  std::vector<Pending> _pending;
+  int _timeout_ms;
+};
+
+FanOut::~FanOut() {
+  for (auto &pending : _pending) {
+    pending.on_abort();
+  }
+}
+
+template<class TThriftClient, class TSend, class TRecv>
+void FanOut::Call(ClientPool<ThriftClient<TThriftClient>> *pool,
+                  const std::string &service_name, TSend send, TRecv recv) {
+  auto client_wrapper = pool->Pop();
+  if (!client_wrapper) {
+    ServiceException se;
+    se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
+    se.message = "Failed to connected to " + service_name;
+    throw se;
+  }
+  try {
+    send(client_wrapper->GetClient());
+  } catch (...) {
+    LOG(error) << "Failed to send request to " << service_name;
+    pool->Remove(client_wrapper);
+    throw;
+  }
+  _pending.emplace_back(Pending{
+      client_wrapper->GetSocketFd(),
+      [pool, client_wrapper, service_name, recv]() {
+        try {
+          recv(client_wrapper->GetClient());
+        } catch (...) {
+          LOG(error) << "Failed to receive reply from " << service_name;
+          pool->Remove(client_wrapper);
+          throw;
+        }
+        pool->Push(client_wrapper);
+      },
+      [pool, client_wrapper]() { pool->Remove(client_wrapper); }});
+}
+
+void FanOut::Wait() {
+  std::exception_ptr eptr;
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(_timeout_ms);
+  std::vector<struct pollfd> pfds;
+
+  while (!_pending.empty()) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    int n = -1;
+    if (remaining > 0) {
+      pfds.clear();
+      for (auto &pending : _pending) {
+        pfds.push_back({pending.fd, POLLIN, 0});
+      }
+      n = ::poll(pfds.data(), pfds.size(), static_cast<int>(remaining));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+    }
+    if (n <= 0) {
+      if (!eptr) {
+        ServiceException se;
+        se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
+        se.message = "Timed out waiting for downstream replies";
+        eptr = std::make_exception_ptr(se);
+      }
+      for (auto &pending : _pending) {
+        pending.on_abort();
+      }
+      _pending.clear();
+      break;
+    }
+
+    // Detach the ready calls first: their callbacks may Call() new ones.
+    std::vector<Pending> ready;
+    std::vector<Pending> waiting;
+    for (size_t i = 0; i < pfds.size(); ++i) {
+      if (pfds[i].revents) {
+        ready.emplace_back(std::move(_pending[i]));
+      } else {
+        waiting.emplace_back(std::move(_pending[i]));
+      }
+    }
+    _pending = std::move(waiting);
+
+    for (auto &pending : ready) {
+      try {
+        pending.on_ready();
+      } catch (...) {
+        if (!eptr) {
+          eptr = std::current_exception();
+        }
+      }
+    }
+  }
+
+  if (eptr) {
+    std::rethrow_exception(eptr);
+  }
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_FANOUT_H
@@ -1,6 +1,7 @@
 #ifndef MEDIA_MICROSERVICES_GENERICCLIENT_H
 #define MEDIA_MICROSERVICES_GENERICCLIENT_H
 
+#include <chrono>
 #include <string>
 
 namespace media_service {
@@ -14,6 +15,9 @@ class GenericClient{
   virtual void Disconnect() = 0;
   virtual bool IsConnected() = 0;
 
+  // Set by ClientPool::Pop() for its client-side latency.
+  std::chrono::steady_clock::time_point _pop_time;
+
  protected:
   std::string _addr;
   int _port;
@@ -0,0 +1,88 @@
+#ifndef MEDIA_MICROSERVICES_LRUCACHE_H
+#define MEDIA_MICROSERVICES_LRUCACHE_H
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace media_service {
+
+// Map of at most capacity entries that evicts the least recently used one.
+// Not thread-safe: the in-process caches built on it (PageCache, TitleCache)
+// hold their own lock around every call.
+template<class TValue>
+class LruCache {
+ public:
+  explicit LruCache(size_t capacity);
+
+  LruCache(const LruCache &) = delete;
+  LruCache &operator=(const LruCache &) = delete;
+
+  // The value stored for key, marked as most recently used, or nullptr.
+  TValue *Get(const std::string &key);
+  // The same without changing its place in the eviction order.
+  TValue *Peek(const std::string &key);
+  // Stores value for key as the most recently used entry, and evicts the
+  // least recently used one if that makes the cache exceed its capacity.
+  void Put(const std::string &key, TValue value);
+  void Erase(const std::string &key);
+
+ private:
+  typedef std::list<std::pair<std::string, TValue>> LruList;
+
+  LruList _lru;
+  std::unordered_map<std::string, typename LruList::iterator> _index;
+  size_t _capacity;
+};
+
+template<class TValue>
+LruCache<TValue>::LruCache(size_t capacity) : _capacity(capacity) {}
+
+template<class TValue>
+TValue *LruCache<TValue>::Get(const std::string &key) {
+  auto it = _index.find(key);
+  if (it == _index.end()) {
+    return nullptr;
+  }
+  _lru.splice(_lru.begin(), _lru, it->second);
+  return &it->second->second;
+}
+
+template<class TValue>
+TValue *LruCache<TValue>::Peek(const std::string &key) {
+  auto it = _index.find(key);
+  if (it == _index.end()) {
+    return nullptr;
+  }
+  return &it->second->second;
+}
+
+template<class TValue>
+void LruCache<TValue>::Put(const std::string &key, TValue value) {
+  auto it = _index.find(key);
+  if (it != _index.end()) {
+    it->second->second = std::move(value);
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return;
+  }
+  _lru.emplace_front(key, std::move(value));
+  _index.emplace(key, _lru.begin());
+  if (_lru.size() > _capacity) {
+    _index.erase(_lru.back().first);
+    _lru.pop_back();
+  }
+}
+
+template<class TValue>
+void LruCache<TValue>::Erase(const std::string &key) {
+  auto it = _index.find(key);
+  if (it != _index.end()) {
+    _lru.erase(it->second);
+    _index.erase(it);
+  }
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_LRUCACHE_H
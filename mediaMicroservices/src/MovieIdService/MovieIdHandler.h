@@ -17,6 +17,7 @@
 #include "../ThriftClient.h"
 #include "../logger.h"
 #include "../tracing.h"
+#include "TitleCache.h"
 
 
 namespace media_service {
@@ -27,7 +28,8 @@ class MovieIdHandler : public MovieIdServiceIf {
       memcached_pool_st *,
       mongoc_client_pool_t *,
       ClientPool<ThriftClient<ComposeReviewServiceClient>> *,
-      ClientPool<ThriftClient<RatingServiceClient>> *);
+      ClientPool<ThriftClient<RatingServiceClient>> *,
+      TitleCache *);
   ~MovieIdHandler() override = default;
   void UploadMovieId(int64_t, const std::string &, int32_t,
                      const std::map<std::string, std::string> &) override;
@@ -39,17 +41,20 @@ class MovieIdHandler : public MovieIdServiceIf {
   mongoc_client_pool_t *_mongodb_client_pool;
   ClientPool<ThriftClient<ComposeReviewServiceClient>> *_compose_client_pool;
   ClientPool<ThriftClient<RatingServiceClient>> *_rating_client_pool;
+  TitleCache *_title_cache;
 };
 
 MovieIdHandler::MovieIdHandler(
     memcached_pool_st *memcached_client_pool,
     mongoc_client_pool_t *mongodb_client_pool,
     ClientPool<ThriftClient<ComposeReviewServiceClient>> *compose_client_pool,
-    ClientPool<ThriftClient<RatingServiceClient>> *rating_client_pool) {
+    ClientPool<ThriftClient<RatingServiceClient>> *rating_client_pool,
+    TitleCache *title_cache) {
   _memcached_client_pool = memcached_client_pool;
   _mongodb_client_pool = mongodb_client_pool;
   _compose_client_pool = compose_client_pool;
   _rating_client_pool = rating_client_pool;
+  _title_cache = title_cache;
 }
 
 void MovieIdHandler::UploadMovieId(
@@ -68,143 +73,173 @@ void MovieIdHandler::UploadMovieId(
       { opentracing::ChildOf(parent_span->get()) });
   opentracing::Tracer::Global()->Inject(span->context(), writer);
 
-  memcached_return_t memcached_rc;
-  memcached_st *memcached_client = memcached_pool_pop(
-      _memcached_client_pool, true, &memcached_rc);
-  if (!memcached_client) {
+  std::string movie_id_str;
+  // Only a title resolved by MongoDB is written back to memcached.
+  bool set_memcached = false;
+  auto lookup = _title_cache ? _title_cache->Get(title, &movie_id_str)
+                             : TitleLookup::MISS;
+  if (lookup == TitleLookup::NOT_FOUND) {
     ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = "Failed to pop a client from memcached pool";
+    se.errorCode = ErrorCode::SE_THRIFT_HANDLER_ERROR;
+    se.message = "Movie " + title + " is not found in MongoDB";
     throw se;
   }
 
-  size_t movie_id_size;
-  uint32_t memcached_flags;
-  // Look for the movie id from memcached
-
-  auto get_span = opentracing::Tracer::Global()->StartSpan(
-      "MmcGetMovieId", { opentracing::ChildOf(&span->context()) });
-
-  char* movie_id_mmc = memcached_get(
-      memcached_client,
-      title.c_str(),
-      title.length(),
-      &movie_id_size,
-      &memcached_flags,
-      &memcached_rc);
-  if (!movie_id_mmc && memcached_rc != MEMCACHED_NOTFOUND) {
-    ServiceException se;
-    se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
-    se.message = memcached_strerror(memcached_client, memcached_rc);
-    memcached_pool_push(_memcached_client_pool, memcached_client);
-    throw se;
-  }
-  get_span->Finish();
-  memcached_pool_push(_memcached_client_pool, memcached_client);
-  std::string movie_id_str;
+  if (lookup == TitleLookup::MISS) {
+    memcached_return_t memcached_rc;
+    memcached_st *memcached_client = memcached_pool_pop(
+        _memcached_client_pool, true, &memcached_rc);
+    if (!memcached_client) {
+      ServiceException se;
+      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
+      se.message = "Failed to pop a client from memcached pool";
+      throw se;
+    }
 
-  // If cached in memcached
-  if (movie_id_mmc) {
-    LOG(debug) << "Get movie_id " << movie_id_mmc
-        << " cache hit from Memcached";
-    movie_id_str = std::string(movie_id_mmc);
-    free(movie_id_mmc);
-  }
+    size_t movie_id_size;
+    uint32_t memcached_flags;
+    // Look for the movie id from memcached
+
+    auto get_span = opentracing::Tracer::Global()->StartSpan(
+        "MmcGetMovieId", { opentracing::ChildOf(&span->context()) });
 
-    // If not cached in memcached
-  else {
-    mongoc_client_t *mongodb_client = mongoc_client_pool_pop(
-        _mongodb_client_pool);
-    if (!mongodb_client) {
+    char* movie_id_mmc = memcached_get(
+        memcached_client,
+        title.c_str(),
+        title.length(),
+        &movie_id_size,
+        &memcached_flags,
+        &memcached_rc);
+    if (!movie_id_mmc && memcached_rc != MEMCACHED_NOTFOUND) {
       ServiceException se;
-      se.errorCode = ErrorCode::SE_MONGODB_ERROR;
-      se.message = "Failed to pop a client from MongoDB pool";
-      free(movie_id_mmc);
+      se.errorCode = ErrorCode::SE_MEMCACHED_ERROR;
+      se.message = memcached_strerror(memcached_client, memcached_rc);
+      memcached_pool_push(_memcached_client_pool, memcached_client);
       throw se;
     }
-    auto collection = mongoc_client_get_collection(
-        mongodb_client, "movie-id", "movie-id");
+    get_span->Finish();
+    memcached_pool_push(_memcached_client_pool, memcached_client);
 
-    if (!collection) {
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_MONGODB_ERROR;
-      se.message = "Failed to create collection user from DB movie-id";
+    // If cached in memcached
+    if (movie_id_mmc) {
+      LOG(debug) << "Get movie_id " << movie_id_mmc
+          << " cache hit from Memcached";
+      movie_id_str = std::string(movie_id_mmc);
       free(movie_id_mmc);
-      mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-      throw se;
+      if (_title_cache) {
+        _title_cache->Put(title, movie_id_str);
+      }
     }
 
-    bson_t *query = bson_new();
-    BSON_APPEND_UTF8(query, "title", title.c_str());
-
-    auto find_span = opentracing::Tracer::Global()->StartSpan(
-        "MongoFindMovieId", { opentracing::ChildOf(&span->context()) });
-    mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
-        collection, query, nullptr, nullptr);
-    const bson_t *doc;
-    bool found = mongoc_cursor_next(cursor, &doc);
-    find_span->Finish();
-
-    if (found) {
-      bson_iter_t iter;
-      if (bson_iter_init_find(&iter, doc, "movie_id")) {
-        movie_id_str = std::string(bson_iter_value(&iter)->value.v_utf8.str);
-        LOG(debug) << "Find movie " << movie_id_str << " cache miss";
+      // If not cached in memcached
+    else {
+      mongoc_client_t *mongodb_client = mongoc_client_pool_pop(
+          _mongodb_client_pool);
+      if (!mongodb_client) {
+        ServiceException se;
+        se.errorCode = ErrorCode::SE_MONGODB_ERROR;
+        se.message = "Failed to pop a client from MongoDB pool";
+        free(movie_id_mmc);
+        throw se;
+      }
+      auto collection = mongoc_client_get_collection(
+          mongodb_client, "movie-id", "movie-id");
+
+      if (!collection) {
+        ServiceException se;
+        se.errorCode = ErrorCode::SE_MONGODB_ERROR;
+        se.message = "Failed to create collection user from DB movie-id";
+        free(movie_id_mmc);
+        mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+        throw se;
+      }
+
+      bson_t *query = bson_new();
+      BSON_APPEND_UTF8(query, "title", title.c_str());
+
+      auto find_span = opentracing::Tracer::Global()->StartSpan(
+          "MongoFindMovieId", { opentracing::ChildOf(&span->context()) });
+      mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
+          collection, query, nullptr, nullptr);
+      const bson_t *doc;
+      bool found = mongoc_cursor_next(cursor, &doc);
+      find_span->Finish();
+
+      if (found) {
+        bson_iter_t iter;
+        if (bson_iter_init_find(&iter, doc, "movie_id")) {
+          movie_id_str = std::string(bson_iter_value(&iter)->value.v_utf8.str);
+          LOG(debug) << "Find movie " << movie_id_str << " cache miss";
+        } else {
+          LOG(error) << "Attribute movie_id is not find in MongoDB";
+          bson_destroy(query);
+          mongoc_cursor_destroy(cursor);
+          mongoc_collection_destroy(collection);
+          mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+          ServiceException se;
+          se.errorCode = ErrorCode::SE_THRIFT_HANDLER_ERROR;
+          se.message = "Attribute movie_id is not find in MongoDB";
+          free(movie_id_mmc);
+          throw se;
+        }
       } else {
-        LOG(error) << "Attribute movie_id is not find in MongoDB";
+        LOG(error) << "Movie " << title << " is not found in MongoDB";
+        if (_title_cache) {
+          _title_cache->PutNotFound(title);
+        }
         bson_destroy(query);
         mongoc_cursor_destroy(cursor);
         mongoc_collection_destroy(collection);
         mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
         ServiceException se;
         se.errorCode = ErrorCode::SE_THRIFT_HANDLER_ERROR;
-        se.message = "Attribute movie_id is not find in MongoDB";
+        se.message = "Movie " + title + " is not found in MongoDB";
         free(movie_id_mmc);
         throw se;
       }
-    } else {
-      LOG(error) << "Movie " << title << " is not found in MongoDB";
       bson_destroy(query);
       mongoc_cursor_destroy(cursor);
       mongoc_collection_destroy(collection);
       mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_THRIFT_HANDLER_ERROR;
-      se.message = "Movie " + title + " is not found in MongoDB";
-      free(movie_id_mmc);
-      throw se;
+      if (_title_cache) {
+        _title_cache->Put(title, movie_id_str);
+      }
+      set_memcached = true;
     }
-    bson_destroy(query);
-    mongoc_cursor_destroy(cursor);
-    mongoc_collection_destroy(collection);
-    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
   }
-  
+
   std::future<void> set_future;
   std::future<void> movie_id_future;
   std::future<void> rating_future;
-  set_future = std::async(std::launch::async, [&]() {
-    memcached_client = memcached_pool_pop(
-        _memcached_client_pool, true, &memcached_rc);
-    auto set_span = opentracing::Tracer::Global()->StartSpan(
-        "MmcSetMovieId", { opentracing::ChildOf(&span->context()) });
-    // Upload the movie id to memcached
-    memcached_rc = memcached_set(
-        memcached_client,
-        title.c_str(),
-        title.length(),
-        movie_id_str.c_str(),
-        movie_id_str.length(),
-        static_cast<time_t>(0),
-        static_cast<uint32_t>(0)
-    );
-    set_span->Finish();
-    if (memcached_rc != MEMCACHED_SUCCESS) {
-      LOG(warning) << "Failed to set movie_id to Memcached: "
-                   << memcached_strerror(memcached_client, memcached_rc);
-    }
-    memcached_pool_push(_memcached_client_pool, memcached_client);    
-  });
+  if (set_memcached) {
+    set_future = std::async(std::launch::async, [&]() {
+      memcached_return_t memcached_rc;
+      memcached_st *memcached_client = memcached_pool_pop(
+          _memcached_client_pool, true, &memcached_rc);
+      if (!memcached_client) {
+        LOG(warning) << "Failed to pop a client from memcached pool";
+        return;
+      }
+      auto set_span = opentracing::Tracer::Global()->StartSpan(
+          "MmcSetMovieId", { opentracing::ChildOf(&span->context()) });
+      // Upload the movie id to memcached
+      memcached_rc = memcached_set(
+          memcached_client,
+          title.c_str(),
+          title.length(),
+          movie_id_str.c_str(),
+          movie_id_str.length(),
+          static_cast<time_t>(0),
+          static_cast<uint32_t>(0)
+      );
+      set_span->Finish();
+      if (memcached_rc != MEMCACHED_SUCCESS) {
+        LOG(warning) << "Failed to set movie_id to Memcached: "
+                     << memcached_strerror(memcached_client, memcached_rc);
+      }
+      memcached_pool_push(_memcached_client_pool, memcached_client);
+    });
+  }
 
   movie_id_future = std::async(std::launch::async, [&]() {
     auto compose_client_wrapper = _compose_client_pool->Pop();
@@ -247,7 +282,9 @@ void MovieIdHandler::UploadMovieId(
   try {
     movie_id_future.get();
     rating_future.get();
-    set_future.get();
+    if (set_future.valid()) {
+      set_future.get();
+    }
   } catch (...) {
     throw;
   }
@@ -335,6 +372,9 @@ void MovieIdHandler::RegisterMovieId (
       throw se;
     }
     bson_destroy(new_doc);
+    if (_title_cache) {
+      _title_cache->Put(title, movie_id);
+    }
   }
   mongoc_cursor_destroy(cursor);
   mongoc_collection_destroy(collection);
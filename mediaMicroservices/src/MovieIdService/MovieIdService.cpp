@@ -1,19 +1,13 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "MovieIdHandler.h"
 
 using json = nlohmann::json;
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -30,12 +24,16 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   int port = config_json["movie-id-service"]["port"];
   std::string compose_addr = config_json["compose-review-service"]["addr"];
   int compose_port = config_json["compose-review-service"]["port"];
   std::string rating_addr = config_json["rating-service"]["addr"];
   int rating_port = config_json["rating-service"]["port"];
+  int title_cache_size = config_json["movie-id-service"]["title_cache_size"];
+  int title_cache_negative_ttl_ms =
+      config_json["movie-id-service"]["title_cache_negative_ttl_ms"];
 
   memcached_pool_st *memcached_client_pool =
       init_memcached_client_pool(config_json, "movie-id", 32, 128);
@@ -58,26 +56,37 @@ int main(int argc, char *argv[]) {
   }
   bool r = false;
   while (!r) {
-    r = CreateIndex(mongodb_client, "movie-id", "movie_id", true);
-    r = CreateIndex(mongodb_client, "movie-id", "title", true);
+    r = CreateIndex(mongodb_client, "movie-id", "movie_id", true) &&
+        CreateIndex(mongodb_client, "movie-id", "title", true);
     if (!r) {
       LOG(error) << "Failed to create mongodb index, try again";
       sleep(1);
     }
   }
+
+  std::unique_ptr<TitleCache> title_cache;
+  if (title_cache_size > 0) {
+    title_cache.reset(
+        new TitleCache(title_cache_size, title_cache_negative_ttl_ms));
+    auto loaded = WarmTitleCache(mongodb_client, title_cache.get());
+    if (loaded < 0) {
+      LOG(warning) << "Failed to warm up the title cache";
+    } else {
+      LOG(info) << "Loaded " << loaded << " titles into the title cache";
+    }
+  }
   mongoc_client_pool_push(mongodb_client_pool, mongodb_client);
 
-  TThreadedServer server(
-      std::make_shared<MovieIdServiceProcessor>(
+  auto processor = std::make_shared<MovieIdServiceProcessor>(
       std::make_shared<MovieIdHandler>(
-              memcached_client_pool, mongodb_client_pool,
-              &compose_client_pool, &rating_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+          memcached_client_pool, mongodb_client_pool,
+          &compose_client_pool, &rating_client_pool, title_cache.get()));
+  SetUpServerMetrics(processor.get(), config_json, "movie-id-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "movie-id-service", port);
   std::cout << "Starting the movie-id-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
 
 
@@ -0,0 +1,135 @@
+#ifndef MEDIA_MICROSERVICES_SRC_MOVIEIDSERVICE_TITLECACHE_H_
+#define MEDIA_MICROSERVICES_SRC_MOVIEIDSERVICE_TITLECACHE_H_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <bson/bson.h>
+#include <mongoc.h>
+
+#include "../LruCache.h"
+#include "../logger.h"
+
+namespace media_service {
+
+struct TitleLookup {
+  enum type {
+    MISS,
+    FOUND,
+    NOT_FOUND
+  };
+};
+
+// In-process LRU of title -> movie_id. A movie_id never changes once
+// registered, so found titles do not expire. Titles that MongoDB does not
+// know are kept as negative entries for negative_ttl_ms, so that reviews of
+// unknown movies do not reach memcached and MongoDB every time; a title
+// registered on this replica replaces its negative entry right away.
+class TitleCache {
+ public:
+  TitleCache(size_t capacity, int negative_ttl_ms);
+
+  TitleCache(const TitleCache &) = delete;
+  TitleCache &operator=(const TitleCache &) = delete;
+
+  // Sets *movie_id when FOUND.
+  TitleLookup::type Get(const std::string &title, std::string *movie_id);
+  void Put(const std::string &title, const std::string &movie_id);
+  void PutNotFound(const std::string &title);
+
+ private:
+  struct Entry {
+    // Empty for a negative entry.
+    std::string movie_id;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  void _Put(const std::string &title, Entry entry);
+
+  std::mutex _mtx;
+  LruCache<Entry> _lru;
+  std::chrono::milliseconds _negative_ttl;
+};
+
+TitleCache::TitleCache(size_t capacity, int negative_ttl_ms)
+    : _lru(capacity), _negative_ttl(negative_ttl_ms) {}
+
+TitleLookup::type TitleCache::Get(const std::string &title,
+                                  std::string *movie_id) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  // Negative entries keep their place, so that they age out of the LRU.
+  const Entry *entry = _lru.Peek(title);
+  if (!entry) {
+    return TitleLookup::MISS;
+  }
+  if (entry->movie_id.empty()) {
+    if (entry->expires <= std::chrono::steady_clock::now()) {
+      _lru.Erase(title);
+      return TitleLookup::MISS;
+    }
+    return TitleLookup::NOT_FOUND;
+  }
+  *movie_id = _lru.Get(title)->movie_id;
+  return TitleLookup::FOUND;
+}
+
+void TitleCache::Put(const std::string &title, const std::string &movie_id) {
+  _Put(title, Entry{movie_id, std::chrono::steady_clock::time_point::max()});
+}
+
+void TitleCache::PutNotFound(const std::string &title) {
+  _Put(title, Entry{"", std::chrono::steady_clock::now() + _negative_ttl});
+}
+
+void TitleCache::_Put(const std::string &title, Entry entry) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  _lru.Put(title, std::move(entry));
+}
+
+// Loads every title of the movie-id collection into the cache. Returns the
+// number loaded, or -1 if the scan failed.
+int64_t WarmTitleCache(mongoc_client_t *mongodb_client, TitleCache *cache) {
+  auto collection = mongoc_client_get_collection(
+      mongodb_client, "movie-id", "movie-id");
+  if (!collection) {
+    return -1;
+  }
+  bson_t *query = bson_new();
+  bson_t *opts = BCON_NEW(
+      "projection", "{",
+      "title", BCON_BOOL(true),
+      "movie_id", BCON_BOOL(true),
+      "_id", BCON_BOOL(false), "}");
+  mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
+      collection, query, opts, nullptr);
+  int64_t loaded = 0;
+  const bson_t *doc;
+  while (mongoc_cursor_next(cursor, &doc)) {
+    bson_iter_t title_iter;
+    bson_iter_t movie_id_iter;
+    if (bson_iter_init_find(&title_iter, doc, "title") &&
+        BSON_ITER_HOLDS_UTF8(&title_iter) &&
+        bson_iter_init_find(&movie_id_iter, doc, "movie_id") &&
+        BSON_ITER_HOLDS_UTF8(&movie_id_iter)) {
+      cache->Put(bson_iter_utf8(&title_iter, nullptr),
+                 bson_iter_utf8(&movie_id_iter, nullptr));
+      ++loaded;
+    }
+  }
+  bson_error_t error;
+  if (mongoc_cursor_error(cursor, &error)) {
+    LOG(error) << "Failed to load titles from MongoDB: " << error.message;
+    loaded = -1;
+  }
+  mongoc_cursor_destroy(cursor);
+  bson_destroy(opts);
+  bson_destroy(query);
+  mongoc_collection_destroy(collection);
+  return loaded;
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_SRC_MOVIEIDSERVICE_TITLECACHE_H_
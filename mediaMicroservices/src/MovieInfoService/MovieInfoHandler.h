@@ -13,6 +13,7 @@
 #include "../../gen-cpp/MovieInfoService.h"
 #include "../logger.h"
 #include "../tracing.h"
+#include "../utils_cache_format.h"
 
 namespace media_service {
 using json = nlohmann::json;
@@ -43,6 +44,49 @@ class MovieInfoHandler : public MovieInfoServiceIf {
   mongoc_client_pool_t *_mongodb_client_pool;
 };
 
+// avg_rating and num_rating are the ratings the movie was written with;
+// rating_sum and rating_num add up the ratings committed since by
+// RatingCommitter or UpdateRating.
+void SetRating(const json &movie_info_json, MovieInfo *movie_info) {
+  double avg_rating = movie_info_json["avg_rating"];
+  int64_t num_rating = movie_info_json["num_rating"];
+  if (movie_info_json.contains("rating_num")) {
+    int64_t rating_num = movie_info_json["rating_num"];
+    int64_t rating_sum = movie_info_json["rating_sum"];
+    if (num_rating + rating_num > 0) {
+      avg_rating = (avg_rating * num_rating + rating_sum) /
+          (num_rating + rating_num);
+    }
+    num_rating += rating_num;
+  }
+  movie_info->avg_rating = avg_rating;
+  movie_info->num_rating = num_rating;
+}
+
+// Fills movie_info from the JSON of a movie-info document.
+void MovieInfoFromJson(const json &movie_info_json, MovieInfo *movie_info) {
+  movie_info->movie_id = movie_info_json["movie_id"];
+  movie_info->title = movie_info_json["title"];
+  SetRating(movie_info_json, movie_info);
+  movie_info->plot_id = movie_info_json["plot_id"];
+  for (auto &item : movie_info_json["photo_ids"]) {
+    movie_info->photo_ids.emplace_back(item);
+  }
+  for (auto &item : movie_info_json["video_ids"]) {
+    movie_info->video_ids.emplace_back(item);
+  }
+  for (auto &item : movie_info_json["thumbnail_ids"]) {
+    movie_info->thumbnail_ids.emplace_back(item);
+  }
+  for (auto &item : movie_info_json["casts"]) {
+    Cast new_cast;
+    new_cast.cast_id = item["cast_id"];
+    new_cast.cast_info_id = item["cast_info_id"];
+    new_cast.character = item["character"];
+    movie_info->casts.emplace_back(new_cast);
+  }
+}
+
 MovieInfoHandler::MovieInfoHandler(
     memcached_pool_st *memcached_client_pool,
     mongoc_client_pool_t *mongodb_client_pool) {
@@ -215,33 +259,26 @@ void MovieInfoHandler::ReadMovieInfo(
   memcached_pool_push(_memcached_client_pool, memcached_client);
   get_span->Finish();
 
+  bool cache_hit = false;
   if (movie_info_mmc) {
     LOG(debug) << "Get movie-info " << movie_id << " cache hit from Memcached";
-    json movie_info_json = json::parse(std::string(
-        movie_info_mmc, movie_info_mmc + movie_info_mmc_size));
-    _return.movie_id = movie_info_json["movie_id"];
-    _return.title = movie_info_json["title"];
-    _return.avg_rating = movie_info_json["avg_rating"];
-    _return.num_rating = movie_info_json["num_rating"];
-    _return.plot_id = movie_info_json["plot_id"];
-    for (auto &item : movie_info_json["photo_ids"]) {
-      _return.photo_ids.emplace_back(item);
-    }
-    for (auto &item : movie_info_json["video_ids"]) {
-      _return.video_ids.emplace_back(item);
-    }
-    for (auto &item : movie_info_json["thumbnail_ids"]) {
-      _return.thumbnail_ids.emplace_back(item);
-    }
-    for (auto &item : movie_info_json["casts"]) {
-      Cast new_cast;
-      new_cast.cast_id = item["cast_id"];
-      new_cast.cast_info_id = item["cast_info_id"];
-      new_cast.character = item["character"];
-      _return.casts.emplace_back(new_cast);
+    try {
+      if (memcached_flags == CacheFormat::COMPACT) {
+        DecodeCompact(movie_info_mmc, movie_info_mmc_size, &_return);
+      } else {
+        MovieInfoFromJson(json::parse(std::string(
+            movie_info_mmc, movie_info_mmc + movie_info_mmc_size)), &_return);
+      }
+      cache_hit = true;
+    } catch (...) {
+      LOG(warning) << "Failed to decode movie-info " << movie_id
+                   << " from Memcached";
+      _return = MovieInfo();
     }
     free(movie_info_mmc);
-  } else {
+  }
+
+  if (!cache_hit) {
     // If not cached in memcached
     mongoc_client_t *mongodb_client = mongoc_client_pool_pop(
         _mongodb_client_pool);
@@ -296,34 +333,18 @@ void MovieInfoHandler::ReadMovieInfo(
     } else {
       LOG(debug) << "Movie_id: " << movie_id << " found in MongoDB";
       auto movie_info_json_char = bson_as_json(doc, nullptr);
-      json movie_info_json = json::parse(movie_info_json_char);
-      _return.movie_id = movie_info_json["movie_id"];
-      _return.title = movie_info_json["title"];
-      _return.avg_rating = movie_info_json["avg_rating"];
-      _return.num_rating = movie_info_json["num_rating"];
-      _return.plot_id = movie_info_json["plot_id"];
-      for (auto &item : movie_info_json["photo_ids"]) {
-        _return.photo_ids.emplace_back(item);
-      }
-      for (auto &item : movie_info_json["video_ids"]) {
-        _return.video_ids.emplace_back(item);
-      }
-      for (auto &item : movie_info_json["thumbnail_ids"]) {
-        _return.thumbnail_ids.emplace_back(item);
-      }
-      for (auto &item : movie_info_json["casts"]) {
-        Cast new_cast;
-        new_cast.cast_id = item["cast_id"];
-        new_cast.cast_info_id = item["cast_info_id"];
-        new_cast.character = item["character"];
-        _return.casts.emplace_back(new_cast);
-      }
+      MovieInfoFromJson(json::parse(movie_info_json_char), &_return);
       bson_destroy(query);
       mongoc_cursor_destroy(cursor);
       mongoc_collection_destroy(collection);
       mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
 
       // upload movie-info to memcached
+      auto cache_format = GetCacheFormat();
+      std::string movie_info_cached =
+          cache_format == CacheFormat::COMPACT ? EncodeCompact(_return)
+                                               : movie_info_json_char;
+      bson_free(movie_info_json_char);
       memcached_client = memcached_pool_pop(
           _memcached_client_pool, true, &memcached_rc);
       if (!memcached_client) {
@@ -339,16 +360,15 @@ void MovieInfoHandler::ReadMovieInfo(
           memcached_client,
           movie_id.c_str(),
           movie_id.length(),
-          movie_info_json_char,
-          std::strlen(movie_info_json_char),
+          movie_info_cached.c_str(),
+          movie_info_cached.length(),
           static_cast<time_t>(0),
-          static_cast<uint32_t>(0));
+          static_cast<uint32_t>(cache_format));
       if (memcached_rc != MEMCACHED_SUCCESS) {
         LOG(warning) << "Failed to set movie_info to Memcached: "
                      << memcached_strerror(memcached_client, memcached_rc);
       }
       set_span->Finish();
-      bson_free(movie_info_json_char);
       memcached_pool_push(_memcached_client_pool, memcached_client);
     }
   }
@@ -378,73 +398,42 @@ void MovieInfoHandler::UpdateRating(
     ServiceException se;
     se.errorCode = ErrorCode::SE_MONGODB_ERROR;
     se.message = "Failed to pop a client from MongoDB pool";
+    bson_destroy(query);
     throw se;
   }
   auto collection = mongoc_client_get_collection(
-      mongodb_client, "social-graph", "social-graph");
+      mongodb_client, "movie-info", "movie-info");
   if (!collection) {
     ServiceException se;
     se.errorCode = ErrorCode::SE_MONGODB_ERROR;
-    se.message = "Failed to create collection social_graph from MongoDB";
+    se.message = "Failed to create collection movie-info from DB movie-info";
+    bson_destroy(query);
     mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
     throw se;
   }
-  auto find_span = opentracing::Tracer::Global()->StartSpan(
-      "MongoFindMovieInfo", {opentracing::ChildOf(&span->context())});
-  mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
-      collection, query, nullptr, nullptr);
-  const bson_t *doc;
-  bool found = mongoc_cursor_next(cursor, &doc);
-  if (found) {
-    bson_iter_t iter_0;
-    bson_iter_t iter_1;
-    bson_iter_init(&iter_0, doc);
-    bson_iter_init(&iter_1, doc);
-    double avg_rating;
-    int32_t num_rating;
-    if (bson_iter_init_find(&iter_0, doc, "avg_rating") &&
-        bson_iter_init_find(&iter_1, doc, "num_rating")) {
-      avg_rating = bson_iter_value(&iter_0)->value.v_double;
-      num_rating = bson_iter_value(&iter_1)->value.v_int32;
-
-      avg_rating = (avg_rating * num_rating + sum_uncommitted_rating) /
-          (num_rating + num_uncommitted_rating);
-      num_rating += num_uncommitted_rating;
-
-      bson_t *update = BCON_NEW(
-          "$set", "{",
-          "avg_rating", BCON_DOUBLE(avg_rating),
-          "num_rating", BCON_INT32(num_rating), "}");
-      bson_error_t error;
-      bson_t reply;
-      auto update_span = opentracing::Tracer::Global()->StartSpan(
-          "MongoUpdateRating", {opentracing::ChildOf(&span->context())});
-      bool updated = mongoc_collection_find_and_modify(
-          collection,
-          query,
-          nullptr,
-          update,
-          nullptr,
-          false,
-          false,
-          true,
-          &reply,
-          &error);
-      if (!updated) {
-        LOG(error) << "Failed to update rating for movie " << movie_id
-                   << " to MongoDB: " << error.message;
-        ServiceException se;
-        se.errorCode = ErrorCode::SE_MONGODB_ERROR;
-        se.message = "Failed to update rating for movie " + movie_id +
-            " to MongoDB: " + error.message;
-        bson_destroy(&reply);
-        bson_destroy(update);
-        mongoc_collection_destroy(collection);
-        mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-        throw se;
-      }
-      update_span->Finish();
-    }
+  // One atomic $inc, the same update RatingCommitter applies in bulk.
+  bson_t *update = BCON_NEW(
+      "$inc", "{",
+      "rating_sum", BCON_INT64(sum_uncommitted_rating),
+      "rating_num", BCON_INT64(num_uncommitted_rating), "}");
+  bson_error_t error;
+  auto update_span = opentracing::Tracer::Global()->StartSpan(
+      "MongoUpdateRating", {opentracing::ChildOf(&span->context())});
+  bool updated = mongoc_collection_update_one(
+      collection, query, update, nullptr, nullptr, &error);
+  update_span->Finish();
+  bson_destroy(update);
+  bson_destroy(query);
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+  if (!updated) {
+    LOG(error) << "Failed to update rating for movie " << movie_id
+               << " to MongoDB: " << error.message;
+    ServiceException se;
+    se.errorCode = ErrorCode::SE_MONGODB_ERROR;
+    se.message = "Failed to update rating for movie " + movie_id +
+        " to MongoDB: " + error.message;
+    throw se;
   }
 
   auto delete_span = opentracing::Tracer::Global()->StartSpan(
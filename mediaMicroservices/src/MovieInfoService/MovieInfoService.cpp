@@ -1,19 +1,14 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "MovieInfoHandler.h"
+#include "RatingCommitter.h"
 
 using json = nlohmann::json;
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -30,8 +25,16 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
+  SetUpCacheFormat(config_json);
 
   int port = config_json["movie-info-service"]["port"];
+  std::string redis_addr = config_json["rating-redis"]["addr"];
+  int redis_port = config_json["rating-redis"]["port"];
+  int rating_commit_interval_ms =
+      config_json["movie-info-service"]["rating_commit_interval_ms"];
+  int rating_commit_batch_size =
+      config_json["movie-info-service"]["rating_commit_batch_size"];
 
   memcached_pool_st *memcached_client_pool =
       init_memcached_client_pool(config_json, "movie-info",
@@ -58,14 +61,20 @@ int main(int argc, char *argv[]) {
   }
   mongoc_client_pool_push(mongodb_client_pool, mongodb_client);
 
-  TThreadedServer server(
-      std::make_shared<MovieInfoServiceProcessor>(
-          std::make_shared<MovieInfoHandler>(
-              memcached_client_pool, mongodb_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  ClientPool<RedisClient> redis_client_pool("rating-redis",
+      redis_addr, redis_port, 0, 4, 1000);
+  RatingCommitter rating_committer(
+      &redis_client_pool, mongodb_client_pool, memcached_client_pool,
+      rating_commit_interval_ms, rating_commit_batch_size);
+  rating_committer.Start();
+
+  auto processor = std::make_shared<MovieInfoServiceProcessor>(
+      std::make_shared<MovieInfoHandler>(
+          memcached_client_pool, mongodb_client_pool));
+  SetUpServerMetrics(processor.get(), config_json, "movie-info-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "movie-info-service", port);
   std::cout << "Starting the movie-info-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
\ No newline at end of file
@@ -0,0 +1,320 @@
+#ifndef MEDIA_MICROSERVICES_SRC_MOVIEINFOSERVICE_RATINGCOMMITTER_H_
+#define MEDIA_MICROSERVICES_SRC_MOVIEINFOSERVICE_RATINGCOMMITTER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <bson/bson.h>
+#include <libmemcached/memcached.h>
+#include <libmemcached/util.h>
+#include <mongoc.h>
+
+#include "../ClientPool.h"
+#include "../RedisClient.h"
+#include "../logger.h"
+#include "../metrics.h"
+#include "../utils_rating.h"
+
+namespace media_service {
+
+// Moves the ratings rating-service stages in rating-redis into movie-info.
+// Every interval_ms it drains the staged sums and counts of up to batch_size
+// movies with one Lua script, and adds them to the movies' rating_sum and
+// rating_num with one unordered bulk of $inc updates. There is no
+// read-modify-write, so commits from several replicas add up. The memcached
+// entries of the committed movies are then deleted. A batch that MongoDB
+// rejects is staged again.
+//
+// rating_commit_lag_ms is how long the oldest rating of the last batch had
+// been staged, and rating_uncommitted_movies how many movies were left.
+class RatingCommitter {
+ public:
+  RatingCommitter(ClientPool<RedisClient> *, mongoc_client_pool_t *,
+                  memcached_pool_st *, int interval_ms, int batch_size);
+
+  RatingCommitter(const RatingCommitter &) = delete;
+  RatingCommitter &operator=(const RatingCommitter &) = delete;
+
+  void Start();
+
+ private:
+  struct StagedRatings {
+    std::string movie_id;
+    int64_t time_ms;
+    int64_t sum;
+    int64_t num;
+  };
+
+  // Returns the number of movies drained; throws on Redis errors.
+  size_t _CommitBatch();
+  bool _Drain(std::vector<StagedRatings> *batch);
+  // The indexes of the updates MongoDB failed, or all of them if it is not
+  // known which did.
+  std::set<size_t> _Apply(const std::vector<StagedRatings> &batch);
+  void _Restage(const std::vector<StagedRatings> &batch,
+                const std::set<size_t> &failed);
+  void _DeleteCached(const std::vector<StagedRatings> &batch);
+
+  ClientPool<RedisClient> *_redis_client_pool;
+  mongoc_client_pool_t *_mongodb_client_pool;
+  memcached_pool_st *_memcached_client_pool;
+  int _interval_ms;
+  int _batch_size;
+  std::atomic<int64_t> *_lag_ms;
+  std::atomic<int64_t> *_uncommitted;
+};
+
+RatingCommitter::RatingCommitter(
+    ClientPool<RedisClient> *redis_client_pool,
+    mongoc_client_pool_t *mongodb_client_pool,
+    memcached_pool_st *memcached_client_pool,
+    int interval_ms,
+    int batch_size) {
+  _redis_client_pool = redis_client_pool;
+  _mongodb_client_pool = mongodb_client_pool;
+  _memcached_client_pool = memcached_client_pool;
+  _interval_ms = interval_ms;
+  _batch_size = batch_size;
+  _lag_ms = Metrics::Get().Gauge("rating_commit_lag_ms");
+  _uncommitted = Metrics::Get().Gauge("rating_uncommitted_movies");
+}
+
+void RatingCommitter::Start() {
+  std::thread([this]() {
+    while (true) {
+      size_t drained = 0;
+      try {
+        drained = _CommitBatch();
+      } catch (...) {
+        LOG_RATE_LIMITED(error) << "Failed to commit staged ratings";
+      }
+      // A full batch means more are waiting; commit them right away.
+      if (drained < static_cast<size_t>(_batch_size)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(_interval_ms));
+      }
+    }
+  }).detach();
+}
+
+size_t RatingCommitter::_CommitBatch() {
+  std::vector<StagedRatings> batch;
+  if (!_Drain(&batch) || batch.empty()) {
+    _lag_ms->store(0, std::memory_order_relaxed);
+    return 0;
+  }
+
+  int64_t oldest_ms = batch.front().time_ms;
+  for (auto &staged : batch) {
+    oldest_ms = std::min(oldest_ms, staged.time_ms);
+  }
+  auto failed = _Apply(batch);
+  if (!failed.empty()) {
+    _Restage(batch, failed);
+  }
+  _DeleteCached(batch);
+  _lag_ms->store(RatingClockMs() - oldest_ms, std::memory_order_relaxed);
+  return batch.size();
+}
+
+bool RatingCommitter::_Drain(std::vector<StagedRatings> *batch) {
+  auto redis_client_wrapper = _redis_client_pool->Pop();
+  if (!redis_client_wrapper) {
+    return false;
+  }
+  RedisPipeline pipeline(redis_client_wrapper);
+  // The oldest movies are listed first, so that the script is given the keys
+  // it drains.
+  cpp_redis::reply list_reply;
+  try {
+    auto list_future = pipeline.Send({"ZRANGE", kUncommittedRatingsKey, "0",
+                                      std::to_string(_batch_size - 1)});
+    pipeline.Commit();
+    list_reply = list_future.get();
+  } catch (...) {
+    _redis_client_pool->Remove(redis_client_wrapper);
+    throw;
+  }
+  if (!list_reply.is_array()) {
+    _redis_client_pool->Push(redis_client_wrapper);
+    LOG_RATE_LIMITED(error)
+        << "Failed to list staged ratings: "
+        << (list_reply.is_error() ? list_reply.error() : "");
+    return false;
+  }
+  std::vector<std::string> movie_ids;
+  for (auto &movie_id : list_reply.as_array()) {
+    movie_ids.emplace_back(movie_id.as_string());
+  }
+  if (movie_ids.empty()) {
+    _redis_client_pool->Push(redis_client_wrapper);
+    _uncommitted->store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  cpp_redis::reply reply;
+  try {
+    auto reply_future = DrainRatings(&pipeline, movie_ids);
+    pipeline.Commit();
+    reply = reply_future.get();
+  } catch (...) {
+    _redis_client_pool->Remove(redis_client_wrapper);
+    throw;
+  }
+  _redis_client_pool->Push(redis_client_wrapper);
+  if (!reply.is_array()) {
+    LOG_RATE_LIMITED(error) << "Failed to drain staged ratings: "
+                            << (reply.is_error() ? reply.error() : "");
+    return false;
+  }
+
+  auto &values = reply.as_array();
+  _uncommitted->store(values[0].as_integer(), std::memory_order_relaxed);
+  for (size_t i = 1; i + 3 < values.size(); i += 4) {
+    StagedRatings staged;
+    staged.movie_id = values[i].as_string();
+    staged.time_ms = std::stoll(values[i + 1].as_string());
+    staged.sum = std::stoll(values[i + 2].as_string());
+    staged.num = std::stoll(values[i + 3].as_string());
+    if (staged.num > 0) {
+      batch->emplace_back(std::move(staged));
+    }
+  }
+  return true;
+}
+
+std::set<size_t> RatingCommitter::_Apply(
+    const std::vector<StagedRatings> &batch) {
+  std::set<size_t> all;
+  for (size_t i = 0; i < batch.size(); ++i) {
+    all.insert(i);
+  }
+
+  mongoc_client_t *mongodb_client = mongoc_client_pool_pop(
+      _mongodb_client_pool);
+  if (!mongodb_client) {
+    LOG_RATE_LIMITED(error) << "Failed to pop a client from MongoDB pool";
+    return all;
+  }
+  auto collection = mongoc_client_get_collection(
+      mongodb_client, "movie-info", "movie-info");
+  if (!collection) {
+    LOG_RATE_LIMITED(error) << "Failed to get collection movie-info";
+    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    return all;
+  }
+
+  bson_t *bulk_opts = BCON_NEW("ordered", BCON_BOOL(false));
+  mongoc_bulk_operation_t *bulk =
+      mongoc_collection_create_bulk_operation_with_opts(collection, bulk_opts);
+  for (auto &staged : batch) {
+    bson_t *selector = BCON_NEW(
+        "movie_id", BCON_UTF8(staged.movie_id.c_str()));
+    bson_t *update = BCON_NEW(
+        "$inc", "{",
+        "rating_sum", BCON_INT64(staged.sum),
+        "rating_num", BCON_INT64(staged.num), "}");
+    bson_error_t error;
+    if (!mongoc_bulk_operation_update_one_with_opts(
+        bulk, selector, update, nullptr, &error)) {
+      LOG_RATE_LIMITED(error) << "Failed to add the update of movie "
+                              << staged.movie_id << ": " << error.message;
+    }
+    bson_destroy(update);
+    bson_destroy(selector);
+  }
+
+  std::set<size_t> failed;
+  bson_t reply;
+  bson_error_t error;
+  if (!mongoc_bulk_operation_execute(bulk, &reply, &error)) {
+    // Per-update errors name the updates that failed. Any other error
+    // (connection, write concern) says nothing about which were applied, so
+    // the whole batch is staged again, at the risk of counting some twice.
+    bson_iter_t iter;
+    bson_iter_t errors_iter;
+    if (bson_iter_init_find(&iter, &reply, "writeErrors") &&
+        BSON_ITER_HOLDS_ARRAY(&iter) &&
+        bson_iter_recurse(&iter, &errors_iter)) {
+      while (bson_iter_next(&errors_iter)) {
+        bson_iter_t index_iter;
+        if (BSON_ITER_HOLDS_DOCUMENT(&errors_iter) &&
+            bson_iter_recurse(&errors_iter, &index_iter) &&
+            bson_iter_find(&index_iter, "index")) {
+          failed.insert(bson_iter_as_int64(&index_iter));
+        }
+      }
+    }
+    if (failed.empty()) {
+      failed = all;
+    }
+    LOG_RATE_LIMITED(error) << "Failed to commit ratings to MongoDB: "
+                            << error.message;
+  }
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(bulk);
+  bson_destroy(bulk_opts);
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+  return failed;
+}
+
+void RatingCommitter::_Restage(const std::vector<StagedRatings> &batch,
+                               const std::set<size_t> &failed) {
+  auto redis_client_wrapper = _redis_client_pool->Pop();
+  if (!redis_client_wrapper) {
+    LOG(error) << "Lost the staged ratings of " << failed.size()
+               << " movies: no connection to rating-redis";
+    return;
+  }
+  // All of them in one round trip.
+  RedisPipeline pipeline(redis_client_wrapper);
+  std::vector<std::future<cpp_redis::reply>> staged;
+  try {
+    for (auto i : failed) {
+      staged.emplace_back(StageRatings(&pipeline, batch[i].movie_id,
+                                       batch[i].sum, batch[i].num,
+                                       batch[i].time_ms));
+    }
+    pipeline.Commit();
+  } catch (...) {
+    _redis_client_pool->Remove(redis_client_wrapper);
+    LOG(error) << "Lost the staged ratings of " << failed.size()
+               << " movies: rating-redis failed";
+    throw;
+  }
+  _redis_client_pool->Push(redis_client_wrapper);
+  size_t n = 0;
+  for (auto i : failed) {
+    try {
+      CheckStaged(staged[n++].get(), batch[i].movie_id);
+    } catch (...) {
+      LOG(error) << "Lost the staged ratings of movie " << batch[i].movie_id;
+    }
+  }
+}
+
+void RatingCommitter::_DeleteCached(const std::vector<StagedRatings> &batch) {
+  memcached_return_t memcached_rc;
+  memcached_st *memcached_client = memcached_pool_pop(
+      _memcached_client_pool, true, &memcached_rc);
+  if (!memcached_client) {
+    LOG_RATE_LIMITED(error) << "Failed to pop a client from memcached pool";
+    return;
+  }
+  for (auto &staged : batch) {
+    memcached_delete(memcached_client, staged.movie_id.c_str(),
+                     staged.movie_id.length(), 0);
+  }
+  memcached_pool_push(_memcached_client_pool, memcached_client);
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_SRC_MOVIEINFOSERVICE_RATINGCOMMITTER_H_
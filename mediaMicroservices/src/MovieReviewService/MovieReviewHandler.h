@@ -12,8 +12,10 @@
 #include "../logger.h"
 #include "../tracing.h"
 #include "../ClientPool.h"
+#include "../FanOut.h"
 #include "../RedisClient.h"
 #include "../ThriftClient.h"
+#include "../utils_review_index.h"
 
 namespace media_service {
 class MovieReviewHandler : public MovieReviewServiceIf {
@@ -21,7 +23,8 @@ class MovieReviewHandler : public MovieReviewServiceIf {
   MovieReviewHandler(
       ClientPool<RedisClient> *,
       mongoc_client_pool_t *,
-      ClientPool<ThriftClient<ReviewStorageServiceClient>> *);
+      ClientPool<ThriftClient<ReviewStorageServiceClient>> *,
+      int);
   ~MovieReviewHandler() override = default;
   void UploadMovieReview(int64_t, const std::string&, int64_t, int64_t,
                          const std::map<std::string, std::string> &) override;
@@ -33,15 +36,18 @@ class MovieReviewHandler : public MovieReviewServiceIf {
   ClientPool<RedisClient> *_redis_client_pool;
   mongoc_client_pool_t *_mongodb_client_pool;
   ClientPool<ThriftClient<ReviewStorageServiceClient>> *_review_client_pool;
+  int _fan_out_timeout_ms;
 };
 
 MovieReviewHandler::MovieReviewHandler(
     ClientPool<RedisClient> *redis_client_pool,
     mongoc_client_pool_t *mongodb_pool,
-    ClientPool<ThriftClient<ReviewStorageServiceClient>> *review_storage_client_pool) {
+    ClientPool<ThriftClient<ReviewStorageServiceClient>> *review_storage_client_pool,
+    int fan_out_timeout_ms) {
   _redis_client_pool = redis_client_pool;
   _mongodb_client_pool = mongodb_pool;
   _review_client_pool = review_storage_client_pool;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
 }
 
 void MovieReviewHandler::UploadMovieReview(
@@ -164,19 +170,9 @@ void MovieReviewHandler::UploadMovieReview(
     se.message = "Cannot connected to Redis server";
     throw se;
   }
-  auto redis_client = redis_client_wrapper->GetClient();
   auto redis_span = opentracing::Tracer::Global()->StartSpan(
       "RedisUpdate", {opentracing::ChildOf(&span->context())});
-  auto num_reviews = redis_client->zcard(movie_id);
-  redis_client->sync_commit();
-  auto num_reviews_reply = num_reviews.get();
-  std::vector<std::string> options{"NX"};
-  if (num_reviews_reply.ok() && num_reviews_reply.as_integer()) {
-    std::multimap<std::string, std::string> value = {{
-      std::to_string(timestamp), std::to_string(review_id)}};
-    redis_client->zadd(movie_id, options, value);
-    redis_client->sync_commit();
-  }
+  AddCachedReview(redis_client_wrapper, movie_id, review_id, timestamp);
   _redis_client_pool->Push(redis_client_wrapper);
   redis_span->Finish();
   span->Finish();
@@ -208,11 +204,13 @@ void MovieReviewHandler::ReadMovieReviews(
     se.message = "Cannot connected to Redis server";
     throw se;
   }
-  auto redis_client = redis_client_wrapper->GetClient();
+  RedisPipeline pipeline(redis_client_wrapper);
   auto redis_span = opentracing::Tracer::Global()->StartSpan(
       "RedisFind", {opentracing::ChildOf(&span->context())});
-  auto review_ids_future = redis_client->zrevrange(movie_id, start, stop - 1);
-  redis_client->commit();
+  auto review_ids_future = pipeline.Send(
+      {"ZREVRANGE", movie_id, std::to_string(start),
+       std::to_string(stop - 1)});
+  pipeline.Commit();
   redis_span->Finish();
 
   cpp_redis::reply review_ids_reply;
@@ -230,8 +228,21 @@ void MovieReviewHandler::ReadMovieReviews(
     review_ids.emplace_back(std::stoul(review_id_reply.as_string()));
   }
 
+  // Hydrate the cached review_ids while the rest are looked up in MongoDB.
+  FanOut review_fan_out(_fan_out_timeout_ms);
+  if (!review_ids.empty()) {
+    review_fan_out.Call(
+        _review_client_pool, "review-storage-service",
+        [&](ReviewStorageServiceClient *client) {
+          client->send_ReadReviews(req_id, review_ids, writer_text_map);
+        },
+        [&](ReviewStorageServiceClient *client) {
+          client->recv_ReadReviews(_return);
+        });
+  }
+
   int mongo_start = start + review_ids.size();
-  std::multimap<std::string, std::string> redis_update_map;
+  std::vector<Review> mongo_reviews;
   if (mongo_start < stop) {
     // Instead find review_ids from mongodb
     mongoc_client_t *mongodb_client = mongoc_client_pool_pop(
@@ -248,6 +259,7 @@ void MovieReviewHandler::ReadMovieReviews(
       ServiceException se;
       se.errorCode = ErrorCode::SE_MONGODB_ERROR;
       se.message = "Failed to create collection movie-review from MongoDB";
+      mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
       throw se;
     }
 
@@ -262,119 +274,80 @@ void MovieReviewHandler::ReadMovieReviews(
         "MongoFindMovieReviews", {opentracing::ChildOf(&span->context())});
     mongoc_cursor_t *cursor = mongoc_collection_find_with_opts(
         collection, query, opts, nullptr);
-    find_span->Finish();
     const bson_t *doc;
     bool found = mongoc_cursor_next(cursor, &doc);
+    find_span->Finish();
+    std::vector<int64_t> mongo_review_ids;
+    std::multimap<std::string, std::string> redis_update_map;
     if (found) {
-      bson_iter_t iter_0;
-      bson_iter_t iter_1;
-      bson_iter_t review_id_child;
-      bson_iter_t timestamp_child;
-      int idx = 0;
-      bson_iter_init(&iter_0, doc);
-      bson_iter_init(&iter_1, doc);
-      while (bson_iter_find_descendant(&iter_0,
-                                       ("reviews." + std::to_string(idx)
-                                           + ".review_id").c_str(),
-                                       &review_id_child)
-          && BSON_ITER_HOLDS_INT64(&review_id_child)
-          && bson_iter_find_descendant(&iter_1,
-                                       ("reviews." + std::to_string(idx)
-                                           + ".timestamp").c_str(),
-                                       &timestamp_child)
-          && BSON_ITER_HOLDS_INT64(&timestamp_child)) {
-        auto curr_review_id = bson_iter_int64(&review_id_child);
-        auto curr_timestamp = bson_iter_int64(&timestamp_child);
-        if (idx >= mongo_start) {
-          review_ids.emplace_back(curr_review_id);
+      bson_iter_t iter;
+      bson_iter_t reviews_iter;
+      if (bson_iter_init_find(&iter, doc, "reviews") &&
+          BSON_ITER_HOLDS_ARRAY(&iter) &&
+          bson_iter_recurse(&iter, &reviews_iter)) {
+        int idx = 0;
+        while (bson_iter_next(&reviews_iter)) {
+          bson_iter_t review_iter;
+          bson_iter_t review_id_child;
+          bson_iter_t timestamp_child;
+          if (!BSON_ITER_HOLDS_DOCUMENT(&reviews_iter) ||
+              !bson_iter_recurse(&reviews_iter, &review_iter) ||
+              !bson_iter_find_descendant(&review_iter, "review_id",
+                                         &review_id_child) ||
+              !BSON_ITER_HOLDS_INT64(&review_id_child) ||
+              !bson_iter_recurse(&reviews_iter, &review_iter) ||
+              !bson_iter_find_descendant(&review_iter, "timestamp",
+                                         &timestamp_child) ||
+              !BSON_ITER_HOLDS_INT64(&timestamp_child)) {
+            break;
+          }
+          auto curr_review_id = bson_iter_int64(&review_id_child);
+          auto curr_timestamp = bson_iter_int64(&timestamp_child);
+          if (idx >= mongo_start) {
+            mongo_review_ids.emplace_back(curr_review_id);
+          }
+          redis_update_map.insert(
+              {std::to_string(curr_timestamp), std::to_string(curr_review_id)});
+          idx++;
         }
-        redis_update_map.insert(
-            {std::to_string(curr_timestamp), std::to_string(curr_review_id)});
-        bson_iter_init(&iter_0, doc);
-        bson_iter_init(&iter_1, doc);
-        idx++;
       }
     }
-    find_span->Finish();
     bson_destroy(opts);
     bson_destroy(query);
     mongoc_cursor_destroy(cursor);
     mongoc_collection_destroy(collection);
     mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-  }
 
-  std::future<std::vector<Review>> review_future = std::async(
-      std::launch::async, [&]() {
-        auto review_client_wrapper = _review_client_pool->Pop();
-        if (!review_client_wrapper) {
-          ServiceException se;
-          se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
-          se.message = "Failed to connected to review-storage-service";
-          throw se;
-        }
-        std::vector<Review> _return_reviews;
-        auto review_client = review_client_wrapper->GetClient();
-        try {
-          review_client->ReadReviews(
-              _return_reviews, req_id, review_ids, writer_text_map);
-        } catch (...) {
-          _review_client_pool->Push(review_client_wrapper);
-          LOG(error) << "Failed to read review from review-storage-service";
-          throw;
-        }
-        _review_client_pool->Push(review_client_wrapper);
-        return _return_reviews;
-      });
+    if (!mongo_review_ids.empty()) {
+      review_fan_out.Call(
+          _review_client_pool, "review-storage-service",
+          [&](ReviewStorageServiceClient *client) {
+            client->send_ReadReviews(req_id, mongo_review_ids,
+                                     writer_text_map);
+          },
+          [&](ReviewStorageServiceClient *client) {
+            client->recv_ReadReviews(mongo_reviews);
+          });
+    }
 
-  std::future<cpp_redis::reply> zadd_reply_future;
-  if (!redis_update_map.empty()) {
-    // Update Redis
-    redis_client_wrapper = _redis_client_pool->Pop();
-    if (!redis_client_wrapper) {
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_REDIS_ERROR;
-      se.message = "Cannot connected to Redis server";
-      throw se;
+    // The reply is not waited for; the next read finds the set cached.
+    if (!redis_update_map.empty()) {
+      auto redis_update_span = opentracing::Tracer::Global()->StartSpan(
+          "RedisUpdate", {opentracing::ChildOf(&span->context())});
+      BackfillReviews(_redis_client_pool, movie_id, redis_update_map);
+      redis_update_span->Finish();
     }
-    redis_client = redis_client_wrapper->GetClient();
-    auto redis_update_span = opentracing::Tracer::Global()->StartSpan(
-        "RedisUpdate", {opentracing::ChildOf(&span->context())});
-    redis_client->del(std::vector<std::string>{movie_id});
-    std::vector<std::string> options{"NX"};
-    zadd_reply_future = redis_client->zadd(
-        movie_id, options, redis_update_map);
-    redis_client->commit();
-    redis_update_span->Finish();
   }
 
   try {
-    _return = review_future.get();
+    review_fan_out.Wait();
   } catch (...) {
     LOG(error) << "Failed to get review from review-storage-service";
-    if (!redis_update_map.empty()) {
-      try {
-        zadd_reply_future.get();
-      } catch (...) {
-        LOG(error) << "Failed to Update Redis Server";
-      }
-      _redis_client_pool->Push(redis_client_wrapper);
-    }
     throw;
   }
-
-  if (!redis_update_map.empty()) {
-    try {
-      zadd_reply_future.get();
-    } catch (...) {
-      LOG(error) << "Failed to Update Redis Server";
-      _redis_client_pool->Push(redis_client_wrapper);
-      throw;
-    }
-    _redis_client_pool->Push(redis_client_wrapper);
-  }
+  _return.insert(_return.end(), mongo_reviews.begin(), mongo_reviews.end());
 
   span->Finish();
-  
 }
 
 } // namespace media_service
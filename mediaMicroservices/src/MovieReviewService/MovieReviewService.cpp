@@ -1,17 +1,11 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
 #include "MovieReviewHandler.h"
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_mongodb.h"
 
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using media_service::MovieReviewHandler;
 using namespace media_service;
 
@@ -30,6 +24,7 @@ int main(int argc, char *argv[]) {
     LOG(fatal) << "Cannot open the config file.";
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   int port = config_json["movie-review-service"]["port"];
   std::string redis_addr =
@@ -65,17 +60,17 @@ int main(int argc, char *argv[]) {
   }
   mongoc_client_pool_push(mongodb_client_pool, mongodb_client);
 
-  TThreadedServer server(
-      std::make_shared<MovieReviewServiceProcessor>(
-          std::make_shared<MovieReviewHandler>(
-              &redis_client_pool,
-              mongodb_client_pool,
-              &review_storage_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  auto processor = std::make_shared<MovieReviewServiceProcessor>(
+      std::make_shared<MovieReviewHandler>(
+          &redis_client_pool,
+          mongodb_client_pool,
+          &review_storage_client_pool,
+          1000));
+  SetUpServerMetrics(processor.get(), config_json, "movie-review-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "movie-review-service", port);
   std::cout << "Starting the movie-review-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 
 }
\ No newline at end of file
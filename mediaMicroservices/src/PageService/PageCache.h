@@ -0,0 +1,75 @@
+#ifndef MEDIA_MICROSERVICES_SRC_PAGESERVICE_PAGECACHE_H_
+#define MEDIA_MICROSERVICES_SRC_PAGESERVICE_PAGECACHE_H_
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../gen-cpp/media_service_types.h"
+#include "../LruCache.h"
+
+namespace media_service {
+
+// The parts of a page that change rarely: movie info, cast info and plot.
+// Reviews are not cached, they are read on every ReadPage.
+struct CachedPage {
+  MovieInfo movie_info;
+  std::vector<CastInfo> cast_infos;
+  std::string plot;
+  std::chrono::steady_clock::time_point expires;
+};
+
+// In-process LRU of composed pages keyed by movie_id. An entry is served
+// until it expires; after that it stays in the cache, and ReadPage uses its
+// cast-info ids and plot_id to send the cast-info and plot calls together
+// with movie-info instead of after it. Entries are shared and immutable, so
+// a hit copies a pointer under the lock, not the page.
+class PageCache {
+ public:
+  PageCache(size_t capacity, int ttl_ms);
+
+  PageCache(const PageCache &) = delete;
+  PageCache &operator=(const PageCache &) = delete;
+
+  // The entry for movie_id, fresh or expired, or nullptr.
+  std::shared_ptr<const CachedPage> Get(const std::string &movie_id);
+  // Stores the page with a new expiry.
+  void Put(const std::string &movie_id, CachedPage page);
+  // Drops the entry, so that the next ReadPage composes the page from
+  // scratch.
+  void Invalidate(const std::string &movie_id);
+
+ private:
+  std::mutex _mtx;
+  LruCache<std::shared_ptr<const CachedPage>> _lru;
+  std::chrono::milliseconds _ttl;
+};
+
+PageCache::PageCache(size_t capacity, int ttl_ms)
+    : _lru(capacity), _ttl(ttl_ms) {}
+
+std::shared_ptr<const CachedPage> PageCache::Get(const std::string &movie_id) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  auto entry = _lru.Get(movie_id);
+  return entry ? *entry : nullptr;
+}
+
+void PageCache::Put(const std::string &movie_id, CachedPage page) {
+  page.expires = std::chrono::steady_clock::now() + _ttl;
+  auto entry = std::make_shared<const CachedPage>(std::move(page));
+
+  std::lock_guard<std::mutex> lock(_mtx);
+  _lru.Put(movie_id, std::move(entry));
+}
+
+void PageCache::Invalidate(const std::string &movie_id) {
+  std::lock_guard<std::mutex> lock(_mtx);
+  _lru.Erase(movie_id);
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_SRC_PAGESERVICE_PAGECACHE_H_
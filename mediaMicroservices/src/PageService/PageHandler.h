@@ -1,9 +1,11 @@
 #ifndef MEDIA_MICROSERVICES_SRC_COMPOSEPAGESERVICE_COMPOSEPAGEHANDLER_H_
 #define MEDIA_MICROSERVICES_SRC_COMPOSEPAGESERVICE_COMPOSEPAGEHANDLER_H_
 
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <future>
+#include <vector>
 
 #include "../../gen-cpp/PageService.h"
 #include "../../gen-cpp/MovieReviewService.h"
@@ -14,6 +16,8 @@
 #include "../tracing.h"
 #include "../ClientPool.h"
 #include "../ThriftClient.h"
+#include "../FanOut.h"
+#include "PageCache.h"
 
 
 namespace media_service {
@@ -24,7 +28,9 @@ class PageHandler : public PageServiceIf {
       ClientPool<ThriftClient<MovieReviewServiceClient>> *,
       ClientPool<ThriftClient<MovieInfoServiceClient>> *,
       ClientPool<ThriftClient<CastInfoServiceClient>> *,
-      ClientPool<ThriftClient<PlotServiceClient>> *);
+      ClientPool<ThriftClient<PlotServiceClient>> *,
+      PageCache *,
+      int);
   ~PageHandler() override = default;
 
   void ReadPage(Page& _return, int64_t req_id, const std::string& movie_id,
@@ -36,16 +42,31 @@ class PageHandler : public PageServiceIf {
   ClientPool<ThriftClient<MovieInfoServiceClient>> *_movie_info_client_pool;
   ClientPool<ThriftClient<CastInfoServiceClient>> *_cast_info_client_pool;
   ClientPool<ThriftClient<PlotServiceClient>> *_plot_client_pool;
+  PageCache *_page_cache;
+  int _fan_out_timeout_ms;
 };
+
+std::vector<int64_t> CastInfoIds(const MovieInfo &movie_info) {
+  std::vector<int64_t> cast_info_ids;
+  for (auto &cast : movie_info.casts) {
+    cast_info_ids.emplace_back(cast.cast_info_id);
+  }
+  return cast_info_ids;
+}
+
 PageHandler::PageHandler(
     ClientPool<ThriftClient<MovieReviewServiceClient>> *movie_review_client_pool,
     ClientPool<ThriftClient<MovieInfoServiceClient>> *movie_info_client_pool,
     ClientPool<ThriftClient<CastInfoServiceClient>> *cast_info_client_pool,
-    ClientPool<ThriftClient<PlotServiceClient>> *plot_client_pool) {
+    ClientPool<ThriftClient<PlotServiceClient>> *plot_client_pool,
+    PageCache *page_cache,
+    int fan_out_timeout_ms) {
   _movie_review_client_pool = movie_review_client_pool;
   _movie_info_client_pool = movie_info_client_pool;
   _cast_info_client_pool = cast_info_client_pool;
   _plot_client_pool = plot_client_pool;
+  _page_cache = page_cache;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
 }
 void PageHandler::ReadPage(
     Page &_return,
@@ -65,116 +86,128 @@ void PageHandler::ReadPage(
       { opentracing::ChildOf(parent_span->get()) });
   opentracing::Tracer::Global()->Inject(span->context(), writer);
 
-  std::future<std::vector<Review>> movie_review_future;
-  std::future<MovieInfo> movie_info_future;
-  std::future<std::vector<CastInfo>> cast_info_future;
-  std::future<std::string> plot_future;
-
-  movie_info_future = std::async(std::launch::async, [&](){
-    MovieInfo _reture_movie_info;
-    auto movie_info_client_wrapper = _movie_info_client_pool->Pop();
-    if (!movie_info_client_wrapper) {
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
-      se.message = "Failed to connected to movie-info-service";
-      throw se;
-    }
-    auto movie_info_client = movie_info_client_wrapper->GetClient();
-    try {
-      movie_info_client->ReadMovieInfo(_reture_movie_info,
-          req_id, movie_id, writer_text_map);
-    } catch (...) {
-      _movie_info_client_pool->Push(movie_info_client_wrapper);
-      LOG(error) << "Failed to read movie_info to movie-info-service";
-      throw;
-    }
-    _movie_info_client_pool->Push(movie_info_client_wrapper);
-    return _reture_movie_info;
-  });
-
-  movie_review_future = std::async(std::launch::async, [&](){
-    std::vector<Review> _return_movie_reviews;
-    auto movie_review_client_wrapper = _movie_review_client_pool->Pop();
-    if (!movie_review_client_wrapper) {
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
-      se.message = "Failed to connected to movie-review-service";
-      throw se;
-    }
-    auto movie_review_client = movie_review_client_wrapper->GetClient();
+  std::shared_ptr<const CachedPage> cached;
+  if (_page_cache) {
+    cached = _page_cache->Get(movie_id);
+  }
+  bool fresh = cached && std::chrono::steady_clock::now() < cached->expires;
+
+  // Reviews are never cached. Everything completes on this thread.
+  FanOut page_fan_out(_fan_out_timeout_ms);
+  page_fan_out.Call(
+      _movie_review_client_pool, "movie-review-service",
+      [&](MovieReviewServiceClient *client) {
+        client->send_ReadMovieReviews(req_id, movie_id, review_start,
+                                      review_stop, writer_text_map);
+      },
+      [&](MovieReviewServiceClient *client) {
+        client->recv_ReadMovieReviews(_return.reviews);
+      });
+
+  if (fresh) {
+    LOG(debug) << "Page of movie " << movie_id << " hit in the page cache";
+    _return.movie_info = cached->movie_info;
+    _return.cast_infos = cached->cast_infos;
+    _return.plot = cached->plot;
     try {
-      movie_review_client->ReadMovieReviews(_return_movie_reviews,
-          req_id, movie_id, review_start, review_stop, writer_text_map);
+      page_fan_out.Wait();
     } catch (...) {
-      _movie_review_client_pool->Push(movie_review_client_wrapper);
-      LOG(error) << "Failed to read reviews to movie-review-service";
+      LOG(error) << "Failed to read page for movie " << movie_id;
+      span->Finish();
       throw;
     }
-    _movie_review_client_pool->Push(movie_review_client_wrapper);
-    return _return_movie_reviews;
-  });
+    span->Finish();
+    return;
+  }
+
+  auto read_cast_info = [&](const std::vector<int64_t> &cast_info_ids,
+                            std::vector<CastInfo> *cast_infos) {
+    page_fan_out.Call(
+        _cast_info_client_pool, "cast-info-service",
+        [&](CastInfoServiceClient *client) {
+          client->send_ReadCastInfo(req_id, cast_info_ids, writer_text_map);
+        },
+        [cast_infos](CastInfoServiceClient *client) {
+          client->recv_ReadCastInfo(*cast_infos);
+        });
+  };
+  auto read_plot = [&](int64_t plot_id, std::string *plot) {
+    page_fan_out.Call(
+        _plot_client_pool, "plot-service",
+        [&](PlotServiceClient *client) {
+          client->send_ReadPlot(req_id, plot_id, writer_text_map);
+        },
+        [plot](PlotServiceClient *client) {
+          client->recv_ReadPlot(*plot);
+        });
+  };
+
+  // An expired entry still knows the cast-info ids and plot_id, which rarely
+  // change, so cast-info and plot go out together with movie-info instead of
+  // one hop later. If movie-info then shows different ids, the early replies
+  // are dropped and the calls are sent again. Without an entry, they are
+  // sent from the movie-info completion, while reviews may be outstanding.
+  std::vector<int64_t> early_cast_info_ids;
+  int64_t early_plot_id = 0;
+  std::vector<CastInfo> early_cast_infos;
+  std::string early_plot;
+  bool use_early_cast_infos = false;
+  bool use_early_plot = false;
+  if (cached) {
+    early_cast_info_ids = CastInfoIds(cached->movie_info);
+    early_plot_id = cached->movie_info.plot_id;
+    read_cast_info(early_cast_info_ids, &early_cast_infos);
+    read_plot(early_plot_id, &early_plot);
+    use_early_cast_infos = true;
+    use_early_plot = true;
+  }
+  page_fan_out.Call(
+      _movie_info_client_pool, "movie-info-service",
+      [&](MovieInfoServiceClient *client) {
+        client->send_ReadMovieInfo(req_id, movie_id, writer_text_map);
+      },
+      [&](MovieInfoServiceClient *client) {
+        client->recv_ReadMovieInfo(_return.movie_info);
+
+        auto cast_info_ids = CastInfoIds(_return.movie_info);
+        if (!use_early_cast_infos || cast_info_ids != early_cast_info_ids) {
+          use_early_cast_infos = false;
+          read_cast_info(cast_info_ids, &_return.cast_infos);
+        }
+        if (!use_early_plot || _return.movie_info.plot_id != early_plot_id) {
+          use_early_plot = false;
+          read_plot(_return.movie_info.plot_id, &_return.plot);
+        }
+      });
 
   try {
-    _return.movie_info = movie_info_future.get();
+    page_fan_out.Wait();
+  } catch (const ServiceException &se) {
+    // The movie is gone from movie-info; do not keep using its old ids.
+    if (_page_cache && se.errorCode == ErrorCode::SE_THRIFT_HANDLER_ERROR) {
+      _page_cache->Invalidate(movie_id);
+    }
+    LOG(error) << "Failed to read page for movie " << movie_id;
+    span->Finish();
+    throw;
   } catch (...) {
+    LOG(error) << "Failed to read page for movie " << movie_id;
+    span->Finish();
     throw;
   }
-  
-  std::vector<int64_t> cast_info_ids;
-  for (auto &cast : _return.movie_info.casts) {
-    cast_info_ids.emplace_back(cast.cast_info_id);
+  if (use_early_cast_infos) {
+    _return.cast_infos = std::move(early_cast_infos);
+  }
+  if (use_early_plot) {
+    _return.plot = std::move(early_plot);
   }
 
-  cast_info_future = std::async(std::launch::async, [&](){
-    std::vector<CastInfo> _return_cast_infos;
-    auto cast_info_client_wrapper = _cast_info_client_pool->Pop();
-    if (!cast_info_client_wrapper) {
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
-      se.message = "Failed to connected to cast-info-service";
-      throw se;
-    }
-    auto cast_info_client = cast_info_client_wrapper->GetClient();
-    try {
-      cast_info_client->ReadCastInfo(_return_cast_infos, req_id,
-          cast_info_ids, writer_text_map);
-    } catch (...) {
-      _cast_info_client_pool->Push(cast_info_client_wrapper);
-      LOG(error) << "Failed to read cast-info to cast-info-service";
-      throw;
-    }
-    _cast_info_client_pool->Push(cast_info_client_wrapper);
-    return _return_cast_infos;
-  });
-
-  plot_future = std::async(std::launch::async, [&](){
-    std::string _return_plot;
-    auto plot_client_wrapper = _plot_client_pool->Pop();
-    if (!plot_client_wrapper) {
-      ServiceException se;
-      se.errorCode = ErrorCode::SE_THRIFT_CONN_ERROR;
-      se.message = "Failed to connected to plot-service";
-      throw se;
-    }
-    auto plot_client = plot_client_wrapper->GetClient();
-    try {
-      plot_client->ReadPlot(_return_plot, req_id, _return.movie_info.plot_id,
-          writer_text_map);
-    } catch (...) {
-      _plot_client_pool->Push(plot_client_wrapper);
-      LOG(error) << "Failed to read plot to plot-service";
-      throw;
-    }
-    _plot_client_pool->Push(plot_client_wrapper);
-    return _return_plot;
-  });
-
-  try {
-    _return.reviews = movie_review_future.get();
-    _return.plot = plot_future.get();
-    _return.cast_infos = cast_info_future.get();
-  } catch (...) {
-    throw;
+  if (_page_cache) {
+    CachedPage page;
+    page.movie_info = _return.movie_info;
+    page.cast_infos = _return.cast_infos;
+    page.plot = _return.plot;
+    _page_cache->Put(movie_id, std::move(page));
   }
   span->Finish();
 }
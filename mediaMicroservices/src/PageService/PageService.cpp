@@ -1,17 +1,11 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "PageHandler.h"
 
 using json = nlohmann::json;
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -28,6 +22,7 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   int port = config_json["page-service"]["port"];
   std::string cast_info_addr = config_json["cast-info-service"]["addr"];
@@ -38,30 +33,45 @@ int main(int argc, char *argv[]) {
   int movie_info_port = config_json["movie-info-service"]["port"];
   std::string plot_addr = config_json["plot-service"]["addr"];
   int plot_port = config_json["plot-service"]["port"];
+  int page_cache_size = config_json["page-service"]["page_cache_size"];
+  int page_cache_ttl_ms = config_json["page-service"]["page_cache_ttl_ms"];
 
-  ClientPool<ThriftClient<MovieInfoServiceClient>>
-      movie_info_client_pool("movie-info-client", movie_info_addr,
-                             movie_info_port, 0, 128, 1000);
-  ClientPool<ThriftClient<CastInfoServiceClient>>
-      cast_info_client_pool("cast-info-client", cast_info_addr,
-                            cast_info_port, 0, 128, 1000);
-  ClientPool<ThriftClient<MovieReviewServiceClient>>
-      movie_review_client_pool("movie-review-client", movie_review_addr,
-                               movie_review_port, 0, 128, 1000);
-  ClientPool<ThriftClient<PlotServiceClient>>
-      plot_client_pool("plot-client", plot_addr, plot_port, 0, 128, 1000);
+  int fan_out_timeout_ms = config_json["page-service"]["timeout_ms"];
 
-  TThreadedServer server(
-      std::make_shared<PageServiceProcessor>(
-          std::make_shared<PageHandler>(
-              &movie_review_client_pool,
-              &movie_info_client_pool,
-              &cast_info_client_pool,
-              &plot_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  ClientPool<ThriftClient<MovieInfoServiceClient>> movie_info_client_pool(
+      "movie-info-client", movie_info_addr, movie_info_port, 0,
+      config_json["movie-info-service"]["connections"],
+      config_json["movie-info-service"]["timeout_ms"]);
+  ClientPool<ThriftClient<CastInfoServiceClient>> cast_info_client_pool(
+      "cast-info-client", cast_info_addr, cast_info_port, 0,
+      config_json["cast-info-service"]["connections"],
+      config_json["cast-info-service"]["timeout_ms"]);
+  ClientPool<ThriftClient<MovieReviewServiceClient>> movie_review_client_pool(
+      "movie-review-client", movie_review_addr, movie_review_port, 0,
+      config_json["movie-review-service"]["connections"],
+      config_json["movie-review-service"]["timeout_ms"]);
+  ClientPool<ThriftClient<PlotServiceClient>> plot_client_pool(
+      "plot-client", plot_addr, plot_port, 0,
+      config_json["plot-service"]["connections"],
+      config_json["plot-service"]["timeout_ms"]);
+
+  std::unique_ptr<PageCache> page_cache;
+  if (page_cache_size > 0) {
+    page_cache.reset(new PageCache(page_cache_size, page_cache_ttl_ms));
+  }
+
+  auto processor = std::make_shared<PageServiceProcessor>(
+      std::make_shared<PageHandler>(
+          &movie_review_client_pool,
+          &movie_info_client_pool,
+          &cast_info_client_pool,
+          &plot_client_pool,
+          page_cache.get(),
+          fan_out_timeout_ms));
+  SetUpServerMetrics(processor.get(), config_json, "page-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "page-service", port);
   std::cout << "Starting the page-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include "../ClientPool.h"
 #include "../ThriftClient.h"
 #include "../RedisClient.h"
+#include "../utils_rating.h"
 #include "../logger.h"
 #include "../tracing.h"
 
@@ -82,14 +83,15 @@ void RatingHandler::UploadRating(
       se.message = "Cannot connected to Redis server";
       throw se;
     }
-    auto redis_client = redis_client_wrapper->GetClient();
+    RedisPipeline pipeline(redis_client_wrapper);
     auto redis_span = opentracing::Tracer::Global()->StartSpan(
         "RedisInsert", {opentracing::ChildOf(&span->context())});
-    redis_client->incrby(movie_id + ":uncommit_sum", rating);
-    redis_client->incr(movie_id + ":uncommit_num");
-    redis_client->sync_commit();
+    // Committed to movie-info by the RatingCommitter of movie-info-service.
+    auto staged = StageRatings(&pipeline, movie_id, rating, 1, RatingClockMs());
+    pipeline.Commit();
     redis_span->Finish();
     _redis_client_pool->Push(redis_client_wrapper);
+    CheckStaged(staged.get(), movie_id);
   });
 
   try {
@@ -1,17 +1,10 @@
 #include <signal.h>
 
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
-
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "RatingHandler.h"
 
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -28,6 +21,7 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   int port = config_json["rating-service"]["port"];
   std::string compose_addr = config_json["compose-review-service"]["addr"];
@@ -42,16 +36,15 @@ int main(int argc, char *argv[]) {
   ClientPool<RedisClient> redis_client_pool("rating-redis",
       redis_addr, redis_port, 0, 128, 1000);
 
-  TThreadedServer server (
-      std::make_shared<RatingServiceProcessor>(
-          std::make_shared<RatingHandler>(
-              &compose_client_pool, 
-              &redis_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  auto processor = std::make_shared<RatingServiceProcessor>(
+      std::make_shared<RatingHandler>(
+          &compose_client_pool,
+          &redis_client_pool));
+  SetUpServerMetrics(processor.get(), config_json, "rating-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "rating-service", port);
 
   std::cout << "Starting the rating-service server..." << std::endl;
-  server.serve();
+  server->serve();
 }
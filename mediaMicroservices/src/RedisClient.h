@@ -1,7 +1,9 @@
 #ifndef MEDIA_MICROSERVICES_REDISCLIENT_H
 #define MEDIA_MICROSERVICES_REDISCLIENT_H
 
+#include <future>
 #include <string>
+#include <vector>
 #include <cpp_redis/cpp_redis>
 
 #include "logger.h"
@@ -76,6 +78,80 @@ void RedisClient::KeepAlive(int timeout_ms) {
 
 }
 
+// Batches the Redis commands of one phase of a handler on one connection.
+// Send() and Eval() only queue a command and return the future of its reply;
+// Commit() writes everything queued at once and waits for all the replies,
+// so the phase costs one round trip however many commands it has. Calling
+// sync_commit() after every command, as the handlers used to, costs one
+// round trip per command.
+class RedisPipeline {
+ public:
+  explicit RedisPipeline(RedisClient *redis_client)
+      : _client(redis_client->GetClient()) {}
+
+  RedisPipeline(const RedisPipeline &) = delete;
+  RedisPipeline &operator=(const RedisPipeline &) = delete;
+
+  std::future<cpp_redis::reply> Send(const std::vector<std::string> &command);
+  // Runs the reply callback from cpp_redis' network thread instead.
+  void Send(const std::vector<std::string> &command,
+            const cpp_redis::client::reply_callback_t &callback);
+  // EVAL script with its keys and args.
+  std::future<cpp_redis::reply> Eval(const std::string &script,
+                                     const std::vector<std::string> &keys,
+                                     const std::vector<std::string> &args);
+  void Eval(const std::string &script, const std::vector<std::string> &keys,
+            const std::vector<std::string> &args,
+            const cpp_redis::client::reply_callback_t &callback);
+
+  // Sends the queued commands and waits until all of them have replied.
+  void Commit();
+  // Sends the queued commands without waiting, for replies handled by
+  // callbacks.
+  void CommitAsync();
+
+ private:
+  cpp_redis::client *_client;
+};
+
+std::future<cpp_redis::reply> RedisPipeline::Send(
+    const std::vector<std::string> &command) {
+  return _client->send(command);
+}
+
+void RedisPipeline::Send(
+    const std::vector<std::string> &command,
+    const cpp_redis::client::reply_callback_t &callback) {
+  _client->send(command, callback);
+}
+
+std::future<cpp_redis::reply> RedisPipeline::Eval(
+    const std::string &script, const std::vector<std::string> &keys,
+    const std::vector<std::string> &args) {
+  std::vector<std::string> command{"EVAL", script, std::to_string(keys.size())};
+  command.insert(command.end(), keys.begin(), keys.end());
+  command.insert(command.end(), args.begin(), args.end());
+  return _client->send(command);
+}
+
+void RedisPipeline::Eval(
+    const std::string &script, const std::vector<std::string> &keys,
+    const std::vector<std::string> &args,
+    const cpp_redis::client::reply_callback_t &callback) {
+  std::vector<std::string> command{"EVAL", script, std::to_string(keys.size())};
+  command.insert(command.end(), keys.begin(), keys.end());
+  command.insert(command.end(), args.begin(), args.end());
+  _client->send(command, callback);
+}
+
+void RedisPipeline::Commit() {
+  _client->sync_commit();
+}
+
+void RedisPipeline::CommitAsync() {
+  _client->commit();
+}
+
 } // mediua_service
 
 #endif //MEDIA_MICROSERVICES_REDISCLIENT_H
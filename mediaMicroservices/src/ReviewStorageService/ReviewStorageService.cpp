@@ -1,19 +1,13 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include "nlohmann/json.hpp"
 #include <signal.h>
 
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_mongodb.h"
 #include "../utils_memcached.h"
 #include "ReviewStorageHandler.h"
 
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 static memcached_pool_st* memcached_client_pool;
@@ -40,6 +34,7 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   int port = config_json["review-storage-service"]["port"];
 
@@ -53,15 +48,14 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
-  TThreadedServer server (
-      std::make_shared<ReviewStorageServiceProcessor>(
-          std::make_shared<ReviewStorageHandler>(
-              memcached_client_pool, mongodb_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  auto processor = std::make_shared<ReviewStorageServiceProcessor>(
+      std::make_shared<ReviewStorageHandler>(
+          memcached_client_pool, mongodb_client_pool));
+  SetUpServerMetrics(processor.get(), config_json, "review-storage-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "review-storage-service", port);
 
   std::cout << "Starting the review-storage-service server..." << std::endl;
-  server.serve();
+  server->serve();
 }
\ No newline at end of file
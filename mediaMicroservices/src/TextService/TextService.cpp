@@ -1,17 +1,10 @@
 #include <signal.h>
 
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
-
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "TextHandler.h"
 
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -26,6 +19,7 @@ int main(int argc, char *argv[]) {
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) == 0) {
+    SetUpThriftProtocol(config_json);
 
     int port = config_json["text-service"]["port"];
     std::string compose_addr = config_json["compose-review-service"]["addr"];
@@ -34,16 +28,15 @@ int main(int argc, char *argv[]) {
     ClientPool<ThriftClient<ComposeReviewServiceClient>> compose_client_pool(
         "compose-review-client", compose_addr, compose_port, 0, 128, 1000);
 
-    TThreadedServer server(
-        std::make_shared<TextServiceProcessor>(
-            std::make_shared<TextHandler>(&compose_client_pool)),
-        std::make_shared<TServerSocket>("0.0.0.0", port),
-        std::make_shared<TFramedTransportFactory>(),
-        std::make_shared<TBinaryProtocolFactory>()
-    );
+    auto processor = std::make_shared<TextServiceProcessor>(
+        std::make_shared<TextHandler>(&compose_client_pool));
+    SetUpServerMetrics(processor.get(), config_json, "text-service");
+
+    auto server = MakeThriftServer(
+        processor, config_json, "text-service", port);
 
     std::cout << "Starting the text-service server..." << std::endl;
-    server.serve();
+    server->serve();
   } else exit(EXIT_FAILURE);
 }
 
@@ -6,17 +6,16 @@
 #include <iostream>
 #include <boost/log/trivial.hpp>
 
-#include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/TTransportUtils.h>
 #include <thrift/stdcxx.h>
 #include "logger.h"
 #include "GenericClient.h"
+#include "utils_thrift.h"
 
 namespace media_service {
 
 using apache::thrift::protocol::TProtocol;
-using apache::thrift::protocol::TBinaryProtocol;
 using apache::thrift::transport::TFramedTransport;
 using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransport;
@@ -35,6 +34,7 @@ class ThriftClient : public GenericClient {
   ~ThriftClient() override;
 
   TThriftClient *GetClient() const;
+  int GetSocketFd() const;
 
   void Connect() override;
   void Disconnect() override;
@@ -56,8 +56,11 @@ ThriftClient<TThriftClient>::ThriftClient(
   _addr = addr;
   _port = port;
   _socket = std::shared_ptr<TTransport>(new TSocket(addr, port));
-  _transport = std::shared_ptr<TTransport>(new TFramedTransport(_socket));
-  _protocol = std::shared_ptr<TProtocol>(new TBinaryProtocol(_transport));
+  // The framed transport and its buffers live as long as the pooled client,
+  // so every call on this connection reuses them.
+  _transport = std::shared_ptr<TTransport>(new TFramedTransport(
+      _socket, GetThriftProtocolConfig().frame_buffer_size));
+  _protocol = MakeThriftProtocol(_transport);
   _client = new TThriftClient(_protocol);
 }
 
@@ -72,6 +75,11 @@ TThriftClient *ThriftClient<TThriftClient>::GetClient() const {
   return _client;
 }
 
+template<class TThriftClient>
+int ThriftClient<TThriftClient>::GetSocketFd() const {
+  return std::static_pointer_cast<TSocket>(_socket)->getSocketFD();
+}
+
 template<class TThriftClient>
 bool ThriftClient<TThriftClient>::IsConnected() {
   return _transport->isOpen();
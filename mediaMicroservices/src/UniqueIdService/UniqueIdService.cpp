@@ -13,18 +13,11 @@
 
 #include <signal.h>
 
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
-
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "UniqueIdHandler.h"
 
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using namespace media_service;
 
 void sigintHandler(int sig) {
@@ -42,6 +35,7 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
 //  std::string addr = config_json["UniqueIdService"]["addr"];
   int port = config_json["unique-id-service"]["port"];
@@ -58,15 +52,14 @@ int main(int argc, char *argv[]) {
   ClientPool<ThriftClient<ComposeReviewServiceClient>> compose_client_pool(
       "compose-review-client", compose_addr, compose_port, 0, 128, 1000);
 
-  TThreadedServer server (
-      std::make_shared<UniqueIdServiceProcessor>(
-          std::make_shared<UniqueIdHandler>(
-              &thread_lock, machine_id, &compose_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  auto processor = std::make_shared<UniqueIdServiceProcessor>(
+      std::make_shared<UniqueIdHandler>(
+          &thread_lock, machine_id, &compose_client_pool));
+  SetUpServerMetrics(processor.get(), config_json, "unique-id-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "unique-id-service", port);
 
   std::cout << "Starting the unique-id-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
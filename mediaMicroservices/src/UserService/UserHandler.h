@@ -3,7 +3,6 @@
 
 #include <iostream>
 #include <string>
-#include <random>
 #include <mongoc.h>
 #include <bson/bson.h>
 #include <libmemcached/memcached.h>
@@ -24,6 +23,7 @@
 #include "../../gen-cpp/ComposeReviewService.h"
 #include "../../third_party/PicoSHA2/picosha2.h"
 #include "../logger.h"
+#include "../utils_random.h"
 
 // Custom Epoch (January 1, 2018 Midnight GMT = 2018-01-01T00:00:00Z)
 #define CUSTOM_EPOCH 1514764800000
@@ -52,22 +52,6 @@ static int GetCounter(int64_t timestamp) {
   }
 }
 
-std::string GenRandomString(const int len) {
-  static const std::string alphanum =
-      "0123456789"
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-      "abcdefghijklmnopqrstuvwxyz";
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<int> dist(
-      0, static_cast<int>(alphanum.length() - 1));
-  std::string s;
-  for (int i = 0; i < len; ++i) {
-    s += alphanum[dist(gen)];
-  }
-  return s;
-}
-
 class UserHandler : public UserServiceIf {
  public:
   UserHandler(
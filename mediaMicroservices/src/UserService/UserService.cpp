@@ -1,19 +1,12 @@
-#include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
-#include <thrift/transport/TServerSocket.h>
-#include <thrift/transport/TBufferTransports.h>
 #include <signal.h>
 
-
 #include "../utils.h"
+#include "../utils_thrift.h"
+#include "../metrics.h"
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "UserHandler.h"
 
-using apache::thrift::server::TThreadedServer;
-using apache::thrift::transport::TServerSocket;
-using apache::thrift::transport::TFramedTransportFactory;
-using apache::thrift::protocol::TBinaryProtocolFactory;
 using media_service::UserHandler;
 using namespace media_service;
 
@@ -31,6 +24,7 @@ int main(int argc, char *argv[]) {
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpThriftProtocol(config_json);
 
   std::string secret = config_json["secret"];
 
@@ -57,19 +51,18 @@ int main(int argc, char *argv[]) {
   ClientPool<ThriftClient<ComposeReviewServiceClient>> compose_client_pool(
       "compose-review-client", compose_addr, compose_port, 0, 128, 1000);
 
-  TThreadedServer server(
-      std::make_shared<UserServiceProcessor>(
-          std::make_shared<UserHandler>(
-              &thread_lock,
-              machine_id,
-              secret,
-              memcached_client_pool,
-              mongodb_client_pool,
-              &compose_client_pool)),
-      std::make_shared<TServerSocket>("0.0.0.0", port),
-      std::make_shared<TFramedTransportFactory>(),
-      std::make_shared<TBinaryProtocolFactory>()
-  );
+  auto processor = std::make_shared<UserServiceProcessor>(
+      std::make_shared<UserHandler>(
+          &thread_lock,
+          machine_id,
+          secret,
+          memcached_client_pool,
+          mongodb_client_pool,
+          &compose_client_pool));
+  SetUpServerMetrics(processor.get(), config_json, "user-service");
+
+  auto server = MakeThriftServer(
+      processor, config_json, "user-service", port);
   std::cout << "Starting the user-service server ..." << std::endl;
-  server.serve();
+  server->serve();
 }
\ No newline at end of file
@@ -0,0 +1,429 @@
+#ifndef MEDIA_MICROSERVICES_METRICS_H
+#define MEDIA_MICROSERVICES_METRICS_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <thrift/TProcessor.h>
+#include <nlohmann/json.hpp>
+
+#include "logger.h"
+
+namespace media_service {
+
+// Latency histogram with HdrHistogram's bucketing: values below
+// kSubBucketCount get a bucket each, every power of two above is split into
+// kSubBucketCount / 2 linear buckets, which keeps the relative error below
+// 1/64. Values are in microseconds and clamped to 2^kMaxValueBits - 1, about
+// 71 minutes.
+struct LatencyBuckets {
+  static constexpr int kSubBucketBits = 7;
+  static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+  static constexpr int kSubBucketHalf = kSubBucketCount / 2;
+  static constexpr int kMaxValueBits = 32;
+  static constexpr int kCount =
+      kSubBucketCount + (kMaxValueBits - kSubBucketBits) * kSubBucketHalf;
+
+  static int Index(uint64_t value) {
+    if (value < kSubBucketCount) {
+      return static_cast<int>(value);
+    }
+    if (value >> kMaxValueBits) {
+      value = (UINT64_C(1) << kMaxValueBits) - 1;
+    }
+    int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+    return kSubBucketCount + (shift - 1) * kSubBucketHalf +
+           static_cast<int>(value >> shift) - kSubBucketHalf;
+  }
+
+  // The highest value that falls into bucket index.
+  static uint64_t HighestValue(int index) {
+    if (index < kSubBucketCount) {
+      return index;
+    }
+    int shift = (index - kSubBucketCount) / kSubBucketHalf + 1;
+    uint64_t sub_bucket = (index - kSubBucketCount) % kSubBucketHalf +
+                          kSubBucketHalf;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+};
+
+// Request count, error count and latency histogram of one endpoint or one
+// downstream pool. Every thread records into a shard of its own with plain
+// relaxed loads and stores, so recording takes no lock and no atomic
+// read-modify-write. Collect() sums the shards; a snapshot taken while
+// threads are recording can be off by the requests in flight.
+class LatencyMetric {
+ public:
+  struct Snapshot {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t sum_us = 0;
+    std::vector<uint64_t> counts;
+
+    uint64_t ValueAtQuantile(double quantile) const;
+  };
+
+  LatencyMetric() : _id(_NextId()) {}
+  LatencyMetric(const LatencyMetric &) = delete;
+  LatencyMetric &operator=(const LatencyMetric &) = delete;
+
+  void Record(int64_t latency_us, bool error) {
+    Shard *shard = _LocalShard();
+    uint64_t value = latency_us > 0 ? latency_us : 0;
+    _Add(&shard->counts[LatencyBuckets::Index(value)], 1);
+    _Add(&shard->requests, 1);
+    _Add(&shard->sum_us, value);
+    if (error) {
+      _Add(&shard->errors, 1);
+    }
+  }
+
+  Snapshot Collect() const;
+
+ private:
+  struct Shard {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> sum_us{0};
+    std::atomic<uint64_t> counts[LatencyBuckets::kCount] = {};
+  };
+
+  // Only the owning thread writes a shard.
+  static void _Add(std::atomic<uint64_t> *counter, uint64_t n) {
+    counter->store(counter->load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+  }
+
+  static size_t _NextId() {
+    static std::atomic<size_t> next_id{0};
+    return next_id.fetch_add(1);
+  }
+
+  Shard *_LocalShard();
+
+  const size_t _id;
+  mutable std::mutex _shards_mtx;
+  // Shards outlive their threads, so what they recorded is still counted.
+  std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+LatencyMetric::Shard *LatencyMetric::_LocalShard() {
+  thread_local std::vector<Shard *> shards;
+  if (_id < shards.size() && shards[_id]) {
+    return shards[_id];
+  }
+  if (_id >= shards.size()) {
+    shards.resize(_id + 1, nullptr);
+  }
+  std::lock_guard<std::mutex> lock(_shards_mtx);
+  _shards.emplace_back(new Shard());
+  shards[_id] = _shards.back().get();
+  return shards[_id];
+}
+
+LatencyMetric::Snapshot LatencyMetric::Collect() const {
+  Snapshot snapshot;
+  snapshot.counts.assign(LatencyBuckets::kCount, 0);
+  std::lock_guard<std::mutex> lock(_shards_mtx);
+  for (auto &shard : _shards) {
+    snapshot.requests += shard->requests.load(std::memory_order_relaxed);
+    snapshot.errors += shard->errors.load(std::memory_order_relaxed);
+    snapshot.sum_us += shard->sum_us.load(std::memory_order_relaxed);
+    for (int i = 0; i < LatencyBuckets::kCount; ++i) {
+      snapshot.counts[i] += shard->counts[i].load(std::memory_order_relaxed);
+    }
+  }
+  return snapshot;
+}
+
+uint64_t LatencyMetric::Snapshot::ValueAtQuantile(double quantile) const {
+  uint64_t total = 0;
+  for (auto count : counts) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(quantile * total + 0.5);
+  rank = rank < 1 ? 1 : rank;
+  uint64_t seen = 0;
+  for (int i = 0; i < static_cast<int>(counts.size()); ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return LatencyBuckets::HighestValue(i);
+    }
+  }
+  return LatencyBuckets::HighestValue(static_cast<int>(counts.size()) - 1);
+}
+
+// Server-side metrics per endpoint and client-side metrics per downstream
+// pool of this process, rendered in Prometheus' text format by /metrics.
+class Metrics {
+ public:
+  // Never destroyed, pools and server threads may record during exit.
+  static Metrics &Get() {
+    static Metrics *metrics = new Metrics();
+    return *metrics;
+  }
+
+  void SetService(const std::string &service) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _service = service;
+  }
+
+  // Looked up once per thread and endpoint, the registry lock is not taken
+  // on the request path after that.
+  LatencyMetric *Server(const std::string &endpoint) {
+    thread_local std::unordered_map<std::string, LatencyMetric *> cache;
+    auto it = cache.find(endpoint);
+    if (it != cache.end()) {
+      return it->second;
+    }
+    LatencyMetric *metric = _Get(&_server, endpoint);
+    cache.emplace(endpoint, metric);
+    return metric;
+  }
+
+  LatencyMetric *Client(const std::string &pool) {
+    return _Get(&_client, pool);
+  }
+
+  // A value that is set rather than recorded, such as a backlog or a lag;
+  // rendered as the gauge <name>.
+  std::atomic<int64_t> *Gauge(const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto &gauge = _gauges[name];
+    if (!gauge) {
+      gauge.reset(new std::atomic<int64_t>(0));
+    }
+    return gauge.get();
+  }
+
+  std::string Render();
+
+ private:
+  using MetricMap = std::map<std::string, std::unique_ptr<LatencyMetric>>;
+
+  Metrics() = default;
+
+  LatencyMetric *_Get(MetricMap *metrics, const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto &metric = (*metrics)[name];
+    if (!metric) {
+      metric.reset(new LatencyMetric());
+    }
+    return metric.get();
+  }
+
+  void _Render(const MetricMap &metrics, const char *side,
+               const char *label, std::string *out);
+
+  std::mutex _mtx;
+  std::string _service;
+  MetricMap _server;
+  MetricMap _client;
+  std::map<std::string, std::unique_ptr<std::atomic<int64_t>>> _gauges;
+};
+
+inline std::string EscapeLabelValue(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+void Metrics::_Render(const MetricMap &metrics, const char *side,
+                      const char *label, std::string *out) {
+  static const std::pair<const char *, double> kQuantiles[] = {
+      {"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999},
+      {"1", 1.0}};
+  std::string prefix = std::string(side) + "_";
+  std::vector<std::pair<std::string, LatencyMetric::Snapshot>> snapshots;
+  for (auto &metric : metrics) {
+    snapshots.emplace_back(
+        "{service=\"" + EscapeLabelValue(_service) + "\"," + label + "=\"" +
+            EscapeLabelValue(metric.first) + "\"",
+        metric.second->Collect());
+  }
+
+  *out += "# TYPE " + prefix + "requests_total counter\n";
+  for (auto &s : snapshots) {
+    *out += prefix + "requests_total" + s.first + "} " +
+            std::to_string(s.second.requests) + "\n";
+  }
+  *out += "# TYPE " + prefix + "errors_total counter\n";
+  for (auto &s : snapshots) {
+    *out += prefix + "errors_total" + s.first + "} " +
+            std::to_string(s.second.errors) + "\n";
+  }
+  *out += "# TYPE " + prefix + "latency_us summary\n";
+  for (auto &s : snapshots) {
+    for (auto &quantile : kQuantiles) {
+      *out += prefix + "latency_us" + s.first + ",quantile=\"" +
+              quantile.first + "\"} " +
+              std::to_string(s.second.ValueAtQuantile(quantile.second)) +
+              "\n";
+    }
+    *out += prefix + "latency_us_sum" + s.first + "} " +
+            std::to_string(s.second.sum_us) + "\n";
+    *out += prefix + "latency_us_count" + s.first + "} " +
+            std::to_string(s.second.requests) + "\n";
+  }
+}
+
+std::string Metrics::Render() {
+  std::lock_guard<std::mutex> lock(_mtx);
+  std::string out;
+  _Render(_server, "server", "endpoint", &out);
+  _Render(_client, "client", "pool", &out);
+  for (auto &gauge : _gauges) {
+    out += "# TYPE " + gauge.first + " gauge\n";
+    out += gauge.first + "{service=\"" + EscapeLabelValue(_service) + "\"} " +
+           std::to_string(gauge.second->load(std::memory_order_relaxed)) +
+           "\n";
+  }
+  return out;
+}
+
+inline int64_t MetricsElapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Records every call of a Thrift processor by function name. Latency runs
+// from the start of reading the call to its reply being written; calls that
+// end in an exception other than the declared ServiceException count as
+// errors, a ServiceException is a regular reply to Thrift. The servers handle
+// a connection on one thread, so the call's state can be thread-local.
+class ServerMetricsEventHandler
+    : public apache::thrift::TProcessorEventHandler {
+ public:
+  void *getContext(const char *fn_name, void *server_context) override {
+    _CallState().start = std::chrono::steady_clock::now();
+    _CallState().error = false;
+    return nullptr;
+  }
+
+  void handlerError(void *ctx, const char *fn_name) override {
+    _CallState().error = true;
+  }
+
+  // Called last on every path, replies, errors and oneway calls alike.
+  void freeContext(void *ctx, const char *fn_name) override {
+    Metrics::Get().Server(fn_name)->Record(
+        MetricsElapsedUs(_CallState().start), _CallState().error);
+  }
+
+ private:
+  struct CallState {
+    std::chrono::steady_clock::time_point start;
+    bool error;
+  };
+
+  static CallState &_CallState() {
+    thread_local CallState state;
+    return state;
+  }
+};
+
+// Serves GET /metrics over plain HTTP/1.0, one connection at a time; it is
+// only meant for a scraper.
+void StartMetricsServer(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (fd < 0 || bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                     sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+    LOG(error) << "Failed to listen on metrics port " << port << ": "
+               << strerror(errno);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+  std::thread([fd]() {
+    while (true) {
+      int conn = accept(fd, nullptr, nullptr);
+      if (conn < 0) {
+        continue;
+      }
+      struct timeval timeout = {1, 0};
+      setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      std::string request;
+      char buf[1024];
+      while (request.find("\r\n\r\n") == std::string::npos &&
+             request.size() < 8192) {
+        ssize_t n = recv(conn, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          break;
+        }
+        request.append(buf, n);
+      }
+      std::string response;
+      if (request.compare(0, 13, "GET /metrics ") == 0) {
+        std::string body = Metrics::Get().Render();
+        response = "HTTP/1.0 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: " + std::to_string(body.size()) +
+                   "\r\n\r\n" + body;
+      } else {
+        response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+      }
+      size_t sent = 0;
+      while (sent < response.size()) {
+        ssize_t n = send(conn, response.data() + sent, response.size() - sent,
+                         MSG_NOSIGNAL);
+        if (n <= 0) {
+          break;
+        }
+        sent += n;
+      }
+      close(conn);
+    }
+  }).detach();
+}
+
+// Records the calls of processor and serves them, with the client-side
+// metrics of the pools, on the port of the "metrics" section of
+// service-config.json.
+void SetUpServerMetrics(apache::thrift::TProcessor *processor,
+                        const nlohmann::json &config_json,
+                        const std::string &service) {
+  Metrics::Get().SetService(service);
+  processor->setEventHandler(std::make_shared<ServerMetricsEventHandler>());
+  if (config_json.contains("metrics")) {
+    StartMetricsServer(config_json["metrics"]["port"]);
+  }
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_METRICS_H
@@ -0,0 +1,86 @@
+#ifndef MEDIA_MICROSERVICES_UTILS_CACHE_FORMAT_H
+#define MEDIA_MICROSERVICES_UTILS_CACHE_FORMAT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <nlohmann/json.hpp>
+
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "logger.h"
+
+namespace media_service {
+using json = nlohmann::json;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::transport::TMemoryBuffer;
+
+// How cast-info-service and movie-info-service store entries in memcached.
+// The value is also the entry's memcached flags, so a reader decodes every
+// entry by its own format, whatever format it writes itself.
+struct CacheFormat {
+  enum type {
+    // The MongoDB document as JSON. Older versions write it with flags 0.
+    JSON = 0,
+    // The generated Thrift struct (CastInfo, MovieInfo) in TCompactProtocol.
+    COMPACT = 1
+  };
+};
+
+// The format written, set by SetUpCacheFormat. Reading both formats lets a
+// rolling upgrade keep writing JSON until no replica of the old version is
+// left, then switch to compact.
+CacheFormat::type &GetCacheFormat() {
+  static CacheFormat::type cache_format = CacheFormat::JSON;
+  return cache_format;
+}
+
+// Reads the top-level "cache-format" section: {"type": "json" | "compact"}.
+// Without it, entries are written as JSON as before.
+void SetUpCacheFormat(const json &config_json) {
+  if (!config_json.contains("cache-format")) {
+    return;
+  }
+  std::string type = config_json["cache-format"]["type"];
+  if (type == "json") {
+    GetCacheFormat() = CacheFormat::JSON;
+  } else if (type == "compact") {
+    GetCacheFormat() = CacheFormat::COMPACT;
+  } else {
+    LOG(error) << "Unknown cache-format type " << type;
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Bounds what a corrupt entry can make the decoder allocate.
+const int32_t kCacheStringLimit = 1 << 24;
+const int32_t kCacheContainerLimit = 1 << 20;
+
+// Each thread keeps its buffer and protocol, so encoding allocates only the
+// returned string, and decoding only the fields of *value.
+template<class TThriftStruct>
+std::string EncodeCompact(const TThriftStruct &value) {
+  thread_local auto buffer = std::make_shared<TMemoryBuffer>();
+  thread_local TCompactProtocolT<TMemoryBuffer> protocol(buffer);
+  buffer->resetBuffer();
+  value.write(&protocol);
+  return buffer->getBufferAsString();
+}
+
+// Reads the struct in place from data; throws TException if it is not a
+// valid encoding.
+template<class TThriftStruct>
+void DecodeCompact(const char *data, size_t size, TThriftStruct *value) {
+  thread_local auto buffer = std::make_shared<TMemoryBuffer>();
+  thread_local TCompactProtocolT<TMemoryBuffer> protocol(
+      buffer, kCacheStringLimit, kCacheContainerLimit);
+  buffer->resetBuffer(reinterpret_cast<uint8_t *>(const_cast<char *>(data)),
+                      size, TMemoryBuffer::OBSERVE);
+  value->read(&protocol);
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_UTILS_CACHE_FORMAT_H
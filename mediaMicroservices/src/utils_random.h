@@ -0,0 +1,59 @@
+#ifndef MEDIA_MICROSERVICES_UTILS_RANDOM_H
+#define MEDIA_MICROSERVICES_UTILS_RANDOM_H
+
+#include <sys/random.h>
+
+#include <cerrno>
+#include <stdexcept>
+#include <string>
+
+namespace media_service {
+
+// Fills buf from the kernel CSPRNG.
+void FillRandomBytes(unsigned char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = getrandom(buf, len, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::runtime_error("getrandom failed");
+    }
+    buf += n;
+    len -= n;
+  }
+}
+
+// Random alphanumeric string, e.g. a password salt. Bytes come from the
+// kernel CSPRNG through a per-thread buffer, so a call costs one getrandom()
+// per 4 KB of output instead of seeding a new generator every time.
+std::string GenRandomString(const int len) {
+  static const char alphanum[] =
+      "0123456789"
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+      "abcdefghijklmnopqrstuvwxyz";
+  static const int n_alphanum = sizeof(alphanum) - 1;
+  // Bytes at or above this bound are skipped so every character is equally
+  // likely.
+  static const int bound = 256 - 256 % n_alphanum;
+  thread_local unsigned char buf[4096];
+  thread_local size_t pos = sizeof(buf);
+
+  std::string s;
+  s.reserve(len);
+  while (static_cast<int>(s.size()) < len) {
+    if (pos == sizeof(buf)) {
+      FillRandomBytes(buf, sizeof(buf));
+      pos = 0;
+    }
+    unsigned char b = buf[pos++];
+    if (b < bound) {
+      s += alphanum[b % n_alphanum];
+    }
+  }
+  return s;
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_UTILS_RANDOM_H
@@ -0,0 +1,106 @@
+#ifndef MEDIA_MICROSERVICES_UTILS_RATING_H
+#define MEDIA_MICROSERVICES_UTILS_RATING_H
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <cpp_redis/cpp_redis>
+
+#include "../gen-cpp/media_service_types.h"
+#include "RedisClient.h"
+
+namespace media_service {
+
+// Ratings are staged in rating-redis and committed to movie-info in batches.
+// For every movie with staged ratings, <movie_id>:uncommit_sum and
+// <movie_id>:uncommit_num hold their sum and count, and the sorted set
+// kUncommittedRatingsKey holds the movie_id, scored by the time in ms of its
+// oldest staged rating.
+//
+// The scripts below declare every key they touch in KEYS, but a script's keys
+// span several hash slots, so rating-redis must be a single Redis instance
+// (or a primary with replicas), not a Redis Cluster.
+const std::string kUncommittedRatingsKey = "uncommitted_ratings";
+
+// Adds sum/num to a movie's staged ratings and marks it uncommitted, keeping
+// the earlier time if it already was. Atomic, so the committer never drains
+// a sum without its count.
+//   KEYS: uncommit_sum, uncommit_num, kUncommittedRatingsKey
+//   ARGV: sum, num, time in ms, movie_id
+const std::string kStageRatingsScript =
+    "redis.call('INCRBY', KEYS[1], ARGV[1]) "
+    "redis.call('INCRBY', KEYS[2], ARGV[2]) "
+    "redis.call('ZADD', KEYS[3], 'NX', ARGV[3], ARGV[4]) "
+    "return 1";
+
+// Takes the staged ratings of the movies in ARGV and deletes them. Movies no
+// longer in kUncommittedRatingsKey, because another committer took them
+// since they were listed, are skipped. Returns the number of movies left
+// uncommitted, followed by movie_id, time, sum and count of every movie taken.
+//   KEYS: kUncommittedRatingsKey, then uncommit_sum and uncommit_num of every
+//         movie in ARGV
+//   ARGV: movie_ids
+const std::string kDrainRatingsScript =
+    "local drained = {0} "
+    "for i = 1, #ARGV do "
+    "  local time = redis.call('ZSCORE', KEYS[1], ARGV[i]) "
+    "  if time then "
+    "    local sum_key = KEYS[2 * i] "
+    "    local num_key = KEYS[2 * i + 1] "
+    "    table.insert(drained, ARGV[i]) "
+    "    table.insert(drained, time) "
+    "    table.insert(drained, redis.call('GET', sum_key) or '0') "
+    "    table.insert(drained, redis.call('GET', num_key) or '0') "
+    "    redis.call('DEL', sum_key, num_key) "
+    "    redis.call('ZREM', KEYS[1], ARGV[i]) "
+    "  end "
+    "end "
+    "drained[1] = redis.call('ZCARD', KEYS[1]) "
+    "return drained";
+
+inline int64_t RatingClockMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Queues the staging of sum/num for movie_id on the pipeline.
+std::future<cpp_redis::reply> StageRatings(
+    RedisPipeline *pipeline, const std::string &movie_id,
+    int64_t sum, int64_t num, int64_t time_ms) {
+  return pipeline->Eval(
+      kStageRatingsScript,
+      {movie_id + ":uncommit_sum", movie_id + ":uncommit_num",
+       kUncommittedRatingsKey},
+      {std::to_string(sum), std::to_string(num), std::to_string(time_ms),
+       movie_id});
+}
+
+// Queues the draining of movie_ids, listed from kUncommittedRatingsKey, on the
+// pipeline.
+std::future<cpp_redis::reply> DrainRatings(
+    RedisPipeline *pipeline, const std::vector<std::string> &movie_ids) {
+  std::vector<std::string> keys{kUncommittedRatingsKey};
+  for (auto &movie_id : movie_ids) {
+    keys.emplace_back(movie_id + ":uncommit_sum");
+    keys.emplace_back(movie_id + ":uncommit_num");
+  }
+  return pipeline->Eval(kDrainRatingsScript, keys, movie_ids);
+}
+
+// Throws ServiceException if Redis rejected the staging of movie_id.
+void CheckStaged(const cpp_redis::reply &reply, const std::string &movie_id) {
+  if (reply.is_error()) {
+    ServiceException se;
+    se.errorCode = ErrorCode::SE_REDIS_ERROR;
+    se.message = "Failed to stage ratings of movie " + movie_id + ": " +
+        reply.error();
+    throw se;
+  }
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_UTILS_RATING_H
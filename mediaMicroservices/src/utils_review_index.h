@@ -0,0 +1,101 @@
+#ifndef MEDIA_MICROSERVICES_UTILS_REVIEW_INDEX_H
+#define MEDIA_MICROSERVICES_UTILS_REVIEW_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <cpp_redis/cpp_redis>
+
+#include "ClientPool.h"
+#include "RedisClient.h"
+#include "logger.h"
+
+namespace media_service {
+
+// user-review-service and movie-review-service cache the reviews of a user or
+// movie in Redis, as a sorted set of review_ids scored by timestamp. A set is
+// only written once it has been loaded from MongoDB, so a missing key means
+// "not cached", never "no reviews".
+
+// Adds a review to a set that is cached, and leaves a missing one missing.
+// Replaces the zcard/zadd pair, which cost two round trips.
+//   KEYS: set key
+//   ARGV: timestamp, review_id
+const std::string kAddCachedReviewScript =
+    "if redis.call('EXISTS', KEYS[1]) == 1 then "
+    "  return redis.call('ZADD', KEYS[1], 'NX', ARGV[1], ARGV[2]) "
+    "end "
+    "return 0";
+
+// Replaces a set with the reviews loaded from MongoDB. Runs as one script so
+// that an AddCachedReview cannot land between the DEL and the ZADD, where it
+// would find no set and skip its review. The members are added 1000 at a
+// time, under the limit of Lua's unpack().
+//   KEYS: set key
+//   ARGV: timestamp, review_id, timestamp, review_id, ...
+const std::string kBackfillReviewsScript =
+    "redis.call('DEL', KEYS[1]) "
+    "for i = 1, #ARGV, 2000 do "
+    "  redis.call('ZADD', KEYS[1], 'NX', "
+    "             unpack(ARGV, i, math.min(i + 1999, #ARGV))) "
+    "end "
+    "return #ARGV / 2";
+
+// Adds review_id to the cached set at key in one round trip. The set is only
+// a cache, so Redis errors are logged and not raised.
+void AddCachedReview(RedisClient *redis_client, const std::string &key,
+                     int64_t review_id, int64_t timestamp) {
+  RedisPipeline pipeline(redis_client);
+  auto reply_future = pipeline.Eval(
+      kAddCachedReviewScript, {key},
+      {std::to_string(timestamp), std::to_string(review_id)});
+  pipeline.Commit();
+  auto reply = reply_future.get();
+  if (reply.is_error()) {
+    LOG_RATE_LIMITED(error) << "Failed to add review " << review_id
+                            << " to " << key << ": " << reply.error();
+  }
+}
+
+// Replaces the cached set at key with the reviews read from MongoDB
+// (timestamp -> review_id) without waiting for Redis. The client goes back
+// to the pool from the reply callback; cpp_redis also runs the callback, with
+// an error reply, when the connection drops.
+void BackfillReviews(ClientPool<RedisClient> *redis_client_pool,
+                     const std::string &key,
+                     const std::multimap<std::string, std::string> &reviews) {
+  RedisClient *redis_client_wrapper;
+  try {
+    redis_client_wrapper = redis_client_pool->Pop();
+  } catch (...) {
+    redis_client_wrapper = nullptr;
+  }
+  if (!redis_client_wrapper) {
+    LOG_RATE_LIMITED(error) << "Failed to backfill " << key
+                            << ": cannot connect to Redis";
+    return;
+  }
+  std::vector<std::string> members;
+  members.reserve(reviews.size() * 2);
+  for (auto &review : reviews) {
+    members.emplace_back(review.first);
+    members.emplace_back(review.second);
+  }
+  RedisPipeline pipeline(redis_client_wrapper);
+  pipeline.Eval(
+      kBackfillReviewsScript, {key}, members,
+      [redis_client_pool, redis_client_wrapper, key](cpp_redis::reply &reply) {
+        if (reply.is_error()) {
+          LOG_RATE_LIMITED(error) << "Failed to backfill " << key << ": "
+                                  << reply.error();
+        }
+        redis_client_pool->Push(redis_client_wrapper);
+      });
+  pipeline.CommitAsync();
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_UTILS_REVIEW_INDEX_H
@@ -0,0 +1,206 @@
+#ifndef MEDIA_MICROSERVICES_UTILS_THRIFT_H
+#define MEDIA_MICROSERVICES_UTILS_THRIFT_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <nlohmann/json.hpp>
+
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/PlatformThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/server/TNonblockingServer.h>
+#include <thrift/server/TServer.h>
+#include <thrift/server/TThreadPoolServer.h>
+#include <thrift/server/TThreadedServer.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TNonblockingServerSocket.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TTransport.h>
+
+#include "logger.h"
+
+namespace media_service {
+using json = nlohmann::json;
+using apache::thrift::TProcessor;
+using apache::thrift::concurrency::PlatformThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TCompactProtocolFactory;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolFactory;
+using apache::thrift::server::TNonblockingServer;
+using apache::thrift::server::TServer;
+using apache::thrift::server::TThreadPoolServer;
+using apache::thrift::server::TThreadedServer;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TNonblockingServerSocket;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportFactory;
+
+struct ThriftServerMode {
+  enum type {
+    THREADED = 0,
+    THREAD_POOL = 1,
+    NONBLOCKING = 2
+  };
+};
+
+struct ThriftProtocol {
+  enum type {
+    BINARY = 0,
+    COMPACT = 1
+  };
+};
+
+struct ThriftProtocolConfig {
+  ThriftProtocol::type protocol = ThriftProtocol::BINARY;
+  // Initial size of a framed transport's write buffer. TFramedTransport keeps
+  // its buffers for the life of the connection, growing them by doubling;
+  // starting at the size of a typical reply avoids the regrowth on the first
+  // calls of every pooled connection.
+  uint32_t frame_buffer_size = 512;
+};
+
+// Process-wide, set by SetUpThriftProtocol before any client or server is
+// built. Both ends of a connection must use the same protocol, so it is a
+// top-level setting with no per-service override.
+ThriftProtocolConfig &GetThriftProtocolConfig() {
+  static ThriftProtocolConfig protocol_config;
+  return protocol_config;
+}
+
+// Reads the top-level "thrift-protocol" section:
+//   {"type": "binary" | "compact", "frame_buffer_size": <bytes>}
+// Without it, services speak TBinaryProtocol as before.
+void SetUpThriftProtocol(const json &config_json) {
+  if (!config_json.contains("thrift-protocol")) {
+    return;
+  }
+  auto &protocol_config = GetThriftProtocolConfig();
+  json section = config_json["thrift-protocol"];
+  std::string type = section["type"];
+  if (type == "binary") {
+    protocol_config.protocol = ThriftProtocol::BINARY;
+  } else if (type == "compact") {
+    protocol_config.protocol = ThriftProtocol::COMPACT;
+  } else {
+    LOG(error) << "Unknown thrift-protocol type " << type;
+    exit(EXIT_FAILURE);
+  }
+  if (section.contains("frame_buffer_size")) {
+    protocol_config.frame_buffer_size = section["frame_buffer_size"];
+  }
+}
+
+std::shared_ptr<TProtocolFactory> MakeThriftProtocolFactory() {
+  if (GetThriftProtocolConfig().protocol == ThriftProtocol::COMPACT) {
+    return std::make_shared<TCompactProtocolFactory>();
+  }
+  return std::make_shared<TBinaryProtocolFactory>();
+}
+
+std::shared_ptr<TProtocol> MakeThriftProtocol(
+    const std::shared_ptr<TTransport> &transport) {
+  return MakeThriftProtocolFactory()->getProtocol(transport);
+}
+
+// TFramedTransportFactory with the write buffer starting at
+// frame_buffer_size instead of TFramedTransport's default.
+class SizedFramedTransportFactory : public TTransportFactory {
+ public:
+  explicit SizedFramedTransportFactory(uint32_t buffer_size)
+      : _buffer_size(buffer_size) {}
+
+  std::shared_ptr<TTransport> getTransport(
+      std::shared_ptr<TTransport> transport) override {
+    return std::make_shared<TFramedTransport>(transport, _buffer_size);
+  }
+
+ private:
+  uint32_t _buffer_size;
+};
+
+// The "thrift-server" section of the service's own section, or else the
+// top-level one.
+json GetThriftServerConfig(const json &config_json,
+                           const std::string &service) {
+  if (config_json.contains(service) &&
+      config_json[service].contains("thrift-server")) {
+    return config_json[service]["thrift-server"];
+  }
+  return config_json["thrift-server"];
+}
+
+// Builds the server engine selected by the "thrift-server" config:
+//
+// - threaded: TThreadedServer, one thread per connection.
+// - thread_pool: TThreadPoolServer, connections served by worker_threads
+//   threads. A connection keeps its worker until it is closed, so the pool
+//   must be at least as large as the upstream pools' connections.
+// - nonblocking: TNonblockingServer, io_threads libevent loops read the
+//   frames of all connections and hand each call to worker_threads threads.
+//   Idle connections hold no thread.
+std::shared_ptr<TServer> MakeThriftServer(
+    const std::shared_ptr<TProcessor> &processor, const json &config_json,
+    const std::string &service, int port) {
+  json server_config = GetThriftServerConfig(config_json, service);
+  std::string mode_str = server_config["mode"];
+  ThriftServerMode::type mode;
+  if (mode_str == "threaded") {
+    mode = ThriftServerMode::THREADED;
+  } else if (mode_str == "thread_pool") {
+    mode = ThriftServerMode::THREAD_POOL;
+  } else if (mode_str == "nonblocking") {
+    mode = ThriftServerMode::NONBLOCKING;
+  } else {
+    LOG(error) << "Unknown thrift-server mode " << mode_str;
+    exit(EXIT_FAILURE);
+  }
+
+  auto protocol_factory = MakeThriftProtocolFactory();
+  auto transport_factory = std::make_shared<SizedFramedTransportFactory>(
+      GetThriftProtocolConfig().frame_buffer_size);
+  if (mode == ThriftServerMode::THREADED) {
+    return std::make_shared<TThreadedServer>(
+        processor,
+        std::make_shared<TServerSocket>("0.0.0.0", port),
+        transport_factory,
+        protocol_factory);
+  }
+
+  int worker_threads = server_config["worker_threads"];
+  auto thread_manager = ThreadManager::newSimpleThreadManager(worker_threads);
+  thread_manager->threadFactory(std::make_shared<PlatformThreadFactory>());
+  thread_manager->start();
+  LOG(info) << "Serving " << service << " with a " << mode_str
+            << " server, " << worker_threads << " worker threads";
+
+  if (mode == ThriftServerMode::THREAD_POOL) {
+    return std::make_shared<TThreadPoolServer>(
+        processor,
+        std::make_shared<TServerSocket>("0.0.0.0", port),
+        transport_factory,
+        protocol_factory,
+        thread_manager);
+  }
+
+  // TNonblockingServer reads and writes frames itself, so it takes no
+  // transport factory; clients must use TFramedTransport, as ThriftClient
+  // does.
+  auto server = std::make_shared<TNonblockingServer>(
+      processor, protocol_factory,
+      std::make_shared<TNonblockingServerSocket>(port), thread_manager);
+  server->setNumIOThreads(server_config["io_threads"]);
+  server->setWriteBufferDefaultSize(
+      GetThriftProtocolConfig().frame_buffer_size);
+  return server;
+}
+
+} // namespace media_service
+
+#endif //MEDIA_MICROSERVICES_UTILS_THRIFT_H
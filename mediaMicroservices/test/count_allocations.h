@@ -0,0 +1,30 @@
+#ifndef MEDIA_MICROSERVICES_TEST_COUNT_ALLOCATIONS_H
+#define MEDIA_MICROSERVICES_TEST_COUNT_ALLOCATIONS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new of the benchmark that includes it, so that
+// allocations counts every heap allocation of the process. Include it from
+// the benchmark's only source file: the replacement must be defined once.
+static std::atomic<int64_t> allocations(0);
+
+void *operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+
+#endif //MEDIA_MICROSERVICES_TEST_COUNT_ALLOCATIONS_H
@@ -0,0 +1,172 @@
+// Compares the two memcached formats of cast-info-service and
+// movie-info-service on one CastInfo and one MovieInfo. "json" is the
+// MongoDB document as JSON, decoded by parsing it with nlohmann and copying
+// the fields into the struct, as the handlers do for entries written with
+// flags 0. "compact" is the struct in TCompactProtocol, decoded straight into
+// the generated type. Reports the entry size, the CPU time to encode and to
+// decode one entry, and the heap allocations of a decode.
+//
+//   testCacheFormat [iterations]
+
+#include "../src/utils_cache_format.h"
+#include "../gen-cpp/media_service_types.h"
+#include "count_allocations.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace media_service;
+
+CastInfo MakeCastInfo() {
+  CastInfo cast_info;
+  cast_info.cast_info_id = 1000001;
+  cast_info.name = "Cast Member";
+  cast_info.gender = true;
+  cast_info.intro = std::string(512, 'i');
+  return cast_info;
+}
+
+MovieInfo MakeMovieInfo() {
+  MovieInfo movie_info;
+  movie_info.movie_id = "tt0000001";
+  movie_info.title = "The Movie";
+  movie_info.plot_id = 1234567890123;
+  movie_info.avg_rating = 7.5;
+  movie_info.num_rating = 12345;
+  for (int i = 0; i < 20; ++i) {
+    Cast cast;
+    cast.cast_id = i;
+    cast.character = "Character " + std::to_string(i);
+    cast.cast_info_id = 1000000 + i;
+    movie_info.casts.push_back(cast);
+  }
+  for (int i = 0; i < 10; ++i) {
+    movie_info.thumbnail_ids.push_back("thumbnail-" + std::to_string(i));
+    movie_info.photo_ids.push_back("photo-" + std::to_string(i));
+    movie_info.video_ids.push_back("video-" + std::to_string(i));
+  }
+  return movie_info;
+}
+
+// The documents cast-info-service and movie-info-service write to MongoDB.
+json CastInfoDocument(const CastInfo &cast_info) {
+  return {{"cast_info_id", cast_info.cast_info_id},
+          {"name", cast_info.name},
+          {"gender", cast_info.gender},
+          {"intro", cast_info.intro}};
+}
+
+json MovieInfoDocument(const MovieInfo &movie_info) {
+  json casts = json::array();
+  for (auto &cast : movie_info.casts) {
+    casts.push_back({{"cast_id", cast.cast_id},
+                     {"cast_info_id", cast.cast_info_id},
+                     {"character", cast.character}});
+  }
+  return {{"movie_id", movie_info.movie_id},
+          {"title", movie_info.title},
+          {"plot_id", movie_info.plot_id},
+          {"avg_rating", movie_info.avg_rating},
+          {"num_rating", movie_info.num_rating},
+          {"casts", casts},
+          {"thumbnail_ids", movie_info.thumbnail_ids},
+          {"photo_ids", movie_info.photo_ids},
+          {"video_ids", movie_info.video_ids}};
+}
+
+// The JSON decoding of CastInfoHandler and MovieInfoHandler.
+void DecodeJson(const std::string &entry, CastInfo *cast_info) {
+  json cast_info_json = json::parse(entry);
+  cast_info->cast_info_id = cast_info_json["cast_info_id"];
+  cast_info->gender = cast_info_json["gender"];
+  cast_info->name = cast_info_json["name"];
+  cast_info->intro = cast_info_json["intro"];
+}
+
+void DecodeJson(const std::string &entry, MovieInfo *movie_info) {
+  json movie_info_json = json::parse(entry);
+  movie_info->movie_id = movie_info_json["movie_id"];
+  movie_info->title = movie_info_json["title"];
+  movie_info->avg_rating = movie_info_json["avg_rating"];
+  movie_info->num_rating = movie_info_json["num_rating"];
+  movie_info->plot_id = movie_info_json["plot_id"];
+  for (auto &item : movie_info_json["photo_ids"]) {
+    movie_info->photo_ids.emplace_back(item);
+  }
+  for (auto &item : movie_info_json["video_ids"]) {
+    movie_info->video_ids.emplace_back(item);
+  }
+  for (auto &item : movie_info_json["thumbnail_ids"]) {
+    movie_info->thumbnail_ids.emplace_back(item);
+  }
+  for (auto &item : movie_info_json["casts"]) {
+    Cast new_cast;
+    new_cast.cast_id = item["cast_id"];
+    new_cast.cast_info_id = item["cast_info_id"];
+    new_cast.character = item["character"];
+    movie_info->casts.emplace_back(new_cast);
+  }
+}
+
+double CpuUs(int n, const std::function<void()> &f) {
+  std::clock_t cpu_start = std::clock();
+  for (int i = 0; i < n; ++i) {
+    f();
+  }
+  return 1e6 * (std::clock() - cpu_start) / CLOCKS_PER_SEC / n;
+}
+
+template<class TThriftStruct>
+void Compare(const std::string &name, const TThriftStruct &value,
+             const json &document, int n) {
+  std::string json_entry = document.dump();
+  std::string compact_entry = EncodeCompact(value);
+
+  TThriftStruct decoded;
+  DecodeJson(json_entry, &decoded);
+  if (!(decoded == value)) {
+    std::cerr << name << " did not round-trip through json" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  decoded = TThriftStruct();
+  DecodeCompact(compact_entry.data(), compact_entry.size(), &decoded);
+  if (!(decoded == value)) {
+    std::cerr << name << " did not round-trip through compact" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  double encode_us = CpuUs(n, [&]() { json_entry = document.dump(); });
+  int64_t allocations_start = allocations.load();
+  double decode_us = CpuUs(n, [&]() {
+    TThriftStruct out;
+    DecodeJson(json_entry, &out);
+  });
+  double allocs = allocations.load() - allocations_start;
+  std::cout << name << "\tjson\t" << json_entry.size() << "\t" << encode_us
+            << "\t" << decode_us << "\t" << allocs / n << std::endl;
+
+  encode_us = CpuUs(n, [&]() { compact_entry = EncodeCompact(value); });
+  allocations_start = allocations.load();
+  decode_us = CpuUs(n, [&]() {
+    TThriftStruct out;
+    DecodeCompact(compact_entry.data(), compact_entry.size(), &out);
+  });
+  allocs = allocations.load() - allocations_start;
+  std::cout << name << "\tcompact\t" << compact_entry.size() << "\t"
+            << encode_us << "\t" << decode_us << "\t" << allocs / n
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  int n = argc > 1 ? std::stoi(argv[1]) : 100000;
+  std::cout << "struct\tformat\tbytes\tencode us\tdecode us\t"
+            << "decode allocs" << std::endl;
+  CastInfo cast_info = MakeCastInfo();
+  Compare("CastInfo", cast_info, CastInfoDocument(cast_info), n);
+  MovieInfo movie_info = MakeMovieInfo();
+  Compare("MovieInfo", movie_info, MovieInfoDocument(movie_info), n);
+  return 0;
+}
@@ -0,0 +1,166 @@
+// Review composition throughput of compose-review-service's two assembly
+// paths: the in-process ReviewAssemblyTable, and the memcached counter and
+// mget sequence used when the table is off or a review spans replicas.
+// Component c of review r is uploaded by thread (r + c) % threads, so the
+// five uploads of a review race on different threads, as they do when they
+// arrive from five services. Only assembly is measured; the composed review
+// is not sent downstream.
+//
+//   testReviewAssembly [threads] [reviews] [memcached addr:port]
+//
+// The memcached path runs only when an address is given.
+
+#include "../src/ComposeReviewService/ReviewAssemblyTable.h"
+
+#include <libmemcached/memcached.h>
+#include <libmemcached/util.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace media_service;
+
+static const char *kKeys[] = {
+    "review_id", "movie_id", "user_id", "text", "rating"};
+
+// Each thread uploads its share of the components with upload(req_id,
+// component), which returns true for the upload completing the review.
+// Returns completed reviews per second.
+double Run(int n_threads, int n_reviews, int64_t base_req_id,
+           const std::function<bool(int64_t, int)> &upload) {
+  std::atomic<int64_t> completed(0);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (int r = 0; r < n_reviews; ++r) {
+        for (int c = 0; c < 5; ++c) {
+          if ((r + c) % n_threads == t && upload(base_req_id + r, c)) {
+            completed.fetch_add(1);
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double elapsed_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  if (completed.load() != n_reviews) {
+    std::cerr << "composed " << completed.load() << " of " << n_reviews
+              << " reviews" << std::endl;
+  }
+  return n_reviews / elapsed_s;
+}
+
+// The memcached path of ComposeReviewHandler: add the counter, add the
+// component, increment the counter, and mget the five components on the
+// last one.
+bool MmcUpload(memcached_pool_st *pool, int64_t req_id, int component,
+               const std::string &value) {
+  memcached_return_t rc;
+  memcached_st *client = memcached_pool_pop(pool, true, &rc);
+  std::string prefix = std::to_string(req_id) + ":";
+  std::string key_counter = prefix + "counter";
+  std::string key = prefix + kKeys[component];
+  memcached_add(client, key_counter.c_str(), key_counter.size(), "0", 1, 60, 0);
+  memcached_add(client, key.c_str(), key.size(), value.c_str(), value.size(),
+                60, 0);
+  uint64_t counter = 0;
+  memcached_increment(client, key_counter.c_str(), key_counter.size(), 1,
+                      &counter);
+  if (counter == 5) {
+    std::string keys[5];
+    const char *key_ptrs[5];
+    size_t key_sizes[5];
+    for (int i = 0; i < 5; ++i) {
+      keys[i] = prefix + kKeys[i];
+      key_ptrs[i] = keys[i].c_str();
+      key_sizes[i] = keys[i].size();
+    }
+    memcached_mget(client, key_ptrs, key_sizes, 5);
+    char return_key[MEMCACHED_MAX_KEY];
+    size_t return_key_length;
+    size_t return_value_length;
+    uint32_t flags;
+    while (char *return_value = memcached_fetch(
+        client, return_key, &return_key_length, &return_value_length,
+        &flags, &rc)) {
+      free(return_value);
+    }
+  }
+  memcached_pool_push(pool, client);
+  return counter == 5;
+}
+
+int main(int argc, char *argv[]) {
+  int n_threads = argc > 1 ? std::stoi(argv[1]) : 16;
+  int n_reviews = argc > 2 ? std::stoi(argv[2]) : 200000;
+  init_logger();
+
+  std::string text(256, 't');
+  std::string movie_id = "tt0000001";
+
+  ReviewAssemblyTable table(64, 1000);
+  double table_rate = Run(
+      n_threads, n_reviews, 0, [&](int64_t req_id, int component) {
+        Review review;
+        auto type = static_cast<ReviewComponent::type>(component);
+        return table.Add(
+            req_id, type,
+            [&](Review *slot) {
+              switch (type) {
+                case ReviewComponent::REVIEW_ID:
+                  slot->review_id = req_id;
+                  break;
+                case ReviewComponent::MOVIE_ID:
+                  slot->movie_id = movie_id;
+                  break;
+                case ReviewComponent::USER_ID:
+                  slot->user_id = req_id % 1000;
+                  break;
+                case ReviewComponent::TEXT:
+                  slot->text = text;
+                  break;
+                case ReviewComponent::RATING:
+                  slot->rating = req_id % 10;
+                  break;
+              }
+            },
+            {}, &review);
+      });
+  std::cout << "assembly table\t" << table_rate << " reviews/s" << std::endl;
+
+  if (argc > 3) {
+    std::string config_str = std::string("--SERVER=") + argv[3];
+    memcached_st *memcached_client =
+        memcached(config_str.c_str(), config_str.length());
+    memcached_behavior_set(memcached_client, MEMCACHED_BEHAVIOR_NO_BLOCK, 1);
+    memcached_behavior_set(memcached_client, MEMCACHED_BEHAVIOR_TCP_NODELAY, 1);
+    memcached_behavior_set(
+        memcached_client, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
+    memcached_pool_st *pool =
+        memcached_pool_create(memcached_client, n_threads, n_threads);
+    // Distinct req_ids per run, so earlier runs' counters do not interfere.
+    int64_t base_req_id = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() *
+        1000000000LL;
+    double mmc_rate = Run(
+        n_threads, n_reviews, base_req_id,
+        [&](int64_t req_id, int component) {
+          std::string value = component == 1 ? movie_id :
+                              component == 3 ? text :
+                              std::to_string(req_id);
+          return MmcUpload(pool, req_id, component, value);
+        });
+    std::cout << "memcached\t" << mmc_rate << " reviews/s" << std::endl;
+    memcached_pool_destroy(pool);
+  }
+  return 0;
+}
@@ -0,0 +1,164 @@
+// Compares the Thrift server engines of utils_thrift.h under the connection
+// pattern the services see: many pooled connections from upstream, few of
+// them busy at once. For each mode a PlotService server runs in a child
+// process, with a handler that waits handler_us like a handler waiting on
+// storage does. The parent opens `connections` framed connections, and
+// `threads` client threads each drive calls round-robin over their share of
+// them. Reports the server's thread count and resident memory with all
+// connections open, its peak memory, and the latency of the calls.
+//
+//   testThriftServerModes [connections] [threads] [calls] [handler_us]
+
+#include "../src/ThriftClient.h"
+#include "../src/metrics.h"
+#include "../src/utils_thrift.h"
+#include "../gen-cpp/PlotService.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace media_service;
+
+static const int kPort = 19090;
+
+class SleepingPlotHandler : public PlotServiceIf {
+ public:
+  explicit SleepingPlotHandler(int handler_us)
+      : _handler_us(handler_us), _plot(512, 'x') {}
+
+  void WritePlot(const int64_t req_id, const int64_t plot_id,
+                 const std::string &plot,
+                 const std::map<std::string, std::string> &carrier) override {}
+
+  void ReadPlot(std::string &_return, const int64_t req_id,
+                const int64_t plot_id,
+                const std::map<std::string, std::string> &carrier) override {
+    std::this_thread::sleep_for(std::chrono::microseconds(_handler_us));
+    _return = _plot;
+  }
+
+ private:
+  int _handler_us;
+  std::string _plot;
+};
+
+// Numeric value of a field of /proc/<pid>/status, e.g. Threads or VmRSS (kB).
+int64_t ProcStatus(pid_t pid, const std::string &field) {
+  std::ifstream status("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, field.size() + 1, field + ":") == 0) {
+      std::istringstream value(line.substr(field.size() + 1));
+      int64_t n = -1;
+      value >> n;
+      return n;
+    }
+  }
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  int n_connections = argc > 1 ? std::stoi(argv[1]) : 512;
+  int n_threads = argc > 2 ? std::stoi(argv[2]) : 16;
+  int n_calls = argc > 3 ? std::stoi(argv[3]) : 100000;
+  int handler_us = argc > 4 ? std::stoi(argv[4]) : 200;
+  if (n_threads > n_connections) {
+    std::cerr << "threads must not exceed connections" << std::endl;
+    return 1;
+  }
+
+  // A thread-pool server keeps a worker per open connection, so it is given
+  // as many as there are connections; with fewer, the extra ones would wait
+  // for a connection to close.
+  std::vector<json> modes = {
+      {{"mode", "threaded"}},
+      {{"mode", "thread_pool"}, {"worker_threads", n_connections}},
+      {{"mode", "nonblocking"}, {"io_threads", 4}, {"worker_threads", 64}}};
+
+  std::cout << "mode\tserver threads\trss MB\tpeak rss MB\tcalls/s\t"
+            << "p50 us\tp99 us\tp99.9 us" << std::endl;
+  for (auto &mode : modes) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      init_logger();
+      auto processor = std::make_shared<PlotServiceProcessor>(
+          std::make_shared<SleepingPlotHandler>(handler_us));
+      json config_json = {{"thrift-server", mode}};
+      MakeThriftServer(processor, config_json, "plot-service", kPort)
+          ->serve();
+      _exit(EXIT_SUCCESS);
+    }
+
+    std::vector<std::unique_ptr<ThriftClient<PlotServiceClient>>> clients;
+    for (int i = 0; i < n_connections; ++i) {
+      clients.emplace_back(
+          new ThriftClient<PlotServiceClient>("127.0.0.1", kPort));
+      for (int attempt = 0;; ++attempt) {
+        try {
+          clients.back()->Connect();
+          break;
+        } catch (const TException &) {
+          if (attempt == 100) {
+            throw;
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+      }
+    }
+    std::map<std::string, std::string> carrier;
+    std::string plot;
+    for (auto &client : clients) {
+      client->GetClient()->ReadPlot(plot, 0, 0, carrier);
+    }
+    int64_t server_threads = ProcStatus(pid, "Threads");
+    int64_t rss_kb = ProcStatus(pid, "VmRSS");
+
+    LatencyMetric latency;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; ++t) {
+      threads.emplace_back([&, t]() {
+        std::map<std::string, std::string> carrier;
+        std::string plot;
+        int next = t;
+        for (int i = t; i < n_calls; i += n_threads) {
+          auto call_start = std::chrono::steady_clock::now();
+          clients[next]->GetClient()->ReadPlot(plot, i, i, carrier);
+          latency.Record(MetricsElapsedUs(call_start), false);
+          next += n_threads;
+          if (next >= n_connections) {
+            next = t;
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    double elapsed_s = MetricsElapsedUs(start) / 1e6;
+    int64_t peak_rss_kb = ProcStatus(pid, "VmHWM");
+
+    clients.clear();
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+
+    auto snapshot = latency.Collect();
+    std::cout << mode["mode"].get<std::string>() << "\t" << server_threads
+              << "\t" << rss_kb / 1024.0 << "\t" << peak_rss_kb / 1024.0
+              << "\t" << snapshot.requests / elapsed_s << "\t"
+              << snapshot.ValueAtQuantile(0.5) << "\t"
+              << snapshot.ValueAtQuantile(0.99) << "\t"
+              << snapshot.ValueAtQuantile(0.999) << std::endl;
+  }
+  return 0;
+}
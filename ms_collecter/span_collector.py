@@ -0,0 +1,105 @@
+"""
+Gathers the spans exported by the services' built-in span recorder
+(socialNetwork/src/span_recorder.h) into a single file in the format of
+Jaeger's query API, the same format as traces-1695947455229.json, so that
+trace_collect.py can process it.
+
+Each service exports batches of spans as {"data": [trace, ...]} documents,
+one per line with the "file" exporter or one per datagram with the "udp"
+exporter. A trace is split across the services it went through; this script
+joins the parts.
+
+  # "file" exporter: copy the span files out of the containers first
+  python3 span_collector.py merge traces.json spans/*.json
+
+  # "udp" exporter: listen until interrupted or for --duration seconds
+  python3 span_collector.py listen traces.json --port 6832 --duration 60
+
+  python3 trace_collect.py traces.json
+"""
+import argparse
+import json
+import socket
+import time
+
+
+class TraceMerger:
+    def __init__(self):
+        self.traces = {}
+
+    def add_document(self, document):
+        for part in document["data"]:
+            trace = self.traces.setdefault(
+                part["traceID"],
+                {"traceID": part["traceID"], "spans": [], "processes": {},
+                 "warnings": None},
+            )
+            # Process ids are only unique within a part, renumber them.
+            process_ids = {}
+            for process_id, process in part["processes"].items():
+                for known_id, known in trace["processes"].items():
+                    if known == process:
+                        process_ids[process_id] = known_id
+                        break
+                else:
+                    new_id = "p%d" % (len(trace["processes"]) + 1)
+                    trace["processes"][new_id] = process
+                    process_ids[process_id] = new_id
+            for span in part["spans"]:
+                span["processID"] = process_ids[span["processID"]]
+                trace["spans"].append(span)
+
+    def dump(self, path):
+        with open(path, "w") as f:
+            json.dump({"data": list(self.traces.values())}, f)
+        print("%d traces, %d spans written to %s" % (
+            len(self.traces),
+            sum(len(t["spans"]) for t in self.traces.values()), path))
+
+
+def merge(out, paths):
+    merger = TraceMerger()
+    for path in paths:
+        with open(path) as f:
+            for line in f:
+                if line.strip():
+                    merger.add_document(json.loads(line))
+    merger.dump(out)
+
+
+def listen(out, port, duration):
+    merger = TraceMerger()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("0.0.0.0", port))
+    sock.settimeout(1)
+    deadline = time.time() + duration if duration else None
+    print("Listening on udp port %d" % port)
+    try:
+        while deadline is None or time.time() < deadline:
+            try:
+                datagram, _ = sock.recvfrom(65535)
+            except socket.timeout:
+                continue
+            merger.add_document(json.loads(datagram))
+    except KeyboardInterrupt:
+        pass
+    merger.dump(out)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        "Collects spans of the built-in span recorder into a Jaeger JSON file.")
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    merge_parser = subparsers.add_parser("merge")
+    merge_parser.add_argument("out")
+    merge_parser.add_argument("paths", nargs="+")
+    listen_parser = subparsers.add_parser("listen")
+    listen_parser.add_argument("out")
+    listen_parser.add_argument("--port", type=int, default=6832)
+    listen_parser.add_argument("--duration", type=float, default=0,
+                               help="seconds to listen, 0 until interrupted")
+    args = parser.parse_args()
+    if args.command == "merge":
+        merge(args.out, args.paths)
+    else:
+        listen(args.out, args.port, args.duration)
@@ -7,6 +7,7 @@ Paper:  Luo, S., Xu, H., Ye, K., Xu, G., Zhang, L., He, J., ... & Xu, C. (2022,
 import json
 import pandas as pd
 import re
+import sys
 
 
 def collect_trace_data(path):
@@ -148,5 +149,6 @@ def collect_trace_data(path):
 if __name__ == "__main__":
     """
     traces-1695947455229.json is the metrics downloading from jaeger, this trace data will be preprocessed and saved as trace.csv
+    A file written by span_collector.py can be passed instead.
     """
-    collect_trace_data('traces-1695947455229.json') 
+    collect_trace_data(sys.argv[1] if len(sys.argv) > 1 else 'traces-1695947455229.json')
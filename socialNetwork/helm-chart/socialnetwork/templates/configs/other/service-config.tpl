@@ -42,7 +42,12 @@
       "workers": 32,
       "connections": 512,
       "timeout_ms": 10000,
-      "keepalive_ms": 10000
+      "keepalive_ms": 10000,
+      "channel": "rabbitmq",
+      "queue_path": "/social-network-microservices/queue/write-home-timeline",
+      "batch_size": 64,
+      "batch_delay_ms": 5,
+      "prefetch": 256
     },
     "write-home-timeline-rabbitmq": {
       "addr": "write-home-timeline-rabbitmq",
@@ -65,7 +70,10 @@
       "port": 9090,
       "connections": 512,
       "timeout_ms": 10000,
-      "keepalive_ms": 10000
+      "keepalive_ms": 10000,
+      "timeline_write_mode": "parallel",
+      "home_timeline_workers": 8,
+      "home_timeline_queue_size": 4096
     },
     "compose-post-redis": {
       "addr": {{ ternary (include "redis-cluster.connection" . | trim) "compose-post-redis" .Values.global.redis.cluster.enabled | quote}},
@@ -81,7 +89,10 @@
       "port": 9090,
       "connections": 512,
       "timeout_ms": 10000,
-      "keepalive_ms": 10000
+      "keepalive_ms": 10000,
+      "backfill_workers": 4,
+      "backfill_queue_size": 4096,
+      "mongodb_max_posts": 1000
     },
     "user-timeline-mongodb": {
       "addr": {{ ternary (include "mongodb-sharded.connection" . | trim) "user-timeline-mongodb" .Values.global.mongodb.sharding.enabled | quote}},
@@ -200,7 +211,9 @@
       "connections": 512,
       "timeout_ms": 10000,
       "keepalive_ms": 10000,
-      "netif": "eth0"
+      "netif": "eth0",
+      "login_cache_ttl_s": 60,
+      "login_cache_size": 65536
     },
     "user-memcached": {
       "addr": {{ ternary (include "memcached-cluster.connection" . | trim) "user-memcached" .Values.global.memcached.cluster.enabled | quote}},
@@ -244,6 +257,15 @@
       "timeout_ms": 10000,
       "port": 6379,
       "connections": 512
+    },
+    "tracing": {
+      "sampling_rate": 0.01,
+      "exporter": "file",
+      "path": "/tmp/spans",
+      "udp_addr": "span-collector",
+      "udp_port": 6832,
+      "flush_interval_ms": 1000,
+      "max_wait_ms": 100
     }
   }
   {{- end }}
\ No newline at end of file
@@ -20,6 +20,19 @@ async def upload_register(session, addr, user):
     return await resp.text()
 
 
+async def upload_register_bulk(session, addr, users):
+  payload = {'req_id': 0, 'carrier': {},
+             'users': [{'first_name': 'first_name_' + user, 'last_name': 'last_name_' + user,
+                        'username': 'username_' + user, 'password': 'password_' + user,
+                        'user_id': int(user)} for user in users]}
+  async with session.post(addr + '/RegisterUsersBulk', json=payload) as resp:
+    if resp.status == 200:
+      # A partial batch lists the users that were inserted.
+      inserted = len((await resp.json())['user_ids'])
+      return 'Success: {} of {} users'.format(inserted, len(users))
+    return await resp.text()
+
+
 async def upload_compose(session, addr, user_id, num_users):
   text = ''.join(random.choices(string.ascii_letters + string.digits, k=256))
   # user mentions
@@ -88,6 +101,19 @@ async def register(addr, nodes, limit=200):
     printResults(results)
 
 
+async def register_bulk(addr, nodes, batch_size, limit=200):
+  tasks = []
+  conn = aiohttp.TCPConnector(limit=limit)
+  async with aiohttp.ClientSession(connector=conn) as session:
+    print('Registering Users in batches of {}...'.format(batch_size))
+    for i in range(0, nodes, batch_size):
+      users = [str(j) for j in range(i, min(i + batch_size, nodes))]
+      tasks.append(asyncio.ensure_future(
+          upload_register_bulk(session, addr, users)))
+    results = await asyncio.gather(*tasks)
+    printResults(results)
+
+
 async def follow(addr, edges, limit=200):
   idx = 0
   tasks = []
@@ -139,6 +165,10 @@ if __name__ == '__main__':
   parser.add_argument('--compose', action='store_true',
                       help='intialize with up to 20 posts per user', default=False)
   parser.add_argument('--limit', type=int, help='total number simultaneous connections', default=200)
+  parser.add_argument('--user-service', help='address of user-service (e.g. `127.0.0.1:9090`). '
+                      'If set, users are registered directly with RegisterUsersBulk instead of one request per user through NGINX.',
+                      default=None)
+  parser.add_argument('--bulk-size', type=int, help='users per RegisterUsersBulk request', default=1000)
   args = parser.parse_args()
 
   with open(os.path.join('datasets/social-graph', args.graph, f'{args.graph}.nodes'), 'r') as f:
@@ -151,7 +181,11 @@ if __name__ == '__main__':
   addr = 'http://{}:{}'.format(args.ip, args.port)
   limit = args.limit
   loop = asyncio.new_event_loop()
-  future = asyncio.ensure_future(register(addr, nodes, limit), loop=loop)
+  if args.user_service:
+    future = asyncio.ensure_future(register_bulk(
+        'http://' + args.user_service, nodes, args.bulk_size, limit), loop=loop)
+  else:
+    future = asyncio.ensure_future(register(addr, nodes, limit), loop=loop)
   loop.run_until_complete(future)
   future = asyncio.ensure_future(follow(addr, edges, limit), loop=loop)
   loop.run_until_complete(future)
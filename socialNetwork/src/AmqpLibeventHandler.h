@@ -2,6 +2,8 @@
 #define SOCIAL_NETWORK_MICROSERVICES_SRC_AMQPLIBEVENTHANDLER_H_
 
 #include <functional>
+#include <memory>
+#include <vector>
 #include <unistd.h>
 #include <amqpcpp.h>
 #include <event2/event.h>
@@ -56,10 +58,30 @@ class AmqpLibeventHandler {
     return is_running_;
   }
 
+  // Runs callback on the event loop thread every interval_ms, e.g. to flush
+  // work accumulated by consumers that did not fill a batch.
+  void AddTimer(int interval_ms, std::function<void()> callback)
+  {
+    timer_callbacks_.emplace_back(new std::function<void()>(std::move(callback)));
+    EventPtrT timer(event_new(evbase_.get(), -1, EV_PERSIST, OnTimer,
+                              timer_callbacks_.back().get()),
+                    event_free);
+    struct timeval interval = {interval_ms / 1000, (interval_ms % 1000) * 1000};
+    event_add(timer.get(), &interval);
+    timers_.emplace_back(std::move(timer));
+  }
+
  private:
+  static void OnTimer(evutil_socket_t fd, short what, void *arg)
+  {
+    (*static_cast<std::function<void()> *>(arg))();
+  }
+
   EventBasePtrT evbase_;
   LibEventHandler evhandler_;
   bool is_running_;
+  std::vector<std::unique_ptr<std::function<void()>>> timer_callbacks_;
+  std::vector<EventPtrT> timers_;
 
 };
 
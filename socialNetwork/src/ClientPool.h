@@ -7,13 +7,56 @@
 #include <deque>
 #include <chrono>
 #include <string>
+#include <thread>
+#include <algorithm>
 #include <nlohmann/json.hpp>
 
 #include "logger.h"
+#include "metrics.h"
 
 namespace social_network {
 using json = nlohmann::json;
 
+// Settings shared by every ClientPool of the process, from the "client-pool"
+// section of service-config.json. Without it, pools open connections lazily
+// in Pop() and have no health check, as before.
+struct ClientPoolConfig {
+  // Raises each pool's min_size, up to its max_size.
+  int min_connections = 0;
+  // Caps each pool's max_size and keepalive_ms; 0 leaves them. An open
+  // connection holds a thread of the httplib server it goes to, and is closed
+  // by that server after 5 s idle (see CMakeLists.txt).
+  int max_connections = 0;
+  int keepalive_ms = 0;
+  // How often idle connections are checked; 0 disables the check.
+  int health_check_interval_ms = 0;
+};
+
+ClientPoolConfig &GetClientPoolConfig() {
+  static ClientPoolConfig config;
+  return config;
+}
+
+// Must run before the pools are constructed.
+void SetUpClientPools(const json &config_json) {
+  if (!config_json.contains("client-pool")) {
+    return;
+  }
+  auto &config = GetClientPoolConfig();
+  config.min_connections =
+      config_json["client-pool"].value("min_connections", 0);
+  config.max_connections =
+      config_json["client-pool"].value("max_connections", 0);
+  config.keepalive_ms = config_json["client-pool"].value("keepalive_ms", 0);
+  config.health_check_interval_ms =
+      config_json["client-pool"].value("health_check_interval_ms", 0);
+}
+
+// The constructor connects min_size clients before the service starts
+// serving. With a health check, a background thread then takes each idle
+// client out in turn, replaces it if it is disconnected or older than
+// keepalive_ms, and reconnects the pool back up to min_size, so that Pop()
+// does not pay for a connect while the pool has idle clients.
 template<class TClient>
 class ClientPool {
  public:
@@ -32,6 +75,11 @@ class ClientPool {
   void Remove(TClient *);
 
  private:
+  void _Delete(TClient *);
+  void _Fill();
+  TClient * _NewClient();
+  void _HealthCheck(int interval_ms);
+
   std::deque<TClient *> _pool;
   std::string _addr;
   std::string _client_type;
@@ -43,29 +91,53 @@ class ClientPool {
   int _keepalive_ms;
   std::mutex _mtx;
   std::condition_variable _cv;
+  // Calls from Pop() to Keepalive(), or to Remove() for failed ones.
+  LatencyMetric *_metric;
+  bool _stopped = false;
+  bool _health_check = false;
+  std::condition_variable _health_cv;
+  std::thread _health_thread;
 };
 
 template<class TClient>
 ClientPool<TClient>::ClientPool(const std::string &client_type,
     const std::string &addr, int port, int min_pool_size,
     int max_pool_size, int timeout_ms, int keepalive_ms) {
+  auto &config = GetClientPoolConfig();
+  if (config.max_connections > 0) {
+    max_pool_size = std::min(max_pool_size, config.max_connections);
+  }
+  if (config.keepalive_ms > 0) {
+    keepalive_ms = std::min(keepalive_ms, config.keepalive_ms);
+  }
   _addr = addr;
   _port = port;
-  _min_pool_size = min_pool_size;
   _max_pool_size = max_pool_size;
   _timeout_ms = timeout_ms;
   _client_type = client_type;
   _keepalive_ms = keepalive_ms;
+  _metric = Metrics::Get().Client(client_type);
 
-  for (int i = 0; i < min_pool_size; ++i) {
-    TClient *client = new TClient(addr, port, keepalive_ms);
-    _pool.emplace_back(client);
+  _min_pool_size = std::min(std::max(min_pool_size, config.min_connections),
+                            max_pool_size);
+  _Fill();
+  if (config.health_check_interval_ms > 0) {
+    _health_check = true;
+    _health_thread = std::thread(&ClientPool::_HealthCheck, this,
+                                 config.health_check_interval_ms);
   }
-  _curr_pool_size = min_pool_size;
 }
 
 template<class TClient>
 ClientPool<TClient>::~ClientPool() {
+  {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _stopped = true;
+  }
+  _health_cv.notify_all();
+  if (_health_thread.joinable()) {
+    _health_thread.join();
+  }
   while (!_pool.empty()) {
     delete _pool.front();
     _pool.pop_front();
@@ -85,8 +157,8 @@ TClient * ClientPool<TClient>::Pop() {
       bool wait_success = _cv.wait_until(cv_lock, wait_time,
             [this] { return _pool.size() > 0 || _curr_pool_size < _max_pool_size; });
       if (!wait_success) {
-        LOG(warning) << "ClientPool pop timeout";
-        LOG(info) << _pool.size() << " " << _curr_pool_size;
+        LOG_RATE_LIMITED(warning) << "ClientPool pop timeout: "
+            << _client_type << " " << _pool.size() << " " << _curr_pool_size;
         cv_lock.unlock();
         return nullptr;
       }
@@ -103,10 +175,11 @@ TClient * ClientPool<TClient>::Pop() {
 
 
   if (client) {
+    client->_pop_time = std::chrono::steady_clock::now();
     try {
       client->Connect();
     } catch (...) {
-      LOG(error) << "Failed to connect " + _client_type;
+      LOG_RATE_LIMITED(error) << "Failed to connect " + _client_type;
       Remove(client);
       throw;
     }
@@ -124,6 +197,12 @@ void ClientPool<TClient>::Push(TClient *client) {
 
 template<class TClient>
 void ClientPool<TClient>::Remove(TClient *client) {
+  _metric->Record(MetricsElapsedUs(client->_pop_time), true);
+  _Delete(client);
+}
+
+template<class TClient>
+void ClientPool<TClient>::_Delete(TClient *client) {
   // No need to delete it from _pool because the *client has been poped out
   delete client;
   std::unique_lock<std::mutex> cv_lock(_mtx);
@@ -132,12 +211,92 @@ void ClientPool<TClient>::Remove(TClient *client) {
   _cv.notify_one();
 }
 
+// Connects new clients until the pool holds _min_pool_size. Stops at the first
+// failure, so that a downstream that is not up yet costs one connect timeout;
+// the health check retries on its next round.
+template<class TClient>
+void ClientPool<TClient>::_Fill() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(_mtx);
+      if (_stopped || _curr_pool_size >= _min_pool_size) {
+        return;
+      }
+      _curr_pool_size++;
+    }
+    TClient *client = _NewClient();
+    if (!client) {
+      _Delete(client);
+      return;
+    }
+    Push(client);
+  }
+}
+
+// Returns a connected client, or nullptr if it cannot connect.
+template<class TClient>
+TClient * ClientPool<TClient>::_NewClient() {
+  TClient *client = nullptr;
+  try {
+    client = new TClient(_addr, _port, _keepalive_ms);
+    client->Connect();
+  } catch (...) {
+    LOG_RATE_LIMITED(warning) << "Failed to pre-connect " << _client_type;
+    delete client;
+    return nullptr;
+  }
+  return client;
+}
+
+template<class TClient>
+void ClientPool<TClient>::_HealthCheck(int interval_ms) {
+  std::unique_lock<std::mutex> lock(_mtx);
+  while (!_health_cv.wait_for(lock, std::chrono::milliseconds(interval_ms),
+                              [this] { return _stopped; })) {
+    // One client at a time, so that Pop() still finds the others. Push()
+    // appends, so each idle client is seen once per round. A client is
+    // replaced in its slot, so that Pop() does not open one meanwhile.
+    int replaced = 0;
+    for (size_t n = _pool.size(); n > 0 && !_pool.empty(); --n) {
+      TClient *client = _pool.front();
+      _pool.pop_front();
+      lock.unlock();
+      long curr_timestamp =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count();
+      if (!client->IsConnected() ||
+          curr_timestamp - client->_connect_timestamp > client->_keepalive_ms) {
+        delete client;
+        client = _NewClient();
+        replaced++;
+      }
+      if (client) {
+        Push(client);
+      } else {
+        _Delete(client);
+      }
+      lock.lock();
+    }
+    lock.unlock();
+    if (replaced > 0) {
+      LOG(debug) << "Replacing " << replaced << " idle " << _client_type
+                 << " clients";
+    }
+    _Fill();
+    lock.lock();
+  }
+}
+
 template<class TClient>
 void ClientPool<TClient>::Keepalive(TClient *client) {
   long curr_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
           std::chrono::system_clock::now().time_since_epoch()).count();
-  if (curr_timestamp - client->_connect_timestamp > client->_keepalive_ms) {
-    Remove(client);
+  _metric->Record(MetricsElapsedUs(client->_pop_time), false);
+  // With a health check, an expired client is replaced by it instead, off
+  // the request path.
+  if (!_health_check &&
+      curr_timestamp - client->_connect_timestamp > client->_keepalive_ms) {
+    _Delete(client);
   } else {
     Push(client);
   }
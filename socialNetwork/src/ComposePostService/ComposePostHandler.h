@@ -6,13 +6,18 @@
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "../social_network_types.h"
 #include "../ClientPool.h"
+#include "../FanOut.h"
 #include "../HttpClientWrapper.h"
+#include "../MessageQueue.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../metrics.h"
+#include "../span_recorder.h"
+#include "../WorkQueue.h"
 
 namespace social_network {
 using json = nlohmann::json;
@@ -20,6 +25,20 @@ using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::system_clock;
 
+// Attempts at a queued home-timeline write before it is given up on, and the
+// wait before the first retry, doubled for each following one.
+static const int kMaxHomeTimelineAttempts = 3;
+static const int kHomeTimelineRetryDelayMs = 100;
+
+struct TimelineWriteMode {
+  enum type {
+    SERIAL = 0,
+    PARALLEL = 1,
+    ASYNC_HOME_TIMELINE = 2,
+    QUEUE_HOME_TIMELINE = 3
+  };
+};
+
 class ComposePostHandler {
  public:
   ComposePostHandler(ClientPool<HttpClientWrapper> *,
@@ -28,7 +47,11 @@ class ComposePostHandler {
                      ClientPool<HttpClientWrapper> *,
                      ClientPool<HttpClientWrapper> *,
                      ClientPool<HttpClientWrapper> *,
-                     ClientPool<HttpClientWrapper> *);
+                     ClientPool<HttpClientWrapper> *,
+                     int,
+                     TimelineWriteMode::type,
+                     WorkQueue *,
+                     MessagePublisher *);
   ~ComposePostHandler() = default;
 
   void ComposePost(int64_t req_id, const std::string &username, int64_t user_id,
@@ -47,31 +70,28 @@ class ComposePostHandler {
   ClientPool<HttpClientWrapper> *_media_service_client_pool;
   ClientPool<HttpClientWrapper> *_text_service_client_pool;
   ClientPool<HttpClientWrapper> *_home_timeline_client_pool;
+  int _fan_out_timeout_ms;
+  TimelineWriteMode::type _timeline_write_mode;
+  WorkQueue *_home_timeline_queue;
+  MessagePublisher *_home_timeline_channel;
+  // Queued home-timeline writes given up on after kMaxHomeTimelineAttempts.
+  std::atomic<int64_t> *_home_timeline_failures;
 
   void _UploadUserTimelineHelper(
-      int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
-      const std::map<std::string, std::string> &carrier);
+      FanOut &fan_out, int64_t req_id, int64_t post_id, int64_t user_id,
+      int64_t timestamp, const std::map<std::string, std::string> &carrier);
 
   void _UploadPostHelper(int64_t req_id, const Post &post,
                          const std::map<std::string, std::string> &carrier);
 
   void _UploadHomeTimelineHelper(
-      int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
-      const std::vector<int64_t> &user_mentions_id,
+      FanOut &fan_out, int64_t req_id, int64_t post_id, int64_t user_id,
+      int64_t timestamp, const std::vector<int64_t> &user_mentions_id,
       const std::map<std::string, std::string> &carrier);
 
-  Creator _ComposeCreaterHelper(
-      int64_t req_id, int64_t user_id, const std::string &username,
-      const std::map<std::string, std::string> &carrier);
-  TextServiceReturn _ComposeTextHelper(
-      int64_t req_id, const std::string &text,
-      const std::map<std::string, std::string> &carrier);
-  std::vector<Media> _ComposeMediaHelper(
-      int64_t req_id, const std::vector<std::string> &media_types,
-      const std::vector<int64_t> &media_ids,
-      const std::map<std::string, std::string> &carrier);
-  int64_t _ComposeUniqueIdHelper(
-      int64_t req_id, PostType::type post_type,
+  void _WriteHomeTimeline(
+      int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
+      const std::vector<int64_t> &user_mentions_id,
       const std::map<std::string, std::string> &carrier);
 };
 
@@ -86,7 +106,11 @@ ComposePostHandler::ComposePostHandler(
     ClientPool<HttpClientWrapper> *media_service_client_pool,
     ClientPool<HttpClientWrapper> *text_service_client_pool,
     ClientPool<HttpClientWrapper>
-        *home_timeline_client_pool) {
+        *home_timeline_client_pool,
+    int fan_out_timeout_ms,
+    TimelineWriteMode::type timeline_write_mode,
+    WorkQueue *home_timeline_queue,
+    MessagePublisher *home_timeline_channel) {
   _post_storage_client_pool = post_storage_client_pool;
   _user_timeline_client_pool = user_timeline_client_pool;
   _user_service_client_pool = user_service_client_pool;
@@ -94,200 +118,25 @@ ComposePostHandler::ComposePostHandler(
   _media_service_client_pool = media_service_client_pool;
   _text_service_client_pool = text_service_client_pool;
   _home_timeline_client_pool = home_timeline_client_pool;
-}
-
-Creator ComposePostHandler::_ComposeCreaterHelper(
-    int64_t req_id, int64_t user_id, const std::string &username,
-    const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "compose_creator_client", {opentracing::ChildOf(parent_span->get())});
-  std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto user_client = _user_service_client_pool->Pop();
-  if (!user_client) {
-    LOG(error) << "Failed to connect to user-service";
-    // span->Finish();
-    throw std::runtime_error("Failed to connect to user-service");
-  }
-
-  Creator _return_creator;
-  try {
-    nlohmann::json req_json = {
-      {"req_id", req_id},
-      {"user_id", user_id},
-      {"username", username},
-      {"carrier", writer_text_map}
-    };
-
-    auto res = user_client->PostJson("/ComposeCreatorWithUserId", req_json);
-    _return_creator.user_id = res["user_id"];
-    _return_creator.username = res["username"];
-  } catch (...) {
-    LOG(error) << "Failed to send compose-creator to user-service";
-    _user_service_client_pool->Remove(user_client);
-    // span->Finish();
-    throw;
-  }
-  _user_service_client_pool->Keepalive(user_client);
-  // span->Finish();
-  return _return_creator;
-}
-
-TextServiceReturn ComposePostHandler::_ComposeTextHelper(
-    int64_t req_id, const std::string &text,
-    const std::map<std::string, std::string> &carrier) {
-  // TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "compose_text_client", {opentracing::ChildOf(parent_span->get())});
-  std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto text_client = _text_service_client_pool->Pop();
-  if (!text_client) {
-    LOG(error) << "Failed to connect to text-service";
-    // span->Finish();
-    throw std::runtime_error("Failed to connect to text-service");
-  }
-
-  TextServiceReturn _return_text;
-  try {
-    nlohmann::json req_json = {
-      {"req_id", req_id},
-      {"text", text},
-      {"carrier", writer_text_map}
-    };
-
-    auto res = text_client->PostJson("/ComposeText", req_json);
-    _return_text.text = res["text"];
-    for (auto &item : res["user_mentions"]) {
-      UserMention user_mention;
-      user_mention.user_id = item["user_id"];
-      user_mention.username = item["username"];
-      _return_text.user_mentions.emplace_back(user_mention);
-    }
-    for (auto &item : res["urls"]) {
-      Url url;
-      url.shortened_url = item["shortened_url"];
-      url.expanded_url = item["expanded_url"];
-      _return_text.urls.emplace_back(url);
-    }
-  } catch (...) {
-    LOG(error) << "Failed to send compose-text to text-service";
-    _text_service_client_pool->Remove(text_client);
-    // span->Finish();
-    throw;
-  }
-  _text_service_client_pool->Keepalive(text_client);
-  // span->Finish();
-  return _return_text;
-}
-
-std::vector<Media> ComposePostHandler::_ComposeMediaHelper(
-    int64_t req_id, const std::vector<std::string> &media_types,
-    const std::vector<int64_t> &media_ids,
-    const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "compose_media_client", {opentracing::ChildOf(parent_span->get())});
-  std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto media_client = _media_service_client_pool->Pop();
-  if (!media_client) {
-    LOG(error) << "Failed to connect to media-service";
-    // span->Finish();
-    throw std::runtime_error("Failed to connect to media-service");
-  }
-
-  std::vector<Media> _return_media;
-  try {
-    nlohmann::json req_json = {
-      {"req_id", req_id},
-      {"media_types", media_types},
-      {"media_ids", media_ids},
-      {"carrier", writer_text_map}
-    };
-
-    auto res = media_client->PostJson("/ComposeMedia", req_json);
-    for (auto &item : res["media"]) {
-      Media media;
-      media.media_id = item["media_id"];
-      media.media_type = item["media_type"];
-      _return_media.emplace_back(media);
-    }
-  } catch (...) {
-    LOG(error) << "Failed to send compose-media to media-service";
-    _media_service_client_pool->Remove(media_client);
-    // span->Finish();
-    throw;
-  }
-  _media_service_client_pool->Keepalive(media_client);
-  // span->Finish();
-  return _return_media;
-}
-
-int64_t ComposePostHandler::_ComposeUniqueIdHelper(
-    int64_t req_id, const PostType::type post_type,
-    const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "compose_unique_id_client", {opentracing::ChildOf(parent_span->get())});
-  std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto unique_id_client = _unique_id_service_client_pool->Pop();
-  if (!unique_id_client) {
-    LOG(error) << "Failed to connect to unique_id-service";
-    // span->Finish();
-    throw std::runtime_error("Failed to connect to unique_id-service");
-  }
-
-  int64_t _return_unique_id;
-  try {
-    nlohmann::json req_json = {
-      {"req_id", req_id},
-      {"post_type", static_cast<int>(post_type)},
-      {"carrier", writer_text_map}
-    };
-
-    auto res = unique_id_client->PostJson("/ComposeUniqueId", req_json);
-    _return_unique_id = res["unique_id"];
-  } catch (...) {
-    LOG(error) << "Failed to send compose-unique_id to unique_id-service";
-    _unique_id_service_client_pool->Remove(unique_id_client);
-    // span->Finish();
-    throw;
-  }
-  _unique_id_service_client_pool->Keepalive(unique_id_client);
-  // span->Finish();
-  return _return_unique_id;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
+  _timeline_write_mode = timeline_write_mode;
+  _home_timeline_queue = home_timeline_queue;
+  _home_timeline_channel = home_timeline_channel;
+  _home_timeline_failures =
+      Metrics::Get().Counter("home_timeline_write_failures_total");
 }
 
 void ComposePostHandler::_UploadPostHelper(
     int64_t req_id, const Post &post,
     const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "store_post_client", {opentracing::ChildOf(parent_span->get())});
+  auto span = StartSpan("store_post_client", carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  span.Inject(&writer_text_map);
 
   auto post_storage_client = _post_storage_client_pool->Pop();
   if (!post_storage_client) {
     LOG(error) << "Failed to connect to post-storage-service";
-    // span->Finish();
+    span.Finish();
     throw std::runtime_error("Failed to connect to post-storage-service");
   }
   try {
@@ -316,80 +165,59 @@ void ComposePostHandler::_UploadPostHelper(
   }
   _post_storage_client_pool->Keepalive(post_storage_client);
 
-  // span->Finish();
+  span.Finish();
 }
 
 void ComposePostHandler::_UploadUserTimelineHelper(
-    int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
-    const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "write_user_timeline_client", {opentracing::ChildOf(parent_span->get())});
+    FanOut &fan_out, int64_t req_id, int64_t post_id, int64_t user_id,
+    int64_t timestamp, const std::map<std::string, std::string> &carrier) {
+  auto span = StartSpan("write_user_timeline_client", carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto user_timeline_client = _user_timeline_client_pool->Pop();
-  if (!user_timeline_client) {
-    LOG(error) << "Failed to connect to user-timeline-service";
-    // span->Finish();
-    throw std::runtime_error("Failed to connect to user-timeline-service");
-  }
-  try {
-    nlohmann::json req_json = {
-      {"req_id", req_id},
-      {"post_id", post_id},
-      {"user_id", user_id},
-      {"timestamp", timestamp},
-      {"carrier", writer_text_map}
-    };
-    user_timeline_client->PostJson("/WriteUserTimeline", req_json);
-  } catch (...) {
-    _user_timeline_client_pool->Remove(user_timeline_client);
-    throw;
-  }
-  _user_timeline_client_pool->Keepalive(user_timeline_client);
-
-  // span->Finish();
+  span.Inject(&writer_text_map);
+
+  nlohmann::json req_json = {
+    {"req_id", req_id},
+    {"post_id", post_id},
+    {"user_id", user_id},
+    {"timestamp", timestamp},
+    {"carrier", writer_text_map}
+  };
+  fan_out.PostJson(_user_timeline_client_pool, "user-timeline-service",
+                   "/WriteUserTimeline", req_json, [](json &) {});
+
+  span.Finish();
 }
 
 void ComposePostHandler::_UploadHomeTimelineHelper(
-    int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
-    const std::vector<int64_t> &user_mentions_id,
+    FanOut &fan_out, int64_t req_id, int64_t post_id, int64_t user_id,
+    int64_t timestamp, const std::vector<int64_t> &user_mentions_id,
     const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "write_home_timeline_client", {opentracing::ChildOf(parent_span->get())});
+  auto span = StartSpan("write_home_timeline_client", carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto home_timeline_client = _home_timeline_client_pool->Pop();
-  if (!home_timeline_client) {
-    LOG(error) << "Failed to connect to home-timeline-service";
-    // span->Finish();
-    throw std::runtime_error("Failed to connect to home-timeline-service");
-  }
-  try {
-    nlohmann::json req_json = {
-      {"req_id", req_id},
-      {"post_id", post_id},
-      {"user_id", user_id},
-      {"timestamp", timestamp},
-      {"user_mentions_id", user_mentions_id},
-      {"carrier", writer_text_map}
-    };
-    home_timeline_client->PostJson("/WriteHomeTimeline", req_json);
-  } catch (...) {
-    _home_timeline_client_pool->Remove(home_timeline_client);
-    LOG(error) << "Failed to write home timeline to home-timeline-service";
-    throw;
-  }
-  _home_timeline_client_pool->Keepalive(home_timeline_client);
+  span.Inject(&writer_text_map);
+
+  nlohmann::json req_json = {
+    {"req_id", req_id},
+    {"post_id", post_id},
+    {"user_id", user_id},
+    {"timestamp", timestamp},
+    {"user_mentions_id", user_mentions_id},
+    {"carrier", writer_text_map}
+  };
+  fan_out.PostJson(_home_timeline_client_pool, "home-timeline-service",
+                   "/WriteHomeTimeline", req_json, [](json &) {});
+
+  span.Finish();
+}
 
-  // span->Finish();
+void ComposePostHandler::_WriteHomeTimeline(
+    int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
+    const std::vector<int64_t> &user_mentions_id,
+    const std::map<std::string, std::string> &carrier) {
+  FanOut home_timeline_fan_out(_fan_out_timeout_ms);
+  _UploadHomeTimelineHelper(home_timeline_fan_out, req_id, post_id, user_id,
+                            timestamp, user_mentions_id, carrier);
+  home_timeline_fan_out.Wait();
 }
 
 void ComposePostHandler::ComposePost(
@@ -397,81 +225,172 @@ void ComposePostHandler::ComposePost(
     const std::string &text, const std::vector<int64_t> &media_ids,
     const std::vector<std::string> &media_types, const PostType::type post_type,
     const std::map<std::string, std::string> &carrier) {
-  TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-      // "compose_post_server", {opentracing::ChildOf(parent_span->get())});
+  auto span = StartSpan("compose_post_server", carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  auto text_future =
-      std::async(std::launch::async, &ComposePostHandler::_ComposeTextHelper,
-                 this, req_id, text, writer_text_map);
-  auto creator_future =
-      std::async(std::launch::async, &ComposePostHandler::_ComposeCreaterHelper,
-                 this, req_id, user_id, username, writer_text_map);
-  auto media_future =
-      std::async(std::launch::async, &ComposePostHandler::_ComposeMediaHelper,
-                 this, req_id, media_types, media_ids, writer_text_map);
-  auto unique_id_future = std::async(
-      std::launch::async, &ComposePostHandler::_ComposeUniqueIdHelper, this,
-      req_id, post_type, writer_text_map);
+  span.Inject(&writer_text_map);
 
   Post post;
   auto timestamp =
       duration_cast<milliseconds>(system_clock::now().time_since_epoch())
           .count();
   post.timestamp = timestamp;
-
-  // try
-  // {
-  post.post_id = unique_id_future.get();
-  post.creator = creator_future.get();
-  post.media = media_future.get();
-  auto text_return = text_future.get();
-  post.text = text_return.text;
-  post.urls = text_return.urls;
-  post.user_mentions = text_return.user_mentions;
   post.req_id = req_id;
   post.post_type = post_type;
-  // }
-  // catch (...)
-  // {
-  //   throw;
-  // }
+
+  // Text, creator, media and unique-id are independent, so their requests
+  // are in flight at once and completed on this thread by the FanOut.
+  FanOut compose_fan_out(_fan_out_timeout_ms);
+  compose_fan_out.PostJson(
+      _text_service_client_pool, "text-service", "/ComposeText",
+      {{"req_id", req_id}, {"text", text}, {"carrier", writer_text_map}},
+      [&post](json &res) {
+        post.text = res["text"];
+        for (auto &item : res["user_mentions"]) {
+          UserMention user_mention;
+          user_mention.user_id = item["user_id"];
+          user_mention.username = item["username"];
+          post.user_mentions.emplace_back(user_mention);
+        }
+        for (auto &item : res["urls"]) {
+          Url url;
+          url.shortened_url = item["shortened_url"];
+          url.expanded_url = item["expanded_url"];
+          post.urls.emplace_back(url);
+        }
+      });
+  // The creator is only the caller's user_id and username, so it is built
+  // here whenever both are known; user-service is asked only otherwise.
+  if (!username.empty()) {
+    post.creator.user_id = user_id;
+    post.creator.username = username;
+  } else {
+    compose_fan_out.PostJson(
+        _user_service_client_pool, "user-service", "/ComposeCreatorWithUserId",
+        {{"req_id", req_id},
+         {"user_id", user_id},
+         {"username", username},
+         {"carrier", writer_text_map}},
+        [&post](json &res) {
+          post.creator.user_id = res["user_id"];
+          post.creator.username = res["username"];
+        });
+  }
+  compose_fan_out.PostJson(
+      _media_service_client_pool, "media-service", "/ComposeMedia",
+      {{"req_id", req_id},
+       {"media_types", media_types},
+       {"media_ids", media_ids},
+       {"carrier", writer_text_map}},
+      [&post](json &res) {
+        for (auto &item : res["media"]) {
+          Media media;
+          media.media_id = item["media_id"];
+          media.media_type = item["media_type"];
+          post.media.emplace_back(media);
+        }
+      });
+  compose_fan_out.PostJson(
+      _unique_id_service_client_pool, "unique-id-service", "/ComposeUniqueId",
+      {{"req_id", req_id},
+       {"post_type", static_cast<int>(post_type)},
+       {"carrier", writer_text_map}},
+      [&post](json &res) { post.post_id = res["unique_id"]; });
+  compose_fan_out.Wait();
 
   std::vector<int64_t> user_mention_ids;
   for (auto &item : post.user_mentions) {
     user_mention_ids.emplace_back(item.user_id);
   }
 
-  //In mixed workloed condition, need to make sure _UploadPostHelper execute
-  //Before _UploadUserTimelineHelper and _UploadHomeTimelineHelper.
-  //Change _UploadUserTimelineHelper and _UploadHomeTimelineHelper to deferred.
-  //To let them start execute after post_future.get() return.
-  auto post_future =
-      std::async(std::launch::async, &ComposePostHandler::_UploadPostHelper,
-                 this, req_id, post, writer_text_map);
-  auto user_timeline_future = std::async(
-      std::launch::deferred, &ComposePostHandler::_UploadUserTimelineHelper, this,
-      req_id, post.post_id, user_id, timestamp, writer_text_map);
-  auto home_timeline_future = std::async(
-      std::launch::deferred, &ComposePostHandler::_UploadHomeTimelineHelper, this,
-      req_id, post.post_id, user_id, timestamp, user_mention_ids,
-      writer_text_map);
-
-  // try
-  // {
-  post_future.get();
-  user_timeline_future.get();
-  home_timeline_future.get();
-  // }
-  // catch (...)
-  // {
-  //   throw;
-  // }
-  // span->Finish();
+  // In mixed workload condition, _UploadPostHelper has to finish before
+  // the timeline writes are issued, so that a timeline never references a
+  // post that can't be read back yet.
+  _UploadPostHelper(req_id, post, writer_text_map);
+
+  switch (_timeline_write_mode) {
+    case TimelineWriteMode::SERIAL: {
+      FanOut user_timeline_fan_out(_fan_out_timeout_ms);
+      _UploadUserTimelineHelper(user_timeline_fan_out, req_id, post.post_id,
+                                user_id, timestamp, writer_text_map);
+      user_timeline_fan_out.Wait();
+      _WriteHomeTimeline(req_id, post.post_id, user_id, timestamp,
+                         user_mention_ids, writer_text_map);
+      break;
+    }
+    case TimelineWriteMode::PARALLEL: {
+      FanOut timeline_fan_out(_fan_out_timeout_ms);
+      _UploadUserTimelineHelper(timeline_fan_out, req_id, post.post_id,
+                                user_id, timestamp, writer_text_map);
+      _UploadHomeTimelineHelper(timeline_fan_out, req_id, post.post_id,
+                                user_id, timestamp, user_mention_ids,
+                                writer_text_map);
+      timeline_fan_out.Wait();
+      break;
+    }
+    case TimelineWriteMode::ASYNC_HOME_TIMELINE: {
+      FanOut user_timeline_fan_out(_fan_out_timeout_ms);
+      _UploadUserTimelineHelper(user_timeline_fan_out, req_id, post.post_id,
+                                user_id, timestamp, writer_text_map);
+      user_timeline_fan_out.Wait();
+
+      // Keyed by author, so one author's home-timeline writes are applied in
+      // the order their posts were acknowledged. A full queue holds the
+      // compose until the author's worker has room. Writing inline instead
+      // could overtake the author's queued writes.
+      // A failed write is retried on the same worker, which holds back the
+      // author's later writes and so keeps them in order.
+      int64_t post_id = post.post_id;
+      bool queued = _home_timeline_queue->Submit(
+          user_id, [this, req_id, post_id, user_id, timestamp,
+                    user_mention_ids, writer_text_map]() {
+            int delay_ms = kHomeTimelineRetryDelayMs;
+            for (int attempt = 1;; ++attempt) {
+              try {
+                _WriteHomeTimeline(req_id, post_id, user_id, timestamp,
+                                   user_mention_ids, writer_text_map);
+                return;
+              } catch (const std::exception &e) {
+                if (attempt == kMaxHomeTimelineAttempts) {
+                  _home_timeline_failures->fetch_add(
+                      1, std::memory_order_relaxed);
+                  LOG_RATE_LIMITED(error)
+                      << "Dropped home-timeline write of post " << post_id
+                      << " after " << attempt << " attempts: " << e.what();
+                  return;
+                }
+              }
+              std::this_thread::sleep_for(milliseconds(delay_ms));
+              delay_ms *= 2;
+            }
+          }, _fan_out_timeout_ms);
+      if (!queued) {
+        LOG_RATE_LIMITED(error) << "Home-timeline queue is full";
+        throw std::runtime_error("Home-timeline queue is full");
+      }
+      break;
+    }
+    case TimelineWriteMode::QUEUE_HOME_TIMELINE: {
+      FanOut user_timeline_fan_out(_fan_out_timeout_ms);
+      _UploadUserTimelineHelper(user_timeline_fan_out, req_id, post.post_id,
+                                user_id, timestamp, writer_text_map);
+      user_timeline_fan_out.Wait();
+
+      // The follower lookup and the Redis updates happen in
+      // write-home-timeline-service, so the cost of this compose no longer
+      // depends on how many followers the author has.
+      json msg_json = {
+        {"req_id", req_id},
+        {"post_id", post.post_id},
+        {"user_id", user_id},
+        {"timestamp", timestamp},
+        {"user_mentions_id", user_mention_ids},
+        {"carrier", writer_text_map}
+      };
+      _home_timeline_channel->Publish(msg_json.dump());
+      break;
+    }
+  }
+  span.Finish();
 }
 
 }  // namespace social_network
@@ -2,9 +2,12 @@
 // #include "./httplib.h"
 
 #include "../utils.h"
+#include "../metrics.h"
 #include "ComposePostHandler.h"
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
+#include "../MessageQueue.h"
+#include "RabbitmqClient.h"
 
 using namespace social_network;
 
@@ -13,13 +16,13 @@ void sigintHandler(int sig) { exit(EXIT_SUCCESS); }
 int main(int argc, char *argv[]) {
     signal(SIGINT, sigintHandler);
     init_logger();
-    // TODO: should I enable tracing?
-    // SetUpTracer("config/jaeger-config.yml", "compose-post-service");
 
     json config_json;
     if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
     }
+    SetUpSpanRecorder(config_json, "compose-post-service");
+    SetUpClientPools(config_json);
 
     int port = config_json["compose-post-service"]["port"];
 
@@ -115,6 +118,56 @@ int main(int argc, char *argv[]) {
 //       "unique-id-service-client", unique_id_addr, unique_id_port, 0,
 //       unique_id_conns, unique_id_timeout, unique_id_keepalive, config_json);
 
+    std::string timeline_write_mode_str =
+        config_json["compose-post-service"]["timeline_write_mode"];
+    TimelineWriteMode::type timeline_write_mode;
+    if (timeline_write_mode_str == "serial") {
+      timeline_write_mode = TimelineWriteMode::SERIAL;
+    } else if (timeline_write_mode_str == "parallel") {
+      timeline_write_mode = TimelineWriteMode::PARALLEL;
+    } else if (timeline_write_mode_str == "async") {
+      timeline_write_mode = TimelineWriteMode::ASYNC_HOME_TIMELINE;
+    } else if (timeline_write_mode_str == "queue") {
+      timeline_write_mode = TimelineWriteMode::QUEUE_HOME_TIMELINE;
+    } else {
+      LOG(error) << "Unknown timeline_write_mode " << timeline_write_mode_str;
+      exit(EXIT_FAILURE);
+    }
+
+    std::unique_ptr<WorkQueue> home_timeline_queue;
+    if (timeline_write_mode == TimelineWriteMode::ASYNC_HOME_TIMELINE) {
+      home_timeline_queue = std::make_unique<WorkQueue>(
+          config_json["compose-post-service"]["home_timeline_workers"],
+          config_json["compose-post-service"]["home_timeline_queue_size"]);
+    }
+
+    // The queue mode publishes home-timeline writes to the channel that
+    // write-home-timeline-service consumes.
+    std::unique_ptr<ClientPool<RabbitmqClient>> rabbitmq_client_pool;
+    std::unique_ptr<MessagePublisher> home_timeline_channel;
+    if (timeline_write_mode == TimelineWriteMode::QUEUE_HOME_TIMELINE) {
+      std::string channel =
+          config_json["write-home-timeline-service"]["channel"];
+      if (channel == "rabbitmq") {
+        rabbitmq_client_pool = std::make_unique<ClientPool<RabbitmqClient>>(
+            "write-home-timeline-rabbitmq",
+            config_json["write-home-timeline-rabbitmq"]["addr"],
+            config_json["write-home-timeline-rabbitmq"]["port"],
+            0,
+            config_json["write-home-timeline-rabbitmq"]["connections"],
+            config_json["write-home-timeline-rabbitmq"]["timeout_ms"],
+            config_json["write-home-timeline-rabbitmq"]["keepalive_ms"]);
+        home_timeline_channel = std::make_unique<RabbitmqMessageQueue>(
+            rabbitmq_client_pool.get());
+      } else if (channel == "file") {
+        home_timeline_channel = std::make_unique<FileMessageQueue>(
+            config_json["write-home-timeline-service"]["queue_path"]);
+      } else {
+        LOG(error) << "Unknown write-home-timeline channel " << channel;
+        exit(EXIT_FAILURE);
+      }
+    }
+
     ComposePostHandler handler(
         &post_storage_client_pool,
         &user_timeline_client_pool,
@@ -122,10 +175,15 @@ int main(int argc, char *argv[]) {
         &unique_id_client_pool,
         &media_client_pool,
         &text_client_pool,
-        &home_timeline_client_pool
+        &home_timeline_client_pool,
+        config_json["compose-post-service"]["timeout_ms"],
+        timeline_write_mode,
+        home_timeline_queue.get(),
+        home_timeline_channel.get()
     );
 
     httplib::Server server;
+    SetUpServerMetrics(&server, "compose-post-service");
 
     server.Post("/ComposePost", [&](const httplib::Request& req, httplib::Response& res) {
         try {
@@ -3,13 +3,19 @@
 
 #include <SimpleAmqpClient/SimpleAmqpClient.h>
 
+#include <chrono>
+#include <stdexcept>
+
+#include "../ClientPool.h"
 #include "../GenericClient.h"
+#include "../MessageQueue.h"
 
 namespace social_network {
 
 class RabbitmqClient : public GenericClient {
  public:
   RabbitmqClient(const std::string &addr, int port);
+  RabbitmqClient(const std::string &addr, int port, int keepalive_ms);
   RabbitmqClient(const RabbitmqClient &) = delete;
   RabbitmqClient &operator=(const RabbitmqClient &) = delete;
   RabbitmqClient(RabbitmqClient &&) = default;
@@ -19,15 +25,11 @@ class RabbitmqClient : public GenericClient {
 
   void Connect() override;
   void Disconnect() override;
-  void KeepAlive() override;
-  void KeepAlive(int timeout_ms) override;
   bool IsConnected() override;
 
   AmqpClient::Channel::ptr_t GetChannel();
 
  private:
-  std::string _addr;
-  int _port;
   AmqpClient::Channel::ptr_t _channel;
   bool _is_connected;
 };
@@ -37,6 +39,16 @@ RabbitmqClient::RabbitmqClient(const std::string &addr, int port) {
   _port = port;
   _channel = AmqpClient::Channel::Create(addr, port);
   _is_connected = false;
+  _connect_timestamp = 0;
+  _keepalive_ms = 0;
+}
+
+RabbitmqClient::RabbitmqClient(const std::string &addr, int port,
+                               int keepalive_ms)
+    : RabbitmqClient(addr, port) {
+  _connect_timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  _keepalive_ms = keepalive_ms;
 }
 
 RabbitmqClient::~RabbitmqClient() { Disconnect(); }
@@ -53,24 +65,49 @@ void RabbitmqClient::Connect() {
 }
 
 void RabbitmqClient::Disconnect() {
-  if (IsConnected()) {
-    try {
-      _channel->DeleteQueue("write-home-timeline");
-      _is_connected = false;
-    } catch (...) {
-      throw;
-    }
-  }
+  // The queue is shared with the consumers in write-home-timeline-service,
+  // so closing a publisher must not delete it.
+  _is_connected = false;
 }
 
-void RabbitmqClient::KeepAlive() {}
-
-void RabbitmqClient::KeepAlive(int timeout_ms) {}
-
 bool RabbitmqClient::IsConnected() { return _is_connected; }
 
 AmqpClient::Channel::ptr_t RabbitmqClient::GetChannel() { return _channel; }
 
+// Publishes to the durable "write-home-timeline" queue that
+// write-home-timeline-service consumes through AMQP-CPP (see
+// AmqpLibeventHandler.h), so only the producer side is implemented here.
+class RabbitmqMessageQueue : public MessagePublisher {
+ public:
+  explicit RabbitmqMessageQueue(ClientPool<RabbitmqClient> *client_pool)
+      : _client_pool(client_pool) {}
+
+  void Publish(const std::string &message) override;
+
+ private:
+  ClientPool<RabbitmqClient> *_client_pool;
+};
+
+void RabbitmqMessageQueue::Publish(const std::string &message) {
+  auto rabbitmq_client = _client_pool->Pop();
+  if (!rabbitmq_client) {
+    LOG(error) << "Failed to connect to write-home-timeline-rabbitmq";
+    throw std::runtime_error(
+        "Failed to connect to write-home-timeline-rabbitmq");
+  }
+  try {
+    auto msg = AmqpClient::BasicMessage::Create(message);
+    msg->DeliveryMode(AmqpClient::BasicMessage::dm_persistent);
+    rabbitmq_client->GetChannel()->BasicPublish("", "write-home-timeline",
+                                                msg);
+  } catch (...) {
+    LOG(error) << "Failed to publish to write-home-timeline-rabbitmq";
+    _client_pool->Remove(rabbitmq_client);
+    throw;
+  }
+  _client_pool->Keepalive(rabbitmq_client);
+}
+
 }  // namespace social_network
 
 #endif  // SOCIAL_NETWORK_MICROSERVICES_SRC_COMPOSEPOSTSERVICE_RABBITMQCLIENT_H_
@@ -0,0 +1,202 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_FANOUT_H
+#define SOCIAL_NETWORK_MICROSERVICES_FANOUT_H
+
+#include <poll.h>
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "ClientPool.h"
+#include "HttpClientWrapper.h"
+#include "logger.h"
+#include "metrics.h"
+
+namespace social_network {
+using json = nlohmann::json;
+
+// Drives several outstanding downstream calls from the calling thread.
+//
+// Each call is issued immediately by Add*() and completed by Wait(), which
+// polls the connections and runs each completion callback as soon as its
+// reply is readable. Completion callbacks may issue further calls on the same
+// FanOut, so a dependent hop can be chained without blocking on the first
+// one. No extra threads are used, which replaces the std::async
+// thread-per-call pattern in the handlers.
+class FanOut {
+ public:
+  explicit FanOut(int timeout_ms) : _timeout_ms(timeout_ms) {}
+  ~FanOut();
+
+  FanOut(const FanOut &) = delete;
+  FanOut &operator=(const FanOut &) = delete;
+
+  // Registers an already-sent call. on_ready is invoked once fd is readable;
+  // it must consume the reply and hand the connection back to its pool.
+  // on_abort releases the connection if the call is abandoned instead.
+  void Add(int fd, std::function<void()> on_ready,
+           std::function<void()> on_abort);
+
+  // Sends path/req_json on a client from pool and calls on_reply with the
+  // parsed response from within Wait(). Like HttpClientWrapper::PostJson, a
+  // request whose connection the server had closed is sent once more.
+  void PostJson(ClientPool<HttpClientWrapper> *pool,
+                const std::string &service_name, const std::string &path,
+                const json &req_json, std::function<void(json &)> on_reply) {
+    _PostJson(pool, service_name, path, req_json, std::move(on_reply), true);
+  }
+
+  // Completes all outstanding calls, including the ones added by callbacks.
+  // Rethrows the first failure after every other call has been drained.
+  void Wait();
+
+ private:
+  struct Pending {
+    int fd;
+    std::function<void()> on_ready;
+    std::function<void()> on_abort;
+  };
+
+  void _PostJson(ClientPool<HttpClientWrapper> *pool,
+                 const std::string &service_name, const std::string &path,
+                 const json &req_json, std::function<void(json &)> on_reply,
+                 bool retry);
+
+  std::vector<Pending> _pending;
+  int _timeout_ms;
+};
+
+FanOut::~FanOut() {
+  for (auto &pending : _pending) {
+    pending.on_abort();
+  }
+}
+
+void FanOut::Add(int fd, std::function<void()> on_ready,
+                 std::function<void()> on_abort) {
+  _pending.emplace_back(Pending{fd, std::move(on_ready), std::move(on_abort)});
+}
+
+void FanOut::_PostJson(ClientPool<HttpClientWrapper> *pool,
+                       const std::string &service_name,
+                       const std::string &path, const json &req_json,
+                       std::function<void(json &)> on_reply, bool retry) {
+  auto client = pool->Pop();
+  if (!client) {
+    LOG(error) << "Failed to connect to " << service_name;
+    throw std::runtime_error("Failed to connect to " + service_name);
+  }
+  try {
+    client->SendPostJson(path, req_json);
+  } catch (...) {
+    bool reply_lost = client->ReplyLost();
+    pool->Remove(client);
+    if (retry && reply_lost) {
+      _PostJson(pool, service_name, path, req_json, std::move(on_reply),
+                false);
+      return;
+    }
+    LOG(error) << "Failed to send " << path << " to " << service_name;
+    throw;
+  }
+  Add(client->GetAsyncFd(),
+      [this, pool, client, service_name, path, req_json, on_reply, retry]() {
+        json res;
+        try {
+          res = client->RecvJson();
+        } catch (...) {
+          bool reply_lost = client->ReplyLost();
+          pool->Remove(client);
+          if (retry && reply_lost) {
+            _PostJson(pool, service_name, path, req_json, on_reply, false);
+            return;
+          }
+          LOG(error) << "Failed to receive " << path << " from "
+                     << service_name;
+          throw;
+        }
+        pool->Keepalive(client);
+        on_reply(res);
+      },
+      [pool, client]() { pool->Remove(client); });
+}
+
+void FanOut::Wait() {
+  std::exception_ptr eptr;
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(_timeout_ms);
+  std::vector<struct pollfd> pfds;
+
+  while (!_pending.empty()) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      for (auto &pending : _pending) {
+        pending.on_abort();
+      }
+      _pending.clear();
+      if (!eptr) {
+        eptr = std::make_exception_ptr(
+            std::runtime_error("FanOut timed out waiting for replies"));
+      }
+      break;
+    }
+
+    pfds.clear();
+    for (auto &pending : _pending) {
+      pfds.push_back({pending.fd, POLLIN, 0});
+    }
+    int n;
+    {
+      ScopedTiming timing(TimingStage::DOWNSTREAM);
+      n = ::poll(pfds.data(), pfds.size(), static_cast<int>(remaining));
+    }
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      for (auto &pending : _pending) {
+        pending.on_abort();
+      }
+      _pending.clear();
+      if (!eptr) {
+        eptr = std::make_exception_ptr(std::runtime_error("FanOut poll failed"));
+      }
+      break;
+    }
+
+    // Detach the ready calls first: their callbacks may Add() new ones.
+    std::vector<Pending> ready;
+    std::vector<Pending> waiting;
+    for (size_t i = 0; i < pfds.size(); ++i) {
+      if (pfds[i].revents) {
+        ready.emplace_back(std::move(_pending[i]));
+      } else {
+        waiting.emplace_back(std::move(_pending[i]));
+      }
+    }
+    _pending = std::move(waiting);
+
+    for (auto &pending : ready) {
+      try {
+        pending.on_ready();
+      } catch (...) {
+        if (!eptr) {
+          eptr = std::current_exception();
+        }
+      }
+    }
+  }
+
+  if (eptr) {
+    std::rethrow_exception(eptr);
+  }
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_FANOUT_H
@@ -15,6 +15,8 @@ class GenericClient{
 
   long _connect_timestamp;
   long _keepalive_ms;
+  // Set by ClientPool::Pop() for its client-side latency.
+  std::chrono::steady_clock::time_point _pop_time;
 
  protected:
   std::string _addr;
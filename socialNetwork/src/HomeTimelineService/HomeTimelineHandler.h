@@ -11,7 +11,7 @@
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
 #include "../social_network_types.h"
 
 using namespace sw::redis;
@@ -99,22 +99,17 @@ void HomeTimelineHandler::WriteHomeTimeline(
     const std::vector<int64_t> &user_mentions_id,
     const std::map<std::string, std::string> &carrier) {
   // Initialize a span
-  // TextMapReader reader(carrier);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "write_home_timeline_server", {opentracing::ChildOf(parent_span->get())});
+  auto span = StartSpan("write_home_timeline_server", carrier);
 
   // Find followers of the user
-  // auto followers_span = opentracing::Tracer::Global()->StartSpan(
-  //     "get_followers_client", {opentracing::ChildOf(&span->context())});
+  auto followers_span = StartSpan("get_followers_client", span);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // opentracing::Tracer::Global()->Inject(followers_span->context(), writer);
+  followers_span.Inject(&writer_text_map);
 
   auto social_graph_client = _social_graph_client_pool->Pop();
   if (!social_graph_client) {
     LOG(error) << "Failed to connect to social-graph-service";
-    // followers_span->Finish();
+    followers_span.Finish();
     throw std::runtime_error("Failed to connect to social-graph-service");
   }
   std::vector<int64_t> followers_id;
@@ -128,20 +123,19 @@ void HomeTimelineHandler::WriteHomeTimeline(
   } catch (...) {
     LOG(error) << "Failed to get followers from social-graph-service";
     _social_graph_client_pool->Remove(social_graph_client);
-    // followers_span->Finish();
+    followers_span.Finish();
     throw;
   }
   _social_graph_client_pool->Keepalive(social_graph_client);
-  // followers_span->Finish();
+  followers_span.Finish();
 
   std::set<int64_t> followers_id_set(followers_id.begin(), followers_id.end());
   followers_id_set.insert(user_mentions_id.begin(), user_mentions_id.end());
 
   // Update Redis ZSet
   // Zset key: follower_id, Zset value: post_id_str, Zset score: timestamp_str
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "write_home_timeline_redis_update_client",
-  //     {opentracing::ChildOf(&span->context())});
+  auto redis_span = StartSpan("write_home_timeline_redis_update_client", span);
+  ScopedTiming redis_timing(TimingStage::REDIS);
 
   std::string post_id_str = std::to_string(post_id);
 
@@ -209,7 +203,8 @@ void HomeTimelineHandler::WriteHomeTimeline(
       }
     }
   }
-  // redis_span->Finish();
+  redis_timing.Stop();
+  redis_span.Finish();
 }
 
 
@@ -217,21 +212,16 @@ void HomeTimelineHandler::ReadHomeTimeline(
     std::vector<Post> &_return, int64_t req_id, int64_t user_id, int start_idx,
     int stop_idx, const std::map<std::string, std::string> &carrier) {
   // Initialize a span
-  // TextMapReader reader(carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "read_home_timeline_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  auto span = StartSpan("read_home_timeline_server", carrier);
+  span.Inject(&writer_text_map);
 
   if (stop_idx <= start_idx || start_idx < 0) {
     return;
   }
 
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "read_home_timeline_redis_find_client",
-  //     {opentracing::ChildOf(&span->context())});
+  auto redis_span = StartSpan("read_home_timeline_redis_find_client", span);
+  ScopedTiming redis_timing(TimingStage::REDIS);
 
   std::vector<std::string> post_ids_str;
   try {
@@ -255,7 +245,8 @@ void HomeTimelineHandler::ReadHomeTimeline(
     LOG(error) << err.what();
     throw err;
   }
-  // redis_span->Finish();
+  redis_timing.Stop();
+  redis_span.Finish();
 
   std::vector<int64_t> post_ids;
   for (auto &post_id_str : post_ids_str) {
@@ -308,7 +299,7 @@ void HomeTimelineHandler::ReadHomeTimeline(
     throw;
   }
   _post_client_pool->Keepalive(post_client);
-  // span->Finish();
+  span.Finish();
 }
 
 }  // namespace social_network
@@ -6,7 +6,8 @@
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../utils.h"
 #include "../utils_redis.h"
 #include "HomeTimelineHandler.h"
@@ -45,12 +46,13 @@ int main(int argc, char *argv[]) {
   }
 
   // Optional: enable distributed tracing if desired
-  // SetUpTracer("config/jaeger-config.yml", "home-timeline-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "home-timeline-service");
+  SetUpClientPools(config_json);
 
   int port = config_json["home-timeline-service"]["port"];
   int redis_cluster_config_flag = config_json["home-timeline-redis"]["use_cluster"];
@@ -86,6 +88,7 @@ int main(int argc, char *argv[]) {
 
 
   httplib::Server server;
+  SetUpServerMetrics(&server, "home-timeline-service");
 
   if (redis_replica_config_flag) {
     Redis redis_replica_client_pool =
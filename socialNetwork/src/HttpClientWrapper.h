@@ -1,50 +1,265 @@
 #ifndef SOCIALNETWORK_SRC_HTTPCLIENTWRAPPER_H_
 #define SOCIALNETWORK_SRC_HTTPCLIENTWRAPPER_H_
 
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <string>
+#include <nlohmann/json.hpp>
 #include "httplib.h"
+#include "metrics.h"
 
+// One keep-alive connection to host:port. ClientPool constructs it with its
+// keepalive_ms, which also bounds connecting, sending and receiving.
 class HttpClientWrapper {
 public:
     HttpClientWrapper(const std::string& host, int port, int timeout_ms)
-        : cli(host, port) {
-        cli.set_connection_timeout(
-            timeout_ms / 1000,
-            (timeout_ms % 1000) * 1000
-        );
+        : _connect_timestamp(0), _keepalive_ms(timeout_ms), _host(host),
+          _port(port), _timeout_ms(timeout_ms) {}
+
+    ~HttpClientWrapper() {
+        _CloseAsync();
     }
 
+    // Opens the connection unless an open one is still usable, so that
+    // ClientPool can connect clients before they are popped.
     void Connect() {
-        // no use, but keep for interface consistency
-        long now = std::chrono::duration_cast<std::chrono::milliseconds>(
-                       std::chrono::system_clock::now().time_since_epoch()).count();
-        _connect_timestamp = now;
+        if (_async_fd >= 0 && _IsAsyncStale()) {
+            _CloseAsync();
+        }
+        if (_async_fd < 0) {
+            _ConnectAsync();
+            _connect_timestamp =
+                std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+        }
+    }
+
+    bool IsConnected() const {
+        return _async_fd >= 0 && !_IsAsyncStale();
     }
-    
 
+    // Sends on the pooled connection, instead of the new connection per call
+    // that httplib::Client made. If the server closed the connection just as
+    // it was reused, the request is sent once more on a new one.
     nlohmann::json PostJson(const std::string& path,
                             const nlohmann::json& body) {
-        auto res = cli.Post(path.c_str(),
-                            body.dump(),
-                            "application/json");
+        social_network::ScopedTiming timing(
+            social_network::TimingStage::DOWNSTREAM);
+        try {
+            SendPostJson(path, body);
+            return RecvJson();
+        } catch (const std::runtime_error &) {
+            if (!ReplyLost()) {
+                throw;
+            }
+        }
+        SendPostJson(path, body);
+        return RecvJson();
+    }
+
+    // Whether the last request failed because the server had closed a
+    // connection that already served requests, before any byte of the reply.
+    // Such a request was not processed and can be sent again.
+    bool ReplyLost() const {
+        return _reply_lost;
+    }
+
+    // Split-phase variant of PostJson used by FanOut: SendPostJson() writes
+    // the request and returns immediately, RecvJson() reads the reply once
+    // GetAsyncFd() polls readable. Only one request may be outstanding.
+    void SendPostJson(const std::string& path, const nlohmann::json& body) {
+        Connect();
+        _reply_lost = false;
+
+        std::string payload = body.dump();
+        std::string request;
+        request.reserve(128 + path.size() + payload.size());
+        request += "POST " + path + " HTTP/1.1\r\n";
+        request += "Host: " + _host + ":" + std::to_string(_port) + "\r\n";
+        request += "Content-Type: application/json\r\n";
+        request += "Content-Length: " + std::to_string(payload.size()) + "\r\n";
+        request += "Connection: keep-alive\r\n\r\n";
+        request += payload;
+
+        size_t sent = 0;
+        while (sent < request.size()) {
+            ssize_t n = ::send(_async_fd, request.data() + sent,
+                               request.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                _reply_lost = _served > 0;
+                _CloseAsync();
+                throw std::runtime_error("HTTP request failed: " + path);
+            }
+            sent += n;
+        }
+        _async_path = path;
+    }
+
+    nlohmann::json RecvJson() {
+        std::string buf;
+        size_t header_end = std::string::npos;
+        while ((header_end = buf.find("\r\n\r\n")) == std::string::npos) {
+            _RecvSome(buf);
+        }
+
+        int status = 0;
+        size_t content_length = std::string::npos;
+        bool close_after = false;
+        size_t line_start = 0;
+        while (line_start < header_end) {
+            size_t line_end = buf.find("\r\n", line_start);
+            std::string line = buf.substr(line_start, line_end - line_start);
+            if (line_start == 0) {
+                auto sp = line.find(' ');
+                if (sp != std::string::npos) {
+                    status = std::atoi(line.c_str() + sp + 1);
+                }
+            } else if (strncasecmp(line.c_str(), "Content-Length:", 15) == 0) {
+                content_length = std::strtoul(line.c_str() + 15, nullptr, 10);
+            } else if (strncasecmp(line.c_str(), "Connection:", 11) == 0 &&
+                       line.find("close") != std::string::npos) {
+                close_after = true;
+            }
+            line_start = line_end + 2;
+        }
+        if (content_length == std::string::npos) {
+            _CloseAsync();
+            throw std::runtime_error("HTTP response without length on " +
+                                     _async_path);
+        }
 
-        if (!res) {
-            throw std::runtime_error("HTTP request failed: " + path);
+        size_t body_start = header_end + 4;
+        while (buf.size() - body_start < content_length) {
+            _RecvSome(buf);
+        }
+        _served++;
+        if (close_after) {
+            _CloseAsync();
         }
-        if (res->status >= 400) {
-            throw std::runtime_error("HTTP " + std::to_string(res->status) +
-                                     " on " + path);
+        if (status >= 400) {
+            throw std::runtime_error("HTTP " + std::to_string(status) +
+                                     " on " + _async_path);
         }
+        return nlohmann::json::parse(buf.begin() + body_start,
+                                     buf.begin() + body_start + content_length);
+    }
 
-        return nlohmann::json::parse(res->body);
+    int GetAsyncFd() const {
+        return _async_fd;
     }
 
 public:
     long _connect_timestamp;
     long _keepalive_ms;
+    // Set by ClientPool::Pop() for its client-side latency.
+    std::chrono::steady_clock::time_point _pop_time;
 
 private:
-    httplib::Client cli;
+    void _ConnectAsync() {
+        struct addrinfo hints = {};
+        struct addrinfo *result = nullptr;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(_host.c_str(), std::to_string(_port).c_str(), &hints,
+                        &result) != 0) {
+            throw std::runtime_error("Failed to resolve " + _host);
+        }
+        for (auto rp = result; rp; rp = rp->ai_next) {
+            int fd = ::socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (_ConnectWithTimeout(fd, rp->ai_addr, rp->ai_addrlen)) {
+                int yes = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                struct timeval tv;
+                tv.tv_sec = _timeout_ms / 1000;
+                tv.tv_usec = (_timeout_ms % 1000) * 1000;
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                _async_fd = fd;
+                _served = 0;
+                break;
+            }
+            ::close(fd);
+        }
+        freeaddrinfo(result);
+        if (_async_fd < 0) {
+            throw std::runtime_error("Failed to connect to " + _host + ":" +
+                                     std::to_string(_port));
+        }
+    }
+
+    // A blocking connect() to an unreachable host would hold the caller, or
+    // ClientPool's health check, for the kernel's SYN retries.
+    bool _ConnectWithTimeout(int fd, const struct sockaddr *addr,
+                             socklen_t addrlen) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int rc = ::connect(fd, addr, addrlen);
+        if (rc < 0 && errno == EINPROGRESS) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            do {
+                rc = ::poll(&pfd, 1, _timeout_ms);
+            } while (rc < 0 && errno == EINTR);
+            int error = 0;
+            socklen_t len = sizeof(error);
+            rc = (rc == 1 &&
+                  getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 &&
+                  error == 0) ? 0 : -1;
+        }
+        fcntl(fd, F_SETFL, flags);
+        return rc == 0;
+    }
+
+    // An idle keep-alive connection that polls readable has either been
+    // closed by the server or carries garbage; either way it can't be reused.
+    bool _IsAsyncStale() const {
+        struct pollfd pfd = {_async_fd, POLLIN, 0};
+        return ::poll(&pfd, 1, 0) != 0;
+    }
+
+    void _RecvSome(std::string &buf) {
+        char chunk[16384];
+        ssize_t n;
+        do {
+            n = ::recv(_async_fd, chunk, sizeof(chunk), 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            _reply_lost = buf.empty() && _served > 0 &&
+                          (n == 0 || errno == ECONNRESET);
+            _CloseAsync();
+            throw std::runtime_error("HTTP response failed on " + _async_path);
+        }
+        buf.append(chunk, n);
+    }
+
+    void _CloseAsync() {
+        if (_async_fd >= 0) {
+            ::close(_async_fd);
+            _async_fd = -1;
+        }
+    }
+
+    std::string _host;
+    int _port;
+    int _timeout_ms;
+    int _async_fd = -1;
+    std::string _async_path;
+    // Requests answered on the current connection.
+    int _served = 0;
+    bool _reply_lost = false;
 };
 
-#endif  // SOCIALNETWORK_SRC_HTTPCLIENTWRAPPER_H_
\ No newline at end of file
+#endif  // SOCIALNETWORK_SRC_HTTPCLIENTWRAPPER_H_
@@ -6,7 +6,7 @@
 #include <string>
 
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
 #include "../social_network_types.h"
 
 // 2018-01-01 00:00:00 UTC
@@ -33,13 +33,9 @@ void MediaHandler::ComposeMedia(
     const std::vector<int64_t> &media_ids,
     const std::map<std::string, std::string> &carrier) {
   // Initialize a span
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "compose_media_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("compose_media_server", carrier);
+  span.Inject(&writer_text_map);
 
   if (media_types.size() != media_ids.size()) {
     LOG(error) << "The lengths of media_id list and media_type list are not equal";
@@ -54,7 +50,7 @@ void MediaHandler::ComposeMedia(
     _return.emplace_back(new_media);
   }
 
-  // span->Finish();
+  span.Finish();
 }
 
 }  // namespace social_network
@@ -4,7 +4,8 @@
 
 #include "../utils.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../HttpClientWrapper.h"  // brings in httplib
 #include "MediaHandler.h"
 
@@ -16,16 +17,17 @@ void sigintHandler(int sig) { exit(EXIT_SUCCESS); }
 int main(int argc, char *argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
-  // SetUpTracer("config/jaeger-config.yml", "media-service");
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "media-service");
 
   int port = config_json["media-service"]["port"];
 
   MediaHandler handler;
   httplib::Server server;
+  SetUpServerMetrics(&server, "media-service");
 
   server.Post("/ComposeMedia", [&](const httplib::Request &req, httplib::Response &res) {
     try {
@@ -0,0 +1,219 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_MESSAGEQUEUE_H
+#define SOCIAL_NETWORK_MICROSERVICES_MESSAGEQUEUE_H
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+namespace social_network {
+
+// Producer side of a channel between a producer that must not wait for some
+// work (e.g. the home-timeline fan-out of ComposePost) and the workers that
+// perform it.
+class MessagePublisher {
+ public:
+  virtual ~MessagePublisher() = default;
+
+  virtual void Publish(const std::string &message) = 0;
+};
+
+// Consumer side of the same channel. Messages are handed out once: a consumed
+// message is gone from the queue.
+class MessageConsumer {
+ public:
+  virtual ~MessageConsumer() = default;
+
+  // Waits up to timeout_ms for at least one message, then appends up to
+  // max_messages of them to *messages. Returns the number appended.
+  virtual size_t Consume(std::vector<std::string> *messages,
+                         size_t max_messages, int timeout_ms) = 0;
+
+  // Micro-batching on top of Consume(): waits up to timeout_ms for a first
+  // message, then keeps collecting until max_messages have arrived or
+  // batch_delay_ms has passed since the first one.
+  size_t ConsumeBatch(std::vector<std::string> *messages, size_t max_messages,
+                      int timeout_ms, int batch_delay_ms);
+};
+
+// A channel that implements both sides.
+class MessageQueue : public MessagePublisher, public MessageConsumer {};
+
+size_t MessageConsumer::ConsumeBatch(std::vector<std::string> *messages,
+                                     size_t max_messages, int timeout_ms,
+                                     int batch_delay_ms) {
+  size_t n = Consume(messages, max_messages, timeout_ms);
+  if (n == 0) {
+    return 0;
+  }
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(batch_delay_ms);
+  while (n < max_messages) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+    if (remaining <= 0) {
+      break;
+    }
+    n += Consume(messages, max_messages - n, static_cast<int>(remaining));
+  }
+  return n;
+}
+
+// In-process queue, for running producer and consumers in one process and
+// for offline tests and benchmarks.
+class LocalMessageQueue : public MessageQueue {
+ public:
+  LocalMessageQueue() = default;
+
+  void Publish(const std::string &message) override;
+  size_t Consume(std::vector<std::string> *messages, size_t max_messages,
+                 int timeout_ms) override;
+
+ private:
+  std::deque<std::string> _messages;
+  std::mutex _mtx;
+  std::condition_variable _cv;
+};
+
+void LocalMessageQueue::Publish(const std::string &message) {
+  std::unique_lock<std::mutex> lock(_mtx);
+  _messages.emplace_back(message);
+  lock.unlock();
+  _cv.notify_one();
+}
+
+size_t LocalMessageQueue::Consume(std::vector<std::string> *messages,
+                                  size_t max_messages, int timeout_ms) {
+  std::unique_lock<std::mutex> lock(_mtx);
+  if (!_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                    [this] { return !_messages.empty(); })) {
+    return 0;
+  }
+  size_t n = std::min(max_messages, _messages.size());
+  for (size_t i = 0; i < n; ++i) {
+    messages->emplace_back(std::move(_messages.front()));
+    _messages.pop_front();
+  }
+  return n;
+}
+
+// Spool-directory queue shared by processes on one host or volume, which
+// stands in for a broker when none is available. Each message is one file
+// whose name sorts in publish order; publishers write to a dot-file and
+// rename it into place, consumers claim a file by renaming it back to a
+// private dot-name, so every message is delivered to exactly one consumer.
+class FileMessageQueue : public MessageQueue {
+ public:
+  explicit FileMessageQueue(const std::string &dir);
+
+  void Publish(const std::string &message) override;
+  size_t Consume(std::vector<std::string> *messages, size_t max_messages,
+                 int timeout_ms) override;
+
+ private:
+  std::string _dir;
+  std::atomic<uint64_t> _counter;
+};
+
+FileMessageQueue::FileMessageQueue(const std::string &dir) {
+  _dir = dir;
+  _counter = 0;
+  for (size_t pos = 1; pos != std::string::npos; ++pos) {
+    pos = _dir.find('/', pos);
+    std::string prefix = _dir.substr(0, pos);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+      LOG(error) << "Cannot create message queue directory " << prefix;
+      throw std::runtime_error("Cannot create " + prefix);
+    }
+    if (pos == std::string::npos) {
+      break;
+    }
+  }
+}
+
+void FileMessageQueue::Publish(const std::string &message) {
+  auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::ostringstream name;
+  name << std::setw(20) << std::setfill('0') << now << "-" << getpid() << "-"
+       << _counter++;
+  std::string tmp_path = _dir + "/." + name.str();
+  std::string path = _dir + "/" + name.str();
+
+  std::ofstream file(tmp_path, std::ios::binary);
+  file.write(message.data(), message.size());
+  file.close();
+  if (!file || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::remove(tmp_path.c_str());
+    LOG(error) << "Failed to publish message to " << _dir;
+    throw std::runtime_error("Failed to publish message to " + _dir);
+  }
+}
+
+size_t FileMessageQueue::Consume(std::vector<std::string> *messages,
+                                 size_t max_messages, int timeout_ms) {
+  auto deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(timeout_ms);
+  std::ostringstream claim_suffix;
+  claim_suffix << ".claimed-" << getpid() << "-" << std::this_thread::get_id();
+
+  size_t n = 0;
+  while (true) {
+    std::vector<std::string> names;
+    DIR *dir = opendir(_dir.c_str());
+    if (!dir) {
+      throw std::runtime_error("Cannot open " + _dir);
+    }
+    while (auto entry = readdir(dir)) {
+      if (entry->d_name[0] != '.') {
+        names.emplace_back(entry->d_name);
+      }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    for (auto &name : names) {
+      if (n == max_messages) {
+        break;
+      }
+      std::string path = _dir + "/" + name;
+      std::string claimed_path = _dir + "/." + name + claim_suffix.str();
+      if (std::rename(path.c_str(), claimed_path.c_str()) != 0) {
+        // Another consumer got there first.
+        continue;
+      }
+      std::ifstream file(claimed_path, std::ios::binary);
+      std::ostringstream body;
+      body << file.rdbuf();
+      file.close();
+      std::remove(claimed_path.c_str());
+      messages->emplace_back(body.str());
+      ++n;
+    }
+
+    if (n > 0 || std::chrono::steady_clock::now() >= deadline) {
+      return n;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_MESSAGEQUEUE_H
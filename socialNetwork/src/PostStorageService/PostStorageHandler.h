@@ -12,7 +12,7 @@
 #include <string>
 
 #include "../logger.h"
-// #include "../tracing.h"  // Tracing disabled
+#include "../span_recorder.h"
 #include "../social_network_types.h"
 
 namespace social_network {
@@ -48,14 +48,9 @@ PostStorageHandler::PostStorageHandler(
 void PostStorageHandler::StorePost(
     int64_t req_id, const social_network::Post &post,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "store_post_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("store_post_server", carrier);
+  span.Inject(&writer_text_map);
 
   mongoc_client_t *mongodb_client =
       mongoc_client_pool_pop(_mongodb_client_pool);
@@ -132,12 +127,10 @@ void PostStorageHandler::StorePost(
   bson_append_array_end(new_doc, &media_list);
 
   bson_error_t error;
-  // auto insert_span = opentracing::Tracer::Global()->StartSpan(
-  //     "post_storage_mongo_insert_client",
-  //     {opentracing::ChildOf(&span->context())});
+  auto insert_span = StartSpan("post_storage_mongo_insert_client", span);
   bool inserted = mongoc_collection_insert_one(collection, new_doc, nullptr,
                                                nullptr, &error);
-  // insert_span->Finish();
+  insert_span.Finish();
 
   if (!inserted) {
     LOG(error) << "Error: Failed to insert post to MongoDB: " << error.message;
@@ -151,20 +144,15 @@ void PostStorageHandler::StorePost(
   mongoc_collection_destroy(collection);
   mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
 
-  // span->Finish();
+  span.Finish();
 }
 
 void PostStorageHandler::ReadPost(
     Post &_return, int64_t req_id, int64_t post_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "read_post_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("read_post_server", carrier);
+  span.Inject(&writer_text_map);
 
   std::string post_id_str = std::to_string(post_id);
 
@@ -178,8 +166,8 @@ void PostStorageHandler::ReadPost(
 
   size_t post_mmc_size;
   uint32_t memcached_flags;
-  // auto get_span = opentracing::Tracer::Global()->StartSpan(
-  //     "post_storage_mmc_get_client", {opentracing::ChildOf(&span->context())});
+  auto get_span = StartSpan("post_storage_mmc_get_client", span);
+  ScopedTiming get_timing(TimingStage::MEMCACHED);
   char *post_mmc =
       memcached_get(memcached_client, post_id_str.c_str(), post_id_str.length(),
                     &post_mmc_size, &memcached_flags, &memcached_rc);
@@ -189,7 +177,8 @@ void PostStorageHandler::ReadPost(
     throw std::runtime_error(memcached_strerror(memcached_client, memcached_rc));
   }
   memcached_pool_push(_memcached_client_pool, memcached_client);
-  // get_span->Finish();
+  get_timing.Stop();
+  get_span.Finish();
 
   if (post_mmc) {
     LOG(debug) << "Get post " << post_id << " cache hit from Memcached";
@@ -240,14 +229,12 @@ void PostStorageHandler::ReadPost(
 
     bson_t *query = bson_new();
     BSON_APPEND_INT64(query, "post_id", post_id);
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "post_storage_mongo_find_client",
-  //     {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("post_storage_mongo_find_client", span);
     mongoc_cursor_t *cursor =
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
     bool found = mongoc_cursor_next(cursor, &doc);
-  // find_span->Finish();
+    find_span.Finish();
     if (!found) {
       bson_error_t error;
       if (mongoc_cursor_error(cursor, &error)) {
@@ -307,9 +294,8 @@ void PostStorageHandler::ReadPost(
         LOG(error) << "Failed to pop a client from memcached pool";
         throw std::runtime_error("Failed to pop a client from memcached pool");
       }
-      // auto set_span = opentracing::Tracer::Global()->StartSpan(
-      //     "post_storage_mmc_set_client",
-      //     {opentracing::ChildOf(&span->context())});
+      auto set_span = StartSpan("post_storage_mmc_set_client", span);
+      ScopedTiming set_timing(TimingStage::MEMCACHED);
 
       memcached_rc = memcached_set(
           memcached_client, post_id_str.c_str(), post_id_str.length(),
@@ -319,27 +305,22 @@ void PostStorageHandler::ReadPost(
         LOG(warning) << "Failed to set post to Memcached: "
                      << memcached_strerror(memcached_client, memcached_rc);
       }
-      // set_span->Finish();
+      set_timing.Stop();
+      set_span.Finish();
       bson_free(post_json_char);
       memcached_pool_push(_memcached_client_pool, memcached_client);
     }
   }
 
-  // span->Finish();
+  span.Finish();
 }
 void PostStorageHandler::ReadPosts(
     std::vector<Post> &_return, int64_t req_id,
     const std::vector<int64_t> &post_ids,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "post_storage_read_posts_server",
-  //     {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("post_storage_read_posts_server", carrier);
+  span.Inject(&writer_text_map);
 
   if (post_ids.empty()) {
     return;
@@ -385,8 +366,8 @@ void PostStorageHandler::ReadPosts(
   char *return_value;
   size_t return_value_length;
   uint32_t flags;
-  // auto get_span = opentracing::Tracer::Global()->StartSpan(
-  //     "post_storage_mmc_mget_client", {opentracing::ChildOf(&span->context())});
+  auto get_span = StartSpan("post_storage_mmc_mget_client", span);
+  ScopedTiming get_timing(TimingStage::MEMCACHED);
 
   while (true) {
     return_value =
@@ -435,7 +416,8 @@ void PostStorageHandler::ReadPosts(
     post_ids_not_cached.erase(new_post.post_id);
     free(return_value);
   }
-  // get_span->Finish();
+  get_timing.Stop();
+  get_span.Finish();
   memcached_quit(memcached_client);
   memcached_pool_push(_memcached_client_pool, memcached_client);
   for (int i = 0; i < post_ids.size(); ++i) {
@@ -482,8 +464,7 @@ void PostStorageHandler::ReadPosts(
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
 
-    // auto find_span = opentracing::Tracer::Global()->StartSpan(
-    //     "mongo_find_client", {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("mongo_find_client", span);
     while (true) {
       bool found = mongoc_cursor_next(cursor, &doc);
       if (!found) {
@@ -521,7 +502,7 @@ void PostStorageHandler::ReadPosts(
       return_map.insert({new_post.post_id, new_post});
       bson_free(post_json_char);
     }
-  // find_span->Finish();
+    find_span.Finish();
     bson_error_t error;
     if (mongoc_cursor_error(cursor, &error)) {
       LOG(warning) << error.message;
@@ -545,8 +526,7 @@ void PostStorageHandler::ReadPosts(
         LOG(error) << "Failed to pop a client from memcached pool";
         throw std::runtime_error("Failed to pop a client from memcached pool");
       }
-      // auto set_span = opentracing::Tracer::Global()->StartSpan(
-      //     "mmc_set_client", {opentracing::ChildOf(&span->context())});
+      auto set_span = StartSpan("mmc_set_client", span);
       for (auto &it : post_json_map) {
         std::string id_str = std::to_string(it.first);
         _rc = memcached_set(_memcached_client, id_str.c_str(), id_str.length(),
@@ -554,7 +534,7 @@ void PostStorageHandler::ReadPosts(
                             static_cast<time_t>(0), static_cast<uint32_t>(0));
       }
       memcached_pool_push(_memcached_client_pool, _memcached_client);
-      // set_span->Finish();
+      set_span.Finish();
     }));
   }
 
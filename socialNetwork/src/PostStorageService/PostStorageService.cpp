@@ -6,7 +6,8 @@
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../HttpClientWrapper.h"  // brings in httplib Server
 #include "PostStorageHandler.h"
 
@@ -29,12 +30,12 @@ void sigintHandler(int sig) {
 int main(int argc, char* argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
-  // SetUpTracer("config/jaeger-config.yml", "post-storage-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "post-storage-service");
 
   int port = config_json["post-storage-service"]["port"];
 
@@ -69,6 +70,7 @@ int main(int argc, char* argv[]) {
 
   PostStorageHandler handler(memcached_client_pool, mongodb_client_pool);
   httplib::Server server;
+  SetUpServerMetrics(&server, "post-storage-service");
 
   // StorePost endpoint
   server.Post("/StorePost", [&](const httplib::Request &req, httplib::Response &res) {
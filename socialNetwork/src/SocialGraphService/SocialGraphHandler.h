@@ -15,7 +15,7 @@
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
 #include "../logger.h"
-// #include "../tracing.h"  // Tracing disabled
+#include "../span_recorder.h"
 #include "../social_network_types.h"
 
 using namespace sw::redis;
@@ -51,8 +51,13 @@ class SocialGraphHandler {
     const std::map<std::string, std::string> &);
   void InsertUser(int64_t, int64_t,
           const std::map<std::string, std::string> &);
+  void InsertUsers(int64_t, const std::vector<int64_t> &,
+                   const std::map<std::string, std::string> &);
 
  private:
+  std::vector<int64_t> _GetUserIds(int64_t, const std::vector<std::string> &,
+                                   const std::map<std::string, std::string> &);
+
   mongoc_client_pool_t *_mongodb_client_pool;
   Redis *_redis_client_pool;
   Redis *_redis_replica_client_pool;
@@ -102,14 +107,9 @@ bool SocialGraphHandler::IsRedisReplicationEnabled() {
 void SocialGraphHandler::Follow(
     int64_t req_id, int64_t user_id, int64_t followee_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "follow_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("follow_server", carrier);
+  span.Inject(&writer_text_map);
 
   int64_t timestamp =
       duration_cast<milliseconds>(system_clock::now().time_since_epoch())
@@ -143,8 +143,7 @@ void SocialGraphHandler::Follow(
                                   BCON_INT64(timestamp), "}", "}");
         bson_error_t error;
         bson_t reply;
-        // auto update_span = opentracing::Tracer::Global()->StartSpan(
-        //     "mongo_update_client", {opentracing::ChildOf(&span->context())});
+        auto update_span = StartSpan("mongo_update_client", span);
         bool updated = mongoc_collection_find_and_modify(
             collection, search_not_exist, nullptr, update, nullptr, false,
             false, true, &reply, &error);
@@ -158,7 +157,7 @@ void SocialGraphHandler::Follow(
           mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
           throw std::runtime_error("Failed to update social graph for user " + std::to_string(user_id) + " to MongoDB: " + error.message);
         }
-        // update_span->Finish();
+        update_span.Finish();
         bson_destroy(&reply);
         bson_destroy(update);
         bson_destroy(search_not_exist);
@@ -192,9 +191,7 @@ void SocialGraphHandler::Follow(
                                   BCON_INT64(user_id), "timestamp",
                                   BCON_INT64(timestamp), "}", "}");
         bson_error_t error;
-        // auto update_span = opentracing::Tracer::Global()->StartSpan(
-        //     "social_graph_mongo_update_client",
-        //     {opentracing::ChildOf(&span->context())});
+        auto update_span = StartSpan("social_graph_mongo_update_client", span);
         bson_t reply;
         bool updated = mongoc_collection_find_and_modify(
             collection, search_not_exist, nullptr, update, nullptr, false,
@@ -202,7 +199,7 @@ void SocialGraphHandler::Follow(
         if (!updated) {
           LOG(error) << "Failed to update social graph for user " << followee_id
                      << " to MongoDB: " << error.message;
-          // update_span->Finish();
+          update_span.Finish();
           bson_destroy(update);
           bson_destroy(&reply);
           bson_destroy(search_not_exist);
@@ -210,7 +207,7 @@ void SocialGraphHandler::Follow(
           mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
           throw std::runtime_error("Failed to update social graph for user " + std::to_string(followee_id) + " to MongoDB: " + error.message);
         }
-        // update_span->Finish();
+        update_span.Finish();
         bson_destroy(update);
         bson_destroy(&reply);
         bson_destroy(search_not_exist);
@@ -219,9 +216,8 @@ void SocialGraphHandler::Follow(
       });
 
   std::future<void> redis_update_future = std::async(std::launch::async, [&]() {
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_redis_update_client",
-  //     {opentracing::ChildOf(&span->context())});
+    auto redis_span = StartSpan("social_graph_redis_update_client", span);
+    ScopedTiming redis_timing(TimingStage::REDIS);
 
     {
       if (_redis_client_pool) {
@@ -271,7 +267,8 @@ void SocialGraphHandler::Follow(
         }
       }
     }
-    // redis_span->Finish();
+    redis_timing.Stop();
+    redis_span.Finish();
   });
 
   try {
@@ -285,20 +282,15 @@ void SocialGraphHandler::Follow(
     throw;
   }
 
-  // span->Finish();
+  span.Finish();
 }
 
 void SocialGraphHandler::Unfollow(
     int64_t req_id, int64_t user_id, int64_t followee_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "unfollow_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("unfollow_server", carrier);
+  span.Inject(&writer_text_map);
 
   std::future<void> mongo_update_follower_future =
       std::async(std::launch::async, [&]() {
@@ -324,9 +316,7 @@ void SocialGraphHandler::Unfollow(
                                   BCON_INT64(followee_id), "}", "}");
         bson_t reply;
         bson_error_t error;
-        // auto update_span = opentracing::Tracer::Global()->StartSpan(
-        //     "social_graph_mongo_delete_client",
-        //     {opentracing::ChildOf(&span->context())});
+        auto update_span = StartSpan("social_graph_mongo_delete_client", span);
         bool updated = mongoc_collection_find_and_modify(
             collection, query, nullptr, update, nullptr, false, false, true,
             &reply, &error);
@@ -340,7 +330,7 @@ void SocialGraphHandler::Unfollow(
           mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
           throw std::runtime_error("Failed to delete social graph for user " + std::to_string(user_id) + " to MongoDB: " + error.message);
         }
-        // update_span->Finish();
+        update_span.Finish();
         bson_destroy(update);
         bson_destroy(query);
         bson_destroy(&reply);
@@ -372,9 +362,7 @@ void SocialGraphHandler::Unfollow(
                                   BCON_INT64(user_id), "}", "}");
         bson_t reply;
         bson_error_t error;
-        // auto update_span = opentracing::Tracer::Global()->StartSpan(
-        //     "social_graph_mongo_delete_client",
-        //     {opentracing::ChildOf(&span->context())});
+        auto update_span = StartSpan("social_graph_mongo_delete_client", span);
         bool updated = mongoc_collection_find_and_modify(
             collection, query, nullptr, update, nullptr, false, false, true,
             &reply, &error);
@@ -390,7 +378,7 @@ void SocialGraphHandler::Unfollow(
           mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
           throw std::runtime_error("Failed to delete social graph for user " + std::to_string(followee_id) + " to MongoDB: " + error.message);
         }
-        // update_span->Finish();
+        update_span.Finish();
         bson_destroy(update);
         bson_destroy(query);
         bson_destroy(&reply);
@@ -399,9 +387,8 @@ void SocialGraphHandler::Unfollow(
       });
 
   std::future<void> redis_update_future = std::async(std::launch::async, [&]() {
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_redis_update_client",
-  //     {opentracing::ChildOf(&span->context())});
+    auto redis_span = StartSpan("social_graph_redis_update_client", span);
+    ScopedTiming redis_timing(TimingStage::REDIS);
     {
       if (_redis_client_pool) {
         auto pipe = _redis_client_pool->pipeline(false);
@@ -446,7 +433,8 @@ void SocialGraphHandler::Unfollow(
         }
       }
     }
-    // redis_span->Finish();
+    redis_timing.Stop();
+    redis_span.Finish();
   });
 
   try {
@@ -457,24 +445,18 @@ void SocialGraphHandler::Unfollow(
     throw;
   }
 
-  // span->Finish();
+  span.Finish();
 }
 
 void SocialGraphHandler::GetFollowers(
     std::vector<int64_t> &_return, const int64_t req_id, const int64_t user_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "get_followers_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_redis_get_client",
-  //     {opentracing::ChildOf(&span->context())});
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("get_followers_server", carrier);
+  span.Inject(&writer_text_map);
+
+  auto redis_span = StartSpan("social_graph_redis_get_client", span);
+  ScopedTiming redis_timing(TimingStage::REDIS);
 
   std::vector<std::string> followers_str;
   std::string key = std::to_string(user_id) + ":followers";
@@ -493,7 +475,8 @@ void SocialGraphHandler::GetFollowers(
     LOG(error) << err.what();
     throw err;
   }
-  // redis_span->Finish();
+  redis_timing.Stop();
+  redis_span.Finish();
 
   // If user_id in the sodical graph Redis server, read from Redis
   if (followers_str.size() > 0) {
@@ -520,9 +503,7 @@ void SocialGraphHandler::GetFollowers(
     }
     bson_t *query = bson_new();
     BSON_APPEND_INT64(query, "user_id", user_id);
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_mongo_find_client",
-  //     {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("social_graph_mongo_find_client", span);
     mongoc_cursor_t *cursor =
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
@@ -556,7 +537,7 @@ void SocialGraphHandler::GetFollowers(
         bson_iter_init(&iter_1, doc);
         index++;
       }
-  // find_span->Finish();
+      find_span.Finish();
       bson_destroy(query);
       mongoc_cursor_destroy(cursor);
       mongoc_collection_destroy(collection);
@@ -564,9 +545,9 @@ void SocialGraphHandler::GetFollowers(
 
       // Update Redis
       std::string key = std::to_string(user_id) + ":followers";
-    // auto redis_insert_span = opentracing::Tracer::Global()->StartSpan(
-    //     "social_graph_redis_insert_client",
-    //     {opentracing::ChildOf(&span->context())});
+      auto redis_insert_span =
+          StartSpan("social_graph_redis_insert_client", span);
+      ScopedTiming redis_insert_timing(TimingStage::REDIS);
       try {
         if (_redis_client_pool) {
           _redis_client_pool->zadd(key, redis_zset.begin(), redis_zset.end());
@@ -582,34 +563,29 @@ void SocialGraphHandler::GetFollowers(
         LOG(error) << err.what();
         throw err;
       }
-  // redis_span->Finish();
+      redis_insert_timing.Stop();
+      redis_span.Finish();
     } else {
       LOG(warning) << "user_id: " << user_id << " not found";
-  // find_span->Finish();
+      find_span.Finish();
       bson_destroy(query);
       mongoc_cursor_destroy(cursor);
       mongoc_collection_destroy(collection);
       mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
     }
   }
-  // span->Finish();
+  span.Finish();
 }
 
 void SocialGraphHandler::GetFollowees(
     std::vector<int64_t> &_return, const int64_t req_id, const int64_t user_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "get_followees_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_redis_get_client",
-  //     {opentracing::ChildOf(&span->context())});
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("get_followees_server", carrier);
+  span.Inject(&writer_text_map);
+
+  auto redis_span = StartSpan("social_graph_redis_get_client", span);
+  ScopedTiming redis_timing(TimingStage::REDIS);
 
   std::vector<std::string> followees_str;
   std::string key = std::to_string(user_id) + ":followees";
@@ -628,7 +604,8 @@ void SocialGraphHandler::GetFollowees(
     LOG(error) << err.what();
     throw err;
   }
-  // redis_span->Finish();
+  redis_timing.Stop();
+  redis_span.Finish();
 
   // If user_id in the sodical graph Redis server, read from Redis
   if (followees_str.size() > 0) {
@@ -639,7 +616,7 @@ void SocialGraphHandler::GetFollowees(
   // If user_id in the sodical graph Redis server, read from MongoDB and
   // update Redis.
   else {
-    // redis_span->Finish();
+    redis_span.Finish();
     mongoc_client_t *mongodb_client =
         mongoc_client_pool_pop(_mongodb_client_pool);
     if (!mongodb_client) {
@@ -656,9 +633,7 @@ void SocialGraphHandler::GetFollowees(
     }
     bson_t *query = bson_new();
     BSON_APPEND_INT64(query, "user_id", user_id);
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_mongo_find_client",
-  //     {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("social_graph_mongo_find_client", span);
     mongoc_cursor_t *cursor =
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
@@ -703,7 +678,7 @@ void SocialGraphHandler::GetFollowees(
         index++;
       }
 
-  // find_span->Finish();
+      find_span.Finish();
       bson_destroy(query);
       mongoc_cursor_destroy(cursor);
       mongoc_collection_destroy(collection);
@@ -711,9 +686,9 @@ void SocialGraphHandler::GetFollowees(
 
       // Update redis
       std::string key = std::to_string(user_id) + ":followees";
-    // auto redis_insert_span = opentracing::Tracer::Global()->StartSpan(
-    //     "social_graph_redis_insert_client",
-    //     {opentracing::ChildOf(&span->context())});
+      auto redis_insert_span =
+          StartSpan("social_graph_redis_insert_client", span);
+      ScopedTiming redis_insert_timing(TimingStage::REDIS);
       try {
         if (_redis_client_pool) {
           _redis_client_pool->zadd(key, redis_zset.begin(), redis_zset.end());
@@ -729,23 +704,19 @@ void SocialGraphHandler::GetFollowees(
         LOG(error) << err.what();
         throw err;
       }
-  // redis_span->Finish();
+      redis_insert_timing.Stop();
+      redis_span.Finish();
     }
   }
-  // span->Finish();
+  span.Finish();
 }
 
 void SocialGraphHandler::InsertUser(
     int64_t req_id, int64_t user_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "insert_user_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("insert_user_server", carrier);
+  span.Inject(&writer_text_map);
 
   mongoc_client_t *mongodb_client =
       mongoc_client_pool_pop(_mongodb_client_pool);
@@ -765,12 +736,10 @@ void SocialGraphHandler::InsertUser(
   bson_t *new_doc = BCON_NEW("user_id", BCON_INT64(user_id), "followers", "[",
                              "]", "followees", "[", "]");
   bson_error_t error;
-  // auto insert_span = opentracing::Tracer::Global()->StartSpan(
-  //     "social_graph_mongo_insert_client",
-  //     {opentracing::ChildOf(&span->context())});
+  auto insert_span = StartSpan("social_graph_mongo_insert_client", span);
   bool inserted = mongoc_collection_insert_one(collection, new_doc, nullptr,
                                                nullptr, &error);
-  // insert_span->Finish();
+  insert_span.Finish();
   if (!inserted) {
     LOG(error) << "Failed to insert social graph for user " << user_id
                << " to MongoDB: " << error.message;
@@ -782,159 +751,125 @@ void SocialGraphHandler::InsertUser(
   bson_destroy(new_doc);
   mongoc_collection_destroy(collection);
   mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-  // span->Finish();
+  span.Finish();
 }
 
-void SocialGraphHandler::FollowWithUsername(
-    int64_t req_id, const std::string &user_name,
-    const std::string &followee_name,
+void SocialGraphHandler::InsertUsers(
+    int64_t req_id, const std::vector<int64_t> &user_ids,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  std::map<std::string, std::string> writer_text_map; // keep empty carrier
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "follow_with_username_server",
-  //     {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  std::future<int64_t> user_id_future = std::async(std::launch::async, [&]() {
-    auto user_client = _user_service_client_pool->Pop();
-    if (!user_client) {
-      LOG(error) << "Failed to connect to user-service";
-      throw std::runtime_error("Failed to connect to user-service");
-    }
-    int64_t _return;
-    try {
-      json req_jso = {
-          {"req_id", req_id},
-          {"user_name", user_name},
-          {"carrier", writer_text_map},
-      };
-      auto res = user_client->PostJson("/GetUserId", req_jso);
-      _return = res["user_id"].get<int64_t>();
-    } catch (...) {
-      _user_service_client_pool->Remove(user_client);
-      LOG(error) << "Failed to get user_id from user-service";
-      throw;
-    }
-    _user_service_client_pool->Keepalive(user_client);
-    return _return;
-  });
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("insert_users_server", carrier);
+  span.Inject(&writer_text_map);
 
-  std::future<int64_t> followee_id_future =
-      std::async(std::launch::async, [&]() {
-        auto user_client = _user_service_client_pool->Pop();
-        if (!user_client) {
-          LOG(error) << "Failed to connect to social-graph-service";
-          throw std::runtime_error("Failed to connect to social-graph-service");
-        }
-        int64_t _return;
-        try {
-          json req_jso = {
-              {"req_id", req_id},
-              {"user_name", followee_name},
-              {"carrier", writer_text_map},
-          };
-          auto res = user_client->PostJson("/GetUserId", req_jso);
-          _return = res["user_id"].get<int64_t>();
-        } catch (...) {
-          _user_service_client_pool->Remove(user_client);
-          LOG(error) << "Failed to get user_id from user-service";
-          throw;
-        }
-        _user_service_client_pool->Keepalive(user_client);
-        return _return;
-      });
+  if (user_ids.empty()) {
+    return;
+  }
+  mongoc_client_t *mongodb_client =
+      mongoc_client_pool_pop(_mongodb_client_pool);
+  if (!mongodb_client) {
+    LOG(error) << "Failed to pop a client from MongoDB pool";
+    throw std::runtime_error("Failed to pop a client from MongoDB pool");
+  }
+  auto collection = mongoc_client_get_collection(mongodb_client, "social-graph",
+                                                 "social-graph");
+  if (!collection) {
+    LOG(error) << "Failed to create collection social_graph from MongoDB";
+    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    throw std::runtime_error(
+        "Failed to create collection social_graph from MongoDB");
+  }
+
+  bson_t *bulk_opts = BCON_NEW("ordered", BCON_BOOL(false));
+  mongoc_bulk_operation_t *bulk =
+      mongoc_collection_create_bulk_operation_with_opts(collection, bulk_opts);
+  bson_destroy(bulk_opts);
+  for (auto user_id : user_ids) {
+    bson_t *new_doc = BCON_NEW("user_id", BCON_INT64(user_id), "followers",
+                               "[", "]", "followees", "[", "]");
+    mongoc_bulk_operation_insert(bulk, new_doc);
+    bson_destroy(new_doc);
+  }
+  bson_t reply;
+  bson_error_t error;
+  auto insert_span = StartSpan("social_graph_mongo_bulk_insert_client", span);
+  bool inserted = mongoc_bulk_operation_execute(bulk, &reply, &error);
+  insert_span.Finish();
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(bulk);
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+  if (!inserted) {
+    LOG(error) << "Failed to insert social graph for " << user_ids.size()
+               << " users to MongoDB: " << error.message;
+    throw std::runtime_error("Failed to insert social graph for " +
+                             std::to_string(user_ids.size()) +
+                             " users to MongoDB: " + error.message);
+  }
+  span.Finish();
+}
 
-  int64_t user_id;
-  int64_t followee_id;
+std::vector<int64_t> SocialGraphHandler::_GetUserIds(
+    int64_t req_id, const std::vector<std::string> &usernames,
+    const std::map<std::string, std::string> &carrier) {
+  auto user_client = _user_service_client_pool->Pop();
+  if (!user_client) {
+    LOG(error) << "Failed to connect to user-service";
+    throw std::runtime_error("Failed to connect to user-service");
+  }
+  std::vector<int64_t> _return;
   try {
-    user_id = user_id_future.get();
-    followee_id = followee_id_future.get();
-  } catch (const std::exception &e) {
-    LOG(warning) << e.what();
+    json req_jso = {
+        {"req_id", req_id},
+        {"usernames", usernames},
+        {"carrier", carrier},
+    };
+    auto res = user_client->PostJson("/GetUserIds", req_jso);
+    _return = res["user_ids"].get<std::vector<int64_t>>();
+  } catch (...) {
+    _user_service_client_pool->Remove(user_client);
+    LOG(error) << "Failed to get user_ids from user-service";
     throw;
   }
+  _user_service_client_pool->Keepalive(user_client);
+  if (_return.size() != usernames.size()) {
+    throw std::runtime_error("Unexpected number of user_ids from user-service");
+  }
+  return _return;
+}
+
+void SocialGraphHandler::FollowWithUsername(
+    int64_t req_id, const std::string &user_name,
+    const std::string &followee_name,
+    const std::map<std::string, std::string> &carrier) {
+  std::map<std::string, std::string> writer_text_map; // keep empty carrier
+  auto span = StartSpan("follow_with_username_server", carrier);
+  span.Inject(&writer_text_map);
+
+  // Both names are resolved by one user-service request.
+  auto user_ids =
+      _GetUserIds(req_id, {user_name, followee_name}, writer_text_map);
+  int64_t user_id = user_ids[0];
+  int64_t followee_id = user_ids[1];
 
   if (user_id >= 0 && followee_id >= 0) {
     Follow(req_id, user_id, followee_id, writer_text_map);
   }
-  // span->Finish();
+  span.Finish();
 }
 
 void SocialGraphHandler::UnfollowWithUsername(
     int64_t req_id, const std::string &user_name,
     const std::string &followee_name,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
   std::map<std::string, std::string> writer_text_map; // keep empty carrier
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "unfollow_with_username_server",
-  //     {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
-
-  std::future<int64_t> user_id_future = std::async(std::launch::async, [&]() {
-    auto user_client = _user_service_client_pool->Pop();
-    if (!user_client) {
-      LOG(error) << "Failed to connect to social-graph-service";
-      throw std::runtime_error("Failed to connect to social-graph-service");
-    }
-    int64_t _return;
-    try {
-      json req_jso = {
-          {"req_id", req_id},
-          {"user_name", user_name},
-          {"carrier", writer_text_map},
-      };
-      auto res = user_client->PostJson("/GetUserId", req_jso);
-      _return = res["user_id"].get<int64_t>();
-    } catch (...) {
-      _user_service_client_pool->Remove(user_client);
-      LOG(error) << "Failed to get user_id from user-service";
-      throw;
-    }
-    _user_service_client_pool->Keepalive(user_client);
-    return _return;
-  });
-
-  std::future<int64_t> followee_id_future =
-      std::async(std::launch::async, [&]() {
-        auto user_client = _user_service_client_pool->Pop();
-        if (!user_client) {
-          LOG(error) << "Failed to connect to user-service";
-          throw std::runtime_error("Failed to connect to user-service");
-        }
-        int64_t _return;
-        try {
-          json req_jso = {
-              {"req_id", req_id},
-              {"user_name", user_name},
-              {"carrier", writer_text_map},
-          };
-          auto res = user_client->PostJson("/GetUserId", req_jso);
-          _return = res["user_id"].get<int64_t>();
-        } catch (...) {
-          _user_service_client_pool->Remove(user_client);
-          LOG(error) << "Failed to get user_id from user-service";
-          throw;
-        }
-        _user_service_client_pool->Keepalive(user_client);
-        return _return;
-      });
+  auto span = StartSpan("unfollow_with_username_server", carrier);
+  span.Inject(&writer_text_map);
 
-  int64_t user_id;
-  int64_t followee_id;
-  try {
-    user_id = user_id_future.get();
-    followee_id = followee_id_future.get();
-  } catch (...) {
-    throw;
-  }
+  // Both names are resolved by one user-service request.
+  auto user_ids =
+      _GetUserIds(req_id, {user_name, followee_name}, writer_text_map);
+  int64_t user_id = user_ids[0];
+  int64_t followee_id = user_ids[1];
 
   if (user_id >= 0 && followee_id >= 0) {
     try {
@@ -943,7 +878,7 @@ void SocialGraphHandler::UnfollowWithUsername(
       throw;
     }
   }
-  // span->Finish();
+  span.Finish();
 }
 
 }  // namespace social_network
@@ -7,7 +7,8 @@
 #include "../utils_mongodb.h"
 #include "../utils_redis.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../ClientPool.h"
 #include "SocialGraphHandler.h"
 
@@ -44,12 +45,13 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // SetUpTracer("config/jaeger-config.yml", "social-graph-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "social-graph-service");
+  SetUpClientPools(config_json);
 
   int port = config_json["social-graph-service"]["port"];
 
@@ -96,6 +98,7 @@ int main(int argc, char *argv[]) {
   mongoc_client_pool_push(mongodb_client_pool, mongodb_client);
 
   httplib::Server server;
+  SetUpServerMetrics(&server, "social-graph-service");
 
   if (redis_cluster_flag || redis_cluster_config_flag) {
     RedisCluster redis_cluster_client_pool =
@@ -207,6 +210,20 @@ int main(int argc, char *argv[]) {
       }
     });
 
+    server.Post("/InsertUsers", [&](const httplib::Request &req, httplib::Response &res) {
+      try {
+        auto j = json::parse(req.body);
+        int64_t req_id = j["req_id"];
+        std::vector<int64_t> user_ids = j["user_ids"];
+        std::map<std::string, std::string> carrier = j["carrier"];
+        handler.InsertUsers(req_id, user_ids, carrier);
+        res.set_content("{\"status\":\"ok\"}", "application/json");
+      } catch (std::exception &e) {
+        res.status = 500;
+        res.set_content("{\"error\":\"exception\"}", "application/json");
+      }
+    });
+
     LOG(info) << "Starting the social-graph-service server with Redis Cluster support...";
     server.listen("0.0.0.0", port);
   } else if (redis_replica_config_flag) {
@@ -320,6 +337,20 @@ int main(int argc, char *argv[]) {
       }
     });
 
+    server.Post("/InsertUsers", [&](const httplib::Request &req, httplib::Response &res) {
+      try {
+        auto j = json::parse(req.body);
+        int64_t req_id = j["req_id"];
+        std::vector<int64_t> user_ids = j["user_ids"];
+        std::map<std::string, std::string> carrier = j["carrier"];
+        handler.InsertUsers(req_id, user_ids, carrier);
+        res.set_content("{\"status\":\"ok\"}", "application/json");
+      } catch (std::exception &e) {
+        res.status = 500;
+        res.set_content("{\"error\":\"exception\"}", "application/json");
+      }
+    });
+
     LOG(info) << "Starting the social-graph-service server with Redis replica support";
     server.listen("0.0.0.0", port);
   } else {
@@ -430,6 +461,20 @@ int main(int argc, char *argv[]) {
       }
     });
 
+    server.Post("/InsertUsers", [&](const httplib::Request &req, httplib::Response &res) {
+      try {
+        auto j = json::parse(req.body);
+        int64_t req_id = j["req_id"];
+        std::vector<int64_t> user_ids = j["user_ids"];
+        std::map<std::string, std::string> carrier = j["carrier"];
+        handler.InsertUsers(req_id, user_ids, carrier);
+        res.set_content("{\"status\":\"ok\"}", "application/json");
+      } catch (std::exception &e) {
+        res.status = 500;
+        res.set_content("{\"error\":\"exception\"}", "application/json");
+      }
+    });
+
     LOG(info) << "Starting the social-graph-service server ...";
     server.listen("0.0.0.0", port);
   }
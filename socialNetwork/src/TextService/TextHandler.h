@@ -10,7 +10,7 @@
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
 
 namespace social_network {
 
@@ -40,13 +40,9 @@ void TextHandler::ComposeText(
     int64_t req_id, const std::string &text,
     const std::map<std::string, std::string> &carrier) {
   // Initialize a span
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "compose_text_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("compose_text_server", carrier);
+  span.Inject(&writer_text_map);
 
   std::vector<std::string> mention_usernames;
   std::smatch m;
@@ -69,11 +65,9 @@ void TextHandler::ComposeText(
   }
 
   auto shortened_urls_future = std::async(std::launch::async, [&]() {
-    // auto url_span = opentracing::Tracer::Global()->StartSpan(
-    //     "compose_urls_client", {opentracing::ChildOf(&span->context())});
+    auto url_span = StartSpan("compose_urls_client", span);
     std::map<std::string, std::string> url_writer_text_map;
-    // TextMapWriter url_writer(url_writer_text_map);
-    // opentracing::Tracer::Global()->Inject(url_span->context(), url_writer);
+    url_span.Inject(&url_writer_text_map);
 
     auto url_client = _url_client_pool->Pop();
     if (!url_client) {
@@ -91,7 +85,7 @@ void TextHandler::ComposeText(
       LOG(error) << "Failed HTTP call to url-shorten-service: " << e.what();
       throw;
     }
-    // url_span->Finish();
+    url_span.Finish();
     std::vector<nlohmann::json> result_urls;
     if (resp_json.contains("urls")) {
       for (auto &item : resp_json["urls"]) {
@@ -102,11 +96,9 @@ void TextHandler::ComposeText(
   });
 
   auto user_mention_future = std::async(std::launch::async, [&]() {
-    // auto user_mention_span = opentracing::Tracer::Global()->StartSpan(
-    //     "compose_user_mentions_client", {opentracing::ChildOf(&span->context())});
+    auto user_mention_span = StartSpan("compose_user_mentions_client", span);
     std::map<std::string, std::string> user_mention_writer_text_map;
-    // TextMapWriter user_mention_writer(user_mention_writer_text_map);
-    // opentracing::Tracer::Global()->Inject(user_mention_span->context(), user_mention_writer);
+    user_mention_span.Inject(&user_mention_writer_text_map);
 
     auto user_mention_client = _user_mention_client_pool->Pop();
     if (!user_mention_client) {
@@ -125,7 +117,7 @@ void TextHandler::ComposeText(
       LOG(error) << "Failed HTTP call to user-mention-service: " << e.what();
       throw;
     }
-    // user_mention_span->Finish();
+    user_mention_span.Finish();
     std::vector<nlohmann::json> result_mentions;
     if (resp_json.contains("user_mentions")) {
       for (auto &item : resp_json["user_mentions"]) {
@@ -169,7 +161,7 @@ void TextHandler::ComposeText(
   user_mentions_out = user_mentions;
   urls_out = target_urls;
   updated_text = updated_text_;
-  // span->Finish();
+  span.Finish();
 }
 
 }  // namespace social_network
@@ -7,7 +7,8 @@
  #include "../HttpClientWrapper.h"
  #include "../ClientPool.h"
  #include "../logger.h"
- #include "../tracing.h"
+ #include "../span_recorder.h"
+ #include "../metrics.h"
  #include "TextHandler.h"
 
  using json = nlohmann::json;
@@ -18,12 +19,13 @@ void sigintHandler(int sig) { exit(EXIT_SUCCESS); }
  int main(int argc, char *argv[]) {
      signal(SIGINT, sigintHandler);
      init_logger();
-    //  SetUpTracer("config/jaeger-config.yml", "text-service");
 
      json config_json;
      if (load_config_file("config/service-config.json", &config_json) != 0) {
          exit(EXIT_FAILURE);
      }
+     SetUpSpanRecorder(config_json, "text-service");
+     SetUpClientPools(config_json);
 
      int port = config_json["text-service"]["port"];
      std::string url_addr = config_json["url-shorten-service"]["addr"];
@@ -47,6 +49,7 @@ void sigintHandler(int sig) { exit(EXIT_SUCCESS); }
 
      TextHandler handler(&url_client_pool, &user_mention_client_pool);
      httplib::Server server;
+     SetUpServerMetrics(&server, "text-service");
 
      server.Post("/ComposeText", [&](const httplib::Request &req, httplib::Response &res) {
          try {
@@ -42,6 +42,7 @@ class ThriftClient : public GenericClient {
   ~ThriftClient() override;
 
   TThriftClient *GetClient() const;
+  int GetSocketFd() const;
 
   void Connect() override;
   void Disconnect() override;
@@ -118,6 +119,11 @@ TThriftClient *ThriftClient<TThriftClient>::GetClient() const {
   return _client;
 }
 
+template<class TThriftClient>
+int ThriftClient<TThriftClient>::GetSocketFd() const {
+  return _socket->getSocketFD();
+}
+
 template<class TThriftClient>
 bool ThriftClient<TThriftClient>::IsConnected() {
   return _transport->isOpen();
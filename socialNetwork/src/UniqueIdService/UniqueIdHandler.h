@@ -9,7 +9,7 @@
 #include <string>
 
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
 
 // Custom Epoch (January 1, 2018 Midnight GMT = 2018-01-01T00:00:00Z)
 #define CUSTOM_EPOCH 1514764800000
@@ -61,13 +61,9 @@ int64_t UniqueIdHandler::ComposeUniqueId(
   int64_t req_id, int /*post_type*/,
   const std::map<std::string, std::string> &carrier) {
   // Initialize a span
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "compose_unique_id_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("compose_unique_id_server", carrier);
+  span.Inject(&writer_text_map);
 
   _thread_lock->lock();
   int64_t timestamp =
@@ -103,7 +99,7 @@ int64_t UniqueIdHandler::ComposeUniqueId(
   int64_t post_id = stoul(post_id_str, nullptr, 16) & 0x7FFFFFFFFFFFFFFF;
   LOG(debug) << "The post_id of the request " << req_id << " is " << post_id;
 
-  // span->Finish();
+  span.Finish();
   return post_id;
 }
 
@@ -17,7 +17,8 @@
 
 #include "../utils.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../HttpClientWrapper.h"  // for httplib server
 #include "UniqueIdHandler.h"
 
@@ -29,12 +30,12 @@ void sigintHandler(int sig) { exit(EXIT_SUCCESS); }
 int main(int argc, char *argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
-  // SetUpTracer("config/jaeger-config.yml", "unique-id-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "unique-id-service");
 
   int port = config_json["unique-id-service"]["port"];
   std::string netif = config_json["unique-id-service"]["netif"];
@@ -48,6 +49,7 @@ int main(int argc, char *argv[]) {
   std::mutex thread_lock;
   UniqueIdHandler handler(&thread_lock, machine_id);
   httplib::Server server;
+  SetUpServerMetrics(&server, "unique-id-service");
 
   server.Post("/ComposeUniqueId", [&](const httplib::Request &req, httplib::Response &res) {
     try {
@@ -6,7 +6,8 @@
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../HttpClientWrapper.h"  // for httplib::Server
 #include "UrlShortenHandler.h"
 
@@ -28,11 +29,11 @@ void sigintHandler(int sig) {
 int main(int argc, char* argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
-  // SetUpTracer("config/jaeger-config.yml", "url-shorten-service");
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "url-shorten-service");
   int port = config_json["url-shorten-service"]["port"];
 
   int mongodb_conns = config_json["url-shorten-mongodb"]["connections"];
@@ -67,6 +68,7 @@ int main(int argc, char* argv[]) {
   std::mutex thread_lock;
   UrlShortenHandler handler(memcached_client_pool, mongodb_client_pool, &thread_lock);
   httplib::Server server;
+  SetUpServerMetrics(&server, "url-shorten-service");
 
   server.Post("/ComposeUrls", [&](const httplib::Request &req, httplib::Response &res) {
     try {
@@ -8,7 +8,7 @@
 
 #include "../social_network_types.h"
 #include "../logger.h"
-// #include "../tracing.h"
+#include "../span_recorder.h"
 #include "../utils.h"
 
 namespace social_network {
@@ -39,14 +39,9 @@ void UserMentionHandler::ComposeUserMentions(
     const std::vector<std::string> &usernames,
     const std::map<std::string, std::string> &carrier) {
   // Initialize a span
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "compose_user_mentions_server",
-  //     {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("compose_user_mentions_server", carrier);
+  span.Inject(&writer_text_map);
 
   std::vector<UserMention> user_mentions;
   if (!usernames.empty()) {
@@ -77,15 +72,16 @@ void UserMentionHandler::ComposeUserMentions(
       idx++;
     }
 
-    // auto get_span = opentracing::Tracer::Global()->StartSpan(
-    //     "compose_user_mentions_memcached_get_client",
-    //     {opentracing::ChildOf(&span->context())});
+    auto get_span =
+        StartSpan("compose_user_mentions_memcached_get_client", span);
+    ScopedTiming get_timing(TimingStage::MEMCACHED);
     rc = memcached_mget(client, keys, key_sizes, usernames.size());
     if (rc != MEMCACHED_SUCCESS) {
       LOG(error) << "Cannot get usernames of request " << req_id << ": "
                  << memcached_strerror(client, rc);
       memcached_pool_push(_memcached_client_pool, client);
-      // get_span->Finish();
+      get_timing.Stop();
+      get_span.Finish();
       throw std::runtime_error("memcached mget failed");
     }
 
@@ -108,7 +104,8 @@ void UserMentionHandler::ComposeUserMentions(
         memcached_quit(client);
         memcached_pool_push(_memcached_client_pool, client);
         LOG(error) << "Cannot get components of request " << req_id;
-        // get_span->Finish();
+        get_timing.Stop();
+        get_span.Finish();
         throw std::runtime_error("memcached fetch failed");
       }
       UserMention new_user_mention;
@@ -124,7 +121,8 @@ void UserMentionHandler::ComposeUserMentions(
     }
     memcached_quit(client);
     memcached_pool_push(_memcached_client_pool, client);
-    // get_span->Finish();
+    get_timing.Stop();
+    get_span.Finish();
     for (int i = 0; i < usernames.size(); ++i) {
       delete keys[i];
     }
@@ -165,9 +163,8 @@ void UserMentionHandler::ComposeUserMentions(
       bson_append_array_end(&query_child_0, &query_username_list);
       bson_append_document_end(query, &query_child_0);
 
-      // auto find_span = opentracing::Tracer::Global()->StartSpan(
-      //     "compose_user_mentions_mongo_find_client",
-      //     {opentracing::ChildOf(&span->context())});
+      auto find_span =
+          StartSpan("compose_user_mentions_mongo_find_client", span);
       mongoc_cursor_t *cursor =
           mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
       const bson_t *doc;
@@ -183,7 +180,7 @@ void UserMentionHandler::ComposeUserMentions(
           mongoc_cursor_destroy(cursor);
           mongoc_collection_destroy(collection);
           mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-          // find_span->Finish();
+          find_span.Finish();
           throw std::runtime_error("mongodb item incomplete");
         }
         if (bson_iter_init_find(&iter, doc, "username")) {
@@ -194,7 +191,7 @@ void UserMentionHandler::ComposeUserMentions(
           mongoc_cursor_destroy(cursor);
           mongoc_collection_destroy(collection);
           mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-          // find_span->Finish();
+          find_span.Finish();
           throw std::runtime_error("mongodb item incomplete");
         }
         user_mentions.emplace_back(new_user_mention);
@@ -203,12 +200,12 @@ void UserMentionHandler::ComposeUserMentions(
       mongoc_cursor_destroy(cursor);
       mongoc_collection_destroy(collection);
       mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-      // find_span->Finish();
+      find_span.Finish();
     }
   }
 
   _return = user_mentions;
-  // span->Finish();
+  span.Finish();
 }
 
 }  // namespace social_network
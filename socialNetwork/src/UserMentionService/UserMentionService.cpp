@@ -6,7 +6,8 @@
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../HttpClientWrapper.h"  // for httplib::Server
 #include "UserMentionHandler.h"
 
@@ -29,12 +30,12 @@ void sigintHandler(int sig) {
 int main(int argc, char* argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
-  // SetUpTracer("config/jaeger-config.yml", "user-mention-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "user-mention-service");
 
   int port = config_json["user-mention-service"]["port"];
 
@@ -54,6 +55,7 @@ int main(int argc, char* argv[]) {
 
   UserMentionHandler handler(memcached_client_pool, mongodb_client_pool);
   httplib::Server server;
+  SetUpServerMetrics(&server, "user-mention-service");
 
   server.Post("/ComposeUserMentions", [&](const httplib::Request &req, httplib::Response &res) {
     try {
@@ -0,0 +1,108 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_SRC_USERSERVICE_SESSIONCACHE_H_
+#define SOCIAL_NETWORK_MICROSERVICES_SRC_USERSERVICE_SESSIONCACHE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace social_network {
+
+// Session tokens issued by UserHandler::Login, keyed by username and a hash
+// of the credentials that were verified to obtain them. A repeated login with
+// the same credentials within ttl_s gets the same token back without another
+// store lookup, password hash or JWT signature. Entries are never refreshed,
+// so a token handed out from the cache is at most ttl_s old.
+class SessionCache {
+ public:
+  SessionCache(int ttl_s, size_t max_entries);
+
+  SessionCache(const SessionCache &) = delete;
+  SessionCache &operator=(const SessionCache &) = delete;
+
+  bool Get(const std::string &username, const std::string &credential_hash,
+           std::string *token);
+  void Put(const std::string &username, const std::string &credential_hash,
+           const std::string &token);
+
+ private:
+  struct Entry {
+    std::string token;
+    std::chrono::steady_clock::time_point expire_at;
+  };
+  struct Shard {
+    std::unordered_map<std::string, Entry> entries;
+    std::mutex mtx;
+  };
+
+  static constexpr size_t kNumShards = 16;
+
+  Shard &_GetShard(const std::string &key);
+
+  std::vector<std::unique_ptr<Shard>> _shards;
+  std::chrono::seconds _ttl;
+  size_t _max_entries_per_shard;
+};
+
+SessionCache::SessionCache(int ttl_s, size_t max_entries) {
+  _ttl = std::chrono::seconds(ttl_s);
+  _max_entries_per_shard = std::max<size_t>(max_entries / kNumShards, 1);
+  for (size_t i = 0; i < kNumShards; ++i) {
+    _shards.emplace_back(new Shard);
+  }
+}
+
+SessionCache::Shard &SessionCache::_GetShard(const std::string &key) {
+  return *_shards[std::hash<std::string>()(key) % kNumShards];
+}
+
+bool SessionCache::Get(const std::string &username,
+                       const std::string &credential_hash,
+                       std::string *token) {
+  std::string key = username + ":" + credential_hash;
+  auto &shard = _GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  auto it = shard.entries.find(key);
+  if (it == shard.entries.end()) {
+    return false;
+  }
+  if (it->second.expire_at <= std::chrono::steady_clock::now()) {
+    shard.entries.erase(it);
+    return false;
+  }
+  *token = it->second.token;
+  return true;
+}
+
+void SessionCache::Put(const std::string &username,
+                       const std::string &credential_hash,
+                       const std::string &token) {
+  std::string key = username + ":" + credential_hash;
+  auto now = std::chrono::steady_clock::now();
+  auto &shard = _GetShard(key);
+  std::lock_guard<std::mutex> lock(shard.mtx);
+  if (shard.entries.size() >= _max_entries_per_shard &&
+      !shard.entries.count(key)) {
+    for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+      if (it->second.expire_at <= now) {
+        it = shard.entries.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    // Still full of live sessions: make room at random, a miss only costs
+    // a regular login.
+    if (shard.entries.size() >= _max_entries_per_shard) {
+      shard.entries.erase(shard.entries.begin());
+    }
+  }
+  shard.entries[key] = Entry{token, now + _ttl};
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_SRC_USERSERVICE_SESSIONCACHE_H_
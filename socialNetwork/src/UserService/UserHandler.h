@@ -6,19 +6,23 @@
 #include <libmemcached/util.h>
 #include <mongoc.h>
 
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <jwt/jwt.hpp>
 #include <nlohmann/json.hpp>
-#include <random>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "../social_network_types.h"
-#include "../../third_party/PicoSHA2/picosha2.h"
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
 #include "../logger.h"
-// #include "../tracing.h"  // Tracing disabled
+#include "../utils_random.h"
+#include "../utils_sha256.h"
+#include "SessionCache.h"
+#include "../span_recorder.h"
 
 // Custom Epoch (January 1, 2018 Midnight GMT = 2018-01-01T00:00:00Z)
 #define CUSTOM_EPOCH 1514764800000
@@ -50,27 +54,20 @@ static int GetCounter(int64_t timestamp) {
   }
 }
 
-std::string GenRandomString(const int len) {
-  static const std::string alphanum =
-      "0123456789"
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-      "abcdefghijklmnopqrstuvwxyz";
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<int> dist(
-      0, static_cast<int>(alphanum.length() - 1));
-  std::string s;
-  for (int i = 0; i < len; ++i) {
-    s += alphanum[dist(gen)];
-  }
-  return s;
-}
+// One entry of a RegisterUsersBulk request.
+struct NewUser {
+  int64_t user_id;
+  std::string first_name;
+  std::string last_name;
+  std::string username;
+  std::string password;
+};
 
 class UserHandler {
  public:
   UserHandler(std::mutex *, const std::string &, const std::string &,
               memcached_pool_st *, mongoc_client_pool_t *,
-        ClientPool<HttpClientWrapper> *);
+        ClientPool<HttpClientWrapper> *, SessionCache *);
   ~UserHandler() = default;
   void RegisterUser(int64_t, const std::string &, const std::string &,
           const std::string &, const std::string &,
@@ -78,6 +75,9 @@ class UserHandler {
   void RegisterUserWithId(int64_t, const std::string &, const std::string &,
                           const std::string &, const std::string &, int64_t,
               const std::map<std::string, std::string> &);
+  std::vector<int64_t> RegisterUsersBulk(
+      int64_t, const std::vector<NewUser> &,
+      const std::map<std::string, std::string> &);
 
   void ComposeCreatorWithUserId(
       Creator &, int64_t, int64_t, const std::string &,
@@ -89,6 +89,8 @@ class UserHandler {
        const std::map<std::string, std::string> &);
   int64_t GetUserId(int64_t, const std::string &,
           const std::map<std::string, std::string> &);
+  std::vector<int64_t> GetUserIds(int64_t, const std::vector<std::string> &,
+                                  const std::map<std::string, std::string> &);
 
  private:
   std::string _machine_id;
@@ -97,19 +99,22 @@ class UserHandler {
   memcached_pool_st *_memcached_client_pool;
   mongoc_client_pool_t *_mongodb_client_pool;
   ClientPool<HttpClientWrapper> *_social_graph_client_pool;
+  SessionCache *_session_cache;
 };
 
 UserHandler::UserHandler(std::mutex *thread_lock, const std::string &machine_id,
                          const std::string &secret,
                          memcached_pool_st *memcached_client_pool,
                          mongoc_client_pool_t *mongodb_client_pool,
-                         ClientPool<HttpClientWrapper> *social_graph_client_pool) {
+                         ClientPool<HttpClientWrapper> *social_graph_client_pool,
+                         SessionCache *session_cache) {
   _thread_lock = thread_lock;
   _machine_id = machine_id;
   _memcached_client_pool = memcached_client_pool;
   _mongodb_client_pool = mongodb_client_pool;
   _secret = secret;
   _social_graph_client_pool = social_graph_client_pool;
+  _session_cache = session_cache;
 }
 
 void UserHandler::RegisterUserWithId(
@@ -117,15 +122,9 @@ void UserHandler::RegisterUserWithId(
     const std::string &last_name, const std::string &username,
     const std::string &password, const int64_t user_id,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "register_user_withid_server",
-  //     {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  auto span = StartSpan("register_user_withid_server", carrier);
+  span.Inject(&writer_text_map);
 
   // Store user info into mongodb
   mongoc_client_t *mongodb_client =
@@ -166,12 +165,11 @@ void UserHandler::RegisterUserWithId(
     BSON_APPEND_UTF8(new_doc, "username", username.c_str());
     std::string salt = GenRandomString(32);
     BSON_APPEND_UTF8(new_doc, "salt", salt.c_str());
-    std::string password_hashed = picosha2::hash256_hex_string(password + salt);
+    std::string password_hashed = sha256_hex_string(password + salt);
     BSON_APPEND_UTF8(new_doc, "password", password_hashed.c_str());
 
     bson_error_t error;
-  // auto user_insert_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mongo_insert_cilent", {opentracing::ChildOf(&span->context())});
+    auto user_insert_span = StartSpan("user_mongo_insert_cilent", span);
     if (!mongoc_collection_insert_one(collection, new_doc, nullptr, nullptr,
                                       &error)) {
       LOG(error) << "Failed to insert user " << username
@@ -185,7 +183,7 @@ void UserHandler::RegisterUserWithId(
     } else {
       LOG(debug) << "User: " << username << " registered";
     }
-  // user_insert_span->Finish();
+    user_insert_span.Finish();
     bson_destroy(new_doc);
   }
   bson_destroy(query);
@@ -211,7 +209,227 @@ void UserHandler::RegisterUserWithId(
     _social_graph_client_pool->Keepalive(social_graph_client);
   }
 
-  // span->Finish();
+  span.Finish();
+}
+
+// Bulk version of RegisterUserWithId for loading datasets. A batch with a
+// username that already exists is rejected as a whole by a single $in query.
+// Like RegisterUser's check, it is not atomic with the insert. The documents
+// then go in with one unordered bulk write, which can insert some users and
+// fail on others, e.g. on a user_id that is taken. Only the inserted users
+// get social-graph entries, created with one InsertUsers call, and
+// login/user_id entries in memcached, so that the first logins after a load
+// do not all fall through to MongoDB. Returns the user_ids inserted, and
+// throws if none were.
+std::vector<int64_t> UserHandler::RegisterUsersBulk(
+    const int64_t req_id, const std::vector<NewUser> &users,
+    const std::map<std::string, std::string> &carrier) {
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("register_users_bulk_server", carrier);
+  span.Inject(&writer_text_map);
+
+  std::vector<int64_t> user_ids;
+  if (users.empty()) {
+    return user_ids;
+  }
+  std::set<std::string> usernames;
+  for (auto &user : users) {
+    if (!usernames.insert(user.username).second) {
+      throw std::runtime_error("User " + user.username +
+                               " appears more than once in the batch");
+    }
+  }
+
+  mongoc_client_t *mongodb_client =
+      mongoc_client_pool_pop(_mongodb_client_pool);
+  if (!mongodb_client) {
+    throw std::runtime_error("Failed to pop a client from MongoDB pool");
+  }
+  auto collection =
+      mongoc_client_get_collection(mongodb_client, "user", "user");
+  if (!collection) {
+    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    throw std::runtime_error("Failed to create collection user from DB user");
+  }
+
+  // Check if any of the usernames has existed in the database
+  bson_t *query = bson_new();
+  bson_t query_child;
+  bson_t query_username_list;
+  const char *key;
+  char buf[16];
+  uint32_t idx = 0;
+  BSON_APPEND_DOCUMENT_BEGIN(query, "username", &query_child);
+  BSON_APPEND_ARRAY_BEGIN(&query_child, "$in", &query_username_list);
+  for (auto &username : usernames) {
+    bson_uint32_to_string(idx, &key, buf, sizeof buf);
+    BSON_APPEND_UTF8(&query_username_list, key, username.c_str());
+    idx++;
+  }
+  bson_append_array_end(&query_child, &query_username_list);
+  bson_append_document_end(query, &query_child);
+  bson_t *opts = BCON_NEW("projection", "{", "username", BCON_BOOL(true), "}",
+                          "limit", BCON_INT64(1));
+
+  auto find_span = StartSpan("user_mongo_find_client", span);
+  mongoc_cursor_t *cursor =
+      mongoc_collection_find_with_opts(collection, query, opts, nullptr);
+  const bson_t *doc;
+  bson_error_t error;
+  bool found = mongoc_cursor_next(cursor, &doc);
+  std::string existing_username;
+  if (found) {
+    bson_iter_t iter_username;
+    if (bson_iter_init_find(&iter_username, doc, "username")) {
+      existing_username = bson_iter_value(&iter_username)->value.v_utf8.str;
+    }
+  }
+  find_span.Finish();
+  bool cursor_failed = mongoc_cursor_error(cursor, &error);
+  bson_destroy(query);
+  bson_destroy(opts);
+  mongoc_cursor_destroy(cursor);
+  if (cursor_failed) {
+    LOG(error) << error.message;
+    mongoc_collection_destroy(collection);
+    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    throw std::runtime_error(error.message);
+  } else if (found) {
+    LOG(warning) << "User " << existing_username << " already existed.";
+    mongoc_collection_destroy(collection);
+    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    throw std::runtime_error("User " + existing_username + " already existed");
+  }
+
+  std::vector<json> logins;
+  bson_t *bulk_opts = BCON_NEW("ordered", BCON_BOOL(false));
+  mongoc_bulk_operation_t *bulk =
+      mongoc_collection_create_bulk_operation_with_opts(collection, bulk_opts);
+  bson_destroy(bulk_opts);
+  for (auto &user : users) {
+    json login_json;
+    login_json["salt"] = GenRandomString(32);
+    login_json["password"] = sha256_hex_string(
+        user.password + login_json["salt"].get<std::string>());
+    login_json["user_id"] = user.user_id;
+
+    bson_t *new_doc = bson_new();
+    BSON_APPEND_INT64(new_doc, "user_id", user.user_id);
+    BSON_APPEND_UTF8(new_doc, "first_name", user.first_name.c_str());
+    BSON_APPEND_UTF8(new_doc, "last_name", user.last_name.c_str());
+    BSON_APPEND_UTF8(new_doc, "username", user.username.c_str());
+    BSON_APPEND_UTF8(new_doc, "salt",
+                     login_json["salt"].get<std::string>().c_str());
+    BSON_APPEND_UTF8(new_doc, "password",
+                     login_json["password"].get<std::string>().c_str());
+    mongoc_bulk_operation_insert(bulk, new_doc);
+    bson_destroy(new_doc);
+    logins.emplace_back(std::move(login_json));
+  }
+
+  auto user_insert_span = StartSpan("user_mongo_bulk_insert_client", span);
+  bson_t reply;
+  bool executed = mongoc_bulk_operation_execute(bulk, &reply, &error);
+  user_insert_span.Finish();
+  // A failed bulk write that only has per-document errors inserted every
+  // other document. Any other failure leaves the outcome unknown.
+  std::vector<bool> inserted(users.size(), executed);
+  bson_iter_t iter;
+  bson_iter_t write_errors;
+  if (!executed && !bson_has_field(&reply, "writeConcernErrors") &&
+      bson_iter_init_find(&iter, &reply, "writeErrors") &&
+      BSON_ITER_HOLDS_ARRAY(&iter) && bson_iter_recurse(&iter, &write_errors)) {
+    inserted.assign(users.size(), true);
+    while (bson_iter_next(&write_errors)) {
+      bson_iter_t write_error;
+      if (BSON_ITER_HOLDS_DOCUMENT(&write_errors) &&
+          bson_iter_recurse(&write_errors, &write_error) &&
+          bson_iter_find(&write_error, "index") &&
+          BSON_ITER_HOLDS_INT32(&write_error)) {
+        int32_t i = bson_iter_int32(&write_error);
+        if (i >= 0 && static_cast<size_t>(i) < users.size()) {
+          inserted[i] = false;
+        }
+      }
+    }
+  }
+  bson_destroy(&reply);
+  mongoc_bulk_operation_destroy(bulk);
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+
+  std::vector<NewUser> inserted_users;
+  std::vector<json> inserted_logins;
+  for (size_t i = 0; i < users.size(); ++i) {
+    if (inserted[i]) {
+      user_ids.emplace_back(users[i].user_id);
+      inserted_users.emplace_back(users[i]);
+      inserted_logins.emplace_back(std::move(logins[i]));
+    }
+  }
+  if (!executed) {
+    LOG(error) << "Failed to insert " << users.size() - user_ids.size()
+               << " of " << users.size()
+               << " users to MongoDB: " << error.message;
+    if (user_ids.empty()) {
+      throw std::runtime_error("Failed to insert users to MongoDB: " +
+                               std::string(error.message));
+    }
+  }
+  LOG(debug) << user_ids.size() << " users registered";
+
+  auto social_graph_client = _social_graph_client_pool->Pop();
+  if (!social_graph_client) {
+    throw std::runtime_error("Failed to connect to social-graph-service");
+  }
+  try {
+    json req_j = {{"req_id", req_id}, {"user_ids", user_ids},
+                  {"carrier", writer_text_map}};
+    auto res = social_graph_client->PostJson("/InsertUsers", req_j);
+    (void)res;
+  } catch (...) {
+    _social_graph_client_pool->Remove(social_graph_client);
+    LOG(error) << "Failed to insert users to social-graph-client";
+    throw;
+  }
+  _social_graph_client_pool->Keepalive(social_graph_client);
+
+  memcached_return_t memcached_rc;
+  memcached_st *memcached_client =
+      memcached_pool_pop(_memcached_client_pool, true, &memcached_rc);
+  if (!memcached_client) {
+    LOG(warning) << "Failed to pop a client from memcached pool";
+  } else {
+    auto set_login_span = StartSpan("user_mmc_set_client", span);
+    ScopedTiming set_login_timing(TimingStage::MEMCACHED);
+    for (size_t i = 0; i < inserted_users.size(); ++i) {
+      auto &username = inserted_users[i].username;
+      std::string login_str = inserted_logins[i].dump();
+      std::string user_id_str = std::to_string(inserted_users[i].user_id);
+      memcached_rc =
+          memcached_set(memcached_client, (username + ":login").c_str(),
+                        (username + ":login").length(), login_str.c_str(),
+                        login_str.length(), 0, 0);
+      if (memcached_rc == MEMCACHED_SUCCESS) {
+        memcached_rc = memcached_set(
+            memcached_client, (username + ":user_id").c_str(),
+            (username + ":user_id").length(), user_id_str.c_str(),
+            user_id_str.length(), 0, 0);
+      }
+      if (memcached_rc != MEMCACHED_SUCCESS) {
+        LOG(warning) << "Failed to set the login info of user " << username
+                     << " to Memcached: "
+                     << memcached_strerror(memcached_client, memcached_rc);
+        break;
+      }
+    }
+    set_login_timing.Stop();
+    set_login_span.Finish();
+    memcached_pool_push(_memcached_client_pool, memcached_client);
+  }
+
+  span.Finish();
+  return user_ids;
 }
 
 void UserHandler::RegisterUser(
@@ -219,14 +437,9 @@ void UserHandler::RegisterUser(
     const std::string &last_name, const std::string &username,
     const std::string &password,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "register_user_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  auto span = StartSpan("register_user_server", carrier);
+  span.Inject(&writer_text_map);
 
   // Compose user_id
   _thread_lock->lock();
@@ -301,11 +514,10 @@ void UserHandler::RegisterUser(
     BSON_APPEND_UTF8(new_doc, "username", username.c_str());
     std::string salt = GenRandomString(32);
     BSON_APPEND_UTF8(new_doc, "salt", salt.c_str());
-    std::string password_hashed = picosha2::hash256_hex_string(password + salt);
+    std::string password_hashed = sha256_hex_string(password + salt);
     BSON_APPEND_UTF8(new_doc, "password", password_hashed.c_str());
 
-  // auto user_insert_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mongo_insert_client", {opentracing::ChildOf(&span->context())});
+    auto user_insert_span = StartSpan("user_mongo_insert_client", span);
     if (!mongoc_collection_insert_one(collection, new_doc, nullptr, nullptr,
                                       &error)) {
       LOG(error) << "Failed to insert user " << username
@@ -319,7 +531,7 @@ void UserHandler::RegisterUser(
     } else {
       LOG(debug) << "User: " << username << " registered";
     }
-  // user_insert_span->Finish();
+    user_insert_span.Finish();
     bson_destroy(new_doc);
   }
   bson_destroy(query);
@@ -346,20 +558,15 @@ void UserHandler::RegisterUser(
     _social_graph_client_pool->Keepalive(social_graph_client);
   }
 
-  // span->Finish();
+  span.Finish();
 }
 
 void UserHandler::ComposeCreatorWithUsername(
     Creator &_return, const int64_t req_id, const std::string &username,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "compose_creator_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("compose_creator_server", carrier);
+  span.Inject(&writer_text_map);
 
   size_t user_id_size;
   uint32_t memcached_flags;
@@ -369,13 +576,14 @@ void UserHandler::ComposeCreatorWithUsername(
       memcached_pool_pop(_memcached_client_pool, true, &memcached_rc);
   char *user_id_mmc;
   if (memcached_client) {
-    // auto id_get_span = opentracing::Tracer::Global()->StartSpan(
-    //     "user_mmc_get_client", {opentracing::ChildOf(&span->context())});
+    auto id_get_span = StartSpan("user_mmc_get_client", span);
+    ScopedTiming id_get_timing(TimingStage::MEMCACHED);
     user_id_mmc =
         memcached_get(memcached_client, (username + ":user_id").c_str(),
                       (username + ":user_id").length(), &user_id_size,
                       &memcached_flags, &memcached_rc);
-    // id_get_span->Finish();
+    id_get_timing.Stop();
+    id_get_span.Finish();
     if (!user_id_mmc && memcached_rc != MEMCACHED_NOTFOUND) {
       auto msg = std::string("Memcached error: ") +
                  memcached_strerror(memcached_client, memcached_rc);
@@ -413,13 +621,12 @@ void UserHandler::ComposeCreatorWithUsername(
     bson_t *query = bson_new();
     BSON_APPEND_UTF8(query, "username", username.c_str());
 
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mongo_find_client", {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("user_mongo_find_client", span);
     mongoc_cursor_t *cursor =
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
     bool found = mongoc_cursor_next(cursor, &doc);
-  // find_span->Finish();
+    find_span.Finish();
     if (!found) {
       bson_error_t error;
       if (mongoc_cursor_error(cursor, &error)) {
@@ -471,15 +678,16 @@ void UserHandler::ComposeCreatorWithUsername(
       memcached_pool_pop(_memcached_client_pool, true, &memcached_rc);
   if (memcached_client) {
     if (user_id != -1 && !cached) {
-    // auto id_set_span = opentracing::Tracer::Global()->StartSpan(
-    //     "user_mmc_set_cilent", {opentracing::ChildOf(&span->context())});
+      auto id_set_span = StartSpan("user_mmc_set_cilent", span);
+      ScopedTiming id_set_timing(TimingStage::MEMCACHED);
       std::string user_id_str = std::to_string(user_id);
       memcached_rc =
           memcached_set(memcached_client, (username + ":user_id").c_str(),
                         (username + ":user_id").length(), user_id_str.c_str(),
                         user_id_str.length(), static_cast<time_t>(0),
                         static_cast<uint32_t>(0));
-    // id_set_span->Finish();
+      id_set_timing.Stop();
+      id_set_span.Finish();
       if (memcached_rc != MEMCACHED_SUCCESS) {
         LOG(warning) << "Failed to set the user_id of user " << username
                      << " to Memcached: "
@@ -490,21 +698,16 @@ void UserHandler::ComposeCreatorWithUsername(
   } else {
     LOG(warning) << "Failed to pop a client from memcached pool";
   }
-  // span->Finish();
+  span.Finish();
 }
 
 void UserHandler::ComposeCreatorWithUserId(
     Creator &_return, int64_t req_id, int64_t user_id,
     const std::string &username,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "compose_creator_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("compose_creator_server", carrier);
+  span.Inject(&writer_text_map);
 
   Creator creator;
   creator.username = username;
@@ -512,21 +715,27 @@ void UserHandler::ComposeCreatorWithUserId(
 
   _return = creator;
 
-  // span->Finish();
+  span.Finish();
 }
 
 void UserHandler::Login(std::string &_return, int64_t req_id,
                         const std::string &username,
                         const std::string &password,
                         const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "login_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("login_server", carrier);
+  span.Inject(&writer_text_map);
+
+  // The credentials are keyed with the JWT secret so that the cache never
+  // holds a plain hash of a password.
+  std::string credential_hash;
+  if (_session_cache) {
+    credential_hash = sha256_hex_string(_secret + password);
+    if (_session_cache->Get(username, credential_hash, &_return)) {
+      LOG(debug) << "Found session of " << username << " in session cache";
+      return;
+    }
+  }
 
   size_t login_size;
   uint32_t memcached_flags;
@@ -538,12 +747,13 @@ void UserHandler::Login(std::string &_return, int64_t req_id,
   if (!memcached_client) {
     LOG(warning) << "Failed to pop a client from memcached pool";
   } else {
-  // auto get_login_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mmc_get_client", {opentracing::ChildOf(&span->context())});
+    auto get_login_span = StartSpan("user_mmc_get_client", span);
+    ScopedTiming get_login_timing(TimingStage::MEMCACHED);
     login_mmc = memcached_get(memcached_client, (username + ":login").c_str(),
                               (username + ":login").length(), &login_size,
                               &memcached_flags, &memcached_rc);
-  // get_login_span->Finish();
+    get_login_timing.Stop();
+    get_login_span.Finish();
     if (!login_mmc && memcached_rc != MEMCACHED_NOTFOUND) {
       LOG(warning) << "Memcached error: "
                    << memcached_strerror(memcached_client, memcached_rc);
@@ -586,13 +796,12 @@ void UserHandler::Login(std::string &_return, int64_t req_id,
     bson_t *query = bson_new();
     BSON_APPEND_UTF8(query, "username", username.c_str());
 
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mongo_find_client", {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("user_mongo_find_client", span);
     mongoc_cursor_t *cursor =
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
     bool found = mongoc_cursor_next(cursor, &doc);
-  // find_span->Finish();
+    find_span.Finish();
 
     bson_error_t error;
     if (mongoc_cursor_error(cursor, &error)) {
@@ -643,7 +852,7 @@ void UserHandler::Login(std::string &_return, int64_t req_id,
   if (user_id_stored != -1 && !salt_stored.empty() &&
       !password_stored.empty()) {
     bool auth =
-        picosha2::hash256_hex_string(password + salt_stored) == password_stored;
+        sha256_hex_string(password + salt_stored) == password_stored;
     if (auth) {
       auto user_id_str = std::to_string(user_id_stored);
       auto timestamp_str = std::to_string(
@@ -655,6 +864,9 @@ void UserHandler::Login(std::string &_return, int64_t req_id,
                                    {"timestamp", timestamp_str},
                                    {"ttl", "3600"}})};
       _return = obj.signature();
+      if (_session_cache) {
+        _session_cache->Put(username, credential_hash, _return);
+      }
     } else {
   throw std::runtime_error("Incorrect username or password");
     }
@@ -669,14 +881,15 @@ void UserHandler::Login(std::string &_return, int64_t req_id,
     if (!memcached_client) {
       LOG(warning) << "Failed to pop a client from memcached pool";
     } else {
-    // auto set_login_span = opentracing::Tracer::Global()->StartSpan(
-    //     "user_mmc_set_client", {opentracing::ChildOf(&span->context())});
+      auto set_login_span = StartSpan("user_mmc_set_client", span);
+      ScopedTiming set_login_timing(TimingStage::MEMCACHED);
       std::string login_str = login_json.dump();
       memcached_rc =
           memcached_set(memcached_client, (username + ":login").c_str(),
                         (username + ":login").length(), login_str.c_str(),
                         login_str.length(), 0, 0);
-    // set_login_span->Finish();
+      set_login_timing.Stop();
+      set_login_span.Finish();
       if (memcached_rc != MEMCACHED_SUCCESS) {
         LOG(warning) << "Failed to set the login info of user " << username
                      << " to Memcached: "
@@ -685,19 +898,14 @@ void UserHandler::Login(std::string &_return, int64_t req_id,
       memcached_pool_push(_memcached_client_pool, memcached_client);
     }
   }
-  // span->Finish();
+  span.Finish();
 }
 int64_t UserHandler::GetUserId(
     int64_t req_id, const std::string &username,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "get_user_id_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("get_user_id_server", carrier);
+  span.Inject(&writer_text_map);
 
   size_t user_id_size;
   uint32_t memcached_flags;
@@ -707,14 +915,14 @@ int64_t UserHandler::GetUserId(
       memcached_pool_pop(_memcached_client_pool, true, &memcached_rc);
   char *user_id_mmc;
   if (memcached_client) {
-  // auto id_get_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mmc_get_user_id_client",
-  //     {opentracing::ChildOf(&span->context())});
+    auto id_get_span = StartSpan("user_mmc_get_user_id_client", span);
+    ScopedTiming id_get_timing(TimingStage::MEMCACHED);
     user_id_mmc =
         memcached_get(memcached_client, (username + ":user_id").c_str(),
                       (username + ":user_id").length(), &user_id_size,
                       &memcached_flags, &memcached_rc);
-  // id_get_span->Finish();
+    id_get_timing.Stop();
+    id_get_span.Finish();
     if (!user_id_mmc && memcached_rc != MEMCACHED_NOTFOUND) {
       auto msg = std::string("Memcached error: ") +
                  memcached_strerror(memcached_client, memcached_rc);
@@ -750,13 +958,12 @@ int64_t UserHandler::GetUserId(
     bson_t *query = bson_new();
     BSON_APPEND_UTF8(query, "username", username.c_str());
 
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_mongo_find_client", {opentracing::ChildOf(&span->context())});
+    auto find_span = StartSpan("user_mongo_find_client", span);
     mongoc_cursor_t *cursor =
         mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
     const bson_t *doc;
     bool found = mongoc_cursor_next(cursor, &doc);
-  // find_span->Finish();
+    find_span.Finish();
     if (!found) {
       bson_error_t error;
       if (mongoc_cursor_error(cursor, &error)) {
@@ -803,13 +1010,14 @@ int64_t UserHandler::GetUserId(
       LOG(warning) << "Failed to pop a client from memcached pool";
     } else {
       std::string user_id_str = std::to_string(user_id);
-    // auto set_login_span = opentracing::Tracer::Global()->StartSpan(
-    //     "user_mmc_set_client", {opentracing::ChildOf(&span->context())});
+      auto set_login_span = StartSpan("user_mmc_set_client", span);
+      ScopedTiming set_login_timing(TimingStage::MEMCACHED);
       memcached_rc =
           memcached_set(memcached_client, (username + ":user_id").c_str(),
                         (username + ":user_id").length(), user_id_str.c_str(),
                         user_id_str.length(), 0, 0);
-    // set_login_span->Finish();
+      set_login_timing.Stop();
+      set_login_span.Finish();
       if (memcached_rc != MEMCACHED_SUCCESS) {
         LOG(warning) << "Failed to set the login info of user " << username
                      << " to Memcached: "
@@ -819,10 +1027,182 @@ int64_t UserHandler::GetUserId(
     }
   }
 
-  // span->Finish();
+  span.Finish();
   return user_id;
 }
 
+// Same as GetUserId for several users at once: one memcached mget for all of
+// them, then a single $in query for the ones that were not cached. The ids
+// are returned in the order of usernames.
+std::vector<int64_t> UserHandler::GetUserIds(
+    int64_t req_id, const std::vector<std::string> &usernames,
+    const std::map<std::string, std::string> &carrier) {
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("get_user_ids_server", carrier);
+  span.Inject(&writer_text_map);
+
+  if (usernames.empty()) {
+    return {};
+  }
+  std::map<std::string, int64_t> user_ids;
+
+  memcached_return_t memcached_rc;
+  memcached_st *memcached_client =
+      memcached_pool_pop(_memcached_client_pool, true, &memcached_rc);
+  if (!memcached_client) {
+    LOG(warning) << "Failed to pop a client from memcached pool";
+  } else {
+    std::vector<std::string> key_strs;
+    std::vector<const char *> keys;
+    std::vector<size_t> key_sizes;
+    for (auto &username : usernames) {
+      key_strs.emplace_back(username + ":user_id");
+    }
+    for (auto &key_str : key_strs) {
+      keys.emplace_back(key_str.c_str());
+      key_sizes.emplace_back(key_str.length());
+    }
+
+    auto get_span = StartSpan("user_mmc_mget_user_id_client", span);
+    ScopedTiming get_timing(TimingStage::MEMCACHED);
+    memcached_rc = memcached_mget(memcached_client, keys.data(),
+                                  key_sizes.data(), keys.size());
+    if (memcached_rc != MEMCACHED_SUCCESS) {
+      LOG(warning) << "Memcached error: "
+                   << memcached_strerror(memcached_client, memcached_rc);
+    } else {
+      char return_key[MEMCACHED_MAX_KEY];
+      size_t return_key_length;
+      char *return_value;
+      size_t return_value_length;
+      uint32_t flags;
+      while (true) {
+        return_value =
+            memcached_fetch(memcached_client, return_key, &return_key_length,
+                            &return_value_length, &flags, &memcached_rc);
+        if (return_value == nullptr) {
+          break;
+        }
+        if (memcached_rc == MEMCACHED_SUCCESS) {
+          std::string username(return_key, return_key + return_key_length);
+          username =
+              username.substr(0, username.length() - std::strlen(":user_id"));
+          user_ids[username] = std::stoul(
+              std::string(return_value, return_value + return_value_length));
+        }
+        free(return_value);
+      }
+    }
+    get_timing.Stop();
+    get_span.Finish();
+    memcached_quit(memcached_client);
+    memcached_pool_push(_memcached_client_pool, memcached_client);
+  }
+
+  std::set<std::string> usernames_not_cached;
+  for (auto &username : usernames) {
+    if (!user_ids.count(username)) {
+      usernames_not_cached.insert(username);
+    }
+  }
+
+  if (!usernames_not_cached.empty()) {
+    LOG(debug) << usernames_not_cached.size()
+               << " user_ids not cached in Memcached";
+    mongoc_client_t *mongodb_client =
+        mongoc_client_pool_pop(_mongodb_client_pool);
+    if (!mongodb_client) {
+      throw std::runtime_error("Failed to pop a client from MongoDB pool");
+    }
+    auto collection =
+        mongoc_client_get_collection(mongodb_client, "user", "user");
+    if (!collection) {
+      mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+      throw std::runtime_error(
+          "Failed to create collection user from DB user");
+    }
+
+    bson_t *query = bson_new();
+    bson_t query_child;
+    bson_t query_username_list;
+    const char *key;
+    char buf[16];
+    uint32_t idx = 0;
+    BSON_APPEND_DOCUMENT_BEGIN(query, "username", &query_child);
+    BSON_APPEND_ARRAY_BEGIN(&query_child, "$in", &query_username_list);
+    for (auto &username : usernames_not_cached) {
+      bson_uint32_to_string(idx, &key, buf, sizeof buf);
+      BSON_APPEND_UTF8(&query_username_list, key, username.c_str());
+      idx++;
+    }
+    bson_append_array_end(&query_child, &query_username_list);
+    bson_append_document_end(query, &query_child);
+
+    auto find_span = StartSpan("user_mongo_find_client", span);
+    mongoc_cursor_t *cursor =
+        mongoc_collection_find_with_opts(collection, query, nullptr, nullptr);
+    const bson_t *doc;
+    std::map<std::string, int64_t> user_ids_found;
+    while (mongoc_cursor_next(cursor, &doc)) {
+      bson_iter_t iter_username;
+      bson_iter_t iter_user_id;
+      if (bson_iter_init_find(&iter_username, doc, "username") &&
+          bson_iter_init_find(&iter_user_id, doc, "user_id")) {
+        user_ids_found[bson_iter_value(&iter_username)->value.v_utf8.str] =
+            bson_iter_value(&iter_user_id)->value.v_int64;
+      } else {
+        LOG(error) << "MongoDB item missing username or user_id";
+      }
+    }
+    find_span.Finish();
+    bson_error_t error;
+    bool cursor_failed = mongoc_cursor_error(cursor, &error);
+    bson_destroy(query);
+    mongoc_cursor_destroy(cursor);
+    mongoc_collection_destroy(collection);
+    mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    if (cursor_failed) {
+      LOG(error) << error.message;
+      throw std::runtime_error(error.message);
+    }
+
+    for (auto &username : usernames_not_cached) {
+      if (!user_ids_found.count(username)) {
+        LOG(warning) << "User: " << username << " doesn't exist in MongoDB";
+        throw std::runtime_error("User: " + username + " is not registered");
+      }
+    }
+
+    memcached_client =
+        memcached_pool_pop(_memcached_client_pool, true, &memcached_rc);
+    if (!memcached_client) {
+      LOG(warning) << "Failed to pop a client from memcached pool";
+    } else {
+      for (auto &item : user_ids_found) {
+        std::string key_str = item.first + ":user_id";
+        std::string user_id_str = std::to_string(item.second);
+        memcached_rc =
+            memcached_set(memcached_client, key_str.c_str(), key_str.length(),
+                          user_id_str.c_str(), user_id_str.length(), 0, 0);
+        if (memcached_rc != MEMCACHED_SUCCESS) {
+          LOG(warning) << "Failed to set the user_id of user " << item.first
+                       << " to Memcached: "
+                       << memcached_strerror(memcached_client, memcached_rc);
+        }
+      }
+      memcached_pool_push(_memcached_client_pool, memcached_client);
+    }
+    user_ids.insert(user_ids_found.begin(), user_ids_found.end());
+  }
+
+  std::vector<int64_t> _return;
+  for (auto &username : usernames) {
+    _return.emplace_back(user_ids[username]);
+  }
+  span.Finish();
+  return _return;
+}
+
 /*
  * The following code which obtaines machine ID from machine's MAC address was
  * inspired from https://stackoverflow.com/a/16859693.
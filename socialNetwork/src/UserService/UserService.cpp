@@ -1,13 +1,15 @@
 // HTTP-based UserService (no Thrift)
 #include <signal.h>
 
+#include <memory>
 #include <nlohmann/json.hpp>
 
 #include "../utils.h"
 #include "../utils_memcached.h"
 #include "../utils_mongodb.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../HttpClientWrapper.h"
 #include "UserHandler.h"
 
@@ -26,12 +28,13 @@ void sigintHandler(int sig) {
 int main(int argc, char *argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
-  // SetUpTracer("config/jaeger-config.yml", "user-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "user-service");
+  SetUpClientPools(config_json);
 
   std::string secret = config_json["secret"];
   int port = config_json["user-service"]["port"];
@@ -84,11 +87,22 @@ int main(int argc, char *argv[]) {
   }
   LOG(info) << "machine_id = " << machine_id;
 
+  // A TTL of 0 disables the login session cache.
+  int login_cache_ttl_s = config_json["user-service"]["login_cache_ttl_s"];
+  int login_cache_size = config_json["user-service"]["login_cache_size"];
+  std::unique_ptr<SessionCache> session_cache;
+  if (login_cache_ttl_s > 0) {
+    session_cache = std::make_unique<SessionCache>(login_cache_ttl_s,
+                                                   login_cache_size);
+  }
+
   std::mutex thread_lock;
   UserHandler handler(&thread_lock, machine_id, secret, memcached_client_pool,
-                      mongodb_client_pool, &social_graph_client_pool);
+                      mongodb_client_pool, &social_graph_client_pool,
+                      session_cache.get());
 
   httplib::Server server;
+  SetUpServerMetrics(&server, "user-service");
 
   // POST /ComposeCreatorWithUserId
   server.Post("/ComposeCreatorWithUserId",
@@ -138,6 +152,24 @@ int main(int argc, char *argv[]) {
     }
   });
 
+  // POST /GetUserIds
+  server.Post("/GetUserIds", [&](const httplib::Request &req, httplib::Response &res) {
+    try {
+      auto j = json::parse(req.body);
+      int64_t req_id = j["req_id"].get<int64_t>();
+      auto usernames = j["usernames"].get<std::vector<std::string>>();
+      std::map<std::string, std::string> carrier;
+      if (j.contains("carrier"))
+        carrier = j["carrier"].get<std::map<std::string, std::string>>();
+
+      auto uids = handler.GetUserIds(req_id, usernames, carrier);
+      res.set_content(json({{"user_ids", uids}}).dump(), "application/json");
+    } catch (const std::exception &e) {
+      res.status = 500;
+      res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+    }
+  });
+
   // Optional: user registration endpoints
   server.Post("/RegisterUser", [&](const httplib::Request &req, httplib::Response &res) {
     try {
@@ -184,6 +216,37 @@ int main(int argc, char *argv[]) {
                 }
               });
 
+  server.Post("/RegisterUsersBulk",
+              [&](const httplib::Request &req, httplib::Response &res) {
+                try {
+                  auto j = json::parse(req.body);
+                  int64_t req_id = j["req_id"].get<int64_t>();
+                  std::vector<NewUser> users;
+                  for (auto &user_j : j["users"]) {
+                    users.emplace_back(NewUser{
+                        user_j["user_id"].get<int64_t>(),
+                        user_j["first_name"].get<std::string>(),
+                        user_j["last_name"].get<std::string>(),
+                        user_j["username"].get<std::string>(),
+                        user_j["password"].get<std::string>()});
+                  }
+                  std::map<std::string, std::string> carrier;
+                  if (j.contains("carrier"))
+                    carrier = j["carrier"].get<std::map<std::string, std::string>>();
+                  auto user_ids =
+                      handler.RegisterUsersBulk(req_id, users, carrier);
+                  std::string status =
+                      user_ids.size() == users.size() ? "ok" : "partial";
+                  res.set_content(json({{"status", status},
+                                        {"user_ids", user_ids}}).dump(),
+                                  "application/json");
+                } catch (const std::exception &e) {
+                  res.status = 500;
+                  res.set_content(json({{"error", e.what()}}).dump(),
+                                  "application/json");
+                }
+              });
+
   LOG(info) << "Starting the user-service HTTP server ...";
   server.listen("0.0.0.0", port);
 }
\ No newline at end of file
@@ -5,17 +5,21 @@
 #include <mongoc.h>
 #include <sw/redis++/redis++.h>
 
-#include <future>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <string>
-#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 #include "../ClientPool.h"
+#include "../FanOut.h"
 #include "../HttpClientWrapper.h"
 #include "../logger.h"
-// #include "../tracing.h"  // Tracing disabled
+#include "../span_recorder.h"
 #include "../social_network_types.h"
+#include "../WorkQueue.h"
 
 using namespace sw::redis;
 
@@ -24,13 +28,13 @@ namespace social_network {
 class UserTimelineHandler {
  public:
   UserTimelineHandler(Redis *, mongoc_client_pool_t *,
-                      ClientPool<HttpClientWrapper> *);
+                      ClientPool<HttpClientWrapper> *, WorkQueue *, int, int);
 
   UserTimelineHandler(Redis *, Redis *, mongoc_client_pool_t *,
-      ClientPool<HttpClientWrapper> *);
+      ClientPool<HttpClientWrapper> *, WorkQueue *, int, int);
 
   UserTimelineHandler(RedisCluster *, mongoc_client_pool_t *,
-                      ClientPool<HttpClientWrapper> *);
+                      ClientPool<HttpClientWrapper> *, WorkQueue *, int, int);
   ~UserTimelineHandler() = default;
 
   bool IsRedisReplicationEnabled();
@@ -49,39 +53,67 @@ class UserTimelineHandler {
   RedisCluster *_redis_cluster_client_pool;
   mongoc_client_pool_t *_mongodb_client_pool;
   ClientPool<HttpClientWrapper> *_post_client_pool;
+  WorkQueue *_backfill_queue;
+  int _fan_out_timeout_ms;
+  int _max_stored_posts;
+
+  // (post_id, timestamp) entries of a user's timeline, newest first.
+  typedef std::vector<std::pair<int64_t, int64_t>> TimelineEntries;
+
+  void _ReadMongoTimeline(int64_t user_id, int skip, int limit,
+                          const std::map<std::string, std::string> &carrier,
+                          TimelineEntries *entries);
+  void _BackfillRedis(int64_t user_id, const TimelineEntries &entries,
+                      const std::map<std::string, std::string> &carrier);
+  void _ReadPostsHelper(FanOut &fan_out, int64_t req_id,
+                        const std::vector<int64_t> &post_ids,
+                        const std::map<std::string, std::string> &carrier,
+                        std::vector<Post> *posts);
 };
 
 UserTimelineHandler::UserTimelineHandler(
     Redis *redis_pool, mongoc_client_pool_t *mongodb_pool,
-    ClientPool<HttpClientWrapper> *post_client_pool) {
+    ClientPool<HttpClientWrapper> *post_client_pool,
+    WorkQueue *backfill_queue, int fan_out_timeout_ms, int max_stored_posts) {
   _redis_client_pool = redis_pool;
   _redis_replica_pool = nullptr;
   _redis_primary_pool = nullptr;
   _redis_cluster_client_pool = nullptr;
   _mongodb_client_pool = mongodb_pool;
   _post_client_pool = post_client_pool;
+  _backfill_queue = backfill_queue;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
+  _max_stored_posts = max_stored_posts;
 }
 
 UserTimelineHandler::UserTimelineHandler(
     Redis* redis_replica_pool, Redis* redis_primary_pool, mongoc_client_pool_t* mongodb_pool,
-    ClientPool<HttpClientWrapper>* post_client_pool) {
+    ClientPool<HttpClientWrapper>* post_client_pool,
+    WorkQueue *backfill_queue, int fan_out_timeout_ms, int max_stored_posts) {
     _redis_client_pool = nullptr;
     _redis_replica_pool = redis_replica_pool;
     _redis_primary_pool = redis_primary_pool;
     _redis_cluster_client_pool = nullptr;
     _mongodb_client_pool = mongodb_pool;
     _post_client_pool = post_client_pool;
+    _backfill_queue = backfill_queue;
+    _fan_out_timeout_ms = fan_out_timeout_ms;
+    _max_stored_posts = max_stored_posts;
 }
 
 UserTimelineHandler::UserTimelineHandler(
     RedisCluster *redis_pool, mongoc_client_pool_t *mongodb_pool,
-    ClientPool<HttpClientWrapper> *post_client_pool) {
+    ClientPool<HttpClientWrapper> *post_client_pool,
+    WorkQueue *backfill_queue, int fan_out_timeout_ms, int max_stored_posts) {
   _redis_cluster_client_pool = redis_pool;
   _redis_replica_pool = nullptr;
   _redis_primary_pool = nullptr;
   _redis_client_pool = nullptr;
   _mongodb_client_pool = mongodb_pool;
   _post_client_pool = post_client_pool;
+  _backfill_queue = backfill_queue;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
+  _max_stored_posts = max_stored_posts;
 }
 
 bool UserTimelineHandler::IsRedisReplicationEnabled() {
@@ -91,14 +123,9 @@ bool UserTimelineHandler::IsRedisReplicationEnabled() {
 void UserTimelineHandler::WriteUserTimeline(
     int64_t req_id, int64_t post_id, int64_t user_id, int64_t timestamp,
     const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
-  // std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "write_user_timeline_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  std::map<std::string, std::string> writer_text_map;
+  auto span = StartSpan("write_user_timeline_server", carrier);
+  span.Inject(&writer_text_map);
 
   mongoc_client_t *mongodb_client =
       mongoc_client_pool_pop(_mongodb_client_pool);
@@ -112,50 +139,44 @@ void UserTimelineHandler::WriteUserTimeline(
     throw std::runtime_error(
         "Failed to create collection user-timeline from MongoDB");
   }
-  bson_t *query = bson_new();
-
-  BSON_APPEND_INT64(query, "user_id", user_id);
-  bson_t *update =
-      BCON_NEW("$push", "{", "posts", "{", "$each", "[", "{", "post_id",
-               BCON_INT64(post_id), "timestamp", BCON_INT64(timestamp), "}",
-               "]", "$position", BCON_INT32(0), "}", "}");
-  bson_error_t error;
-  bson_t reply;
-  // auto update_span = opentracing::Tracer::Global()->StartSpan(
-  //     "write_user_timeline_mongo_insert_client",
-  //     {opentracing::ChildOf(&span->context())});
-  bool updated = mongoc_collection_find_and_modify(collection, query, nullptr,
-                                                   update, nullptr, false, true,
-                                                   true, &reply, &error);
-  // update_span->Finish();
 
-  if (!updated) {
-    // update the newly inserted document (upsert: false)
-    updated = mongoc_collection_find_and_modify(collection, query, nullptr,
-                                                update, nullptr, false, false,
-                                                true, &reply, &error);
-    if (!updated) {
-      LOG(error) << "Failed to update user-timeline for user " << user_id
-                 << " to MongoDB: " << error.message;
-      bson_destroy(update);
-      bson_destroy(query);
-      bson_destroy(&reply);
-      mongoc_collection_destroy(collection);
-      mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
-      throw std::runtime_error(error.message);
-    }
+  // One upsert appends the post at the end of the array and trims it to the
+  // newest _max_stored_posts entries, so the update does not grow with the
+  // user's history. post_count lets reads locate a range from the end.
+  bson_t *query = BCON_NEW("user_id", BCON_INT64(user_id));
+  bson_t *update;
+  if (_max_stored_posts > 0) {
+    update = BCON_NEW(
+        "$push", "{", "posts", "{", "$each", "[", "{", "post_id",
+        BCON_INT64(post_id), "timestamp", BCON_INT64(timestamp), "}", "]",
+        "$slice", BCON_INT32(-_max_stored_posts), "}", "}",
+        "$inc", "{", "post_count", BCON_INT64(1), "}");
+  } else {
+    update = BCON_NEW(
+        "$push", "{", "posts", "{", "post_id", BCON_INT64(post_id),
+        "timestamp", BCON_INT64(timestamp), "}", "}",
+        "$inc", "{", "post_count", BCON_INT64(1), "}");
   }
-
+  bson_t *opts = BCON_NEW("upsert", BCON_BOOL(true));
+  bson_error_t error;
+  auto update_span = StartSpan("write_user_timeline_mongo_insert_client", span);
+  bool updated = mongoc_collection_update_one(collection, query, update, opts,
+                                              nullptr, &error);
+  update_span.Finish();
+  bson_destroy(opts);
   bson_destroy(update);
-  bson_destroy(&reply);
   bson_destroy(query);
   mongoc_collection_destroy(collection);
   mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+  if (!updated) {
+    LOG(error) << "Failed to update user-timeline for user " << user_id
+               << " to MongoDB: " << error.message;
+    throw std::runtime_error(error.message);
+  }
 
   // Update user's timeline in redis
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "write_user_timeline_redis_update_client",
-  //     {opentracing::ChildOf(&span->context())});
+  auto redis_span = StartSpan("write_user_timeline_redis_update_client", span);
+  ScopedTiming redis_timing(TimingStage::REDIS);
   try {
     if (_redis_client_pool)
       _redis_client_pool->zadd(std::to_string(user_id), std::to_string(post_id),
@@ -172,29 +193,24 @@ void UserTimelineHandler::WriteUserTimeline(
     LOG(error) << err.what();
     throw;
   }
-  // redis_span->Finish();
-  // span->Finish();
+  redis_timing.Stop();
+  redis_span.Finish();
+  span.Finish();
 }
 
 void UserTimelineHandler::ReadUserTimeline(
     std::vector<Post> &_return, int64_t req_id, int64_t user_id, int start,
     int stop, const std::map<std::string, std::string> &carrier) {
-  // Tracing disabled
-  // TextMapReader reader(carrier);
   std::map<std::string, std::string> writer_text_map;
-  // TextMapWriter writer(writer_text_map);
-  // auto parent_span = opentracing::Tracer::Global()->Extract(reader);
-  // auto span = opentracing::Tracer::Global()->StartSpan(
-  //     "read_user_timeline_server", {opentracing::ChildOf(parent_span->get())});
-  // opentracing::Tracer::Global()->Inject(span->context(), writer);
+  auto span = StartSpan("read_user_timeline_server", carrier);
+  span.Inject(&writer_text_map);
 
   if (stop <= start || start < 0) {
     return;
   }
 
-  // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-  //     "read_user_timeline_redis_find_client",
-  //     {opentracing::ChildOf(&span->context())});
+  auto redis_span = StartSpan("read_user_timeline_redis_find_client", span);
+  ScopedTiming redis_timing(TimingStage::REDIS);
 
   std::vector<std::string> post_ids_str;
   try {
@@ -212,167 +228,243 @@ void UserTimelineHandler::ReadUserTimeline(
     LOG(error) << err.what();
     throw err;
   }
-  // redis_span->Finish();
+  redis_timing.Stop();
+  redis_span.Finish();
 
   std::vector<int64_t> post_ids;
   for (auto &post_id_str : post_ids_str) {
     post_ids.emplace_back(std::stoul(post_id_str));
   }
 
-  // find in mongodb
+  // The posts found in Redis are hydrated while MongoDB is asked for the rest
+  // of the range. Both post-storage calls are completed on this thread.
+  FanOut fan_out(_fan_out_timeout_ms);
+  std::vector<Post> cached_posts;
+  if (!post_ids.empty()) {
+    _ReadPostsHelper(fan_out, req_id, post_ids, writer_text_map,
+                     &cached_posts);
+  }
+
   int mongo_start = start + post_ids.size();
-  std::unordered_map<std::string, double> redis_update_map;
+  std::vector<Post> mongo_posts;
   if (mongo_start < stop) {
-    // Instead find post_ids from mongodb
-    mongoc_client_t *mongodb_client =
-        mongoc_client_pool_pop(_mongodb_client_pool);
-    if (!mongodb_client) {
-      throw std::runtime_error("Failed to pop a client from MongoDB pool");
+    TimelineEntries entries;
+    _ReadMongoTimeline(user_id, mongo_start, stop - mongo_start,
+                       writer_text_map, &entries);
+    std::vector<int64_t> mongo_post_ids;
+    for (auto &entry : entries) {
+      //In mixed workload condition, post may composed between redis and mongo read
+      //mongodb index will shift and duplicate post_id occurs
+      if (std::find(post_ids.begin(), post_ids.end(), entry.first) ==
+          post_ids.end()) {
+        mongo_post_ids.emplace_back(entry.first);
+      }
     }
-    auto collection = mongoc_client_get_collection(
-        mongodb_client, "user-timeline", "user-timeline");
-    if (!collection) {
-      throw std::runtime_error(
-          "Failed to create collection user-timeline from MongoDB");
+    if (!mongo_post_ids.empty()) {
+      _ReadPostsHelper(fan_out, req_id, mongo_post_ids, writer_text_map,
+                       &mongo_posts);
     }
 
-    bson_t *query = BCON_NEW("user_id", BCON_INT64(user_id));
-    bson_t *opts = BCON_NEW("projection", "{", "posts", "{", "$slice", "[",
-                            BCON_INT32(0), BCON_INT32(stop), "]", "}", "}");
-
-  // auto find_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_timeline_mongo_find_client",
-  //     {opentracing::ChildOf(&span->context())});
-    mongoc_cursor_t *cursor =
-        mongoc_collection_find_with_opts(collection, query, opts, nullptr);
-  // find_span->Finish();
-    const bson_t *doc;
-    bool found = mongoc_cursor_next(cursor, &doc);
-    if (found) {
-      bson_iter_t iter_0;
-      bson_iter_t iter_1;
-      bson_iter_t post_id_child;
-      bson_iter_t timestamp_child;
-      int idx = 0;
-      bson_iter_init(&iter_0, doc);
-      bson_iter_init(&iter_1, doc);
-      while (bson_iter_find_descendant(
-                 &iter_0, ("posts." + std::to_string(idx) + ".post_id").c_str(),
-                 &post_id_child) &&
-             BSON_ITER_HOLDS_INT64(&post_id_child) &&
-             bson_iter_find_descendant(
-                 &iter_1,
-                 ("posts." + std::to_string(idx) + ".timestamp").c_str(),
-                 &timestamp_child) &&
-             BSON_ITER_HOLDS_INT64(&timestamp_child)) {
-        auto curr_post_id = bson_iter_int64(&post_id_child);
-        auto curr_timestamp = bson_iter_int64(&timestamp_child);
-        if (idx >= mongo_start) {
-          //In mixed workload condition, post may composed between redis and mongo read
-          //mongodb index will shift and duplicate post_id occurs
-          if ( std::find(post_ids.begin(), post_ids.end(), curr_post_id) == post_ids.end() ) {
-            post_ids.emplace_back(curr_post_id);
-          }
+    // Redis holds a prefix of each timeline. The entries just read extend it
+    // only if it ends right before them, which is known when Redis returned
+    // part of the range or the range starts at 0. Otherwise the prefix up to
+    // stop is reloaded from MongoDB. Either way it is done after the reply.
+    if (!entries.empty()) {
+      bool contiguous = !post_ids.empty() || start == 0;
+      auto backfill = [this, user_id, stop, contiguous, entries,
+                       writer_text_map]() {
+        if (contiguous) {
+          _BackfillRedis(user_id, entries, writer_text_map);
+        } else {
+          TimelineEntries prefix;
+          _ReadMongoTimeline(user_id, 0, stop, writer_text_map, &prefix);
+          _BackfillRedis(user_id, prefix, writer_text_map);
         }
-        redis_update_map.insert(std::make_pair(std::to_string(curr_post_id),
-                                               (double)curr_timestamp));
-        bson_iter_init(&iter_0, doc);
-        bson_iter_init(&iter_1, doc);
-        idx++;
+      };
+      if (!_backfill_queue->Submit(user_id, std::move(backfill))) {
+        LOG_RATE_LIMITED(warning)
+            << "User timeline backfill queue is full, dropping a backfill";
       }
     }
-    bson_destroy(opts);
-    bson_destroy(query);
-    mongoc_cursor_destroy(cursor);
-    mongoc_collection_destroy(collection);
+  }
+
+  try {
+    fan_out.Wait();
+  } catch (...) {
+    LOG(error) << "Failed to get post from post-storage-service";
+    throw;
+  }
+  _return = std::move(cached_posts);
+  _return.insert(_return.end(), std::make_move_iterator(mongo_posts.begin()),
+                 std::make_move_iterator(mongo_posts.end()));
+  span.Finish();
+}
+
+// Reads limit entries of the timeline starting at skip, newest first. Posts
+// are stored oldest first, so the projection takes the range from the end of
+// the array: $slice [-(skip + limit), limit]. When the array is shorter than
+// skip + limit MongoDB starts at its first element instead, and the entries
+// past the range are dropped using post_count.
+void UserTimelineHandler::_ReadMongoTimeline(
+    int64_t user_id, int skip, int limit,
+    const std::map<std::string, std::string> &carrier,
+    TimelineEntries *entries) {
+  mongoc_client_t *mongodb_client =
+      mongoc_client_pool_pop(_mongodb_client_pool);
+  if (!mongodb_client) {
+    throw std::runtime_error("Failed to pop a client from MongoDB pool");
+  }
+  auto collection = mongoc_client_get_collection(
+      mongodb_client, "user-timeline", "user-timeline");
+  if (!collection) {
     mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+    throw std::runtime_error(
+        "Failed to create collection user-timeline from MongoDB");
   }
 
-  std::future<std::vector<Post>> post_future =
-      std::async(std::launch::async, [&]() {
-        auto post_client = _post_client_pool->Pop();
-        if (!post_client) {
-          LOG(error) << "Failed to connect to post-storage-service";
-          throw std::runtime_error(
-              "Failed to connect to post-storage-service");
+  bson_t *query = BCON_NEW("user_id", BCON_INT64(user_id));
+  bson_t *opts = BCON_NEW("projection", "{", "posts", "{", "$slice", "[",
+                          BCON_INT32(-(skip + limit)), BCON_INT32(limit), "]",
+                          "}", "post_count", BCON_INT32(1), "}");
+
+  auto find_span = StartSpan("user_timeline_mongo_find_client", carrier);
+  mongoc_cursor_t *cursor =
+      mongoc_collection_find_with_opts(collection, query, opts, nullptr);
+  const bson_t *doc;
+  bool found = mongoc_cursor_next(cursor, &doc);
+  find_span.Finish();
+  TimelineEntries oldest_first;
+  int64_t post_count = -1;
+  bson_iter_t iter;
+  if (found && bson_iter_init(&iter, doc)) {
+    while (bson_iter_next(&iter)) {
+      if (strcmp(bson_iter_key(&iter), "post_count") == 0 &&
+          BSON_ITER_HOLDS_INT64(&iter)) {
+        post_count = bson_iter_int64(&iter);
+        continue;
+      }
+      bson_iter_t posts_iter;
+      if (strcmp(bson_iter_key(&iter), "posts") != 0 ||
+          !BSON_ITER_HOLDS_ARRAY(&iter) ||
+          !bson_iter_recurse(&iter, &posts_iter)) {
+        continue;
+      }
+      while (bson_iter_next(&posts_iter)) {
+        bson_iter_t post_iter;
+        if (!BSON_ITER_HOLDS_DOCUMENT(&posts_iter) ||
+            !bson_iter_recurse(&posts_iter, &post_iter)) {
+          continue;
         }
-        std::vector<Post> _return_posts;
-        try {
-          nlohmann::json req_json = {
-              {"req_id", req_id}, {"post_ids", post_ids},
-              {"carrier", writer_text_map}};
-          auto res = post_client->PostJson("/ReadPosts", req_json);
-          for (auto &item : res["posts"]) {
-            Post p;
-            p.req_id = item["req_id"];
-            p.timestamp = item["timestamp"];
-            p.post_id = item["post_id"];
-            p.creator.user_id = item["creator"]["user_id"];
-            p.creator.username = item["creator"]["username"];
-            p.post_type = static_cast<PostType::type>((int)item["post_type"]);
-            p.text = item["text"];
-            for (auto &m : item["media"]) {
-              Media media;
-              media.media_id = m["media_id"];
-              media.media_type = m["media_type"];
-              p.media.emplace_back(media);
-            }
-            for (auto &um : item["user_mentions"]) {
-              UserMention u;
-              u.user_id = um["user_id"];
-              u.username = um["username"];
-              p.user_mentions.emplace_back(u);
-            }
-            for (auto &u : item["urls"]) {
-              Url url;
-              url.shortened_url = u["shortened_url"];
-              url.expanded_url = u["expanded_url"];
-              p.urls.emplace_back(url);
-            }
-            _return_posts.emplace_back(std::move(p));
+        int64_t post_id = -1;
+        int64_t timestamp = -1;
+        while (bson_iter_next(&post_iter)) {
+          if (!BSON_ITER_HOLDS_INT64(&post_iter)) {
+            continue;
+          }
+          if (strcmp(bson_iter_key(&post_iter), "post_id") == 0) {
+            post_id = bson_iter_int64(&post_iter);
+          } else if (strcmp(bson_iter_key(&post_iter), "timestamp") == 0) {
+            timestamp = bson_iter_int64(&post_iter);
           }
-        } catch (...) {
-          _post_client_pool->Remove(post_client);
-          LOG(error) << "Failed to read posts from post-storage-service";
-          throw;
         }
-        _post_client_pool->Keepalive(post_client);
-        return _return_posts;
-      });
-
-  if (redis_update_map.size() > 0) {
-  // auto redis_update_span = opentracing::Tracer::Global()->StartSpan(
-  //     "user_timeline_redis_update_client",
-  //     {opentracing::ChildOf(&span->context())});
-    try {
-      if (_redis_client_pool)
-        _redis_client_pool->zadd(std::to_string(user_id),
-                               redis_update_map.begin(),
-                               redis_update_map.end());
-      else if (IsRedisReplicationEnabled()) {
-          _redis_primary_pool->zadd(std::to_string(user_id),
-              redis_update_map.begin(),
-              redis_update_map.end());
+        if (post_id != -1 && timestamp != -1) {
+          oldest_first.emplace_back(post_id, timestamp);
+        }
       }
-      else
-        _redis_cluster_client_pool->zadd(std::to_string(user_id),
-                               redis_update_map.begin(),
-                               redis_update_map.end());
-
-    } catch (const Error &err) {
-      LOG(error) << err.what();
-      throw;
     }
-    // redis_update_span->Finish();
   }
+  bson_destroy(opts);
+  bson_destroy(query);
+  mongoc_cursor_destroy(cursor);
+  mongoc_collection_destroy(collection);
+  mongoc_client_pool_push(_mongodb_client_pool, mongodb_client);
+
+  if (post_count >= 0) {
+    int64_t length = post_count;
+    if (_max_stored_posts > 0) {
+      length = std::min<int64_t>(length, _max_stored_posts);
+    }
+    int64_t first = std::max<int64_t>(0, length - skip - limit);
+    int64_t in_range = std::max<int64_t>(0, length - skip - first);
+    if (static_cast<int64_t>(oldest_first.size()) > in_range) {
+      oldest_first.resize(in_range);
+    }
+  }
+  entries->insert(entries->end(), oldest_first.rbegin(), oldest_first.rend());
+}
 
+void UserTimelineHandler::_BackfillRedis(
+    int64_t user_id, const TimelineEntries &entries,
+    const std::map<std::string, std::string> &carrier) {
+  std::vector<std::pair<std::string, double>> redis_update;
+  redis_update.reserve(entries.size());
+  for (auto &entry : entries) {
+    redis_update.emplace_back(std::to_string(entry.first),
+                              static_cast<double>(entry.second));
+  }
+  auto redis_update_span =
+      StartSpan("user_timeline_redis_update_client", carrier);
   try {
-    _return = post_future.get();
-  } catch (...) {
-    LOG(error) << "Failed to get post from post-storage-service";
+    if (_redis_client_pool)
+      _redis_client_pool->zadd(std::to_string(user_id),
+                             redis_update.begin(),
+                             redis_update.end());
+    else if (IsRedisReplicationEnabled()) {
+        _redis_primary_pool->zadd(std::to_string(user_id),
+            redis_update.begin(),
+            redis_update.end());
+    }
+    else
+      _redis_cluster_client_pool->zadd(std::to_string(user_id),
+                             redis_update.begin(),
+                             redis_update.end());
+
+  } catch (const Error &err) {
+    LOG(error) << err.what();
     throw;
   }
-  // span->Finish();
+  redis_update_span.Finish();
+}
+
+void UserTimelineHandler::_ReadPostsHelper(
+    FanOut &fan_out, int64_t req_id, const std::vector<int64_t> &post_ids,
+    const std::map<std::string, std::string> &carrier,
+    std::vector<Post> *posts) {
+  nlohmann::json req_json = {
+      {"req_id", req_id}, {"post_ids", post_ids}, {"carrier", carrier}};
+  fan_out.PostJson(
+      _post_client_pool, "post-storage-service", "/ReadPosts", req_json,
+      [posts](json &res) {
+        for (auto &item : res["posts"]) {
+          Post p;
+          p.req_id = item["req_id"];
+          p.timestamp = item["timestamp"];
+          p.post_id = item["post_id"];
+          p.creator.user_id = item["creator"]["user_id"];
+          p.creator.username = item["creator"]["username"];
+          p.post_type = static_cast<PostType::type>((int)item["post_type"]);
+          p.text = item["text"];
+          for (auto &m : item["media"]) {
+            Media media;
+            media.media_id = m["media_id"];
+            media.media_type = m["media_type"];
+            p.media.emplace_back(media);
+          }
+          for (auto &um : item["user_mentions"]) {
+            UserMention u;
+            u.user_id = um["user_id"];
+            u.username = um["username"];
+            p.user_mentions.emplace_back(u);
+          }
+          for (auto &u : item["urls"]) {
+            Url url;
+            url.shortened_url = u["shortened_url"];
+            url.expanded_url = u["expanded_url"];
+            p.urls.emplace_back(url);
+          }
+          posts->emplace_back(std::move(p));
+        }
+      });
 }
 
 }  // namespace social_network
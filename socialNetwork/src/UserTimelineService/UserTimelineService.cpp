@@ -6,8 +6,10 @@
 
 #include "../ClientPool.h"
 #include "../HttpClientWrapper.h"
+#include "../WorkQueue.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../utils.h"
 #include "../utils_mongodb.h"
 #include "../utils_redis.h"
@@ -46,12 +48,13 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  // SetUpTracer("config/jaeger-config.yml", "user-timeline-service");
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "user-timeline-service");
+  SetUpClientPools(config_json);
 
   int port = config_json["user-timeline-service"]["port"];
 
@@ -99,12 +102,23 @@ int main(int argc, char *argv[]) {
   }
   mongoc_client_pool_push(mongodb_client_pool, mongodb_client);
 
+  // Redis is refilled from MongoDB by these workers, after the read that
+  // missed has been answered.
+  WorkQueue backfill_queue(
+      config_json["user-timeline-service"]["backfill_workers"],
+      config_json["user-timeline-service"]["backfill_queue_size"]);
+  int fan_out_timeout_ms = config_json["user-timeline-service"]["timeout_ms"];
+  int max_stored_posts =
+      config_json["user-timeline-service"]["mongodb_max_posts"];
+
   if (redis_cluster_flag || redis_cluster_config_flag) {
     RedisCluster redis_client_pool =
         init_redis_cluster_client_pool(config_json, "user-timeline");
     UserTimelineHandler handler(&redis_client_pool, mongodb_client_pool,
-                                &post_storage_client_pool);
+                                &post_storage_client_pool, &backfill_queue,
+                                fan_out_timeout_ms, max_stored_posts);
     httplib::Server server;
+    SetUpServerMetrics(&server, "user-timeline-service");
     server.Post("/WriteUserTimeline",
                 [&](const httplib::Request &req, httplib::Response &res) {
                   try {
@@ -188,8 +202,10 @@ int main(int argc, char *argv[]) {
       UserTimelineHandler handler(&redis_replica_client_pool,
                                   &redis_primary_client_pool,
                                   mongodb_client_pool,
-                                  &post_storage_client_pool);
+                                  &post_storage_client_pool, &backfill_queue,
+                                fan_out_timeout_ms, max_stored_posts);
       httplib::Server server;
+      SetUpServerMetrics(&server, "user-timeline-service");
       server.Post("/WriteUserTimeline",
                   [&](const httplib::Request &req, httplib::Response &res) {
                     try {
@@ -272,8 +288,10 @@ int main(int argc, char *argv[]) {
     Redis redis_client_pool =
         init_redis_client_pool(config_json, "user-timeline");
     UserTimelineHandler handler(&redis_client_pool, mongodb_client_pool,
-                                &post_storage_client_pool);
+                                &post_storage_client_pool, &backfill_queue,
+                                fan_out_timeout_ms, max_stored_posts);
     httplib::Server server;
+    SetUpServerMetrics(&server, "user-timeline-service");
     server.Post("/WriteUserTimeline",
                 [&](const httplib::Request &req, httplib::Response &res) {
                   try {
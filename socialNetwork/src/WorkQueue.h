@@ -0,0 +1,113 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_WORKQUEUE_H
+#define SOCIAL_NETWORK_MICROSERVICES_WORKQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+namespace social_network {
+
+// Fixed pool of worker threads for work that can finish after the request
+// has been answered. Tasks submitted with the same key always land on the
+// same worker, so they run in submission order; tasks with different keys
+// run concurrently. Once a worker has max_pending tasks queued, Submit()
+// waits up to timeout_ms for one of them to start, then refuses the task.
+class WorkQueue {
+ public:
+  WorkQueue(int n_workers, int max_pending);
+  ~WorkQueue();
+
+  WorkQueue(const WorkQueue &) = delete;
+  WorkQueue &operator=(const WorkQueue &) = delete;
+
+  bool Submit(uint64_t key, std::function<void()> task, int timeout_ms = 0);
+
+ private:
+  struct Worker {
+    std::deque<std::function<void()>> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    // Signalled when a task is taken, for Submit() calls waiting for room.
+    std::condition_variable space_cv;
+    std::thread thread;
+  };
+
+  void _Run(Worker *worker);
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  size_t _max_pending;
+  std::atomic<bool> _stopping;
+};
+
+WorkQueue::WorkQueue(int n_workers, int max_pending) {
+  _max_pending = max_pending;
+  _stopping = false;
+  for (int i = 0; i < n_workers; ++i) {
+    _workers.emplace_back(new Worker);
+  }
+  for (auto &worker : _workers) {
+    worker->thread = std::thread(&WorkQueue::_Run, this, worker.get());
+  }
+}
+
+WorkQueue::~WorkQueue() {
+  _stopping = true;
+  for (auto &worker : _workers) {
+    // Taking the lock orders the flag against a worker about to wait.
+    std::unique_lock<std::mutex> lock(worker->mtx);
+    lock.unlock();
+    worker->cv.notify_one();
+  }
+  for (auto &worker : _workers) {
+    worker->thread.join();
+  }
+}
+
+bool WorkQueue::Submit(uint64_t key, std::function<void()> task,
+                       int timeout_ms) {
+  auto &worker = _workers[key % _workers.size()];
+  std::unique_lock<std::mutex> lock(worker->mtx);
+  if (!worker->space_cv.wait_for(
+          lock, std::chrono::milliseconds(timeout_ms),
+          [&] { return worker->tasks.size() < _max_pending; })) {
+    return false;
+  }
+  worker->tasks.emplace_back(std::move(task));
+  lock.unlock();
+  worker->cv.notify_one();
+  return true;
+}
+
+void WorkQueue::_Run(Worker *worker) {
+  while (true) {
+    std::unique_lock<std::mutex> lock(worker->mtx);
+    worker->cv.wait(lock, [&] { return _stopping || !worker->tasks.empty(); });
+    // Drain what is left before exiting so accepted work is not dropped.
+    if (worker->tasks.empty()) {
+      return;
+    }
+    auto task = std::move(worker->tasks.front());
+    worker->tasks.pop_front();
+    lock.unlock();
+    worker->space_cv.notify_one();
+    try {
+      task();
+    } catch (const std::exception &e) {
+      LOG(error) << "WorkQueue task failed: " << e.what();
+    } catch (...) {
+      LOG(error) << "WorkQueue task failed";
+    }
+  }
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_WORKQUEUE_H
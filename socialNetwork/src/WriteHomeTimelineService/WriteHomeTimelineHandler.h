@@ -0,0 +1,229 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_SRC_WRITEHOMETIMELINESERVICE_WRITEHOMETIMELINEHANDLER_H_
+#define SOCIAL_NETWORK_MICROSERVICES_SRC_WRITEHOMETIMELINESERVICE_WRITEHOMETIMELINEHANDLER_H_
+
+#include <sw/redis++/redis++.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "../ClientPool.h"
+#include "../FanOut.h"
+#include "../HttpClientWrapper.h"
+#include "../logger.h"
+#include "../span_recorder.h"
+
+using namespace sw::redis;
+namespace social_network {
+using json = nlohmann::json;
+
+// Applies the home-timeline updates published by compose-post-service.
+//
+// Messages are handled a batch at a time: the followers of every distinct
+// author in the batch are fetched concurrently, and all the resulting
+// insertions are grouped per follower timeline and sent to Redis in one
+// pipeline (one per shard with Redis Cluster), the same way
+// HomeTimelineHandler::WriteHomeTimeline does for a single post. A batch of
+// one message behaves like the old per-message worker.
+class WriteHomeTimelineHandler {
+ public:
+  // With Redis replication, pass the primary: this service only writes.
+  WriteHomeTimelineHandler(Redis *,
+                           ClientPool<HttpClientWrapper> *,
+                           int fan_out_timeout_ms);
+
+  WriteHomeTimelineHandler(RedisCluster *,
+                           ClientPool<HttpClientWrapper> *,
+                           int fan_out_timeout_ms);
+  ~WriteHomeTimelineHandler() = default;
+
+  // Malformed messages are logged and skipped; a downstream failure fails
+  // the whole batch.
+  void WriteHomeTimeline(const std::vector<std::string> &messages);
+
+ private:
+  struct Update {
+    int64_t req_id;
+    int64_t user_id;
+    int64_t post_id;
+    int64_t timestamp;
+    std::vector<int64_t> user_mentions_id;
+  };
+
+  // Zset key: follower_id, Zset value: post_id_str, Zset score: timestamp
+  using TimelineValues =
+      std::map<std::string, std::vector<std::pair<std::string, double>>>;
+
+  void _WriteRedis(const TimelineValues &timeline_values);
+  void _WriteRedisCluster(const TimelineValues &timeline_values);
+
+  Redis *_redis_client_pool;
+  RedisCluster *_redis_cluster_client_pool;
+  ClientPool<HttpClientWrapper> *_social_graph_client_pool;
+  int _fan_out_timeout_ms;
+};
+
+WriteHomeTimelineHandler::WriteHomeTimelineHandler(
+    Redis *redis_client_pool,
+    ClientPool<HttpClientWrapper> *social_graph_client_pool,
+    int fan_out_timeout_ms) {
+  _redis_client_pool = redis_client_pool;
+  _redis_cluster_client_pool = nullptr;
+  _social_graph_client_pool = social_graph_client_pool;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
+}
+
+WriteHomeTimelineHandler::WriteHomeTimelineHandler(
+    RedisCluster *redis_cluster_client_pool,
+    ClientPool<HttpClientWrapper> *social_graph_client_pool,
+    int fan_out_timeout_ms) {
+  _redis_client_pool = nullptr;
+  _redis_cluster_client_pool = redis_cluster_client_pool;
+  _social_graph_client_pool = social_graph_client_pool;
+  _fan_out_timeout_ms = fan_out_timeout_ms;
+}
+
+void WriteHomeTimelineHandler::WriteHomeTimeline(
+    const std::vector<std::string> &messages) {
+  std::vector<Update> updates;
+  // One server span per message, each message belongs to its own trace.
+  std::vector<Span> spans;
+  updates.reserve(messages.size());
+  spans.reserve(messages.size());
+  for (auto &msg_body : messages) {
+    try {
+      json msg_json = json::parse(msg_body);
+
+      std::map<std::string, std::string> carrier;
+      for (auto it = msg_json["carrier"].begin();
+           it != msg_json["carrier"].end(); ++it) {
+        carrier.emplace(std::make_pair(it.key(), it.value()));
+      }
+
+      Update update;
+      update.req_id = msg_json["req_id"];
+      update.user_id = msg_json["user_id"];
+      update.post_id = msg_json["post_id"];
+      update.timestamp = msg_json["timestamp"];
+      update.user_mentions_id =
+          msg_json["user_mentions_id"].get<std::vector<int64_t>>();
+      updates.emplace_back(std::move(update));
+      spans.emplace_back(StartSpan("write_home_timeline_server", carrier));
+    } catch (const std::exception &e) {
+      LOG(error) << "Dropping malformed write-home-timeline message: "
+                 << e.what();
+    }
+  }
+  if (updates.empty()) {
+    return;
+  }
+
+  // Find the followers of every author in the batch, one request per author
+  // no matter how many of its posts the batch holds. The request is traced
+  // as part of the first of them.
+  std::vector<Span> followers_spans;
+  std::map<int64_t, std::vector<int64_t>> followers_ids;
+  {
+    FanOut fan_out(_fan_out_timeout_ms);
+    for (size_t i = 0; i < updates.size(); ++i) {
+      auto &update = updates[i];
+      if (followers_ids.count(update.user_id)) {
+        continue;
+      }
+      followers_spans.emplace_back(
+          StartSpan("get_followers_client", spans[i]));
+      std::map<std::string, std::string> writer_text_map;
+      followers_spans.back().Inject(&writer_text_map);
+      auto &followers_id = followers_ids[update.user_id];
+      json req_json = {{"req_id", update.req_id},
+                       {"user_id", update.user_id},
+                       {"carrier", writer_text_map}};
+      fan_out.PostJson(_social_graph_client_pool, "social-graph-service",
+                       "/GetFollowers", req_json,
+                       [&followers_id](json &res) {
+                         followers_id =
+                             res["followers_id"].get<std::vector<int64_t>>();
+                       });
+    }
+    try {
+      fan_out.Wait();
+    } catch (...) {
+      LOG(error) << "Failed to get followers from social-graph-service";
+      throw;
+    }
+  }
+  followers_spans.clear();
+
+  // Group the insertions by home timeline, so each follower key gets a
+  // single ZADD however many posts of the batch it receives.
+  TimelineValues timeline_values;
+  for (auto &update : updates) {
+    auto &followers_id = followers_ids[update.user_id];
+    std::set<int64_t> followers_id_set(followers_id.begin(),
+                                       followers_id.end());
+    followers_id_set.insert(update.user_mentions_id.begin(),
+                            update.user_mentions_id.end());
+    std::string post_id_str = std::to_string(update.post_id);
+    for (auto &follower_id : followers_id_set) {
+      timeline_values[std::to_string(follower_id)].emplace_back(
+          post_id_str, update.timestamp);
+    }
+  }
+
+  // Update Redis ZSet
+  std::vector<Span> redis_spans;
+  for (auto &span : spans) {
+    redis_spans.emplace_back(
+        StartSpan("write_home_timeline_redis_update_client", span));
+  }
+  try {
+    if (_redis_client_pool) {
+      _WriteRedis(timeline_values);
+    } else {
+      _WriteRedisCluster(timeline_values);
+    }
+  } catch (const Error &err) {
+    LOG(error) << err.what();
+    throw;
+  }
+}
+
+void WriteHomeTimelineHandler::_WriteRedis(
+    const TimelineValues &timeline_values) {
+  auto pipe = _redis_client_pool->pipeline(false);
+  for (auto &timeline : timeline_values) {
+    pipe.zadd(timeline.first, timeline.second.begin(), timeline.second.end(),
+              UpdateType::NOT_EXIST);
+  }
+  pipe.exec();
+}
+
+void WriteHomeTimelineHandler::_WriteRedisCluster(
+    const TimelineValues &timeline_values) {
+  // Create multi-pipeline that match with shards pool
+  std::map<std::shared_ptr<ConnectionPool>, std::shared_ptr<Pipeline>> pipe_map;
+  auto *shards_pool = _redis_cluster_client_pool->get_shards_pool();
+
+  for (auto &timeline : timeline_values) {
+    auto conn = shards_pool->fetch(timeline.first);
+    auto pipe = pipe_map.find(conn);
+    if (pipe == pipe_map.end()) {
+      auto new_pipe = std::make_shared<Pipeline>(
+          _redis_cluster_client_pool->pipeline(timeline.first, false));
+      pipe = pipe_map.insert(std::make_pair(conn, new_pipe)).first;
+    }
+    pipe->second->zadd(timeline.first, timeline.second.begin(),
+                       timeline.second.end(), UpdateType::NOT_EXIST);
+  }
+  for (auto const &it : pipe_map) {
+    it.second->exec();
+  }
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_SRC_WRITEHOMETIMELINESERVICE_WRITEHOMETIMELINEHANDLER_H_
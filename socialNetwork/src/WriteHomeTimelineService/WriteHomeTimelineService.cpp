@@ -1,113 +1,32 @@
 
-#include <cpp_redis/cpp_redis>
+#include <chrono>
 #include <csignal>
+#include <memory>
 #include <mutex>
-#include <set>
 #include <sstream>
 #include <thread>
+#include <boost/program_options.hpp>
 #include <nlohmann/json.hpp>
 
 #include "../social_network_types.h"
 #include "../AmqpLibeventHandler.h"
 #include "../ClientPool.h"
-#include "../RedisClient.h"
 #include "../HttpClientWrapper.h"
+#include "../MessageQueue.h"
 #include "../logger.h"
-#include "../tracing.h"
+#include "../span_recorder.h"
+#include "../metrics.h"
 #include "../utils.h"
+#include "../utils_redis.h"
+#include "WriteHomeTimelineHandler.h"
 
 using namespace social_network;
 
 static std::exception_ptr _teptr;
-static ClientPool<RedisClient> *_redis_client_pool;
-static ClientPool<HttpClientWrapper> *_social_graph_client_pool;
+static WriteHomeTimelineHandler *_handler;
 
 void sigintHandler(int sig) { exit(EXIT_SUCCESS); }
 
-void OnReceivedWorker(const AMQP::Message &msg) {
-  try {
-    json msg_json = json::parse(std::string(msg.body(), msg.bodySize()));
-
-    std::map<std::string, std::string> carrier;
-    for (auto it = msg_json["carrier"].begin(); it != msg_json["carrier"].end();
-         ++it) {
-      carrier.emplace(std::make_pair(it.key(), it.value()));
-    }
-
-    // Jaeger tracing
-    // TextMapReader span_reader(carrier);
-    // auto parent_span = opentracing::Tracer::Global()->Extract(span_reader);
-    // auto span = opentracing::Tracer::Global()->StartSpan(
-    //     "write_home_timeline_server",
-    //     {opentracing::ChildOf(parent_span->get())});
-
-    // Extract information from rabbitmq messages
-    int64_t user_id = msg_json["user_id"];
-    int64_t req_id = msg_json["req_id"];
-    int64_t post_id = msg_json["post_id"];
-    int64_t timestamp = msg_json["timestamp"];
-    std::vector<int64_t> user_mentions_id = msg_json["user_mentions_id"];
-
-    // Find followers of the user
-    // auto followers_span = opentracing::Tracer::Global()->StartSpan(
-    //     "get_followers_client", {opentracing::ChildOf(&span->context())});
-    std::map<std::string, std::string> writer_text_map;
-    // TextMapWriter writer(writer_text_map);
-    // opentracing::Tracer::Global()->Inject(followers_span->context(), writer);
-
-    auto social_graph_client = _social_graph_client_pool->Pop();
-    if (!social_graph_client) {
-      // followers_span->Finish();
-      throw std::runtime_error("Failed to connect to social-graph-service");
-    }
-    std::vector<int64_t> followers_id;
-    try {
-      nlohmann::json req_json = {{"req_id", req_id},
-                                 {"user_id", user_id},
-                                 {"carrier", writer_text_map}};
-      auto res = social_graph_client->PostJson("/GetFollowers", req_json);
-      followers_id = res["followers_id"].get<std::vector<int64_t>>();
-    } catch (...) {
-      LOG(error) << "Failed to get followers from social-graph-service";
-      _social_graph_client_pool->Remove(social_graph_client);
-      // followers_span->Finish();
-      throw;
-    }
-    _social_graph_client_pool->Keepalive(social_graph_client);
-    // followers_span->Finish();
-
-    std::set<int64_t> followers_id_set(followers_id.begin(),
-                                       followers_id.end());
-    followers_id_set.insert(user_mentions_id.begin(), user_mentions_id.end());
-
-    // Update Redis ZSet
-    // auto redis_span = opentracing::Tracer::Global()->StartSpan(
-    //     "write_home_timeline_redis_update_client",
-    //     {opentracing::ChildOf(&span->context())});
-    auto redis_client_wrapper = _redis_client_pool->Pop();
-    if (!redis_client_wrapper) {
-      throw std::runtime_error("Cannot connect to Redis server");
-    }
-    auto redis_client = redis_client_wrapper->GetClient();
-    std::vector<std::string> options{"NX"};
-    std::string post_id_str = std::to_string(post_id);
-    std::string timestamp_str = std::to_string(timestamp);
-    std::multimap<std::string, std::string> value = {
-        {timestamp_str, post_id_str}};
-
-    for (auto &follower_id : followers_id_set) {
-      redis_client->zadd(std::to_string(follower_id), options, value);
-    }
-
-    redis_client->sync_commit();
-    // redis_span->Finish();
-    _redis_client_pool->Keepalive(redis_client_wrapper);
-  } catch (...) {
-    LOG(error) << "OnReveived worker error";
-    throw;
-  }
-}
-
 void HeartbeatSend(AmqpLibeventHandler &handler,
                    AMQP::TcpConnection &connection, int interval) {
   while (handler.GetIsRunning()) {
@@ -117,7 +36,20 @@ void HeartbeatSend(AmqpLibeventHandler &handler,
   }
 }
 
-void WorkerThread(std::string &addr, int port) {
+// Attempts at a batch consumed through MessageConsumer before it is dropped,
+// and the wait before the first retry, doubled for each following one.
+static const int kMaxBatchAttempts = 3;
+static const int kBatchRetryDelayMs = 100;
+
+// Deliveries are acknowledged manually, once per batch: the broker keeps up
+// to prefetch unacknowledged messages in flight, the batch is written when
+// batch_size of them have arrived or batch_delay_ms has passed, and a single
+// multiple-ack then settles all of them. The messages of a failed batch are
+// requeued on their first delivery and dropped on their redelivery, so that
+// a message that can never be written is not redelivered forever. Redelivery
+// is safe because the timeline writes are idempotent ZADDs.
+void WorkerThread(std::string &addr, int port, int batch_size,
+                  int batch_delay_ms, int prefetch) {
   AmqpLibeventHandler handler;
   AMQP::TcpConnection connection(
       handler, AMQP::Address(addr, port, AMQP::Login("guest", "guest"), "/"));
@@ -126,16 +58,53 @@ void WorkerThread(std::string &addr, int port) {
     LOG(error) << "Channel error: " << message;
     handler.Stop();
   });
+  channel.setQos(prefetch);
   channel.declareQueue("write-home-timeline", AMQP::durable)
       .onSuccess([&connection](const std::string &name, uint32_t messagecount,
                                uint32_t consumercount) {
         LOG(debug) << "Created queue: " << name;
       });
-  channel.consume("write-home-timeline", AMQP::noack)
-      .onReceived([](const AMQP::Message &msg, uint64_t tag, bool redelivered) {
-        LOG(debug) << "Received: " << std::string(msg.body(), msg.bodySize());
-        OnReceivedWorker(msg);
+
+  std::vector<std::string> batch;
+  // Delivery tag and redelivered flag of each message of batch.
+  std::vector<std::pair<uint64_t, bool>> deliveries;
+  auto flush = [&]() {
+    if (batch.empty()) {
+      return;
+    }
+    try {
+      _handler->WriteHomeTimeline(batch);
+      channel.ack(deliveries.back().first, AMQP::multiple);
+    } catch (const std::exception &e) {
+      int dropped = 0;
+      for (auto &delivery : deliveries) {
+        if (delivery.second) {
+          channel.reject(delivery.first);
+          ++dropped;
+        } else {
+          channel.reject(delivery.first, AMQP::requeue);
+        }
+      }
+      LOG(error) << "Failed to write home timeline batch of " << batch.size()
+                 << ", requeued " << batch.size() - dropped
+                 << " and dropped " << dropped << " redelivered: "
+                 << e.what();
+    }
+    batch.clear();
+    deliveries.clear();
+  };
+
+  channel.consume("write-home-timeline")
+      .onReceived([&](const AMQP::Message &msg, uint64_t tag,
+                      bool redelivered) {
+        batch.emplace_back(msg.body(), msg.bodySize());
+        deliveries.emplace_back(tag, redelivered);
+        LOG(debug) << "Received: " << batch.back();
+        if (batch.size() >= static_cast<size_t>(batch_size)) {
+          flush();
+        }
       });
+  handler.AddTimer(batch_delay_ms, flush);
 
   std::thread heartbeat_thread(HeartbeatSend, std::ref(handler),
                                std::ref(connection), 30);
@@ -145,29 +114,93 @@ void WorkerThread(std::string &addr, int port) {
   connection.close();
 }
 
+// Consumer loop for the channels implemented by MessageConsumer, which have
+// no acknowledgements to requeue with: a failed batch is retried in place up
+// to kMaxBatchAttempts times, with a growing delay, before it is dropped.
+void QueueWorkerThread(MessageConsumer *queue, int batch_size,
+                       int batch_delay_ms) {
+  std::vector<std::string> messages;
+  while (true) {
+    messages.clear();
+    if (queue->ConsumeBatch(&messages, batch_size, 1000, batch_delay_ms) ==
+        0) {
+      continue;
+    }
+    int delay_ms = kBatchRetryDelayMs;
+    for (int attempt = 1; attempt <= kMaxBatchAttempts; ++attempt) {
+      try {
+        _handler->WriteHomeTimeline(messages);
+        break;
+      } catch (const std::exception &e) {
+        if (attempt == kMaxBatchAttempts) {
+          LOG(error) << "Dropped home timeline batch of " << messages.size()
+                     << " after " << attempt << " attempts: " << e.what();
+          break;
+        }
+        LOG(warning) << "Failed to write home timeline batch of "
+                     << messages.size() << ", retrying in " << delay_ms
+                     << " ms: " << e.what();
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+      delay_ms *= 2;
+    }
+  }
+}
+
 int main(int argc, char *argv[]) {
   signal(SIGINT, sigintHandler);
   init_logger();
 
-  // SetUpTracer("config/jaeger-config.yml", "write-home-timeline-service");
+  // Command line options
+  namespace po = boost::program_options;
+  po::options_description desc("Options");
+  desc.add_options()("help", "produce help message")(
+      "redis-cluster",
+      po::value<bool>()->default_value(false)->implicit_value(true),
+      "Enable redis cluster mode");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << "\n";
+    return 0;
+  }
+
+  bool redis_cluster_flag = false;
+  if (vm.count("redis-cluster")) {
+    if (vm["redis-cluster"].as<bool>()) {
+      redis_cluster_flag = true;
+    }
+  }
+
 
   json config_json;
   if (load_config_file("config/service-config.json", &config_json) != 0) {
     exit(EXIT_FAILURE);
   }
+  SetUpSpanRecorder(config_json, "write-home-timeline-service");
+  SetUpClientPools(config_json);
 
   int port = config_json["write-home-timeline-service"]["port"];
   int n_workers = config_json["write-home-timeline-service"]["workers"];
+  std::string channel = config_json["write-home-timeline-service"]["channel"];
+  int batch_size = config_json["write-home-timeline-service"]["batch_size"];
+  int batch_delay_ms =
+      config_json["write-home-timeline-service"]["batch_delay_ms"];
+  int prefetch = config_json["write-home-timeline-service"]["prefetch"];
+  int fan_out_timeout_ms =
+      config_json["write-home-timeline-service"]["timeout_ms"];
 
   std::string rabbitmq_addr =
       config_json["write-home-timeline-rabbitmq"]["addr"];
   int rabbitmq_port = config_json["write-home-timeline-rabbitmq"]["port"];
 
-  std::string redis_addr = config_json["home-timeline-redis"]["addr"];
-  int redis_port = config_json["home-timeline-redis"]["port"];
-  int redis_conns = config_json["home-timeline-redis"]["connections"];
-  int redis_timeout = config_json["home-timeline-redis"]["timeout_ms"];
-  int redis_keepalive = config_json["home-timeline-redis"]["keepalive_ms"];
+  int redis_cluster_config_flag =
+      config_json["home-timeline-redis"]["use_cluster"];
+  int redis_replica_config_flag =
+      config_json["home-timeline-redis"]["use_replica"];
 
   std::string social_graph_service_addr =
       config_json["social-graph-service"]["addr"];
@@ -179,22 +212,69 @@ int main(int argc, char *argv[]) {
   int social_graph_service_keepalive =
       config_json["social-graph-service"]["keepalive_ms"];
 
-  ClientPool<RedisClient> redis_client_pool("redis", redis_addr, redis_port, 0,
-                                            redis_conns, redis_timeout,
-                                            redis_keepalive);
+  if (redis_replica_config_flag &&
+      (redis_cluster_config_flag || redis_cluster_flag)) {
+    LOG(error) << "Can't start service when Redis Cluster and Redis Replica "
+                  "are enabled at the same time";
+    exit(EXIT_FAILURE);
+  }
 
   ClientPool<HttpClientWrapper> social_graph_client_pool(
     "social-graph-service", social_graph_service_addr,
     social_graph_service_port, 0, social_graph_service_conns,
     social_graph_service_timeout, social_graph_service_keepalive);
 
-  _redis_client_pool = &redis_client_pool;
-  _social_graph_client_pool = &social_graph_client_pool;
+  std::unique_ptr<Redis> redis_client_pool;
+  std::unique_ptr<RedisCluster> redis_cluster_client_pool;
+  std::unique_ptr<WriteHomeTimelineHandler> handler;
+  if (redis_replica_config_flag) {
+    // Only writes are issued, so only the primary is needed.
+    redis_client_pool = std::make_unique<Redis>(
+        init_redis_replica_client_pool(config_json, "redis-primary"));
+    handler = std::make_unique<WriteHomeTimelineHandler>(
+        redis_client_pool.get(), &social_graph_client_pool,
+        fan_out_timeout_ms);
+  } else if (redis_cluster_flag || redis_cluster_config_flag) {
+    redis_cluster_client_pool = std::make_unique<RedisCluster>(
+        init_redis_cluster_client_pool(config_json, "home-timeline"));
+    handler = std::make_unique<WriteHomeTimelineHandler>(
+        redis_cluster_client_pool.get(), &social_graph_client_pool,
+        fan_out_timeout_ms);
+  } else {
+    redis_client_pool = std::make_unique<Redis>(
+        init_redis_client_pool(config_json, "home-timeline"));
+    handler = std::make_unique<WriteHomeTimelineHandler>(
+        redis_client_pool.get(), &social_graph_client_pool,
+        fan_out_timeout_ms);
+  }
+  _handler = handler.get();
+
+  std::unique_ptr<MessageConsumer> queue;
+  if (channel == "file") {
+    queue = std::make_unique<FileMessageQueue>(
+        config_json["write-home-timeline-service"]["queue_path"]);
+  } else if (channel != "rabbitmq") {
+    LOG(error) << "Unknown write-home-timeline channel " << channel;
+    exit(EXIT_FAILURE);
+  }
+
+  // The service is fed by a queue; its port only serves /metrics.
+  httplib::Server metrics_server;
+  SetUpServerMetrics(&metrics_server, "write-home-timeline-service");
+  std::thread([&metrics_server, port]() {
+    metrics_server.listen("0.0.0.0", port);
+  }).detach();
 
   std::unique_ptr<std::thread> threads_ptr[n_workers];
   for (auto &thread_ptr : threads_ptr) {
-    thread_ptr = std::make_unique<std::thread>(
-        WorkerThread, std::ref(rabbitmq_addr), rabbitmq_port);
+    if (queue) {
+      thread_ptr = std::make_unique<std::thread>(
+          QueueWorkerThread, queue.get(), batch_size, batch_delay_ms);
+    } else {
+      thread_ptr = std::make_unique<std::thread>(
+          WorkerThread, std::ref(rabbitmq_addr), rabbitmq_port, batch_size,
+          batch_delay_ms, prefetch);
+    }
   }
   for (auto &thread_ptr : threads_ptr) {
     thread_ptr->join();
@@ -1,29 +1,349 @@
 #ifndef SOCIAL_NETWORK_MICROSERVICES_LOGGER_H
 #define SOCIAL_NETWORK_MICROSERVICES_LOGGER_H
 
-#include <boost/log/trivial.hpp>
-#include <boost/log/utility/setup/console.hpp>
-#include <boost/log/utility/setup/common_attributes.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <string.h>
 
+// Statements below this severity are compiled out, operands included.
+// Build with e.g. -DLOG_MIN_SEVERITY=debug to get the debug lines back.
+#ifndef LOG_MIN_SEVERITY
+#define LOG_MIN_SEVERITY info
+#endif
+
 namespace social_network {
+
+struct LogSeverity {
+  enum type { trace, debug, info, warning, error, fatal };
+};
+
 #define __FILENAME__ \
     (strrchr(__FILE__, '/') ? strrchr(__FILE__, '/') + 1 : __FILE__)
+
+// LOG(severity) << ...; formats the line on the calling thread and hands it
+// to a per-thread ring buffer. A background thread writes the lines to stderr.
+// Only fatal lines are written synchronously, after everything queued before
+// them, so that the usual LOG(fatal) + exit() still leaves its message.
 #define LOG(severity) \
-    BOOST_LOG_TRIVIAL(severity) << "(" << __FILENAME__ << ":" \
-    << __LINE__ << ":" << __FUNCTION__ << ") "
+    !::social_network::LogIsOn(::social_network::LogSeverity::severity) \
+        ? (void)0 \
+        : ::social_network::LogVoidify() & \
+              ::social_network::LogLine( \
+                  ::social_network::LogSeverity::severity, __FILENAME__, \
+                  __LINE__, __FUNCTION__).stream()
+
+// Same as LOG, but a call site prints at most one line per
+// kLogRateLimitIntervalMs; the lines it swallows are counted and the count is
+// appended to the next line that gets through. Meant for errors that can
+// repeat for every request, e.g. a downstream service being unreachable.
+#define LOG_RATE_LIMITED(severity) \
+    for (uint64_t _log_suppressed = 0, _log_once = \
+             ::social_network::LogRateLimitedIsOn( \
+                 ::social_network::LogSeverity::severity, \
+                 []() -> ::social_network::LogRateLimiter & { \
+                   static ::social_network::LogRateLimiter limiter; \
+                   return limiter; \
+                 }(), &_log_suppressed); \
+         _log_once; _log_once = 0) \
+      ::social_network::LogLine(::social_network::LogSeverity::severity, \
+                                __FILENAME__, __LINE__, __FUNCTION__, \
+                                _log_suppressed).stream()
+
+static constexpr int kLogRateLimitIntervalMs = 1000;
+static constexpr int kLogFlushIntervalMs = 10;
+
+struct LogRecord {
+  std::chrono::system_clock::time_point time;
+  LogSeverity::type severity;
+  std::string text;
+};
+
+// Single-producer single-consumer ring of log records. The producer is the
+// thread owning the ring, the consumer is whoever holds Logger::_flush_mtx.
+class LogRing {
+ public:
+  static constexpr size_t kCapacity = 1024;
+
+  LogRing() : _records(kCapacity), _head(0), _tail(0), closed(false) {}
+
+  bool Push(LogRecord *record) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == kCapacity) {
+      return false;
+    }
+    auto &slot = _records[tail % kCapacity];
+    slot.time = record->time;
+    slot.severity = record->severity;
+    slot.text.swap(record->text);
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  void Drain(std::vector<LogRecord> *records) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      records->emplace_back();
+      auto &slot = _records[head % kCapacity];
+      records->back().time = slot.time;
+      records->back().severity = slot.severity;
+      records->back().text.swap(slot.text);
+    }
+    _head.store(tail, std::memory_order_release);
+  }
+
+ private:
+  std::vector<LogRecord> _records;
+  std::atomic<size_t> _head;
+  std::atomic<size_t> _tail;
+
+ public:
+  // Set when the owning thread exits; the ring is dropped once drained.
+  std::atomic<bool> closed;
+};
+
+class Logger {
+ public:
+  // Never destroyed, so that threads still running during exit can log.
+  static Logger &Get() {
+    static Logger *logger = new Logger();
+    return *logger;
+  }
+
+  LogSeverity::type level() const {
+    return _level.load(std::memory_order_relaxed);
+  }
+  void set_level(LogSeverity::type level) {
+    _level.store(level, std::memory_order_relaxed);
+  }
+
+  void Submit(LogRecord *record) {
+    if (record->severity >= LogSeverity::fatal) {
+      Flush();
+      std::string out;
+      _Format(*record, &out);
+      std::lock_guard<std::mutex> lock(_flush_mtx);
+      fwrite(out.data(), 1, out.size(), stderr);
+      fflush(stderr);
+      return;
+    }
+    if (!_ThreadRing()->Push(record)) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Writes out everything queued so far.
+  void Flush() {
+    std::lock_guard<std::mutex> flush_lock(_flush_mtx);
+    std::vector<std::shared_ptr<LogRing>> rings;
+    {
+      std::lock_guard<std::mutex> lock(_rings_mtx);
+      rings = _rings;
+    }
+    _records.clear();
+    std::vector<LogRing *> closed_rings;
+    for (auto &ring : rings) {
+      // Read before draining: a closed ring gets no more records.
+      if (ring->closed.load(std::memory_order_acquire)) {
+        closed_rings.emplace_back(ring.get());
+      }
+      ring->Drain(&_records);
+    }
+    if (!closed_rings.empty()) {
+      std::lock_guard<std::mutex> lock(_rings_mtx);
+      _rings.erase(
+          std::remove_if(_rings.begin(), _rings.end(),
+                         [&](const std::shared_ptr<LogRing> &ring) {
+                           return std::find(closed_rings.begin(),
+                                            closed_rings.end(), ring.get()) !=
+                                  closed_rings.end();
+                         }),
+          _rings.end());
+    }
+
+    uint64_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+    if (_records.empty() && dropped == 0) {
+      return;
+    }
+    std::stable_sort(_records.begin(), _records.end(),
+                     [](const LogRecord &a, const LogRecord &b) {
+                       return a.time < b.time;
+                     });
+    _out.clear();
+    for (auto &record : _records) {
+      _Format(record, &_out);
+    }
+    if (dropped) {
+      LogRecord record{std::chrono::system_clock::now(), LogSeverity::warning,
+                       std::to_string(dropped) +
+                           " log lines dropped, log buffers full"};
+      _Format(record, &_out);
+    }
+    fwrite(_out.data(), 1, _out.size(), stderr);
+    fflush(stderr);
+  }
+
+ private:
+  Logger() : _level(LogSeverity::info), _dropped(0) {
+    std::thread([this]() {
+      while (true) {
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(kLogFlushIntervalMs));
+        Flush();
+      }
+    }).detach();
+    std::atexit([]() { Logger::Get().Flush(); });
+  }
+
+  LogRing *_ThreadRing() {
+    struct RingHolder {
+      std::shared_ptr<LogRing> ring;
+      ~RingHolder() {
+        if (ring) {
+          ring->closed.store(true, std::memory_order_release);
+        }
+      }
+    };
+    static thread_local RingHolder holder;
+    if (!holder.ring) {
+      holder.ring = std::make_shared<LogRing>();
+      std::lock_guard<std::mutex> lock(_rings_mtx);
+      _rings.emplace_back(holder.ring);
+    }
+    return holder.ring.get();
+  }
+
+  // Same layout as the Boost.Log console sink this replaces:
+  // [2018-01-01 00:00:00.000000] <info>: message
+  static void _Format(const LogRecord &record, std::string *out) {
+    static const char *severity_names[] = {"trace",   "debug", "info",
+                                           "warning", "error", "fatal"};
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                  record.time.time_since_epoch()).count();
+    time_t seconds = us / 1000000;
+    struct tm tm;
+    localtime_r(&seconds, &tm);
+    char buf[64];
+    size_t len = strftime(buf, sizeof buf, "[%Y-%m-%d %H:%M:%S", &tm);
+    len += snprintf(buf + len, sizeof buf - len, ".%06lld] <%s>: ",
+                    static_cast<long long>(us % 1000000),
+                    severity_names[record.severity]);
+    out->append(buf, len);
+    out->append(record.text);
+    out->push_back('\n');
+  }
+
+  std::atomic<LogSeverity::type> _level;
+  std::atomic<uint64_t> _dropped;
+  std::mutex _rings_mtx;
+  std::vector<std::shared_ptr<LogRing>> _rings;
+  // Serializes consumers; _records and _out are only touched under it.
+  std::mutex _flush_mtx;
+  std::vector<LogRecord> _records;
+  std::string _out;
+};
+
+// The first check is a constant, so for severities below LOG_MIN_SEVERITY
+// the whole LOG statement is dead code.
+inline bool LogIsOn(LogSeverity::type severity) {
+  return severity >= LogSeverity::LOG_MIN_SEVERITY &&
+         severity >= Logger::Get().level();
+}
+
+class LogRateLimiter {
+ public:
+  LogRateLimiter() : _last_ms(0), _suppressed(0) {}
+
+  bool Allow(uint64_t *suppressed) {
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = _last_ms.load(std::memory_order_relaxed);
+    if ((last != 0 && now - last < kLogRateLimitIntervalMs) ||
+        !_last_ms.compare_exchange_strong(last, now)) {
+      _suppressed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    *suppressed = _suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+
+ private:
+  std::atomic<int64_t> _last_ms;
+  std::atomic<uint64_t> _suppressed;
+};
+
+inline bool LogRateLimitedIsOn(LogSeverity::type severity,
+                               LogRateLimiter &limiter, uint64_t *suppressed) {
+  return LogIsOn(severity) && limiter.Allow(suppressed);
+}
+
+class LogLine {
+ public:
+  LogLine(LogSeverity::type severity, const char *file, int line,
+          const char *function, uint64_t suppressed = 0)
+      : _severity(severity), _suppressed(suppressed) {
+    _stream = _AcquireStream();
+    *_stream << "(" << file << ":" << line << ":" << function << ") ";
+  }
+
+  ~LogLine() {
+    if (_suppressed) {
+      *_stream << " (" << _suppressed << " similar lines suppressed)";
+    }
+    LogRecord record{std::chrono::system_clock::now(), _severity,
+                     _stream->str()};
+    Logger::Get().Submit(&record);
+    _ReleaseStream(_stream);
+  }
+
+  std::ostream &stream() { return *_stream; }
+
+ private:
+  // Streams are recycled per thread; constructing an ostringstream for every
+  // line costs about as much as formatting it. A LOG evaluated inside
+  // another LOG's operands simply takes a second stream.
+  static std::vector<std::unique_ptr<std::ostringstream>> &_FreeStreams() {
+    static thread_local std::vector<std::unique_ptr<std::ostringstream>>
+        streams;
+    return streams;
+  }
+  static std::ostringstream *_AcquireStream() {
+    auto &streams = _FreeStreams();
+    if (streams.empty()) {
+      return new std::ostringstream();
+    }
+    auto stream = streams.back().release();
+    streams.pop_back();
+    return stream;
+  }
+  static void _ReleaseStream(std::ostringstream *stream) {
+    stream->str(std::string());
+    stream->clear();
+    _FreeStreams().emplace_back(stream);
+  }
+
+  LogSeverity::type _severity;
+  uint64_t _suppressed;
+  std::ostringstream *_stream;
+};
+
+struct LogVoidify {
+  void operator&(std::ostream &) {}
+};
 
 void init_logger() {
-  boost::log::register_simple_formatter_factory
-      <boost::log::trivial::severity_level, char>("Severity");
-  boost::log::add_common_attributes();
-  boost::log::add_console_log(
-      std::cerr, boost::log::keywords::format =
-          "[%TimeStamp%] <%Severity%>: %Message%");
-  boost::log::core::get()->set_filter (
-      boost::log::trivial::severity >= boost::log::trivial::info
-  );
+  Logger::Get().set_level(LogSeverity::info);
 }
 
 
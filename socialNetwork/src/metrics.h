@@ -0,0 +1,433 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_METRICS_H
+#define SOCIAL_NETWORK_MICROSERVICES_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "httplib.h"
+
+namespace social_network {
+
+// Latency histogram with HdrHistogram's bucketing: values below
+// kSubBucketCount get a bucket each, every power of two above is split into
+// kSubBucketCount / 2 linear buckets, which keeps the relative error below
+// 1/64. Values are in microseconds and clamped to 2^kMaxValueBits - 1, about
+// 71 minutes.
+struct LatencyBuckets {
+  static constexpr int kSubBucketBits = 7;
+  static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+  static constexpr int kSubBucketHalf = kSubBucketCount / 2;
+  static constexpr int kMaxValueBits = 32;
+  static constexpr int kCount =
+      kSubBucketCount + (kMaxValueBits - kSubBucketBits) * kSubBucketHalf;
+
+  static int Index(uint64_t value) {
+    if (value < kSubBucketCount) {
+      return static_cast<int>(value);
+    }
+    if (value >> kMaxValueBits) {
+      value = (UINT64_C(1) << kMaxValueBits) - 1;
+    }
+    int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+    return kSubBucketCount + (shift - 1) * kSubBucketHalf +
+           static_cast<int>(value >> shift) - kSubBucketHalf;
+  }
+
+  // The highest value that falls into bucket index.
+  static uint64_t HighestValue(int index) {
+    if (index < kSubBucketCount) {
+      return index;
+    }
+    int shift = (index - kSubBucketCount) / kSubBucketHalf + 1;
+    uint64_t sub_bucket = (index - kSubBucketCount) % kSubBucketHalf +
+                          kSubBucketHalf;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+};
+
+// Request count, error count and latency histogram of one endpoint or one
+// downstream pool. Every thread records into a shard of its own with plain
+// relaxed loads and stores, so recording takes no lock and no atomic
+// read-modify-write. Collect() sums the shards; a snapshot taken while
+// threads are recording can be off by the requests in flight.
+class LatencyMetric {
+ public:
+  struct Snapshot {
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t sum_us = 0;
+    std::vector<uint64_t> counts;
+
+    uint64_t ValueAtQuantile(double quantile) const;
+  };
+
+  LatencyMetric() : _id(_NextId()) {}
+  LatencyMetric(const LatencyMetric &) = delete;
+  LatencyMetric &operator=(const LatencyMetric &) = delete;
+
+  void Record(int64_t latency_us, bool error) {
+    Shard *shard = _LocalShard();
+    uint64_t value = latency_us > 0 ? latency_us : 0;
+    _Add(&shard->counts[LatencyBuckets::Index(value)], 1);
+    _Add(&shard->requests, 1);
+    _Add(&shard->sum_us, value);
+    if (error) {
+      _Add(&shard->errors, 1);
+    }
+  }
+
+  Snapshot Collect() const;
+
+ private:
+  struct Shard {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> sum_us{0};
+    std::atomic<uint64_t> counts[LatencyBuckets::kCount] = {};
+  };
+
+  // Only the owning thread writes a shard.
+  static void _Add(std::atomic<uint64_t> *counter, uint64_t n) {
+    counter->store(counter->load(std::memory_order_relaxed) + n,
+                   std::memory_order_relaxed);
+  }
+
+  static size_t _NextId() {
+    static std::atomic<size_t> next_id{0};
+    return next_id.fetch_add(1);
+  }
+
+  Shard *_LocalShard();
+
+  const size_t _id;
+  mutable std::mutex _shards_mtx;
+  // Shards outlive their threads, so what they recorded is still counted.
+  std::vector<std::unique_ptr<Shard>> _shards;
+};
+
+LatencyMetric::Shard *LatencyMetric::_LocalShard() {
+  thread_local std::vector<Shard *> shards;
+  if (_id < shards.size() && shards[_id]) {
+    return shards[_id];
+  }
+  if (_id >= shards.size()) {
+    shards.resize(_id + 1, nullptr);
+  }
+  std::lock_guard<std::mutex> lock(_shards_mtx);
+  _shards.emplace_back(new Shard());
+  shards[_id] = _shards.back().get();
+  return shards[_id];
+}
+
+LatencyMetric::Snapshot LatencyMetric::Collect() const {
+  Snapshot snapshot;
+  snapshot.counts.assign(LatencyBuckets::kCount, 0);
+  std::lock_guard<std::mutex> lock(_shards_mtx);
+  for (auto &shard : _shards) {
+    snapshot.requests += shard->requests.load(std::memory_order_relaxed);
+    snapshot.errors += shard->errors.load(std::memory_order_relaxed);
+    snapshot.sum_us += shard->sum_us.load(std::memory_order_relaxed);
+    for (int i = 0; i < LatencyBuckets::kCount; ++i) {
+      snapshot.counts[i] += shard->counts[i].load(std::memory_order_relaxed);
+    }
+  }
+  return snapshot;
+}
+
+uint64_t LatencyMetric::Snapshot::ValueAtQuantile(double quantile) const {
+  uint64_t total = 0;
+  for (auto count : counts) {
+    total += count;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(quantile * total + 0.5);
+  rank = rank < 1 ? 1 : rank;
+  uint64_t seen = 0;
+  for (int i = 0; i < static_cast<int>(counts.size()); ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return LatencyBuckets::HighestValue(i);
+    }
+  }
+  return LatencyBuckets::HighestValue(static_cast<int>(counts.size()) - 1);
+}
+
+inline std::string EscapeLabelValue(const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+      escaped += c;
+    } else if (c == '\n') {
+      escaped += "\\n";
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+inline int64_t MetricsElapsedUs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+struct TimingStage {
+  enum type { REDIS, MEMCACHED, MONGO, DOWNSTREAM, COUNT };
+};
+
+static const char *const kTimingStageNames[TimingStage::COUNT] = {
+    "redis", "memcached", "mongo", "downstream"};
+
+// Time the current request has spent in each storage client and in
+// downstream HTTP calls. httplib serves a request on one thread from start to
+// finish, so the timing lives in that thread; work a handler hands to other
+// threads is not counted. Parallel calls on the request thread are counted
+// for the time it waited on them, not for the sum of their durations.
+class RequestTiming {
+ public:
+  static RequestTiming &Current() {
+    thread_local RequestTiming timing;
+    return timing;
+  }
+
+  void Reset() {
+    _us.fill(0);
+    _calls.fill(0);
+  }
+
+  void Add(TimingStage::type stage, int64_t us) {
+    _us[stage] += us;
+    ++_calls[stage];
+  }
+
+  int64_t us(TimingStage::type stage) const { return _us[stage]; }
+  int calls(TimingStage::type stage) const { return _calls[stage]; }
+
+ private:
+  RequestTiming() { Reset(); }
+
+  std::array<int64_t, TimingStage::COUNT> _us;
+  std::array<int, TimingStage::COUNT> _calls;
+};
+
+// Adds the time until Stop() or the end of the scope to stage.
+class ScopedTiming {
+ public:
+  explicit ScopedTiming(TimingStage::type stage)
+      : _stage(stage), _start(std::chrono::steady_clock::now()),
+        _stopped(false) {}
+  ScopedTiming(const ScopedTiming &) = delete;
+  ScopedTiming &operator=(const ScopedTiming &) = delete;
+  ~ScopedTiming() { Stop(); }
+
+  void Stop() {
+    if (!_stopped) {
+      _stopped = true;
+      RequestTiming::Current().Add(_stage, MetricsElapsedUs(_start));
+    }
+  }
+
+ private:
+  TimingStage::type _stage;
+  std::chrono::steady_clock::time_point _start;
+  bool _stopped;
+};
+
+// Server-side metrics per endpoint, with their breakdown per stage, and
+// client-side metrics per downstream pool of this process, rendered in
+// Prometheus' text format by /metrics.
+class Metrics {
+ public:
+  // Never destroyed, pools and server threads may record during exit.
+  static Metrics &Get() {
+    static Metrics *metrics = new Metrics();
+    return *metrics;
+  }
+
+  void SetService(const std::string &service) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    _service = service;
+  }
+
+  // Looked up once per thread and endpoint, the registry lock is not taken
+  // on the request path after that.
+  LatencyMetric *Server(const std::string &endpoint) {
+    thread_local std::unordered_map<std::string, LatencyMetric *> cache;
+    auto it = cache.find(endpoint);
+    if (it != cache.end()) {
+      return it->second;
+    }
+    LatencyMetric *metric =
+        _Get(&_server, "endpoint=\"" + EscapeLabelValue(endpoint) + "\"");
+    cache.emplace(endpoint, metric);
+    return metric;
+  }
+
+  // Time requests to endpoint spent in stage, see RequestTiming.
+  LatencyMetric *Stage(const std::string &endpoint, TimingStage::type stage) {
+    thread_local std::unordered_map<
+        std::string, std::array<LatencyMetric *, TimingStage::COUNT>> cache;
+    auto &metrics = cache[endpoint];
+    if (!metrics[stage]) {
+      metrics[stage] = _Get(&_stage, "endpoint=\"" +
+                                         EscapeLabelValue(endpoint) +
+                                         "\",stage=\"" +
+                                         kTimingStageNames[stage] + "\"");
+    }
+    return metrics[stage];
+  }
+
+  LatencyMetric *Client(const std::string &pool) {
+    return _Get(&_client, "pool=\"" + EscapeLabelValue(pool) + "\"");
+  }
+
+  // A count of events that are not requests, such as background work given
+  // up on; rendered as the counter <name>. Look it up once and keep it.
+  std::atomic<int64_t> *Counter(const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto &counter = _counters[name];
+    if (!counter) {
+      counter.reset(new std::atomic<int64_t>(0));
+    }
+    return counter.get();
+  }
+
+  std::string Render();
+
+ private:
+  // Keyed by the metric's labels, in Prometheus' syntax.
+  using MetricMap = std::map<std::string, std::unique_ptr<LatencyMetric>>;
+
+  Metrics() = default;
+
+  LatencyMetric *_Get(MetricMap *metrics, const std::string &name) {
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto &metric = (*metrics)[name];
+    if (!metric) {
+      metric.reset(new LatencyMetric());
+    }
+    return metric.get();
+  }
+
+  void _Render(const MetricMap &metrics, const std::string &prefix,
+               std::string *out);
+
+  std::mutex _mtx;
+  std::string _service;
+  MetricMap _server;
+  MetricMap _stage;
+  MetricMap _client;
+  std::map<std::string, std::unique_ptr<std::atomic<int64_t>>> _counters;
+};
+
+void Metrics::_Render(const MetricMap &metrics, const std::string &prefix,
+                      std::string *out) {
+  static const std::pair<const char *, double> kQuantiles[] = {
+      {"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999},
+      {"1", 1.0}};
+  std::vector<std::pair<std::string, LatencyMetric::Snapshot>> snapshots;
+  for (auto &metric : metrics) {
+    snapshots.emplace_back(
+        "{service=\"" + EscapeLabelValue(_service) + "\"," + metric.first,
+        metric.second->Collect());
+  }
+
+  *out += "# TYPE " + prefix + "requests_total counter\n";
+  for (auto &s : snapshots) {
+    *out += prefix + "requests_total" + s.first + "} " +
+            std::to_string(s.second.requests) + "\n";
+  }
+  *out += "# TYPE " + prefix + "errors_total counter\n";
+  for (auto &s : snapshots) {
+    *out += prefix + "errors_total" + s.first + "} " +
+            std::to_string(s.second.errors) + "\n";
+  }
+  *out += "# TYPE " + prefix + "latency_us summary\n";
+  for (auto &s : snapshots) {
+    for (auto &quantile : kQuantiles) {
+      *out += prefix + "latency_us" + s.first + ",quantile=\"" +
+              quantile.first + "\"} " +
+              std::to_string(s.second.ValueAtQuantile(quantile.second)) +
+              "\n";
+    }
+    *out += prefix + "latency_us_sum" + s.first + "} " +
+            std::to_string(s.second.sum_us) + "\n";
+    *out += prefix + "latency_us_count" + s.first + "} " +
+            std::to_string(s.second.requests) + "\n";
+  }
+}
+
+std::string Metrics::Render() {
+  std::lock_guard<std::mutex> lock(_mtx);
+  std::string out;
+  _Render(_server, "server_", &out);
+  _Render(_stage, "server_stage_", &out);
+  _Render(_client, "client_", &out);
+  for (auto &counter : _counters) {
+    out += "# TYPE " + counter.first + " counter\n";
+    out += counter.first + "{service=\"" + EscapeLabelValue(_service) +
+           "\"} " +
+           std::to_string(counter.second->load(std::memory_order_relaxed)) +
+           "\n";
+  }
+  return out;
+}
+
+// Records every request of server by route, with the time it spent in each
+// stage of RequestTiming, and serves GET /metrics. Latency runs from the
+// start of reading the request to the response being ready to be written;
+// responses with a 4xx or 5xx status count as errors. The stages are also
+// returned to the caller in a Server-Timing header, in milliseconds.
+void SetUpServerMetrics(httplib::Server *server, const std::string &service) {
+  Metrics::Get().SetService(service);
+  server->Get("/metrics", [](const httplib::Request &,
+                             httplib::Response &res) {
+    res.set_content(Metrics::Get().Render(), "text/plain; version=0.0.4");
+  });
+  server->set_pre_routing_handler([](const httplib::Request &,
+                                     httplib::Response &) {
+    RequestTiming::Current().Reset();
+    return httplib::Server::HandlerResponse::Unhandled;
+  });
+  server->set_post_routing_handler([](const httplib::Request &req,
+                                      httplib::Response &res) {
+    const std::string &endpoint =
+        req.matched_route.empty() ? "unmatched" : req.matched_route;
+    int64_t total_us = MetricsElapsedUs(req.start_time_);
+    Metrics::Get().Server(endpoint)->Record(total_us, res.status >= 400);
+
+    auto &timing = RequestTiming::Current();
+    std::string server_timing;
+    char buf[64];
+    for (int i = 0; i < TimingStage::COUNT; ++i) {
+      auto stage = static_cast<TimingStage::type>(i);
+      if (!timing.calls(stage)) {
+        continue;
+      }
+      Metrics::Get().Stage(endpoint, stage)->Record(timing.us(stage), false);
+      snprintf(buf, sizeof buf, "%s;dur=%.3f, ", kTimingStageNames[i],
+               timing.us(stage) / 1000.0);
+      server_timing += buf;
+    }
+    snprintf(buf, sizeof buf, "total;dur=%.3f", total_us / 1000.0);
+    server_timing += buf;
+    res.set_header("Server-Timing", server_timing);
+  });
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_METRICS_H
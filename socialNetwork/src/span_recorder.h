@@ -0,0 +1,585 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_SPAN_RECORDER_H
+#define SOCIAL_NETWORK_MICROSERVICES_SPAN_RECORDER_H
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+#include "utils_random.h"
+
+namespace social_network {
+
+using json = nlohmann::json;
+
+// Built-in replacement for the Jaeger client, whose spans are commented out
+// throughout the handlers. Spans are kept in per-thread buffers and a
+// background thread exports them in batches as the JSON that Jaeger's query
+// API returns, which is what ms_collecter/trace_collect.py reads.
+//
+// The sampling decision is made once, by the first service a request reaches,
+// and travels in the request's carrier under Jaeger's key and format,
+// "{trace-id}:{span-id}:{parent-span-id}:{flags}" in hex. Unsampled requests
+// only pay for parsing and re-injecting that entry.
+static const char kSpanContextKey[] = "uber-trace-id";
+
+struct SpanContext {
+  uint64_t trace_id;
+  uint64_t span_id;
+  bool sampled;
+};
+
+struct SpanRecord {
+  uint64_t trace_id;
+  uint64_t span_id;
+  uint64_t parent_id;
+  const char *operation;
+  int64_t start_us;
+  int64_t duration_us;
+};
+
+struct SpanExporter {
+  enum type { NONE, LOCAL_FILE, UDP };
+};
+
+class SpanRecorder {
+ public:
+  // Never destroyed, like Logger, so that spans finishing during exit are
+  // not recorded into a dead object.
+  static SpanRecorder &Get() {
+    static SpanRecorder *recorder = new SpanRecorder();
+    return *recorder;
+  }
+
+  void Configure(const json &config, const std::string &service);
+
+  bool Sample() {
+    if (_sampling_rate <= 0) {
+      return false;
+    }
+    return _sampling_rate >= 1 ||
+           (NewId() >> 11) * (1.0 / (UINT64_C(1) << 53)) < _sampling_rate;
+  }
+
+  // xorshift64*, seeded per thread from the kernel.
+  uint64_t NewId() {
+    thread_local uint64_t state = 0;
+    while (state == 0) {
+      FillRandomBytes(reinterpret_cast<unsigned char *>(&state),
+                      sizeof(state));
+    }
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * UINT64_C(2685821657736338717);
+  }
+
+  // Copies the record into the calling thread's ring; nothing is allocated
+  // or formatted here. A ring that reaches half full wakes the exporter, and
+  // a full one makes the thread wait for it.
+  void Record(const SpanRecord &record) {
+    if (_exporter == SpanExporter::NONE) {
+      return;
+    }
+    auto buffer = _ThreadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    uint64_t tail = buffer->tail.load(std::memory_order_acquire);
+    if (head - tail == kSpanBufferSize && !_WaitForSpace(buffer, head)) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    buffer->spans[head % kSpanBufferSize] = record;
+    buffer->head.store(head + 1, std::memory_order_release);
+    if (head + 1 - tail == kSpanBufferSize / 2) {
+      _WakeExporter();
+    }
+  }
+
+  // Exports everything recorded so far.
+  void Flush();
+
+  // Spans dropped since the start because a ring stayed full for
+  // max_wait_ms.
+  uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+ private:
+  // Per thread, 96 KB.
+  static constexpr uint64_t kSpanBufferSize = 2048;
+  // Stay below the largest UDP payload.
+  static constexpr size_t kMaxDatagramSize = 60000;
+
+  // Single-producer single-consumer ring: the owning thread advances head,
+  // Flush() advances tail once the spans are exported.
+  struct SpanBuffer {
+    SpanRecord spans[kSpanBufferSize];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<bool> closed{false};
+  };
+
+  SpanRecorder()
+      : _sampling_rate(0), _exporter(SpanExporter::NONE), _file(nullptr),
+        _socket(-1), _max_wait_ms(100), _dropped(0), _dropped_reported(0),
+        _wake(false) {}
+
+  SpanBuffer *_ThreadBuffer();
+  bool _WaitForSpace(SpanBuffer *buffer, uint64_t head);
+  void _WakeExporter();
+  // Appends the trace of the spans in [first, last), all of one trace.
+  void _AppendTrace(const SpanRecord *first, const SpanRecord *last,
+                    std::string *out) const;
+  // Appends the spans of the ring in [tail, head) to the documents, one trace
+  // per run of spans of the same trace.
+  void _AppendSpans(const SpanBuffer &buffer, uint64_t tail, uint64_t head);
+  void _Export(const std::string &document);
+
+  double _sampling_rate;
+  SpanExporter::type _exporter;
+  std::string _service;
+  std::string _hostname;
+  // The "processes" member of every exported trace, built once.
+  std::string _processes_json;
+  FILE *_file;
+  int _socket;
+  int _max_wait_ms;
+  std::atomic<uint64_t> _dropped;
+  uint64_t _dropped_reported;
+  std::mutex _buffers_mtx;
+  std::vector<std::shared_ptr<SpanBuffer>> _buffers;
+  // Serializes Flush(), which also owns the two strings below. They keep
+  // their capacity between flushes.
+  std::mutex _flush_mtx;
+  std::string _document;
+  // A trace moved to the next datagram.
+  std::string _trace_str;
+  // The exporter thread sleeps on _wake_cv between flushes, threads waiting
+  // for room in their ring on _space_cv.
+  std::mutex _wake_mtx;
+  std::condition_variable _wake_cv;
+  bool _wake;
+  std::mutex _space_mtx;
+  std::condition_variable _space_cv;
+};
+
+// Spans are serialized by hand, building nlohmann::json objects for every
+// span costs several times more than recording it.
+inline void FormatHex(uint64_t id, char *buf) {
+  static const char kDigits[] = "0123456789abcdef";
+  for (int i = 15; i >= 0; --i) {
+    buf[i] = kDigits[id & 0xf];
+    id >>= 4;
+  }
+}
+
+inline void AppendHex(uint64_t id, std::string *out) {
+  char buf[16];
+  FormatHex(id, buf);
+  out->append(buf, 16);
+}
+
+template<size_t N>
+inline void AppendLiteral(const char (&literal)[N], std::string *out) {
+  out->append(literal, N - 1);
+}
+
+inline void AppendInt(int64_t value, std::string *out) {
+  char buf[24];
+  char *end = buf + sizeof buf;
+  char *p = end;
+  bool negative = value < 0;
+  uint64_t u = negative ? -static_cast<uint64_t>(value) : value;
+  do {
+    *--p = static_cast<char>('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (negative) {
+    *--p = '-';
+  }
+  out->append(p, end - p);
+}
+
+// Parses the hex fields of the carrier entry, "{trace-id}:{span-id}:...".
+inline const char *ParseHex(const char *p, uint64_t *value) {
+  const char *start = p;
+  uint64_t v = 0;
+  for (;; ++p) {
+    char c = *p;
+    if (c >= '0' && c <= '9') {
+      v = (v << 4) | static_cast<uint64_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      v = (v << 4) | static_cast<uint64_t>(c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      v = (v << 4) | static_cast<uint64_t>(c - 'A' + 10);
+    } else {
+      break;
+    }
+  }
+  *value = v;
+  return p == start || p - start > 16 ? nullptr : p;
+}
+
+// Takes the "tracing" section of service-config.json. Without one nothing is
+// recorded, but sampling decisions made upstream are still passed on.
+void SpanRecorder::Configure(const json &config, const std::string &service) {
+  _service = service;
+  char hostname[256] = {0};
+  gethostname(hostname, sizeof(hostname) - 1);
+  _hostname = hostname;
+  json processes = {
+      {"p1",
+       {{"serviceName", _service},
+        {"tags", {{{"key", "hostname"}, {"type", "string"},
+                   {"value", _hostname}}}}}}};
+  _processes_json = processes.dump();
+  if (!config.is_object()) {
+    return;
+  }
+  _sampling_rate = config.value("sampling_rate", 0.0);
+  std::string exporter = config.value("exporter", std::string("none"));
+  if (exporter == "file") {
+    std::string path = config.value("path", std::string("/tmp/spans"));
+    mkdir(path.c_str(), 0755);
+    std::string file_name = path + "/" + service + "-" + _hostname + ".json";
+    _file = fopen(file_name.c_str(), "a");
+    if (!_file) {
+      LOG(error) << "Failed to open " << file_name << ", spans are not exported";
+      return;
+    }
+    _exporter = SpanExporter::LOCAL_FILE;
+  } else if (exporter == "udp") {
+    std::string addr = config.value("udp_addr", std::string("127.0.0.1"));
+    std::string port = std::to_string(config.value("udp_port", 6832));
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *result;
+    if (getaddrinfo(addr.c_str(), port.c_str(), &hints, &result) != 0) {
+      LOG(error) << "Failed to resolve " << addr << ", spans are not exported";
+      return;
+    }
+    _socket = socket(result->ai_family, result->ai_socktype,
+                     result->ai_protocol);
+    if (_socket < 0 ||
+        connect(_socket, result->ai_addr, result->ai_addrlen) != 0) {
+      LOG(error) << "Failed to connect to " << addr << ":" << port
+                 << ", spans are not exported";
+      freeaddrinfo(result);
+      return;
+    }
+    freeaddrinfo(result);
+    _exporter = SpanExporter::UDP;
+  } else if (exporter != "none") {
+    LOG(error) << "Unknown span exporter " << exporter;
+    return;
+  }
+  if (_exporter == SpanExporter::NONE) {
+    return;
+  }
+
+  _max_wait_ms = config.value("max_wait_ms", 100);
+  int flush_interval_ms = config.value("flush_interval_ms", 1000);
+  std::thread([this, flush_interval_ms]() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(_wake_mtx);
+        _wake_cv.wait_for(lock, std::chrono::milliseconds(flush_interval_ms),
+                          [this] { return _wake; });
+        _wake = false;
+      }
+      Flush();
+    }
+  }).detach();
+  std::atexit([]() { SpanRecorder::Get().Flush(); });
+  LOG(info) << "Recording spans, sampling rate " << _sampling_rate
+            << ", exporter " << exporter;
+}
+
+SpanRecorder::SpanBuffer *SpanRecorder::_ThreadBuffer() {
+  struct BufferHolder {
+    std::shared_ptr<SpanBuffer> buffer;
+    ~BufferHolder() {
+      if (buffer) {
+        buffer->closed.store(true, std::memory_order_release);
+      }
+    }
+  };
+  static thread_local BufferHolder holder;
+  if (!holder.buffer) {
+    holder.buffer = std::make_shared<SpanBuffer>();
+    std::lock_guard<std::mutex> lock(_buffers_mtx);
+    _buffers.emplace_back(holder.buffer);
+  }
+  return holder.buffer.get();
+}
+
+bool SpanRecorder::_WaitForSpace(SpanBuffer *buffer, uint64_t head) {
+  _WakeExporter();
+  std::unique_lock<std::mutex> lock(_space_mtx);
+  return _space_cv.wait_for(
+      lock, std::chrono::milliseconds(_max_wait_ms), [buffer, head] {
+        return head - buffer->tail.load(std::memory_order_acquire) <
+               kSpanBufferSize;
+      });
+}
+
+void SpanRecorder::_WakeExporter() {
+  std::lock_guard<std::mutex> lock(_wake_mtx);
+  _wake = true;
+  _wake_cv.notify_one();
+}
+
+void SpanRecorder::Flush() {
+  std::lock_guard<std::mutex> flush_lock(_flush_mtx);
+  std::vector<std::shared_ptr<SpanBuffer>> buffers;
+  {
+    std::lock_guard<std::mutex> lock(_buffers_mtx);
+    buffers = _buffers;
+    _buffers.erase(std::remove_if(_buffers.begin(), _buffers.end(),
+                                  [](const std::shared_ptr<SpanBuffer> &b) {
+                                    return b->closed.load(
+                                        std::memory_order_acquire);
+                                  }),
+                   _buffers.end());
+  }
+  // The spans are formatted straight from the rings, and their slots handed
+  // back once the documents holding them are written.
+  _document.clear();
+  bool drained = false;
+  for (auto &buffer : buffers) {
+    uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+    uint64_t head = buffer->head.load(std::memory_order_acquire);
+    if (head == tail) {
+      continue;
+    }
+    _AppendSpans(*buffer, tail, head);
+    if (_exporter == SpanExporter::LOCAL_FILE) {
+      AppendLiteral("]}", &_document);
+      _Export(_document);
+      _document.clear();
+    }
+    buffer->tail.store(head, std::memory_order_release);
+    drained = true;
+  }
+  if (!_document.empty()) {
+    AppendLiteral("]}", &_document);
+    _Export(_document);
+  }
+  if (drained) {
+    if (_file) {
+      fflush(_file);
+    }
+    std::lock_guard<std::mutex> lock(_space_mtx);
+    _space_cv.notify_all();
+  }
+  uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+  if (dropped != _dropped_reported) {
+    LOG(warning) << dropped - _dropped_reported
+                 << " spans dropped, span buffers full for " << _max_wait_ms
+                 << " ms";
+    _dropped_reported = dropped;
+  }
+}
+
+void SpanRecorder::_AppendSpans(const SpanBuffer &buffer, uint64_t tail,
+                                uint64_t head) {
+  // A thread serves one request at a time, so the spans of a trace are mostly
+  // next to each other. span_collector.py joins the parts of a trace that are
+  // not.
+  const SpanRecord *ring = buffer.spans;
+  while (tail != head) {
+    size_t first = tail % kSpanBufferSize;
+    // The run also ends where the ring wraps around.
+    size_t end = first + std::min(head - tail, kSpanBufferSize - first);
+    size_t last = first + 1;
+    while (last != end && ring[last].trace_id == ring[first].trace_id) {
+      ++last;
+    }
+    tail += last - first;
+    // The trace is formatted in place and moved to the next datagram if it
+    // does not fit in this one.
+    size_t mark = _document.size();
+    if (_document.empty()) {
+      AppendLiteral("{\"data\":[", &_document);
+    } else {
+      _document.push_back(',');
+    }
+    _AppendTrace(ring + first, ring + last, &_document);
+    if (_exporter == SpanExporter::UDP && mark != 0 &&
+        _document.size() + 2 > kMaxDatagramSize) {
+      _trace_str.assign(_document, mark + 1, std::string::npos);
+      _document.resize(mark);
+      AppendLiteral("]}", &_document);
+      _Export(_document);
+      _document.clear();
+      AppendLiteral("{\"data\":[", &_document);
+      _document += _trace_str;
+    }
+  }
+}
+
+void SpanRecorder::_AppendTrace(const SpanRecord *first,
+                                const SpanRecord *last,
+                                std::string *out) const {
+  char trace_id[16];
+  FormatHex(first->trace_id, trace_id);
+  AppendLiteral("{\"traceID\":\"", out);
+  out->append(trace_id, 16);
+  AppendLiteral("\",\"spans\":[", out);
+  for (auto span = first; span != last; ++span) {
+    if (span != first) {
+      out->push_back(',');
+    }
+    AppendLiteral("{\"traceID\":\"", out);
+    out->append(trace_id, 16);
+    AppendLiteral("\",\"spanID\":\"", out);
+    AppendHex(span->span_id, out);
+    AppendLiteral("\",\"flags\":1,\"operationName\":\"", out);
+    // Operation names are string literals of the handlers, nothing to escape.
+    out->append(span->operation);
+    AppendLiteral("\",\"references\":[", out);
+    if (span->parent_id) {
+      AppendLiteral("{\"refType\":\"CHILD_OF\",\"traceID\":\"", out);
+      out->append(trace_id, 16);
+      AppendLiteral("\",\"spanID\":\"", out);
+      AppendHex(span->parent_id, out);
+      AppendLiteral("\"}", out);
+    }
+    AppendLiteral("],\"startTime\":", out);
+    AppendInt(span->start_us, out);
+    AppendLiteral(",\"duration\":", out);
+    AppendInt(span->duration_us, out);
+    AppendLiteral(",\"tags\":[],\"logs\":[],\"processID\":\"p1\","
+                  "\"warnings\":null}", out);
+  }
+  AppendLiteral("],\"processes\":", out);
+  out->append(_processes_json);
+  AppendLiteral(",\"warnings\":null}", out);
+}
+
+void SpanRecorder::_Export(const std::string &document) {
+  if (_exporter == SpanExporter::LOCAL_FILE) {
+    fwrite(document.data(), 1, document.size(), _file);
+    fputc('\n', _file);
+  } else if (_exporter == SpanExporter::UDP) {
+    if (send(_socket, document.data(), document.size(), 0) < 0) {
+      LOG_RATE_LIMITED(warning) << "Failed to send spans: " << strerror(errno);
+    }
+  }
+}
+
+inline int64_t SpanNowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// A span of the current request. Unsampled spans only carry the context to
+// pass on. A span that is not finished explicitly finishes when it goes out
+// of scope, so early returns and exceptions are still covered.
+class Span {
+ public:
+  Span(const char *operation, const SpanContext &parent, bool is_root)
+      : _operation(operation), _context(parent),
+        _parent_id(is_root ? 0 : parent.span_id), _start_us(0),
+        _finished(!parent.sampled) {
+    if (_context.sampled) {
+      _context.span_id = SpanRecorder::Get().NewId();
+      _start_us = SpanNowUs();
+    }
+  }
+  Span(Span &&other)
+      : _operation(other._operation), _context(other._context),
+        _parent_id(other._parent_id), _start_us(other._start_us),
+        _finished(other._finished) {
+    other._finished = true;
+  }
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+  ~Span() { Finish(); }
+
+  void Finish() {
+    if (_finished) {
+      return;
+    }
+    _finished = true;
+    SpanRecorder::Get().Record(SpanRecord{_context.trace_id, _context.span_id,
+                                          _parent_id, _operation, _start_us,
+                                          SpanNowUs() - _start_us});
+  }
+
+  // Puts this span's context into a carrier sent downstream.
+  void Inject(std::map<std::string, std::string> *carrier) const {
+    std::string &value = (*carrier)[kSpanContextKey];
+    value.clear();
+    value.reserve(52);
+    AppendHex(_context.trace_id, &value);
+    value.push_back(':');
+    AppendHex(_context.span_id, &value);
+    value.push_back(':');
+    AppendHex(_parent_id, &value);
+    value.append(_context.sampled ? ":1" : ":0");
+  }
+
+  const SpanContext &context() const { return _context; }
+
+ private:
+  const char *_operation;
+  SpanContext _context;
+  uint64_t _parent_id;
+  int64_t _start_us;
+  bool _finished;
+};
+
+// Server span of a request: a child of the caller's span found in the
+// carrier, or the root of a new trace, sampled or not, if there is none.
+Span StartSpan(const char *operation,
+               const std::map<std::string, std::string> &carrier) {
+  auto it = carrier.find(kSpanContextKey);
+  if (it != carrier.end()) {
+    uint64_t trace_id, span_id, parent_id, flags;
+    const char *p = ParseHex(it->second.c_str(), &trace_id);
+    p = p && *p == ':' ? ParseHex(p + 1, &span_id) : nullptr;
+    p = p && *p == ':' ? ParseHex(p + 1, &parent_id) : nullptr;
+    p = p && *p == ':' ? ParseHex(p + 1, &flags) : nullptr;
+    if (p && trace_id) {
+      return Span(operation, SpanContext{trace_id, span_id, (flags & 1) != 0},
+                  false);
+    }
+  }
+  auto &recorder = SpanRecorder::Get();
+  return Span(operation, SpanContext{recorder.NewId(), 0, recorder.Sample()},
+              true);
+}
+
+// Child span within the same service.
+Span StartSpan(const char *operation, const Span &parent) {
+  return Span(operation, parent.context(), false);
+}
+
+void SetUpSpanRecorder(const json &config_json, const std::string &service) {
+  SpanRecorder::Get().Configure(
+      config_json.contains("tracing") ? config_json["tracing"] : json(),
+      service);
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_SPAN_RECORDER_H
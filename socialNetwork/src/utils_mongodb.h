@@ -4,10 +4,24 @@
 #include <mongoc.h>
 #include <bson/bson.h>
 
+#include "metrics.h"
+
 #define SERVER_SELECTION_TIMEOUT_MS 300
 
 namespace social_network {
 
+// Command monitoring callbacks; they run on the thread that issued the
+// command, so its duration goes to the RequestTiming of that request.
+void MongoCommandSucceeded(const mongoc_apm_command_succeeded_t *event) {
+  RequestTiming::Current().Add(
+      TimingStage::MONGO, mongoc_apm_command_succeeded_get_duration(event));
+}
+
+void MongoCommandFailed(const mongoc_apm_command_failed_t *event) {
+  RequestTiming::Current().Add(
+      TimingStage::MONGO, mongoc_apm_command_failed_get_duration(event));
+}
+
 mongoc_client_pool_t* init_mongodb_client_pool(
     const json &config_json,
     const std::string &service_name,
@@ -42,6 +56,11 @@ mongoc_client_pool_t* init_mongodb_client_pool(
 
     mongoc_client_pool_t *client_pool= mongoc_client_pool_new(mongodb_uri);
     mongoc_client_pool_max_size(client_pool, max_size);
+    mongoc_apm_callbacks_t *callbacks = mongoc_apm_callbacks_new();
+    mongoc_apm_set_command_succeeded_cb(callbacks, MongoCommandSucceeded);
+    mongoc_apm_set_command_failed_cb(callbacks, MongoCommandFailed);
+    mongoc_client_pool_set_apm_callbacks(client_pool, callbacks, nullptr);
+    mongoc_apm_callbacks_destroy(callbacks);
     return client_pool;
   }
 }
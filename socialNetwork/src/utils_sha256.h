@@ -0,0 +1,32 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_SRC_UTILS_SHA256_H_
+#define SOCIAL_NETWORK_MICROSERVICES_SRC_UTILS_SHA256_H_
+
+#include <openssl/evp.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace social_network {
+
+// Hex SHA-256 through OpenSSL's EVP interface, which uses the CPU's SHA
+// extensions where available. The output is identical to
+// picosha2::hash256_hex_string, so stored password hashes stay valid.
+std::string sha256_hex_string(const std::string &data) {
+  static const char hex_digits[] = "0123456789abcdef";
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  if (EVP_Digest(data.data(), data.size(), digest, &digest_len, EVP_sha256(),
+                 nullptr) != 1) {
+    throw std::runtime_error("EVP_Digest(sha256) failed");
+  }
+  std::string hex(digest_len * 2, '0');
+  for (unsigned int i = 0; i < digest_len; ++i) {
+    hex[2 * i] = hex_digits[digest[i] >> 4];
+    hex[2 * i + 1] = hex_digits[digest[i] & 0xf];
+  }
+  return hex;
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_SRC_UTILS_SHA256_H_
@@ -0,0 +1,65 @@
+#ifndef SOCIAL_NETWORK_MICROSERVICES_TEST_BENCHMARK_H
+#define SOCIAL_NETWORK_MICROSERVICES_TEST_BENCHMARK_H
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace social_network {
+
+struct RunResult {
+  // Calls per second, wall clock.
+  double rate;
+  // CPU time per call of the threads running body, and of the whole process,
+  // which adds that of any background thread, such as an exporter.
+  double request_cpu_us;
+  double cpu_us;
+};
+
+double ThreadCpuUs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Runs body(i) for i in [0, n) split over n_threads, then finish(), which
+// counts towards the time taken.
+RunResult Run(int n, int n_threads, const std::function<void(int)> &body,
+              const std::function<void()> &finish) {
+  auto start = std::chrono::steady_clock::now();
+  std::clock_t cpu_start = std::clock();
+  std::vector<double> request_cpu_us(n_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      double thread_start = ThreadCpuUs();
+      for (int i = t; i < n; i += n_threads) {
+        body(i);
+      }
+      request_cpu_us[t] = ThreadCpuUs() - thread_start;
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  finish();
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  double total_request_cpu_us = 0;
+  for (double us : request_cpu_us) {
+    total_request_cpu_us += us;
+  }
+  return RunResult{n * 1e6 / elapsed, total_request_cpu_us / n,
+                   1e6 * (std::clock() - cpu_start) / CLOCKS_PER_SEC / n};
+}
+
+// Runs body(i) for i in [0, n) split over n_threads, returns calls/s.
+double Run(int n, int n_threads, const std::function<void(int)> &body) {
+  return Run(n, n_threads, body, [] {}).rate;
+}
+
+} // namespace social_network
+
+#endif //SOCIAL_NETWORK_MICROSERVICES_TEST_BENCHMARK_H
@@ -0,0 +1,152 @@
+// Latency of Pop() + PostJson() + Keepalive() against a local httplib server,
+// for a pool that connects lazily and for one pre-warmed to the number of
+// callers with a health check. Each pool is measured right after it is
+// constructed, as a service is after a deploy, and again after its
+// connections have been idle for longer than the server's keep-alive timeout.
+// Also reports the connects made by the callers, and checks that the warm
+// pool's callers never had to connect themselves.
+//
+//   testClientPool [calls] [threads]
+
+#include "../src/ClientPool.h"
+#include "../src/HttpClientWrapper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace social_network;
+
+struct Phase {
+  std::vector<int64_t> latencies_us;
+  int64_t connections = 0;
+};
+
+// Set on the threads that call the pool, as opposed to its health check.
+thread_local bool caller = false;
+std::atomic<int64_t> caller_connects(0);
+
+class CountingClient : public HttpClientWrapper {
+ public:
+  using HttpClientWrapper::HttpClientWrapper;
+
+  void Connect() {
+    long connect_timestamp = _connect_timestamp;
+    HttpClientWrapper::Connect();
+    if (caller && _connect_timestamp != connect_timestamp) {
+      caller_connects++;
+    }
+  }
+};
+
+Phase RunPhase(ClientPool<CountingClient> *pool, int n_calls,
+               int n_threads) {
+  Phase phase;
+  int64_t connections_start = caller_connects.load();
+  std::vector<std::vector<int64_t>> latencies(n_threads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      caller = true;
+      for (int i = t; i < n_calls; i += n_threads) {
+        auto start = std::chrono::steady_clock::now();
+        auto client = pool->Pop();
+        long connect_timestamp = client->_connect_timestamp;
+        try {
+          client->PostJson("/echo", {{"i", i}});
+          // PostJson() reconnects by itself when the server closed the
+          // connection.
+          if (client->_connect_timestamp != connect_timestamp) {
+            caller_connects++;
+          }
+        } catch (...) {
+          pool->Remove(client);
+          continue;
+        }
+        pool->Keepalive(client);
+        latencies[t].push_back(
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (auto &thread_latencies : latencies) {
+    phase.latencies_us.insert(phase.latencies_us.end(),
+                              thread_latencies.begin(),
+                              thread_latencies.end());
+  }
+  std::sort(phase.latencies_us.begin(), phase.latencies_us.end());
+  phase.connections = caller_connects.load() - connections_start;
+  return phase;
+}
+
+void Print(const std::string &name, const Phase &phase) {
+  auto &l = phase.latencies_us;
+  std::cout << name << "\t" << l[l.size() / 2] << "\t"
+            << l[std::min(l.size() - 1, l.size() * 99 / 100)] << "\t"
+            << l.back() << "\t" << phase.connections << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  int n_calls = argc > 1 ? std::stoi(argv[1]) : 20000;
+  int n_threads = argc > 2 ? std::stoi(argv[2]) : 8;
+  int server_keepalive_s = 2;
+  // Below the server's keep-alive timeout, as in service-config.json.
+  int keepalive_ms = 1500;
+
+  httplib::Server server;
+  server.set_keep_alive_timeout(server_keepalive_s);
+  // Each open connection holds a server thread. Enough of them that the
+  // connections of the previous pool, until their close is noticed, do not
+  // stall the next one.
+  server.new_task_queue = [n_threads] {
+    return new httplib::ThreadPool(4 * n_threads);
+  };
+  server.Post("/echo", [](const httplib::Request &req,
+                          httplib::Response &res) {
+    res.set_content(req.body, "application/json");
+  });
+  int port = server.bind_to_any_port("127.0.0.1");
+  std::thread server_thread([&server]() { server.listen_after_bind(); });
+  server.wait_until_ready();
+
+  std::cout << "pool\tp50 us\tp99 us\tmax us\tconnects" << std::endl;
+  bool ok = true;
+  for (bool warm : {false, true}) {
+    GetClientPoolConfig().min_connections = warm ? n_threads : 0;
+    GetClientPoolConfig().health_check_interval_ms = warm ? 200 : 0;
+    std::string name = warm ? "warm" : "cold";
+    ClientPool<CountingClient> pool(name, "127.0.0.1", port, 0, n_threads,
+                                    1000, keepalive_ms);
+
+    Phase after_start = RunPhase(&pool, n_calls, n_threads);
+    Print(name + " after start", after_start);
+
+    // The cold pool's connections have been closed by the server, the warm
+    // pool's replaced by its health check once older than keepalive_ms.
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(server_keepalive_s * 1000 + 500));
+    Phase after_idle = RunPhase(&pool, n_calls, n_threads);
+    Print(name + " after idle", after_idle);
+
+    if (warm) {
+      ok = after_start.connections == 0 && after_idle.connections == 0;
+    }
+  }
+
+  server.stop();
+  server_thread.join();
+  if (!ok) {
+    std::cerr << "the warm pool connected on the request path" << std::endl;
+    return 1;
+  }
+  return 0;
+}
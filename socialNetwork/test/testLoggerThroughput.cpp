@@ -0,0 +1,77 @@
+// Cost of a LOG statement on the calling thread: the asynchronous backend in
+// logger.h vs a synchronous sink that takes a global lock, formats the
+// timestamp and writes to stderr for every line, as the Boost.Log console
+// sink did. Redirect stderr when running it:
+//
+//   testLoggerThroughput [lines] [threads] 2>/dev/null
+
+#include "../src/logger.h"
+#include "benchmark.h"
+
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace social_network;
+
+static std::mutex sync_mtx;
+static int expensive_calls = 0;
+
+void SyncLog(const std::string &message) {
+  std::lock_guard<std::mutex> lock(sync_mtx);
+  auto now = std::chrono::system_clock::now();
+  time_t seconds = std::chrono::system_clock::to_time_t(now);
+  struct tm tm;
+  localtime_r(&seconds, &tm);
+  char buf[64];
+  strftime(buf, sizeof buf, "[%Y-%m-%d %H:%M:%S]", &tm);
+  fprintf(stderr, "%s <error>: %s\n", buf, message.c_str());
+  fflush(stderr);
+}
+
+std::string Expensive() {
+  ++expensive_calls;
+  return std::string(256, 'x');
+}
+
+int main(int argc, char *argv[]) {
+  init_logger();
+  int n_lines = argc > 1 ? std::stoi(argv[1]) : 1000000;
+  int n_threads = argc > 2 ? std::stoi(argv[2]) : 8;
+
+  std::cout << "case\tlines/s" << std::endl;
+
+  std::cout << "sync locked sink\t"
+            << Run(n_lines, n_threads, [](int i) {
+                 SyncLog("(testLoggerThroughput.cpp:0:main) ClientPool pop "
+                         "timeout " + std::to_string(i));
+               })
+            << std::endl;
+
+  std::cout << "LOG(error)\t"
+            << Run(n_lines, n_threads, [](int i) {
+                 LOG(error) << "ClientPool pop timeout " << i;
+               })
+            << std::endl;
+
+  std::cout << "LOG_RATE_LIMITED(error)\t"
+            << Run(n_lines, n_threads, [](int i) {
+                 LOG_RATE_LIMITED(error) << "ClientPool pop timeout " << i;
+               })
+            << std::endl;
+
+  std::cout << "LOG(debug)\t"
+            << Run(n_lines, n_threads, [](int i) {
+                 LOG(debug) << Expensive() << i;
+               })
+            << std::endl;
+  Logger::Get().Flush();
+
+  if (expensive_calls != 0) {
+    std::cerr << "LOG(debug) evaluated its operands" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+// CPU cost of UserService's login path, without the stores:
+//   * password check with picosha2 (previous backend) vs OpenSSL EVP,
+//   * a full uncached login (password check + JWT signature) vs a login
+//     served from SessionCache.
+//
+//   testLoginThroughput [logins] [users] [threads]
+
+#include "../src/UserService/SessionCache.h"
+#include "../src/utils_sha256.h"
+#include "../third_party/PicoSHA2/picosha2.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <jwt/jwt.hpp>
+#include <string>
+#include <vector>
+
+using namespace social_network;
+using namespace jwt::params;
+
+static const std::string kSecret = "secret";
+
+struct User {
+  std::string username;
+  std::string password;
+  std::string salt;
+  std::string password_hashed;
+};
+
+std::string SignToken(const User &user, int64_t user_id) {
+  jwt::jwt_object obj{algorithm("HS256"), secret(kSecret),
+                      payload({{"user_id", std::to_string(user_id)},
+                               {"username", user.username},
+                               {"timestamp", "0"},
+                               {"ttl", "3600"}})};
+  return obj.signature();
+}
+
+int main(int argc, char *argv[]) {
+  int n_logins = argc > 1 ? std::stoi(argv[1]) : 200000;
+  int n_users = argc > 2 ? std::stoi(argv[2]) : 1000;
+  int n_threads = argc > 3 ? std::stoi(argv[3]) : 4;
+
+  std::vector<User> users(n_users);
+  for (int i = 0; i < n_users; ++i) {
+    users[i].username = "username_" + std::to_string(i);
+    users[i].password = "password_" + std::to_string(i);
+    users[i].salt = "salt_" + std::to_string(i);
+    users[i].password_hashed =
+        sha256_hex_string(users[i].password + users[i].salt);
+    if (users[i].password_hashed !=
+        picosha2::hash256_hex_string(users[i].password + users[i].salt)) {
+      std::cerr << "EVP and picosha2 digests differ" << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << "case\tlogins/s" << std::endl;
+
+  std::cout << "verify picosha2\t"
+            << Run(n_logins, n_threads, [&](int i) {
+                 auto &user = users[i % n_users];
+                 if (picosha2::hash256_hex_string(user.password + user.salt) !=
+                     user.password_hashed) {
+                   std::abort();
+                 }
+               })
+            << std::endl;
+
+  std::cout << "verify EVP\t"
+            << Run(n_logins, n_threads, [&](int i) {
+                 auto &user = users[i % n_users];
+                 if (sha256_hex_string(user.password + user.salt) !=
+                     user.password_hashed) {
+                   std::abort();
+                 }
+               })
+            << std::endl;
+
+  std::cout << "login uncached\t"
+            << Run(n_logins, n_threads, [&](int i) {
+                 auto &user = users[i % n_users];
+                 if (sha256_hex_string(user.password + user.salt) !=
+                     user.password_hashed) {
+                   std::abort();
+                 }
+                 SignToken(user, i % n_users);
+               })
+            << std::endl;
+
+  SessionCache session_cache(60, n_users);
+  std::cout << "login cached\t"
+            << Run(n_logins, n_threads, [&](int i) {
+                 auto &user = users[i % n_users];
+                 std::string credential_hash =
+                     sha256_hex_string(kSecret + user.password);
+                 std::string token;
+                 if (!session_cache.Get(user.username, credential_hash,
+                                        &token)) {
+                   if (sha256_hex_string(user.password + user.salt) !=
+                       user.password_hashed) {
+                     std::abort();
+                   }
+                   session_cache.Put(user.username, credential_hash,
+                                     SignToken(user, i % n_users));
+                 }
+               })
+            << std::endl;
+
+  return 0;
+}
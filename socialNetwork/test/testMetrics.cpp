@@ -0,0 +1,78 @@
+// Checks the quantiles of LatencyMetric against exact ones and the rendering
+// of counters, and measures the cost of Record() on the request path:
+// per-thread shards vs one histogram behind a mutex.
+//
+//   testMetrics [records] [threads]
+
+#include "../src/metrics.h"
+#include "benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace social_network;
+
+int main(int argc, char *argv[]) {
+  int n_records = argc > 1 ? std::stoi(argv[1]) : 10000000;
+  int n_threads = argc > 2 ? std::stoi(argv[2]) : 8;
+
+  // Log-normal latencies around 1 ms, recorded from several threads.
+  std::vector<int64_t> latencies(1000000);
+  std::mt19937_64 rng(1);
+  std::lognormal_distribution<double> dist(std::log(1000.0), 1.0);
+  for (auto &latency : latencies) {
+    latency = static_cast<int64_t>(dist(rng));
+  }
+  LatencyMetric metric;
+  Run(latencies.size(), n_threads, [&](int i) {
+    metric.Record(latencies[i], i % 100 == 0);
+  });
+  auto snapshot = metric.Collect();
+  std::sort(latencies.begin(), latencies.end());
+  bool ok = snapshot.requests == latencies.size() &&
+            snapshot.errors == latencies.size() / 100;
+  std::cout << "quantile\texact\trecorded" << std::endl;
+  for (double q : {0.5, 0.9, 0.99, 0.999, 1.0}) {
+    int64_t exact = latencies[std::min(latencies.size() - 1,
+                                       static_cast<size_t>(
+                                           q * latencies.size()))];
+    uint64_t recorded = snapshot.ValueAtQuantile(q);
+    std::cout << q << "\t" << exact << "\t" << recorded << std::endl;
+    ok = ok && std::abs(static_cast<double>(recorded) - exact) <=
+                   exact / 64.0 + 1;
+  }
+
+  Metrics::Get().SetService("test");
+  Metrics::Get().Counter("test_events_total")->fetch_add(3);
+  ok = ok && Metrics::Get().Render().find(
+                 "test_events_total{service=\"test\"} 3\n") !=
+                 std::string::npos;
+
+  std::cout << "case\trecords/s" << std::endl;
+  LatencyMetric sharded;
+  std::cout << "per-thread shards\t"
+            << Run(n_records, n_threads,
+                   [&](int i) { sharded.Record(i & 0xffff, false); })
+            << std::endl;
+  std::mutex mtx;
+  std::vector<uint64_t> counts(LatencyBuckets::kCount);
+  uint64_t requests = 0, sum_us = 0;
+  std::cout << "mutex\t"
+            << Run(n_records, n_threads,
+                   [&](int i) {
+                     std::lock_guard<std::mutex> lock(mtx);
+                     ++counts[LatencyBuckets::Index(i & 0xffff)];
+                     ++requests;
+                     sum_us += i & 0xffff;
+                   })
+            << std::endl;
+
+  if (!ok) {
+    std::cerr << "recorded quantiles, counts or counters are off" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,60 @@
+// CPU cost of the per-user work in UserHandler::RegisterUser(WithId): salt
+// generation plus password hash, with the previous GenRandomString
+// (std::random_device + std::mt19937 per call) against the buffered
+// getrandom() one in utils_random.h.
+//
+//   testRegisterUserCpu [registrations] [threads]
+
+#include "../src/utils_random.h"
+#include "../src/utils_sha256.h"
+#include "benchmark.h"
+
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace social_network;
+
+std::string GenRandomStringMt19937(const int len) {
+  static const std::string alphanum =
+      "0123456789"
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+      "abcdefghijklmnopqrstuvwxyz";
+  std::random_device rd;
+  std::mt19937 gen(rd());
+  std::uniform_int_distribution<int> dist(
+      0, static_cast<int>(alphanum.length() - 1));
+  std::string s;
+  for (int i = 0; i < len; ++i) {
+    s += alphanum[dist(gen)];
+  }
+  return s;
+}
+
+// Registers user i with a salt from gen_salt.
+void Register(int i, const std::function<std::string(int)> &gen_salt) {
+  std::string salt = gen_salt(32);
+  std::string password_hashed =
+      sha256_hex_string("password_" + std::to_string(i) + salt);
+  if (password_hashed.size() != 64) {
+    std::abort();
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int n_registrations = argc > 1 ? std::stoi(argv[1]) : 200000;
+  int n_threads = argc > 2 ? std::stoi(argv[2]) : 4;
+
+  std::cout << "salt generator\tregistrations/s" << std::endl;
+  std::cout << "mt19937\t"
+            << Run(n_registrations, n_threads,
+                   [](int i) { Register(i, GenRandomStringMt19937); })
+            << std::endl;
+  std::cout << "getrandom buffer\t"
+            << Run(n_registrations, n_threads,
+                   [](int i) { Register(i, GenRandomString); })
+            << std::endl;
+  return 0;
+}
@@ -0,0 +1,120 @@
+// Throughput of write-home-timeline-service's consumer for a range of batch
+// sizes. The broker is replaced by a LocalMessageQueue and social-graph-service
+// by an in-process stub returning a fixed follower list, so only a Redis
+// server is needed:
+//
+//   testWriteHomeTimelineBatch [redis_addr] [redis_port] [messages] [workers]
+//                              [followers]
+
+#include "../src/WriteHomeTimelineService/WriteHomeTimelineHandler.h"
+#include "../src/MessageQueue.h"
+#include "../src/httplib.h"
+#include "../src/logger.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace social_network;
+
+static const int kSocialGraphPort = 19090;
+static const int kAuthors = 1000;
+
+void RunSocialGraphStub(httplib::Server *server, int n_followers) {
+  server->Post("/GetFollowers", [n_followers](const httplib::Request &req,
+                                              httplib::Response &res) {
+    int64_t user_id = json::parse(req.body)["user_id"];
+    std::vector<int64_t> followers_id;
+    for (int i = 1; i <= n_followers; ++i) {
+      followers_id.emplace_back((user_id + i) % kAuthors);
+    }
+    json res_json = {{"followers_id", followers_id}};
+    res.set_content(res_json.dump(), "application/json");
+  });
+  server->listen("127.0.0.1", kSocialGraphPort);
+}
+
+// Publishes n_messages while n_workers consume them, and returns messages/s
+// from the first publish to the end of the batch holding the last message.
+double RunBatchSize(WriteHomeTimelineHandler *handler, int n_messages,
+                    int n_workers, int batch_size, int batch_delay_ms) {
+  LocalMessageQueue queue;
+  std::atomic<int> processed(0);
+  std::chrono::steady_clock::time_point end;
+  std::vector<std::thread> workers;
+  for (int i = 0; i < n_workers; ++i) {
+    workers.emplace_back([&]() {
+      std::vector<std::string> messages;
+      while (processed.load() < n_messages) {
+        messages.clear();
+        if (queue.ConsumeBatch(&messages, batch_size, 100, batch_delay_ms) ==
+            0) {
+          continue;
+        }
+        handler->WriteHomeTimeline(messages);
+        if (processed.fetch_add(messages.size()) + messages.size() ==
+            static_cast<size_t>(n_messages)) {
+          end = std::chrono::steady_clock::now();
+        }
+      }
+    });
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < n_messages; ++i) {
+    json msg_json = {{"req_id", i},
+                     {"post_id", i},
+                     {"user_id", i % kAuthors},
+                     {"timestamp", i},
+                     {"user_mentions_id", std::vector<int64_t>()},
+                     {"carrier", json::object()}};
+    queue.Publish(msg_json.dump());
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      end - start).count();
+  return n_messages * 1e6 / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+  init_logger();
+  std::string redis_addr = argc > 1 ? argv[1] : "127.0.0.1";
+  int redis_port = argc > 2 ? std::stoi(argv[2]) : 6379;
+  int n_messages = argc > 3 ? std::stoi(argv[3]) : 20000;
+  int n_workers = argc > 4 ? std::stoi(argv[4]) : 4;
+  int n_followers = argc > 5 ? std::stoi(argv[5]) : 20;
+
+  httplib::Server social_graph;
+  std::thread social_graph_thread(RunSocialGraphStub, &social_graph,
+                                  n_followers);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+  ConnectionOptions connection_options;
+  connection_options.host = redis_addr;
+  connection_options.port = redis_port;
+  ConnectionPoolOptions pool_options;
+  pool_options.size = 128;
+  pool_options.wait_timeout = std::chrono::milliseconds(1000);
+  Redis redis_client_pool(connection_options, pool_options);
+  ClientPool<HttpClientWrapper> social_graph_client_pool(
+      "social-graph-service", "127.0.0.1", kSocialGraphPort, 0, 128, 1000,
+      10000);
+  WriteHomeTimelineHandler handler(&redis_client_pool,
+                                   &social_graph_client_pool, 1000);
+
+  std::cout << "batch_size\tmsgs/s" << std::endl;
+  for (int batch_size : {1, 8, 32, 64, 256}) {
+    double throughput = RunBatchSize(&handler, n_messages, n_workers,
+                                     batch_size, 5);
+    std::cout << batch_size << "\t" << throughput << std::endl;
+  }
+
+  social_graph.stop();
+  social_graph_thread.join();
+  return 0;
+}